@@ -0,0 +1,108 @@
+#ifndef ALLOCATION_TRACKER_H
+#define ALLOCATION_TRACKER_H
+
+// Counts the heap allocations of the whole process by replacing the global operator new. The frame
+// loop reads the count once per frame and, once the warm up is over, expects it not to change.
+// On by default in debug builds, define TRACK_ALLOCATIONS 0 or 1 to override. The replacement is
+// compiled into the one translation unit which defines ALLOCATION_TRACKER_IMPLEMENTATION before
+// including this header.
+
+#ifndef TRACK_ALLOCATIONS
+#ifdef NDEBUG
+#define TRACK_ALLOCATIONS 0
+#else
+#define TRACK_ALLOCATIONS 1
+#endif
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Allocations made with the plain operator new/new[] since the start by all threads, 0 when tracking is off
+inline std::atomic<unsigned long long>& allocationCounter()
+{
+    static std::atomic<unsigned long long> counter(0);
+    return counter;
+}
+
+inline unsigned long long allocationCount()
+{
+    return allocationCounter().load(std::memory_order_relaxed);
+}
+
+// Allocations of the calling thread. With the update and the render stage overlapping, each stage
+// counts its own thread so work of the next frame does not end up in the current one.
+inline unsigned long long& threadAllocationCounter()
+{
+    static thread_local unsigned long long counter = 0;
+    return counter;
+}
+
+inline unsigned long long threadAllocationCount()
+{
+    return threadAllocationCounter();
+}
+
+// Allocations of all job workers together, they work for whichever stage gave them jobs
+inline std::atomic<unsigned long long>& workerAllocationCounter()
+{
+    static std::atomic<unsigned long long> counter(0);
+    return counter;
+}
+
+inline unsigned long long workerAllocationCount()
+{
+    return workerAllocationCounter().load(std::memory_order_relaxed);
+}
+
+// Set by the job workers, their allocations count into workerAllocationCount as well
+inline bool& allocationWorkerThread()
+{
+    static thread_local bool worker = false;
+    return worker;
+}
+
+#if TRACK_ALLOCATIONS && defined(ALLOCATION_TRACKER_IMPLEMENTATION)
+
+void* operator new(std::size_t size)
+{
+    allocationCounter().fetch_add(1, std::memory_order_relaxed);
+    threadAllocationCounter()++;
+    if (allocationWorkerThread())
+        workerAllocationCounter().fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "GpuProfiler.h"
+#include "RenderThread.h"
+#include "ShadingLod.h"
+#include "Log.h"
+
+// Command line of the application, everything defaults to the interactive window
+struct BenchmarkOptions
+{
+    bool headless = false;
+    int width = 1280;
+    int height = 960;
+    int frames = 600;
+    int warmupFrames = 30;                  // rendered but not measured (shader variants, caches, driver warm up)
+    float timeStep = 1.0f / 60.0f;          // simulated seconds per frame in headless mode
+    float simulationStep = 1.0f / 120.0f;   // seconds per fixed update of the animations and the camera
+    std::string contextApi = "native";      // native | egl | osmesa
+    std::string cameraPath;                 // headless: path to play, empty = scripted orbit
+    std::string recordCameraPath;           // interactive: where to save the flown path on exit
+    std::string output = "benchmark.json";
+    std::string scene = "main";             // main | backpack | stress | occlusion
+    // performance suite: every scene headless, checked against baselines and golden images
+    bool suite = false;
+    bool updateBaselines = false;
+    bool settingsGiven = false;             // resolution, frames or steps on the command line, else --suite takes the baselines' ones
+    std::string baselinesPath = "../benchmarks/baselines.txt";
+    std::string goldenDirectory = "../benchmarks/golden/";
+    std::string reportPath = "perf_report.json";
+    std::string logFile;                    // log messages go to this file as well
+    bool logBenchmark = false;              // measure the logger and exit
+    bool profilerBenchmark = false;         // measure the cost of a CPU profiler scope and exit
+    bool singleThread = false;              // update and render one after the other on the main thread
+    bool jobBenchmark = false;              // measure the scaling of the job system and exit
+    bool tangentBenchmark = false;          // compare the tangent generator with Assimp's and exit
+    bool bakeConeMap = false;               // bake the cone step map of the parallax quad and exit
+    bool parallaxBenchmark = false;         // compare the parallax paths over view angles and exit
+    int shadingLod = -1;                    // shading level forced on every object, -1 picks by screen size
+    bool depthPrepass = false;              // depth of the opaque objects first, the color pass shades each pixel once
+    // reflection probe of the mirror cubes
+    int probeFaces = 1;                     // cubemap faces rendered per frame at most, 0 = mirrors reflect the skybox only
+    int probeSize = 128;                    // pixels per face side
+    std::string probeUpdate = "always";     // always | motion (only after something near the probe moved)
+    bool probePrefilter = false;            // mipmaps rebuilt after every complete update
+    std::string occlusion = "hiz";          // off | hiz | conditional | software, occlusion culling of the container grid
+    bool occlusionBenchmark = false;        // the occlusion scene once per occlusion mode, then exit
+    // dynamic resolution: the scene rendered smaller while the frames take longer than the budget, then stretched
+    bool dynamicResolution = false;
+    float frameBudgetMs = 16.67f;
+    float minResolutionScale = 0.5f;
+    float maxResolutionScale = 1.0f;
+    // post-processing (PostProcess.h), off unless one of the stages is switched on
+    bool bloom = false;
+    int bloomLevels = 5;
+    float bloomThreshold = 1.0f;
+    float bloomIntensity = 0.6f;
+    bool toneMapping = false;
+    float exposure = 1.0f;
+    bool sharpen = false;
+    std::string outline = "screen";         // stencil | screen, how the containers are outlined
+    float outlineWidth = 2.0f;              // pixels of the window, the screen-space outline only
+    bool outlineBenchmark = false;          // compare the outline passes over the number of objects and exit
+    bool textureArrays = false;             // the stress grid instanced, its diffuse maps in one texture array
+    int textureArraySize = 512;             // layer size the maps are resized to, 0 keeps them (one array per size and format)
+    // texture streaming (TextureStreaming.h): the textures start with their small mipmaps, finer ones follow the screen size
+    bool textureStreaming = false;
+    float textureBudgetMb = 64.0f;
+    int textureStartSize = 64;
+    bool softwareOcclusionBenchmark = false;    // measure the CPU occlusion rasterizer and exit
+    bool bvhBenchmark = false;              // measure building and querying bounding volume hierarchies and exit
+    bool pickBenchmark = false;             // measure ray picks against the backpack and exit
+};
+
+inline void printBenchmarkUsage(const char* program)
+{
+    Logger::Instance().Flush();     // errors about the arguments come first
+    std::cout << "usage: " << program << " [options]\n"
+        << "  --headless              render offscreen into a framebuffer object, no visible window\n"
+        << "  --width N --height N    render resolution (default 1280x960)\n"
+        << "  --frames N              measured frames in headless mode (default 600)\n"
+        << "  --warmup N              frames rendered before measuring (default 30)\n"
+        << "  --time-step S           simulated seconds per frame (default 1/60)\n"
+        << "  --sim-step S            seconds per fixed simulation update (default 1/120)\n"
+        << "  --camera-path FILE      camera path to play in headless mode (default: orbit)\n"
+        << "  --record-camera FILE    record the camera of an interactive session\n"
+        << "  --context native|egl|osmesa\n"
+        << "                          context creation API, osmesa needs no display or GPU\n"
+        << "  --output FILE           headless results (default benchmark.json)\n"
+        << "  --scene main|backpack|stress|occlusion\n"
+        << "  --suite                 run every scene headless and check it against the baselines, with their resolution,\n"
+        << "                          frames and steps unless given\n"
+        << "  --update-baselines      with --suite: store the results as new baselines and golden images\n"
+        << "  --baselines FILE        (default ../benchmarks/baselines.txt)\n"
+        << "  --golden-dir DIR        (default ../benchmarks/golden/)\n"
+        << "  --report FILE           suite results (default perf_report.json)\n"
+        << "  --log FILE              append the log to FILE as well as to the console\n"
+        << "  --log-benchmark         measure the enqueue latency of the logger under contention and exit\n"
+        << "  --profiler-benchmark    measure the cost of an empty CPU profiler scope and exit\n"
+        << "  --single-thread         no render thread, update and render run one after the other\n"
+        << "  --job-benchmark         measure how parallel culling scales from 1 to all hardware threads and exit\n"
+        << "  --tangent-benchmark     tangent generation against Assimp's on a large grid and the backpack, then exit\n"
+        << "  --bake-cone-map         bake ../textures/toy_box_cone.png from the parallax depth map and exit\n"
+        << "  --parallax-benchmark    step counts and fragment cost of the parallax paths per view angle, then exit\n"
+        << "  --shading-lod auto|relief|normal|plain\n"
+        << "                          force a shading level on every object (default auto: by screen size, F5 cycles)\n"
+        << "  --depth-prepass         depth-only pass before the color pass (F6 toggles)\n"
+        << "  --probe-faces N         reflection probe faces rendered per frame, 0 to 6 (default 1, 0 = skybox reflections)\n"
+        << "  --probe-size N          reflection probe face size (default 128)\n"
+        << "  --probe-update always|motion\n"
+        << "                          refresh the probe continuously or only when something near it moves (default always)\n"
+        << "  --probe-prefilter       mipmapped reflection probe, rebuilt after every complete update\n"
+        << "  --occlusion off|hiz|conditional|software\n"
+        << "                          occlusion culling of the container grid (default hiz, F7 cycles)\n"
+        << "  --dynamic-resolution    scale the render resolution to keep the frame time within the budget (F8 toggles)\n"
+        << "  --frame-budget MS       frame time the dynamic resolution aims for (default 16.67)\n"
+        << "  --resolution-scale MIN MAX\n"
+        << "                          bounds of the dynamic resolution scale, 0.1 to 1 (default 0.5 1)\n"
+        << "  --bloom                 glow around what is brighter than the threshold, mostly the emission (F9 toggles)\n"
+        << "  --bloom-levels N        levels of the bloom pyramid from half resolution down, 1 to 6 (default 5)\n"
+        << "  --bloom-threshold T     brightness where the bloom starts (default 1)\n"
+        << "  --bloom-intensity I     (default 0.6)\n"
+        << "  --tone-mapping          filmic tone mapping instead of clamping (F10 toggles)\n"
+        << "  --exposure E            scale of the colors before the tone mapping (default 1)\n"
+        << "  --sharpen               contrast adaptive sharpening of the final image (F11 toggles)\n"
+        << "  --outline stencil|screen\n"
+        << "                          containers outlined by drawing them again or by a screen-space pass (default screen, F12 switches)\n"
+        << "  --outline-width PX      width of the screen-space outline (default 2, jump flooding above 3)\n"
+        << "  --outline-benchmark     GPU cost of both outline passes from 1 to 4096 outlined objects, then exit\n"
+        << "  --texture-arrays        the stress grid's diffuse maps as layers of a texture array, one instanced draw per shader variant\n"
+        << "  --texture-array-size N  layer size the maps are resized to (default 512, 0 = no resizing, only maps of equal size batch)\n"
+        << "  --texture-streaming     textures start with small mipmaps, finer ones are loaded as they get larger on screen\n"
+        << "  --texture-budget MB     memory the streamed mipmaps may take (default 64)\n"
+        << "  --texture-start-size N  largest mipmap a streamed texture starts with (default 64)\n"
+        << "  --occlusion-benchmark   the occlusion scene headless with every occlusion mode, culled share and frame time gain\n"
+        << "  --software-occlusion-benchmark\n"
+        << "                          triangles/ms of the CPU occlusion rasterizer from 1 to all hardware threads, then exit\n"
+        << "  --bvh-benchmark         build, refit, frustum and ray query times of the bounding volume hierarchies, then exit\n"
+        << "  --pick-benchmark        picks per second from random cursor positions around the backpack, then exit" << std::endl;
+}
+
+// Returns false on unknown or malformed arguments, after printing the usage
+inline bool parseBenchmarkOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless")
+            options.headless = true;
+        else if (arg == "--width" && hasValue)
+        {
+            options.width = std::atoi(argv[++i]);
+            options.settingsGiven = true;
+        }
+        else if (arg == "--height" && hasValue)
+        {
+            options.height = std::atoi(argv[++i]);
+            options.settingsGiven = true;
+        }
+        else if (arg == "--frames" && hasValue)
+        {
+            options.frames = std::atoi(argv[++i]);
+            options.settingsGiven = true;
+        }
+        else if (arg == "--warmup" && hasValue)
+        {
+            options.warmupFrames = std::atoi(argv[++i]);
+            options.settingsGiven = true;
+        }
+        else if (arg == "--time-step" && hasValue)
+        {
+            options.timeStep = (float)std::atof(argv[++i]);
+            options.settingsGiven = true;
+        }
+        else if (arg == "--sim-step" && hasValue)
+        {
+            options.simulationStep = (float)std::atof(argv[++i]);
+            options.settingsGiven = true;
+        }
+        else if (arg == "--camera-path" && hasValue)
+            options.cameraPath = argv[++i];
+        else if (arg == "--record-camera" && hasValue)
+            options.recordCameraPath = argv[++i];
+        else if (arg == "--context" && hasValue)
+            options.contextApi = argv[++i];
+        else if (arg == "--output" && hasValue)
+            options.output = argv[++i];
+        else if (arg == "--scene" && hasValue)
+            options.scene = argv[++i];
+        else if (arg == "--suite")
+            options.suite = options.headless = true;
+        else if (arg == "--update-baselines")
+            options.updateBaselines = true;
+        else if (arg == "--baselines" && hasValue)
+            options.baselinesPath = argv[++i];
+        else if (arg == "--golden-dir" && hasValue)
+            options.goldenDirectory = argv[++i];
+        else if (arg == "--report" && hasValue)
+            options.reportPath = argv[++i];
+        else if (arg == "--log" && hasValue)
+            options.logFile = argv[++i];
+        else if (arg == "--log-benchmark")
+            options.logBenchmark = true;
+        else if (arg == "--profiler-benchmark")
+            options.profilerBenchmark = true;
+        else if (arg == "--single-thread")
+            options.singleThread = true;
+        else if (arg == "--job-benchmark")
+            options.jobBenchmark = true;
+        else if (arg == "--tangent-benchmark")
+            options.tangentBenchmark = true;
+        else if (arg == "--bake-cone-map")
+            options.bakeConeMap = true;
+        else if (arg == "--parallax-benchmark")
+            options.parallaxBenchmark = options.headless = true;
+        else if (arg == "--shading-lod" && hasValue)
+        {
+            std::string level = argv[++i];
+            options.shadingLod = -2;
+            for (int l = -1; l < SHADING_LEVEL_COUNT; l++)
+                if (level == shadingLevelName(l))
+                    options.shadingLod = l;
+        }
+        else if (arg == "--depth-prepass")
+            options.depthPrepass = true;
+        else if (arg == "--probe-faces" && hasValue)
+            options.probeFaces = std::atoi(argv[++i]);
+        else if (arg == "--probe-size" && hasValue)
+            options.probeSize = std::atoi(argv[++i]);
+        else if (arg == "--probe-update" && hasValue)
+            options.probeUpdate = argv[++i];
+        else if (arg == "--probe-prefilter")
+            options.probePrefilter = true;
+        else if (arg == "--occlusion" && hasValue)
+            options.occlusion = argv[++i];
+        else if (arg == "--dynamic-resolution")
+            options.dynamicResolution = true;
+        else if (arg == "--frame-budget" && hasValue)
+            options.frameBudgetMs = (float)std::atof(argv[++i]);
+        else if (arg == "--resolution-scale" && i + 2 < argc)
+        {
+            options.minResolutionScale = (float)std::atof(argv[++i]);
+            options.maxResolutionScale = (float)std::atof(argv[++i]);
+        }
+        else if (arg == "--bloom")
+            options.bloom = true;
+        else if (arg == "--bloom-levels" && hasValue)
+            options.bloomLevels = std::atoi(argv[++i]);
+        else if (arg == "--bloom-threshold" && hasValue)
+            options.bloomThreshold = (float)std::atof(argv[++i]);
+        else if (arg == "--bloom-intensity" && hasValue)
+            options.bloomIntensity = (float)std::atof(argv[++i]);
+        else if (arg == "--tone-mapping")
+            options.toneMapping = true;
+        else if (arg == "--exposure" && hasValue)
+            options.exposure = (float)std::atof(argv[++i]);
+        else if (arg == "--sharpen")
+            options.sharpen = true;
+        else if (arg == "--outline" && hasValue)
+            options.outline = argv[++i];
+        else if (arg == "--outline-width" && hasValue)
+            options.outlineWidth = (float)std::atof(argv[++i]);
+        else if (arg == "--outline-benchmark")
+            options.outlineBenchmark = options.headless = true;
+        else if (arg == "--texture-arrays")
+            options.textureArrays = true;
+        else if (arg == "--texture-array-size" && hasValue)
+            options.textureArraySize = std::atoi(argv[++i]);
+        else if (arg == "--texture-streaming")
+            options.textureStreaming = true;
+        else if (arg == "--texture-budget" && hasValue)
+            options.textureBudgetMb = (float)std::atof(argv[++i]);
+        else if (arg == "--texture-start-size" && hasValue)
+            options.textureStartSize = std::atoi(argv[++i]);
+        else if (arg == "--occlusion-benchmark")
+            options.occlusionBenchmark = options.headless = true;
+        else if (arg == "--software-occlusion-benchmark")
+            options.softwareOcclusionBenchmark = true;
+        else if (arg == "--bvh-benchmark")
+            options.bvhBenchmark = true;
+        else if (arg == "--pick-benchmark")
+            options.pickBenchmark = true;
+        else
+        {
+            LOG_ERROR << "ERROR::ARGUMENTS::UNKNOWN_OR_INCOMPLETE: " << arg;
+            printBenchmarkUsage(argv[0]);
+            return false;
+        }
+    }
+    if (options.width <= 0 || options.height <= 0 || options.frames <= 0 || options.warmupFrames < 0 || options.timeStep <= 0.0f || options.simulationStep <= 0.0f
+        || (options.contextApi != "native" && options.contextApi != "egl" && options.contextApi != "osmesa")
+        || (options.scene != "main" && options.scene != "backpack" && options.scene != "stress" && options.scene != "occlusion") || options.shadingLod < -1
+        || options.probeFaces < 0 || options.probeFaces > 6 || options.probeSize < 8 || (options.probeUpdate != "always" && options.probeUpdate != "motion")
+        || (options.occlusion != "off" && options.occlusion != "hiz" && options.occlusion != "conditional" && options.occlusion != "software")
+        || options.frameBudgetMs <= 0.0f || options.minResolutionScale < 0.1f || options.minResolutionScale > options.maxResolutionScale
+        || options.maxResolutionScale > 1.0f || options.bloomLevels < 1 || options.bloomLevels > 6 || options.bloomThreshold < 0.0f
+        || options.bloomIntensity < 0.0f || options.exposure <= 0.0f || (options.outline != "stencil" && options.outline != "screen")
+        || options.outlineWidth < 1.0f || options.outlineWidth > 64.0f || options.textureArraySize < 0 || options.textureArraySize > 8192
+        || options.textureBudgetMb <= 0.0f || options.textureStartSize < 1)
+    {
+        LOG_ERROR << "ERROR::ARGUMENTS::INVALID_VALUE";
+        printBenchmarkUsage(argv[0]);
+        return false;
+    }
+    //the arrays are copies of the full size maps, taken once
+    if (options.textureArrays && options.textureStreaming)
+    {
+        LOG_ERROR << "ERROR::ARGUMENTS::TEXTURE_ARRAYS_NOT_STREAMED";
+        printBenchmarkUsage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+// Color + depth/stencil render target which replaces the default framebuffer in headless mode
+class OffscreenTarget
+{
+public:
+    GLuint FBO = 0;
+    GLuint Color = 0;
+    GLuint DepthStencil = 0;
+
+    bool Create(int width, int height)
+    {
+        glGenFramebuffers(1, &this->FBO);
+        glGenRenderbuffers(1, &this->Color);
+        glGenRenderbuffers(1, &this->DepthStencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->Color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->DepthStencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->Color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->DepthStencil);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete)
+            LOG_ERROR << "ERROR::FRAMEBUFFER::OFFSCREEN_TARGET_NOT_COMPLETE";
+        return complete;
+    }
+
+    void Delete()
+    {
+        glDeleteFramebuffers(1, &this->FBO);
+        glDeleteRenderbuffers(1, &this->Color);
+        glDeleteRenderbuffers(1, &this->DepthStencil);
+        this->FBO = this->Color = this->DepthStencil = 0;
+    }
+};
+
+struct TimingSummary
+{
+    size_t count = 0;
+    double mean = 0.0, min = 0.0, max = 0.0;
+    double p50 = 0.0, p95 = 0.0, p99 = 0.0;
+};
+
+// Nearest-rank percentiles
+inline TimingSummary summarizeTimings(std::vector<double> values)
+{
+    TimingSummary s;
+    if (values.empty())
+        return s;
+    std::sort(values.begin(), values.end());
+    s.count = values.size();
+    for (size_t i = 0; i < values.size(); i++)
+        s.mean += values[i];
+    s.mean /= values.size();
+    s.min = values.front();
+    s.max = values.back();
+    double percentiles[] = { 0.50, 0.95, 0.99 };
+    double* results[] = { &s.p50, &s.p95, &s.p99 };
+    for (int i = 0; i < 3; i++)
+    {
+        size_t rank = (size_t)std::ceil(percentiles[i] * values.size());
+        *results[i] = values[rank > 0 ? rank - 1 : 0];
+    }
+    return s;
+}
+
+inline void writeTimingSummary(std::ostream& out, const TimingSummary& s)
+{
+    out << "{\"count\":" << s.count << ",\"mean\":" << s.mean << ",\"min\":" << s.min << ",\"max\":" << s.max
+        << ",\"p50\":" << s.p50 << ",\"p95\":" << s.p95 << ",\"p99\":" << s.p99 << "}";
+}
+
+// Systems the scaling benchmarks run on: 1, 2, 4 ... threads, the last one all hardware threads
+inline std::vector<int> benchmarkThreadCounts()
+{
+    int maxThreads = (int)std::thread::hardware_concurrency();
+    maxThreads = maxThreads < 1 ? 1 : maxThreads;
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+    return threadCounts;
+}
+
+// Linear congruential generator of the benchmark data, the fixed seed makes every run measure the same scene
+class BenchmarkRandom
+{
+public:
+    explicit BenchmarkRandom(unsigned int seed = 12345) : seed(seed)
+    {
+    }
+    // Uniform in [0, 1)
+    float operator()()
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    }
+
+private:
+    unsigned int seed;
+};
+
+// Frame times are CPU wall clock milliseconds between two finished frames (a frame ends with glFinish), pass
+// timings come from the GPU profiler history and skip the warm up frames.
+inline bool writeBenchmarkJson(const std::string& path, const BenchmarkOptions& options, const std::vector<double>& frameTimesMs,
+    const GpuProfiler& profiler, const PipelineStats& pipeline, double shaderStartupMs)
+{
+    std::ofstream file(path.c_str());
+    if (!file.is_open())
+    {
+        LOG_ERROR << "ERROR::BENCHMARK::FILE_NOT_WRITTEN: " << path;
+        return false;
+    }
+
+    std::vector<std::string> passes;
+    std::map<std::string, std::vector<double> > passTimes;
+    const std::vector<GpuPassTiming>& history = profiler.History();
+    for (size_t i = 0; i < history.size(); i++)
+    {
+        if (history[i].frame < (unsigned long long)options.warmupFrames)
+            continue;
+        std::vector<double>& times = passTimes[history[i].name];
+        if (times.empty())
+            passes.push_back(history[i].name);
+        times.push_back(history[i].durationMs);
+    }
+
+    GLExtensions& ext = glExtensions();
+    file << std::fixed << std::setprecision(4);
+    file << "{\n  \"width\": " << options.width << ",\n  \"height\": " << options.height
+        << ",\n  \"frames\": " << frameTimesMs.size() << ",\n  \"warmup_frames\": " << options.warmupFrames
+        << ",\n  \"time_step\": " << options.timeStep << ",\n  \"simulation_step\": " << options.simulationStep
+        << ",\n  \"camera_path\": \"" << (options.cameraPath.empty() ? "orbit" : options.cameraPath) << "\""
+        << ",\n  \"context\": \"" << options.contextApi << "\""
+        << ",\n  \"renderer\": \"" << ext.renderer << "\",\n  \"version\": \"" << ext.version << "\""
+        << ",\n  \"shader_startup_ms\": " << shaderStartupMs
+        << ",\n  \"pipeline\": {\"threaded\": " << (options.singleThread ? "false" : "true") << ", \"update_ms\": " << pipeline.UpdateMs()
+        << ", \"render_ms\": " << pipeline.RenderMs() << ", \"overlap\": " << pipeline.Overlap() << "}"
+        << ",\n  \"frame_ms\": ";
+    writeTimingSummary(file, summarizeTimings(frameTimesMs));
+    file << ",\n  \"gpu_passes_ms\": {";
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        file << (i ? "," : "") << "\n    \"" << passes[i] << "\": ";
+        writeTimingSummary(file, summarizeTimings(passTimes[passes[i]]));
+    }
+    file << "\n  }\n}\n";
+    return true;
+}
+
+#endif
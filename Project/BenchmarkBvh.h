@@ -0,0 +1,173 @@
+#ifndef BENCHMARK_BVH_H
+#define BENCHMARK_BVH_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Benchmark.h"
+#include "BenchmarkMesh.h"
+#include "JobSystem.h"
+#include "Frustum.h"
+#include "Bvh.h"
+#include "Log.h"
+
+// Bounding volume hierarchies: an object hierarchy over random boxes built on a system of 1, 2, 4 ... hardware threads,
+// refitted after every box moved, frustum and ray queries against testing every box. Then the triangle hierarchy of the
+// height field of the tangent benchmark, rays against testing every triangle. The answers of both ways are compared
+inline void runBvhBenchmark(size_t boxCount = 1 << 18, int gridSize = 512, int repeats = 15)
+{
+    BenchmarkRandom random;
+    std::vector<Aabb> boxes(boxCount);
+    for (size_t i = 0; i < boxCount; i++)
+    {
+        glm::vec3 center(random() * 200.0f - 100.0f, random() * 50.0f, random() * 200.0f - 100.0f);
+        glm::vec3 extent(0.2f + random(), 0.2f + random(), 0.2f + random());
+        boxes[i].boxMin = center - extent;
+        boxes[i].boxMax = center + extent;
+    }
+
+    const std::vector<int> threadCounts = benchmarkThreadCounts();
+    Bvh bvh;
+    double singleThreadMs = 0.0;
+    for (size_t c = 0; c < threadCounts.size(); c++)
+    {
+        int threads = threadCounts[c];
+        JobSystem jobs(threads - 1);
+        std::vector<double> times;
+        for (int r = 0; r <= std::min(repeats, 5); r++)     // the first run warms up
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            bvh.Build(boxes, jobs);
+            if (r > 0)
+                times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        double ms = summarizeTimings(times).p50;
+        if (threads == 1)
+            singleThreadMs = ms;
+        LOG_INFO << "BVH benchmark, " << threads << " threads: build over " << boxCount << " boxes p50 " << ms << " ms, speedup "
+            << (ms > 0.0 ? singleThreadMs / ms : 0.0) << "x, " << bvh.Nodes.size() << " nodes, SAH cost " << bvh.SahCost();
+    }
+
+    // every box moves a little, the tree keeps its topology
+    std::vector<Aabb> moved(boxes);
+    for (size_t i = 0; i < boxCount; i++)
+    {
+        glm::vec3 offset(random() - 0.5f, random() - 0.5f, random() - 0.5f);
+        moved[i].boxMin += offset;
+        moved[i].boxMax += offset;
+    }
+    std::vector<double> refitTimes;
+    for (int r = 0; r < repeats; r++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bvh.Refit(r % 2 ? boxes : moved);
+        refitTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    bvh.Refit(moved);
+    float refittedCost = bvh.SahCost();
+    bvh.Build(moved);
+    LOG_INFO << "BVH benchmark: refit p50 " << summarizeTimings(refitTimes).p50 << " ms, SAH cost " << refittedCost << " refitted, "
+        << bvh.SahCost() << " rebuilt";
+
+    // frustum queries from the middle of the boxes, turning around
+    std::vector<double> bvhTimes, bruteTimes;
+    size_t bvhFound = 0, bruteFound = 0;
+    for (int r = 0; r < repeats; r++)
+    {
+        float angle = 6.2831853f * r / repeats;
+        Frustum frustum(glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f)
+            * glm::lookAt(glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(std::sin(angle), 10.0f, -std::cos(angle)), glm::vec3(0.0f, 1.0f, 0.0f)));
+        size_t found = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bvh.QueryFrustum(frustum, [&frustum, &moved, &found](unsigned int box) {
+            found += frustum.IntersectsBox(moved[box].boxMin, moved[box].boxMax) ? 1 : 0;
+        });
+        bvhTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        bvhFound += found;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < boxCount; i++)
+            bruteFound += frustum.IntersectsBox(moved[i].boxMin, moved[i].boxMax) ? 1 : 0;
+        bruteTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    LOG_INFO << "BVH benchmark: frustum query p50 " << summarizeTimings(bvhTimes).p50 << " ms against " << summarizeTimings(bruteTimes).p50
+        << " ms for every box, " << bvhFound / repeats << " boxes found per query" << (bvhFound == bruteFound ? "" : ", DIFFERENT from every box");
+
+    // rays from above into the boxes, closest hit
+    const int rayCount = 10000;
+    std::vector<glm::vec3> origins(rayCount), directions(rayCount);
+    for (int i = 0; i < rayCount; i++)
+    {
+        origins[i] = glm::vec3(random() * 200.0f - 100.0f, 60.0f, random() * 200.0f - 100.0f);
+        directions[i] = glm::normalize(glm::vec3(random() - 0.5f, -1.0f, random() - 0.5f));
+    }
+    int mismatches = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<float> closest(rayCount);
+    for (int i = 0; i < rayCount; i++)
+    {
+        const glm::vec3 inverseDirection = 1.0f / directions[i];
+        float tMax = 1e30f;
+        bvh.Raycast(origins[i], directions[i], tMax, [&](unsigned int box, float& t) {
+            float tEnter;
+            if (rayIntersectsBox(origins[i], inverseDirection, moved[box].boxMin, moved[box].boxMax, t, tEnter))
+                t = tEnter;
+        });
+        closest[i] = tMax;
+    }
+    double bvhRayMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const int bruteRays = 200;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < bruteRays; i++)
+    {
+        const glm::vec3 inverseDirection = 1.0f / directions[i];
+        float tMax = 1e30f, tEnter;
+        for (size_t box = 0; box < boxCount; box++)
+            if (rayIntersectsBox(origins[i], inverseDirection, moved[box].boxMin, moved[box].boxMax, tMax, tEnter))
+                tMax = tEnter;
+        mismatches += tMax == closest[i] ? 0 : 1;
+    }
+    double bruteRayMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO << "BVH benchmark: " << rayCount / bvhRayMs << " rays/ms against boxes, " << bruteRays / bruteRayMs << " rays/ms testing every box, "
+        << mismatches << " of " << bruteRays << " closest hits different";
+
+    // triangles
+    TangentBenchmarkMesh mesh;
+    makeTangentBenchmarkGrid(gridSize, mesh);
+    MeshBvh meshBvh;
+    start = std::chrono::steady_clock::now();
+    meshBvh.Build(&mesh.positions[0].x, sizeof(glm::vec3), mesh.positions.size(), mesh.indices.data(), mesh.indices.size());
+    double meshBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (int i = 0; i < rayCount; i++)
+    {
+        origins[i] = glm::vec3(random() * gridSize, 10.0f, random() * gridSize);
+        directions[i] = glm::normalize(glm::vec3(random() - 0.5f, -1.0f, random() - 0.5f));
+    }
+    std::vector<RayHit> hits(rayCount);
+    std::vector<unsigned char> hit(rayCount);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rayCount; i++)
+        hit[i] = meshBvh.Raycast(origins[i], directions[i], 1e30f, hits[i]) ? 1 : 0;
+    double meshRayMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    // the first rays against every triangle
+    mismatches = 0;
+    const int bruteMeshRays = 20;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < bruteMeshRays; i++)
+    {
+        float best = closestTriangleHit(mesh, origins[i], directions[i]);
+        bool found = best < 1e30f;
+        mismatches += found != (hit[i] != 0) || (found && std::fabs(best - hits[i].t) > 1e-3f * best) ? 1 : 0;
+    }
+    double bruteMeshMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO << "BVH benchmark: " << meshBvh.Triangles() << " triangles built in " << meshBuildMs << " ms (" << meshBvh.Tree().Nodes.size()
+        << " nodes, SAH cost " << meshBvh.Tree().SahCost() << "), " << rayCount / meshRayMs << " rays/ms against "
+        << bruteMeshRays / bruteMeshMs << " rays/ms testing every triangle, " << mismatches << " of " << bruteMeshRays << " closest hits different";
+    Logger::Instance().Flush();
+}
+
+#endif
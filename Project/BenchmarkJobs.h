@@ -0,0 +1,63 @@
+#ifndef BENCHMARK_JOBS_H
+#define BENCHMARK_JOBS_H
+
+#include <vector>
+#include <chrono>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "Frustum.h"
+#include "Log.h"
+
+// Scaling of the job system: frustum culling of bounding spheres with ParallelFor on a system of 1, 2, 4 ...
+// hardware threads (the calling thread counts as one). Speedup and efficiency are against one thread.
+inline void runJobBenchmark(size_t sphereCount = 1 << 20, int repeats = 15)
+{
+    std::vector<glm::vec4> spheres(sphereCount);
+    BenchmarkRandom random;
+    for (size_t i = 0; i < sphereCount; i++)
+    {
+        float v[4];
+        for (int k = 0; k < 4; k++)
+            v[k] = random();
+        spheres[i] = glm::vec4(v[0] * 200.0f - 100.0f, v[1] * 50.0f, v[2] * 200.0f - 100.0f, 0.2f + v[3]);
+    }
+    Frustum frustum(glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f)
+        * glm::lookAt(glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0.0f, 10.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    std::vector<unsigned char> visible(sphereCount);
+
+    const std::vector<int> threadCounts = benchmarkThreadCounts();
+
+    double singleThreadMs = 0.0;
+    for (size_t c = 0; c < threadCounts.size(); c++)
+    {
+        int threads = threadCounts[c];
+        JobSystem jobs(threads - 1);
+        std::vector<double> times;
+        size_t visibleCount = 0;
+        for (int r = 0; r <= repeats; r++)      // the first run warms up
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            jobs.ParallelFor(sphereCount, 4096, [&spheres, &frustum, &visible](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                    visible[i] = frustum.IntersectsSphere(glm::vec3(spheres[i]), spheres[i].w) ? 1 : 0;
+            });
+            if (r > 0)
+                times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        for (size_t i = 0; i < sphereCount; i++)
+            visibleCount += visible[i];
+        double ms = summarizeTimings(times).p50;
+        if (threads == 1)
+            singleThreadMs = ms;
+        double speedup = ms > 0.0 ? singleThreadMs / ms : 0.0;
+        LOG_INFO << "Job benchmark, " << threads << " threads: culling " << sphereCount << " spheres (" << visibleCount << " visible) p50 "
+            << ms << " ms, speedup " << speedup << "x, efficiency " << speedup / threads * 100.0 << "%, " << jobs.StolenJobs() << " jobs stolen";
+    }
+    Logger::Instance().Flush();
+}
+
+#endif
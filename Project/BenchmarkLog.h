@@ -0,0 +1,61 @@
+#ifndef BENCHMARK_LOG_H
+#define BENCHMARK_LOG_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+
+#include "Benchmark.h"
+#include "Log.h"
+
+// Enqueue latency of the logger with 1, 2, 4 ... hardware threads producers logging at once. The sinks are
+// switched off meanwhile, so the numbers are the cost on the logging thread: formatting, the clock read
+// and the ring push. Messages the writer could not take fast enough are counted as dropped.
+inline void runLogBenchmark(int messagesPerThread = 50000)
+{
+    Logger& logger = Logger::Instance();
+    logger.Flush();
+    logger.SetConsole(false);
+    const std::vector<int> threadCounts = benchmarkThreadCounts();
+
+    std::vector<std::string> lines;
+    for (size_t c = 0; c < threadCounts.size(); c++)
+    {
+        int threads = threadCounts[c];
+        std::vector<std::vector<double> > samples(threads, std::vector<double>(messagesPerThread));
+        std::vector<std::thread> producers;
+        size_t droppedBefore = logger.Dropped();
+        for (int t = 0; t < threads; t++)
+        {
+            producers.push_back(std::thread([t, messagesPerThread, &samples]() {
+                for (int i = 0; i < messagesPerThread; i++)
+                {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    LogLine(LOG_LEVEL_INFO) << "benchmark message " << i << " from producer " << t << ", value " << i * 0.5;
+                    samples[t][i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                }
+            }));
+        }
+        for (int t = 0; t < threads; t++)
+            producers[t].join();
+        logger.Flush();
+
+        std::vector<double> all;
+        for (int t = 0; t < threads; t++)
+            all.insert(all.end(), samples[t].begin(), samples[t].end());
+        TimingSummary s = summarizeTimings(all);
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1) << threads << " producers: enqueue ns mean " << s.mean << ", p50 " << s.p50
+            << ", p99 " << s.p99 << ", max " << s.max << ", dropped " << logger.Dropped() - droppedBefore << " of " << all.size();
+        lines.push_back(line.str());
+    }
+    logger.SetConsole(true);
+    for (size_t i = 0; i < lines.size(); i++)
+        LOG_INFO << "Log benchmark, " << lines[i];
+    logger.Flush();
+}
+
+#endif
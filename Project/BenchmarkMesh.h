@@ -0,0 +1,74 @@
+#ifndef BENCHMARK_MESH_H
+#define BENCHMARK_MESH_H
+
+#include <vector>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "TangentSpace.h"
+
+// Mesh of the tangent benchmark, Assimp's tangents and bitangents stay empty when it did not import the mesh
+struct TangentBenchmarkMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> assimpTangents;
+    std::vector<glm::vec3> assimpBitangents;
+
+    TangentMeshView View() const
+    {
+        TangentMeshView view = { &this->positions[0].x, sizeof(glm::vec3), &this->normals[0].x, sizeof(glm::vec3),
+            &this->texCoords[0].x, sizeof(glm::vec2), this->positions.size(), this->indices.data(), this->indices.size() };
+        return view;
+    }
+};
+
+// Rolling height field of gridSize x gridSize quads. The texture coordinates are mirrored at the middle, so
+// half of it has a left handed tangent space.
+inline void makeTangentBenchmarkGrid(int gridSize, TangentBenchmarkMesh& mesh)
+{
+    const int side = gridSize + 1;
+    const float frequency = 6.2831853f / 64.0f, amplitude = 2.0f;
+    for (int y = 0; y < side; y++)
+        for (int x = 0; x < side; x++)
+        {
+            float h = amplitude * std::sin(x * frequency) * std::cos(y * frequency);
+            float dx = amplitude * frequency * std::cos(x * frequency) * std::cos(y * frequency);
+            float dy = -amplitude * frequency * std::sin(x * frequency) * std::sin(y * frequency);
+            mesh.positions.push_back(glm::vec3((float)x, h, (float)y));
+            mesh.normals.push_back(glm::normalize(glm::vec3(-dx, 1.0f, -dy)));
+            mesh.texCoords.push_back(glm::vec2(std::fabs(x - gridSize * 0.5f) / 16.0f, y / 16.0f));
+        }
+    for (int y = 0; y < gridSize; y++)
+        for (int x = 0; x < gridSize; x++)
+        {
+            unsigned int corner = y * side + x;
+            unsigned int quad[6] = { corner, corner + side, corner + 1, corner + 1, corner + side, corner + side + 1 };
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+}
+
+// Distance to the closest triangle of the mesh the ray hits, both sides count, 1e30 for none. Every triangle is tested,
+// the reference of the ray benchmarks
+inline float closestTriangleHit(const TangentBenchmarkMesh& mesh, const glm::vec3& origin, const glm::vec3& direction)
+{
+    float best = 1e30f;
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+    {
+        glm::vec3 a = mesh.positions[mesh.indices[t]], b = mesh.positions[mesh.indices[t + 1]], c = mesh.positions[mesh.indices[t + 2]];
+        glm::vec3 e1 = b - a, e2 = c - a, p = glm::cross(direction, e2);
+        float determinant = glm::dot(e1, p);
+        if (std::fabs(determinant) < 1e-12f)
+            continue;
+        glm::vec3 sv = origin - a, q = glm::cross(sv, e1);
+        float u = glm::dot(sv, p) / determinant, v = glm::dot(direction, q) / determinant, tHit = glm::dot(e2, q) / determinant;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && tHit >= 0.0f && tHit < best)
+            best = tHit;
+    }
+    return best;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef BENCHMARK_OCCLUSION_H
+#define BENCHMARK_OCCLUSION_H
+
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "OcclusionCulling.h"
+#include "SoftwareOcclusion.h"
+#include "Log.h"
+
+// One mode of --occlusion-benchmark: the occlusion scene headless, per measured frame
+struct OcclusionBenchmarkRun
+{
+    double frameMsP50 = 0.0;
+    double frameMsP95 = 0.0;
+    double culledPercent = 0.0;     // of the grid cubes in the view frustum
+    double drawCalls = 0.0;         // with OCCLUSION_SOFTWARE including the queries which check it
+    double falseCulledPercent = 0.0;    // OCCLUSION_SOFTWARE: of the culled cubes, visible by the queries of the GPU
+    double trianglesPerMs = 0.0;        // OCCLUSION_SOFTWARE: occluders rasterized on the CPU
+};
+
+// runs[mode], the gain is the frame time saved against OCCLUSION_OFF
+inline void logOcclusionBenchmark(const std::vector<OcclusionBenchmarkRun>& runs)
+{
+    for (size_t mode = 0; mode < runs.size(); mode++)
+    {
+        const OcclusionBenchmarkRun& run = runs[mode];
+        const double offMs = runs[OCCLUSION_OFF].frameMsP50;
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2) << "Occlusion benchmark, " << occlusionModeName((int)mode) << ": frame ms p50 " << run.frameMsP50
+            << " p95 " << run.frameMsP95 << ", " << run.drawCalls << " draw calls, " << run.culledPercent << "% of the grid culled";
+        if (mode != OCCLUSION_OFF)
+            line << ", gain " << offMs - run.frameMsP50 << " ms (" << (offMs > 0.0 ? 100.0 * (offMs - run.frameMsP50) / offMs : 0.0) << "%)";
+        // the queries are exact, what they hide is the share a perfect test would cull
+        if (mode == OCCLUSION_SOFTWARE && OCCLUSION_CONDITIONAL < runs.size())
+            line << ", " << run.falseCulledPercent << "% of it visible, " << run.culledPercent - runs[OCCLUSION_CONDITIONAL].culledPercent
+                << " points against the exact share, " << run.trianglesPerMs << " triangles/ms";
+        LOG_INFO << line.str();
+    }
+    Logger::Instance().Flush();
+}
+
+// Throughput of SoftwareOcclusion: a city of boxes in front of the camera rasterized on a system of 1, 2, 4 ... hardware
+// threads, in triangles/ms of setup and binning (one thread) plus rasterization. Then small boxes scattered between the
+// buildings are tested against it. The exact accuracy, against the depth of the GPU, is in --occlusion-benchmark
+inline void runSoftwareOcclusionBenchmark(int width = 256, int height = 192, int repeats = 15)
+{
+    static const float cube[] = { -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, -0.5f, 0.5f, -0.5f,
+        -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f, 0.5f, 0.5f, 0.5f, -0.5f, 0.5f, 0.5f };
+    static const unsigned int cubeIndices[] = { 0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4, 0, 4, 7, 7, 3, 0, 1, 5, 6, 6, 2, 1, 3, 2, 6, 6, 7, 3,
+        0, 1, 5, 5, 4, 0 };
+    std::vector<glm::mat4> occluders;
+    std::vector<glm::vec3> occludees;
+    BenchmarkRandom random;
+    for (int i = 0; i < 512; i++)
+    {
+        glm::vec3 position(random() * 80.0f - 40.0f, 0.0f, -5.0f - random() * 60.0f);
+        glm::vec3 size(1.0f + random() * 4.0f, 2.0f + random() * 10.0f, 1.0f + random() * 4.0f);
+        occluders.push_back(glm::scale(glm::translate(glm::mat4(1.0f), position + glm::vec3(0.0f, 0.5f * size.y, 0.0f)), size));
+    }
+    for (int i = 0; i < 4096; i++)
+        occludees.push_back(glm::vec3(random() * 80.0f - 40.0f, random() * 3.0f, -5.0f - random() * 60.0f));
+    glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), (float)width / height, 0.1f, 100.0f)
+        * glm::lookAt(glm::vec3(0.0f, 1.7f, 0.0f), glm::vec3(0.0f, 1.7f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    const std::vector<int> threadCounts = benchmarkThreadCounts();
+
+    SoftwareOcclusion occlusion;
+    occlusion.Create(width, height, occluders.size() * 12);
+    double singleThreadMs = 0.0;
+    for (size_t c = 0; c < threadCounts.size(); c++)
+    {
+        int threads = threadCounts[c];
+        JobSystem jobs(threads - 1);
+        std::vector<double> times;
+        for (int r = 0; r <= repeats; r++)      // the first run warms up
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            occlusion.BeginFrame(viewProjection);
+            for (size_t i = 0; i < occluders.size(); i++)
+                occlusion.AddOccluder(cube, 3 * sizeof(float), 8, cubeIndices, 36, occluders[i]);
+            occlusion.Rasterize(jobs);
+            if (r > 0)
+                times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        double ms = summarizeTimings(times).p50;
+        if (threads == 1)
+            singleThreadMs = ms;
+        double speedup = ms > 0.0 ? singleThreadMs / ms : 0.0;
+        LOG_INFO << "Software occlusion benchmark, " << threads << " threads: " << occlusion.Triangles() << " occluder triangles at " << width << "x"
+            << height << " p50 " << ms << " ms, " << (ms > 0.0 ? occlusion.Triangles() / ms : 0.0) << " triangles/ms, speedup " << speedup << "x"
+            << (SOFTWARE_OCCLUSION_SSE ? " (SSE2)" : " (scalar)");
+    }
+
+    // a conservative test culls less at a low resolution, the share at four times the resolution shows what it leaves
+    SoftwareOcclusion fine;
+    fine.Create(4 * width, 4 * height, occluders.size() * 12);
+    fine.BeginFrame(viewProjection);
+    for (size_t i = 0; i < occluders.size(); i++)
+        fine.AddOccluder(cube, 3 * sizeof(float), 8, cubeIndices, 36, occluders[i]);
+    fine.Rasterize();
+    size_t culled = 0, fineCulled = 0;
+    for (size_t i = 0; i < occludees.size(); i++)
+    {
+        glm::vec3 boxMin = occludees[i] - glm::vec3(0.25f), boxMax = occludees[i] + glm::vec3(0.25f);
+        culled += occlusion.Occluded(boxMin, boxMax) ? 1 : 0;
+        fineCulled += fine.Occluded(boxMin, boxMax) ? 1 : 0;
+    }
+    LOG_INFO << "Software occlusion benchmark: " << culled << " of " << occludees.size() << " boxes culled at " << width << "x" << height << ", "
+        << fineCulled << " at " << 4 * width << "x" << 4 * height;
+    Logger::Instance().Flush();
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef BENCHMARK_OUTLINE_H
+#define BENCHMARK_OUTLINE_H
+
+#include <vector>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Benchmark.h"
+#include "Shader.h"
+#include "Outline.h"
+#include "Log.h"
+
+// Outlines of a growing number of cubes drawn into an offscreen target: the stencil pass draws every cube a second time,
+// the screen-space one draws a fixed number of full screen passes (the direct search at 2 pixels, jump flooding at 8).
+// The cubes are drawn flat with the outline shader first, marking the stencil, and the cost of an outline is the wall
+// clock time up to glFinish (timer queries miss the deferred rasterization of software renderers) minus that of the
+// cubes alone. The stencil outline is scaled to about 2 pixels as well
+inline void runOutlineBenchmark(Shader& flatShader, unsigned int cubeVAO, int width, int height, int repeats = 15)
+{
+    ScreenSpaceOutline screenOutline;
+    OffscreenTarget target;
+    if (!target.Create(width, height) || !screenOutline.Create(width, height))
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+    glViewport(0, 0, width, height);
+    const float distance = 2.4f, halfHeight = distance * std::tan(glm::radians(22.5f));
+    const glm::mat4 projectionMat = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 10.0f);
+    const glm::mat4 viewMat = glm::lookAt(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    flatShader.Use();
+    flatShader.setMat4("projectionMat", projectionMat);
+    flatShader.setMat4("viewMat", viewMat);
+    std::vector<glm::mat4> cubes, scaledCubes;
+    const int counts[] = { 1, 16, 64, 256, 1024, 4096 };
+    for (int count : counts)
+    {
+        // a square grid filling the height of the view, the cubes half as large as their cells
+        const int side = (int)std::ceil(std::sqrt((double)count));
+        const float cell = 2.0f * halfHeight / side, cubeSize = 0.5f * cell;
+        const float cubePixels = cubeSize * height / (2.0f * halfHeight);
+        const float outlineScale = 1.0f + 2.0f * 2.0f / cubePixels;
+        cubes.clear();
+        scaledCubes.clear();
+        for (int i = 0; i < count; i++)
+        {
+            glm::mat4 modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(-halfHeight + (i % side + 0.5f) * cell, -halfHeight + (i / side + 0.5f) * cell, 0.0f));
+            modelMat = glm::rotate(modelMat, 0.5f, glm::vec3(1.0f, 1.0f, 0.0f));
+            cubes.push_back(glm::scale(modelMat, glm::vec3(cubeSize)));
+            scaledCubes.push_back(glm::scale(modelMat, glm::vec3(cubeSize * outlineScale)));
+        }
+        // 0: the cubes alone, 1: stencil outline, 2: screen-space 2 pixels, 3: screen-space 8 pixels
+        double ms[4];
+        for (int pass = 0; pass < 4; pass++)
+        {
+            std::vector<double> times;
+            for (int r = 0; r <= repeats; r++)      // the first one warms up
+            {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+                glFinish();
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                flatShader.Use();
+                flatShader.setVec3("outlineColor", glm::vec3(0.6f));
+                glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+                glBindVertexArray(cubeVAO);
+                for (int i = 0; i < count; i++)
+                {
+                    flatShader.setMat4("modelMat", cubes[i]);
+                    glDrawArrays(GL_TRIANGLES, 0, 36);
+                }
+                glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+                if (pass == 1)
+                {
+                    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+                    flatShader.setVec3("outlineColor", glm::vec3(1.0f, 0.0f, 0.0f));
+                    for (int i = 0; i < count; i++)
+                    {
+                        flatShader.setMat4("modelMat", scaledCubes[i]);
+                        glDrawArrays(GL_TRIANGLES, 0, 36);
+                    }
+                    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+                }
+                glBindVertexArray(0);
+                if (pass >= 2)
+                {
+                    OutlineBounds outlined;
+                    for (int i = 0; i < count; i++)
+                        outlined.Add(projectionMat * viewMat, glm::vec3(cubes[i][3]) - cubeSize, glm::vec3(cubes[i][3]) + cubeSize, width, height);
+                    screenOutline.Draw(target.FBO, width, height, outlined, 1, glm::vec3(1.0f, 0.0f, 0.0f), pass == 2 ? 2.0f : 8.0f);
+                }
+                glFinish();
+                if (r > 0)
+                    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            ms[pass] = summarizeTimings(times).p50;
+        }
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(3) << "Outline benchmark, " << count << " objects: cubes " << ms[0] << " ms, stencil outline "
+            << ms[1] - ms[0] << " ms (" << count << " more draws), screen-space 2 px " << ms[2] - ms[0] << " ms, 8 px " << ms[3] - ms[0]
+            << " ms (jump flooding)";
+        LOG_INFO << line.str();
+    }
+    screenOutline.Delete();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    target.Delete();
+    Logger::Instance().Flush();
+}
+
+#endif
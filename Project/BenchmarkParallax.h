@@ -0,0 +1,134 @@
+#ifndef BENCHMARK_PARALLAX_H
+#define BENCHMARK_PARALLAX_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Benchmark.h"
+#include "Shader.h"
+#include "ConeStepMap.h"
+#include "Log.h"
+
+// Parallax quad with the linear march against cone step mapping, from a head-on view to a grazing one.
+// Fetches are counted by the CPU versions of both paths over a grid of texture coordinates. The GPU cost is
+// the wall clock time of a batch of quads drawn into an offscreen target up to glFinish (like the frame
+// times, timer queries miss the deferred rasterization of software renderers), per fragment which passed.
+// The difference is how far the cone path ends from the linear one, in texels.
+inline void runParallaxBenchmark(Shader& shader, unsigned int quadVAO, unsigned int diffuseMap, unsigned int normalMap,
+    unsigned int depthMap, unsigned int coneMap, const std::string& depthPath, const std::string& conePath,
+    int width, int height, int repeats = 20, int drawsPerRepeat = 8)
+{
+    ConeStepMap depth, cones;
+    if (!loadConeStepMap(depthPath, depth) || !loadConeStepMap(conePath, cones) || !cones.HasCones())
+    {
+        LOG_ERROR << "ERROR::PARALLAX_BENCHMARK::NO_CONE_STEP_MAP: " << conePath << " (run --bake-cone-map first)";
+        Logger::Instance().Flush();
+        return;
+    }
+    const float heightScale = 0.1f;
+    const int grid = 128;
+    OffscreenTarget target;
+    if (!target.Create(width, height))
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+    glViewport(0, 0, width, height);
+    GLuint samplesQuery;
+    glGenQueries(1, &samplesQuery);
+    glDisable(GL_DEPTH_TEST);       // every quad of a batch is shaded again
+    glDisable(GL_STENCIL_TEST);
+    const unsigned int variants[2] = { 0, shader.Feature("CONE_STEP_MAPPING") };
+    const unsigned int maps[2] = { depthMap, coneMap };
+
+    const float angles[] = { 0.0f, 15.0f, 30.0f, 45.0f, 60.0f, 70.0f, 80.0f };
+    for (float angle : angles)
+    {
+        // around the normal of the quad a bit, so the rays cross the relief diagonally
+        float theta = glm::radians(angle), phi = glm::radians(30.0f);
+        glm::vec3 direction(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+
+        double fetches[2] = { 0.0, 0.0 }, difference = 0.0;
+        int maxFetches[2] = { 0, 0 };
+        for (int y = 0; y < grid; y++)
+            for (int x = 0; x < grid; x++)
+            {
+                glm::vec2 texCoords((x + 0.5f) / grid, (y + 0.5f) / grid);
+                ParallaxTrace traces[2] = { traceParallaxLinear(depth, texCoords, direction, heightScale),
+                    traceParallaxCone(cones, texCoords, direction, heightScale) };
+                for (int i = 0; i < 2; i++)
+                {
+                    fetches[i] += traces[i].fetches;
+                    maxFetches[i] = traces[i].fetches > maxFetches[i] ? traces[i].fetches : maxFetches[i];
+                }
+                difference += glm::length((traces[1].texCoords - traces[0].texCoords) * glm::vec2(depth.width, depth.height));
+            }
+
+        glm::vec3 cameraPosition = direction * 2.6f;
+        glm::mat4 projectionMat = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 10.0f);
+        glm::mat4 viewMat = glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        double gpuMs[2] = { 0.0, 0.0 }, nsPerFragment[2] = { 0.0, 0.0 };
+        GLuint64 fragments = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            shader.Use(variants[i]);
+            shader.setMat4("projectionMat", projectionMat);
+            shader.setMat4("viewMat", viewMat);
+            shader.setMat4("modelMat", glm::mat4(1.0f));
+            shader.setVec3("viewPos", cameraPosition);
+            shader.setVec3("lightPos", cameraPosition);
+            shader.setFloat("heightScale", heightScale);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, diffuseMap);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, normalMap);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, maps[i]);
+            glBindVertexArray(quadVAO);
+            std::vector<double> times;
+            GLuint64 samples = 0;
+            glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glEndQuery(GL_SAMPLES_PASSED);
+            glGetQueryObjectui64v(samplesQuery, GL_QUERY_RESULT, &samples);
+            for (int r = 0; r <= repeats; r++)      // the first batch warms up
+            {
+                glClear(GL_COLOR_BUFFER_BIT);
+                glFinish();
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                for (int d = 0; d < drawsPerRepeat; d++)
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                glFinish();
+                if (r > 0)
+                    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / drawsPerRepeat);
+            }
+            gpuMs[i] = summarizeTimings(times).p50;
+            nsPerFragment[i] = samples > 0 ? gpuMs[i] * 1.0e6 / samples : 0.0;
+            fragments = samples;
+        }
+        glBindVertexArray(0);
+
+        const double samples = (double)grid * grid;
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2) << "Parallax benchmark, " << angle << " deg: linear " << fetches[0] / samples
+            << " fetches (max " << maxFetches[0] << ") " << gpuMs[0] << " ms " << nsPerFragment[0] << " ns/fragment, cone step "
+            << fetches[1] / samples << " fetches (max " << maxFetches[1] << ") " << gpuMs[1] << " ms " << nsPerFragment[1]
+            << " ns/fragment, speedup " << (gpuMs[1] > 0.0 ? gpuMs[0] / gpuMs[1] : 0.0) << "x, mean difference "
+            << difference / samples << " texels, " << fragments << " fragments";
+        LOG_INFO << line.str();
+    }
+    glDeleteQueries(1, &samplesQuery);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_STENCIL_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    target.Delete();
+    Logger::Instance().Flush();
+}
+
+#endif
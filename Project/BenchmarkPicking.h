@@ -0,0 +1,105 @@
+#ifndef BENCHMARK_PICKING_H
+#define BENCHMARK_PICKING_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <assimp/Importer.hpp>
+
+#include "Benchmark.h"
+#include "BenchmarkMesh.h"
+#include "BenchmarkTangent.h"
+#include "Bvh.h"
+#include "Picking.h"
+#include "Log.h"
+
+// Picks per second: cursor rays through random pixels of a camera circling the model, every mesh of it an object of the
+// picker like in the backpack scene. Without the model (no Assimp) the height field of the tangent benchmark takes its
+// place. The first picks are checked against every triangle of every mesh
+inline void runPickBenchmark(const std::string& modelPath, int pickCount = 100000, int width = 1280, int height = 960)
+{
+    std::vector<TangentBenchmarkMesh> meshes;
+    double importMs = 0.0;
+    std::string error;
+    if (!importTangentBenchmarkMeshes([&modelPath](Assimp::Importer& importer, unsigned int flags) { return importer.ReadFile(modelPath, flags); },
+        0, meshes, importMs, error))
+    {
+        LOG_WARNING << "Pick benchmark: " << modelPath << " not imported (" << error << "), the height field instead";
+        meshes.assign(1, TangentBenchmarkMesh());
+        makeTangentBenchmarkGrid(256, meshes[0]);
+    }
+    Aabb bounds;
+    size_t triangleCount = 0;
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+        for (size_t i = 0; i < meshes[m].positions.size(); i++)
+            bounds.Grow(meshes[m].positions[i]);
+        triangleCount += meshes[m].indices.size() / 3;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<MeshBvh> meshBvhs(meshes.size());
+    ObjectPicker picker;
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+        meshBvhs[m].Build(&meshes[m].positions[0].x, sizeof(glm::vec3), meshes[m].positions.size(), meshes[m].indices.data(), meshes[m].indices.size());
+        picker.Add(&meshBvhs[m], glm::mat4(1.0f));
+    }
+    picker.Build();
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // the camera circles the model a little above it, far enough for all of it to be in view
+    BenchmarkRandom random;
+    const glm::vec3 center = 0.5f * (bounds.boxMin + bounds.boxMax);
+    const float size = glm::length(bounds.boxMax - bounds.boxMin);
+    const glm::mat4 projectionMat = glm::perspective(glm::radians(45.0f), (float)width / height, 0.01f * size, 10.0f * size);
+    std::vector<glm::vec3> origins(pickCount), directions(pickCount);
+    for (int i = 0; i < pickCount; i++)
+    {
+        float angle = 6.2831853f * random();
+        glm::vec3 eye = center + glm::vec3(0.8f * size * std::sin(angle), 0.4f * size, 0.8f * size * std::cos(angle));
+        cursorRay(random() * width, random() * height, width, height, projectionMat, glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f)),
+            origins[i], directions[i]);
+    }
+
+    std::vector<PickHit> hits(pickCount);
+    std::vector<unsigned char> hit(pickCount);
+    std::vector<double> pickTimes(pickCount);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < pickCount; i++)
+    {
+        std::chrono::steady_clock::time_point pickStart = std::chrono::steady_clock::now();
+        hit[i] = picker.Pick(origins[i], directions[i], hits[i]) ? 1 : 0;
+        pickTimes[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+    }
+    double pickMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t hitCount = 0;
+    for (int i = 0; i < pickCount; i++)
+        hitCount += hit[i];
+
+    int mismatches = 0;
+    const int brutePicks = std::min(pickCount, 200);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < brutePicks; i++)
+    {
+        float best = 1e30f;
+        for (size_t m = 0; m < meshes.size(); m++)
+            best = std::min(best, closestTriangleHit(meshes[m], origins[i], directions[i]));
+        bool found = best < 1e30f;
+        mismatches += found != (hit[i] != 0) || (found && std::fabs(best - hits[i].t) > 1e-3f * best) ? 1 : 0;
+    }
+    double bruteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    TimingSummary summary = summarizeTimings(pickTimes);
+    LOG_INFO << "Pick benchmark: " << meshes.size() << " meshes, " << triangleCount << " triangles, hierarchies built in " << buildMs << " ms";
+    LOG_INFO << "Pick benchmark: " << pickCount / (pickMs / 1000.0) << " picks/s, p50 " << summary.p50 << " us, p95 " << summary.p95
+        << " us, p99 " << summary.p99 << " us, " << 100.0 * hitCount / pickCount << "% of the picks hit, "
+        << brutePicks / (bruteMs / 1000.0) << " picks/s testing every triangle, " << mismatches << " of " << brutePicks << " different";
+    Logger::Instance().Flush();
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef BENCHMARK_PROFILER_H
+#define BENCHMARK_PROFILER_H
+
+#include <vector>
+
+#include "Benchmark.h"
+#include "CpuProfiler.h"
+#include "Log.h"
+
+// Cost of an empty PROFILE_SCOPE: two clock reads and the push into the ring of the thread, the median of
+// `repeats` runs of `scopes` scopes each. Budget is 50 ns per scope.
+inline void runProfilerBenchmark(unsigned int scopes = 1000000, int repeats = 5)
+{
+#if CPU_PROFILER_ENABLED
+    CpuProfiler::Instance().MeasureOverheadNs(scopes / 10);        // warms up the scratch buffer and the caches
+    std::vector<double> times;
+    for (int r = 0; r < repeats; r++)
+        times.push_back(CpuProfiler::Instance().MeasureOverheadNs(scopes));
+    TimingSummary s = summarizeTimings(times);
+    LOG_INFO << "Profiler benchmark: empty scope p50 " << s.p50 << " ns, max " << s.max << " ns over " << repeats << " x " << scopes
+        << " scopes (budget 50 ns)";
+#else
+    LOG_WARNING << "Profiler benchmark: the CPU profiler is compiled out (CPU_PROFILER_ENABLED 0)";
+#endif
+    Logger::Instance().Flush();
+}
+
+#endif
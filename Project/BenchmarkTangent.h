@@ -0,0 +1,187 @@
+#ifndef BENCHMARK_TANGENT_H
+#define BENCHMARK_TANGENT_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+
+#include <glm/glm.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "Benchmark.h"
+#include "BenchmarkMesh.h"
+#include "JobSystem.h"
+#include "TangentSpace.h"
+#include "Log.h"
+
+// Wavefront OBJ text of a mesh, for Assimp to import it from memory
+inline std::string tangentBenchmarkObj(const TangentBenchmarkMesh& mesh)
+{
+    std::ostringstream obj;
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+        obj << "v " << mesh.positions[i].x << " " << mesh.positions[i].y << " " << mesh.positions[i].z << "\n";
+    for (size_t i = 0; i < mesh.texCoords.size(); i++)
+        obj << "vt " << mesh.texCoords[i].x << " " << mesh.texCoords[i].y << "\n";
+    for (size_t i = 0; i < mesh.normals.size(); i++)
+        obj << "vn " << mesh.normals[i].x << " " << mesh.normals[i].y << " " << mesh.normals[i].z << "\n";
+    for (size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        obj << "f";
+        for (int k = 0; k < 3; k++)
+            obj << " " << mesh.indices[i + k] + 1 << "/" << mesh.indices[i + k] + 1 << "/" << mesh.indices[i + k] + 1;
+        obj << "\n";
+    }
+    return obj.str();
+}
+
+// Imports a scene `repeats` + 1 times (the first run warms up) and measures aiProcess_CalcTangentSpace alone on
+// each. The triangles of the last import with their Assimp tangents end up in meshes.
+inline bool importTangentBenchmarkMeshes(const std::function<const aiScene*(Assimp::Importer&, unsigned int)>& import,
+    int repeats, std::vector<TangentBenchmarkMesh>& meshes, double& assimpMs, std::string& error)
+{
+    std::vector<double> times;
+    for (int r = 0; r <= repeats; r++)
+    {
+        Assimp::Importer importer;
+        const aiScene* scene = import(importer, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals);
+        if (!scene || !scene->mRootNode)
+        {
+            error = importer.GetErrorString();
+            return false;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        scene = importer.ApplyPostProcessing(aiProcess_CalcTangentSpace);
+        if (r > 0)
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (!scene)
+        {
+            error = importer.GetErrorString();
+            return false;
+        }
+        if (r < repeats)
+            continue;
+        for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+        {
+            const aiMesh* source = scene->mMeshes[m];
+            if (!source->mNormals || !source->mTextureCoords[0] || !source->mTangents)
+                continue;
+            TangentBenchmarkMesh mesh;
+            for (unsigned int i = 0; i < source->mNumVertices; i++)
+            {
+                mesh.positions.push_back(glm::vec3(source->mVertices[i].x, source->mVertices[i].y, source->mVertices[i].z));
+                mesh.normals.push_back(glm::vec3(source->mNormals[i].x, source->mNormals[i].y, source->mNormals[i].z));
+                mesh.texCoords.push_back(glm::vec2(source->mTextureCoords[0][i].x, source->mTextureCoords[0][i].y));
+                mesh.assimpTangents.push_back(glm::vec3(source->mTangents[i].x, source->mTangents[i].y, source->mTangents[i].z));
+                mesh.assimpBitangents.push_back(glm::vec3(source->mBitangents[i].x, source->mBitangents[i].y, source->mBitangents[i].z));
+            }
+            for (unsigned int f = 0; f < source->mNumFaces; f++)
+                if (source->mFaces[f].mNumIndices == 3)     // points and lines have no tangents
+                    mesh.indices.insert(mesh.indices.end(), source->mFaces[f].mIndices, source->mFaces[f].mIndices + 3);
+            if (!mesh.indices.empty())
+                meshes.push_back(mesh);
+        }
+    }
+    assimpMs = summarizeTimings(times).p50;
+    return !meshes.empty();
+}
+
+// generateTangents on one thread and on all hardware threads against aiProcess_CalcTangentSpace on one (all Assimp
+// has), over the same imported triangles: a rolling grid of gridSize x gridSize quads and the meshes of the model.
+// Without Assimp the grid is measured alone. The difference is the mean angle between both tangents, the packing
+// error the largest angle between a tangent and the one unpacked from its 4 bytes.
+inline void runTangentBenchmark(const std::string& modelPath, int gridSize = 512, int repeats = 5)
+{
+    TangentBenchmarkMesh grid;
+    makeTangentBenchmarkGrid(gridSize, grid);
+    const std::string gridObj = tangentBenchmarkObj(grid);
+    const std::string names[2] = { "grid", modelPath };
+    const std::function<const aiScene*(Assimp::Importer&, unsigned int)> imports[2] = {
+        [&gridObj](Assimp::Importer& importer, unsigned int flags) { return importer.ReadFileFromMemory(gridObj.data(), gridObj.size(), flags, "obj"); },
+        [&modelPath](Assimp::Importer& importer, unsigned int flags) { return importer.ReadFile(modelPath, flags); }
+    };
+    const int maxThreads = benchmarkThreadCounts().back();
+    for (int source = 0; source < 2; source++)
+    {
+        std::vector<TangentBenchmarkMesh> meshes;
+        double assimpMs = 0.0;
+        std::string error;
+        bool assimp = importTangentBenchmarkMeshes(imports[source], repeats, meshes, assimpMs, error);
+        if (!assimp)
+        {
+            LOG_WARNING << "Tangent benchmark, " << names[source] << ": not imported by Assimp (" << error << ")"
+                << (source == 0 ? ", the generator alone" : "");
+            if (source != 0)
+                continue;
+            meshes.assign(1, grid);
+        }
+        size_t vertexCount = 0, triangleCount = 0;
+        for (size_t m = 0; m < meshes.size(); m++)
+        {
+            vertexCount += meshes[m].positions.size();
+            triangleCount += meshes[m].indices.size() / 3;
+        }
+
+        double generatorMs[2] = { 0.0, 0.0 };
+        std::vector<std::vector<glm::vec4> > tangents(meshes.size());
+        for (int run = 0; run < 2; run++)
+        {
+            JobSystem jobs(run == 0 ? 0 : maxThreads - 1);
+            std::vector<double> times;
+            for (int r = 0; r <= repeats; r++)
+            {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                for (size_t m = 0; m < meshes.size(); m++)
+                    generateTangents(meshes[m].View(), tangents[m], jobs);
+                if (r > 0)
+                    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            generatorMs[run] = summarizeTimings(times).p50;
+        }
+
+        double angleSum = 0.0, packingError = 0.0;
+        size_t compared = 0, sameSign = 0;
+        for (size_t m = 0; m < meshes.size(); m++)
+            for (size_t i = 0; i < tangents[m].size(); i++)
+            {
+                glm::vec3 tangent = glm::vec3(tangents[m][i]);
+                glm::vec3 unpacked = glm::normalize(glm::vec3(unpackTangent(packTangent(tangents[m][i]))));
+                packingError = std::max(packingError, (double)std::acos(glm::clamp(glm::dot(tangent, unpacked), -1.0f, 1.0f)));
+                if (meshes[m].assimpTangents.empty())
+                    continue;
+                glm::vec3 assimpTangent = meshes[m].assimpTangents[i];
+                float length = glm::length(assimpTangent);
+                if (!(length > 0.0f))       // Assimp marks vertices it could not handle with NaN
+                    continue;
+                angleSum += std::acos(glm::clamp(glm::dot(tangent, assimpTangent / length), -1.0f, 1.0f));
+                float assimpSign = glm::dot(glm::cross(meshes[m].normals[i], assimpTangent), meshes[m].assimpBitangents[i]) < 0.0f ? -1.0f : 1.0f;
+                sameSign += assimpSign == tangents[m][i].w ? 1 : 0;
+                compared++;
+            }
+
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2) << "Tangent benchmark, " << names[source] << ": " << vertexCount << " vertices, "
+            << triangleCount << " triangles, ";
+        if (assimp)
+            line << "Assimp p50 " << assimpMs << " ms, ";
+        line << "generator 1 thread p50 " << generatorMs[0] << " ms";
+        if (assimp)
+            line << " (" << (generatorMs[0] > 0.0 ? assimpMs / generatorMs[0] : 0.0) << "x)";
+        line << ", " << maxThreads << " threads p50 " << generatorMs[1] << " ms";
+        if (assimp)
+            line << " (" << (generatorMs[1] > 0.0 ? assimpMs / generatorMs[1] : 0.0) << "x), mean difference "
+                << (compared ? glm::degrees(angleSum / compared) : 0.0) << " deg, same bitangent sign "
+                << (compared ? 100.0 * sameSign / compared : 0.0) << "%";
+        line << ", packing error " << glm::degrees(packingError) << " deg";
+        LOG_INFO << line.str();
+    }
+    Logger::Instance().Flush();
+}
+
+#endif
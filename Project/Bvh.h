@@ -0,0 +1,622 @@
+#ifndef BVH_H
+#define BVH_H
+
+// Bounding volume hierarchies: Bvh over the bounds of objects, MeshBvh over the triangles of a mesh.
+// Build splits the primitives by the surface area heuristic evaluated at BIN_COUNT planes per axis (binned SAH): the
+// split with the lowest expected cost of a query, a node stays a leaf when no split is cheaper than testing all of it.
+// The top of the tree is split on the calling thread until the nodes left are small enough for a job, their subtrees are
+// built in parallel and appended behind the top. The nodes are one array of 32 byte nodes, two to a cache line, the two
+// children of a node next to each other and always behind it, so Refit walks the array backwards once.
+//   bvh.Build(bounds);                             // once
+//   bvh.Refit(bounds);                             // after objects moved, the tree keeps its topology
+//   bvh.QueryFrustum(frustum, [&](unsigned int object) { test and draw it });
+//   bvh.Raycast(origin, direction, tMax, [&](unsigned int object, float& tMax) { intersect it, shorten tMax on a hit });
+// A refitted tree stays correct but grows looser, objects which move far from where they were built need a Build again.
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_BVH_SSE 1
+#include <emmintrin.h>
+#else
+#define MESH_BVH_SSE 0
+#endif
+
+#include "CpuProfiler.h"
+#include "JobSystem.h"
+#include "Frustum.h"
+
+struct Aabb
+{
+    glm::vec3 boxMin = glm::vec3(1e30f);
+    glm::vec3 boxMax = glm::vec3(-1e30f);
+
+    void Grow(const glm::vec3& point)
+    {
+        this->boxMin = glm::min(this->boxMin, point);
+        this->boxMax = glm::max(this->boxMax, point);
+    }
+    void Grow(const Aabb& box)
+    {
+        this->boxMin = glm::min(this->boxMin, box.boxMin);
+        this->boxMax = glm::max(this->boxMax, box.boxMax);
+    }
+    bool Empty() const
+    {
+        return this->boxMin.x > this->boxMax.x;
+    }
+    float SurfaceArea() const
+    {
+        if (this->Empty())
+            return 0.0f;
+        glm::vec3 size = this->boxMax - this->boxMin;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+};
+
+// Axis aligned bounds of the box localMin to localMax under a matrix (Arvo)
+inline Aabb transformBounds(const glm::mat4& modelMat, const glm::vec3& localMin, const glm::vec3& localMax)
+{
+    glm::vec3 center = glm::vec3(modelMat * glm::vec4(0.5f * (localMin + localMax), 1.0f));
+    glm::vec3 halfSize = 0.5f * (localMax - localMin);
+    glm::vec3 extent = glm::abs(glm::vec3(modelMat[0])) * halfSize.x + glm::abs(glm::vec3(modelMat[1])) * halfSize.y
+        + glm::abs(glm::vec3(modelMat[2])) * halfSize.z;
+    Aabb bounds;
+    bounds.boxMin = center - extent;
+    bounds.boxMax = center + extent;
+    return bounds;
+}
+
+// Slab test, inverseDirection is 1 / direction. True when the ray enters the box before tMax, tEnter is where
+inline bool rayIntersectsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boxMin, const glm::vec3& boxMax,
+    float tMax, float& tEnter)
+{
+    glm::vec3 t0 = (boxMin - origin) * inverseDirection, t1 = (boxMax - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+    tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+    return tEnter <= tExit;
+}
+
+struct BvhNode
+{
+    glm::vec3 boundsMin;
+    unsigned int first;         // a leaf: its first primitive in Bvh::Primitives, an inner node: the left child, the right one follows
+    glm::vec3 boundsMax;
+    unsigned int count;         // primitives of a leaf, 0 for an inner node
+};
+
+class Bvh
+{
+public:
+    static const int BIN_COUNT = 16;
+    static const int MAX_DEPTH = 64;                // deeper nodes stay leaves, the traversal stacks are sized for it
+    static const unsigned int MAX_LEAF_SIZE = 8;    // bigger leaves are split even when the heuristic would keep them
+
+    std::vector<BvhNode> Nodes;                     // Nodes[0] is the root
+    std::vector<unsigned int> Primitives;           // the primitives of the leaves, leaf after leaf
+    unsigned int LeafBatch = 1;                     // primitives a leaf tests at once, the heuristic counts started batches
+
+    void Build(const std::vector<Aabb>& bounds, JobSystem& jobs = JobSystem::Instance())
+    {
+        PROFILE_SCOPE("bvh build");
+        this->Nodes.clear();
+        this->Primitives.resize(bounds.size());
+        for (size_t i = 0; i < bounds.size(); i++)
+            this->Primitives[i] = (unsigned int)i;
+        if (bounds.empty())
+            return;
+        this->centroids.resize(bounds.size());
+        for (size_t i = 0; i < bounds.size(); i++)
+            this->centroids[i] = 0.5f * (bounds[i].boxMin + bounds[i].boxMax);
+        this->Nodes.reserve(2 * bounds.size());
+        this->Nodes.push_back(this->leaf(bounds, 0, (unsigned int)bounds.size()));
+
+        // the top, on this thread until every node left is a job of its own
+        const unsigned int jobSize = (unsigned int)std::max<size_t>(bounds.size() / (4 * (jobs.WorkerCount() + 1)), 256);
+        std::vector<PendingNode> pending(1, PendingNode{ 0, 0 });
+        std::vector<PendingNode> subtrees;
+        while (!pending.empty())
+        {
+            PendingNode node = pending.back();
+            pending.pop_back();
+            if (this->Nodes[node.index].count <= jobSize)
+                subtrees.push_back(node);
+            else if (node.depth < MAX_DEPTH && this->split(bounds, this->Nodes, node.index))
+            {
+                pending.push_back(PendingNode{ this->Nodes[node.index].first, node.depth + 1 });
+                pending.push_back(PendingNode{ this->Nodes[node.index].first + 1, node.depth + 1 });
+            }
+        }
+
+        // the subtrees into arrays of their own, then behind the top with their child indices moved
+        std::vector<std::vector<BvhNode> > built(subtrees.size());
+        jobs.ParallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                this->buildSubtree(bounds, this->Nodes[subtrees[i].index], subtrees[i].depth, built[i]);
+        });
+        for (size_t i = 0; i < subtrees.size(); i++)
+        {
+            const unsigned int offset = (unsigned int)this->Nodes.size() - 1;
+            for (size_t k = 0; k < built[i].size(); k++)
+            {
+                BvhNode node = built[i][k];
+                if (node.count == 0)
+                    node.first += offset;
+                if (k == 0)
+                    this->Nodes[subtrees[i].index] = node;
+                else
+                    this->Nodes.push_back(node);
+            }
+        }
+    }
+
+    // New bounds of the same primitives, the children of a node are behind it
+    void Refit(const std::vector<Aabb>& bounds)
+    {
+        PROFILE_SCOPE("bvh refit");
+        for (size_t i = this->Nodes.size(); i-- > 0;)
+        {
+            BvhNode& node = this->Nodes[i];
+            Aabb box;
+            if (node.count > 0)
+                for (unsigned int k = node.first; k < node.first + node.count; k++)
+                    box.Grow(bounds[this->Primitives[k]]);
+            else
+                for (unsigned int k = node.first; k < node.first + 2; k++)
+                {
+                    box.boxMin = glm::min(box.boxMin, this->Nodes[k].boundsMin);
+                    box.boxMax = glm::max(box.boxMax, this->Nodes[k].boundsMax);
+                }
+            node.boundsMin = box.boxMin;
+            node.boundsMax = box.boxMax;
+        }
+    }
+
+    // Expected cost of a query relative to testing the root, a node costs one and a primitive one
+    float SahCost() const
+    {
+        if (this->Nodes.empty())
+            return 0.0f;
+        float cost = 0.0f;
+        for (size_t i = 0; i < this->Nodes.size(); i++)
+            cost += area(this->Nodes[i]) * (this->Nodes[i].count > 0 ? (float)this->Nodes[i].count : 1.0f);
+        float rootArea = area(this->Nodes[0]);
+        return rootArea > 0.0f ? cost / rootArea : 0.0f;
+    }
+
+    // visit(primitive) for the primitives of every leaf which intersects the frustum (conservative like Frustum::IntersectsBox),
+    // the primitives themselves are tested by the caller. Below a node inside the frustum nothing is tested any more
+    template<typename Visit>
+    void QueryFrustum(const Frustum& frustum, Visit visit) const
+    {
+        if (this->Nodes.empty())
+            return;
+        struct Entry
+        {
+            unsigned int node;
+            bool inside;
+        } stack[2 * MAX_DEPTH + 2];
+        int size = 0;
+        stack[size++] = Entry{ 0, false };
+        while (size > 0)
+        {
+            Entry entry = stack[--size];
+            const BvhNode& node = this->Nodes[entry.node];
+            if (!entry.inside)
+            {
+                if (!frustum.IntersectsBox(node.boundsMin, node.boundsMax))
+                    continue;
+                entry.inside = frustum.ContainsBox(node.boundsMin, node.boundsMax);
+            }
+            if (node.count > 0)
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                    visit(this->Primitives[i]);
+            else
+            {
+                stack[size++] = Entry{ node.first + 1, entry.inside };
+                stack[size++] = Entry{ node.first, entry.inside };
+            }
+        }
+    }
+
+    // visit(primitive) for the primitives of every leaf which overlaps the box
+    template<typename Visit>
+    void QueryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, Visit visit) const
+    {
+        if (this->Nodes.empty())
+            return;
+        unsigned int stack[2 * MAX_DEPTH + 2];
+        int size = 0;
+        stack[size++] = 0;
+        while (size > 0)
+        {
+            const BvhNode& node = this->Nodes[stack[--size]];
+            if (glm::any(glm::lessThan(node.boundsMax, boxMin)) || glm::any(glm::greaterThan(node.boundsMin, boxMax)))
+                continue;
+            if (node.count > 0)
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                    visit(this->Primitives[i]);
+            else
+            {
+                stack[size++] = node.first + 1;
+                stack[size++] = node.first;
+            }
+        }
+    }
+
+    // intersect(primitive, tMax) for the primitives whose bounds the ray enters before tMax, nearer nodes first. A hit
+    // shortens tMax, nodes behind it are skipped from then on
+    template<typename Intersect>
+    void Raycast(const glm::vec3& origin, const glm::vec3& direction, float& tMax, Intersect intersect) const
+    {
+        if (this->Nodes.empty())
+            return;
+        const glm::vec3 inverseDirection = 1.0f / direction;
+        unsigned int stack[2 * MAX_DEPTH + 2];
+        int size = 0;
+        stack[size++] = 0;
+        while (size > 0)
+        {
+            const BvhNode& node = this->Nodes[stack[--size]];
+            float tEnter;
+            if (!rayIntersectsBox(origin, inverseDirection, node.boundsMin, node.boundsMax, tMax, tEnter))
+                continue;
+            if (node.count > 0)
+            {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                    intersect(this->Primitives[i], tMax);
+                continue;
+            }
+            const BvhNode& left = this->Nodes[node.first];
+            const BvhNode& right = this->Nodes[node.first + 1];
+            float tLeft, tRight;
+            bool hitLeft = rayIntersectsBox(origin, inverseDirection, left.boundsMin, left.boundsMax, tMax, tLeft);
+            bool hitRight = rayIntersectsBox(origin, inverseDirection, right.boundsMin, right.boundsMax, tMax, tRight);
+            if (hitLeft && hitRight)
+            {
+                stack[size++] = tLeft <= tRight ? node.first + 1 : node.first;     // the farther one waits
+                stack[size++] = tLeft <= tRight ? node.first : node.first + 1;
+            }
+            else if (hitLeft)
+                stack[size++] = node.first;
+            else if (hitRight)
+                stack[size++] = node.first + 1;
+        }
+    }
+
+private:
+    struct PendingNode
+    {
+        unsigned int index;
+        int depth;
+    };
+
+    std::vector<glm::vec3> centroids;       // of the primitives while building
+
+    float batches(unsigned int count) const
+    {
+        return (float)((count + this->LeafBatch - 1) / this->LeafBatch);
+    }
+
+    static float area(const BvhNode& node)
+    {
+        Aabb box;
+        box.boxMin = node.boundsMin;
+        box.boxMax = node.boundsMax;
+        return box.SurfaceArea();
+    }
+
+    BvhNode leaf(const std::vector<Aabb>& bounds, unsigned int first, unsigned int count) const
+    {
+        Aabb box;
+        for (unsigned int i = first; i < first + count; i++)
+            box.Grow(bounds[this->Primitives[i]]);
+        BvhNode node;
+        node.boundsMin = box.boxMin;
+        node.boundsMax = box.boxMax;
+        node.first = first;
+        node.count = count;
+        return node;
+    }
+
+    void buildSubtree(const std::vector<Aabb>& bounds, const BvhNode& root, int rootDepth, std::vector<BvhNode>& nodes)
+    {
+        nodes.reserve(2 * root.count);
+        nodes.push_back(root);
+        std::vector<PendingNode> pending(1, PendingNode{ 0, rootDepth });
+        while (!pending.empty())
+        {
+            PendingNode node = pending.back();
+            pending.pop_back();
+            if (node.depth < MAX_DEPTH && this->split(bounds, nodes, node.index))
+            {
+                pending.push_back(PendingNode{ nodes[node.index].first, node.depth + 1 });
+                pending.push_back(PendingNode{ nodes[node.index].first + 1, node.depth + 1 });
+            }
+        }
+    }
+
+    // Splits the leaf nodes[index] at the cheapest bin plane, its children are appended to nodes. False when it stays a leaf.
+    // The primitives of different leaves never overlap, so subtrees can split at the same time
+    bool split(const std::vector<Aabb>& bounds, std::vector<BvhNode>& nodes, unsigned int index)
+    {
+        const BvhNode node = nodes[index];
+        if (node.count < 2)
+            return false;
+        Aabb centroidBounds;
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+            centroidBounds.Grow(this->centroids[this->Primitives[i]]);
+
+        float bestCost = 1e30f;
+        int bestAxis = -1, bestPlane = 0;
+        Aabb bestLeft, bestRight;
+        // all three axes in one pass, the primitives are read once
+        Aabb axisBins[3][BIN_COUNT];
+        unsigned int axisCounts[3][BIN_COUNT] = {};
+        const glm::vec3 low = centroidBounds.boxMin, extent = centroidBounds.boxMax - centroidBounds.boxMin;
+        const glm::vec3 scale(extent.x > 0.0f ? BIN_COUNT / extent.x : 0.0f, extent.y > 0.0f ? BIN_COUNT / extent.y : 0.0f,
+            extent.z > 0.0f ? BIN_COUNT / extent.z : 0.0f);
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+        {
+            const unsigned int primitive = this->Primitives[i];
+            const Aabb& box = bounds[primitive];
+            const glm::vec3 position = (this->centroids[primitive] - low) * scale;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int bin = std::min((int)position[axis], BIN_COUNT - 1);
+                axisBins[axis][bin].Grow(box);
+                axisCounts[axis][bin]++;
+            }
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (extent[axis] <= 0.0f)
+                continue;
+            const Aabb* bins = axisBins[axis];
+            const unsigned int* counts = axisCounts[axis];
+            // the areas and counts left of every plane, then a sweep from the right
+            Aabb left[BIN_COUNT - 1];
+            unsigned int leftCount[BIN_COUNT - 1];
+            unsigned int count = 0;
+            for (int plane = 0; plane < BIN_COUNT - 1; plane++)
+            {
+                if (plane > 0)
+                    left[plane] = left[plane - 1];
+                left[plane].Grow(bins[plane]);
+                count += counts[plane];
+                leftCount[plane] = count;
+            }
+            Aabb right;
+            count = 0;
+            for (int plane = BIN_COUNT - 2; plane >= 0; plane--)
+            {
+                right.Grow(bins[plane + 1]);
+                count += counts[plane + 1];
+                if (leftCount[plane] == 0 || count == 0)
+                    continue;
+                float cost = this->batches(leftCount[plane]) * left[plane].SurfaceArea() + this->batches(count) * right.SurfaceArea();
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestPlane = plane;
+                    bestLeft = left[plane];
+                    bestRight = right;
+                }
+            }
+        }
+        const float nodeArea = area(node);
+        if (bestAxis < 0 || (nodeArea + bestCost >= this->batches(node.count) * nodeArea && node.count <= MAX_LEAF_SIZE))
+            return false;
+
+        const std::vector<glm::vec3>& centers = this->centroids;
+        const float axisLow = low[bestAxis], axisScale = scale[bestAxis];
+        unsigned int* middle = std::partition(&this->Primitives[node.first], &this->Primitives[node.first] + node.count,
+            [&centers, bestAxis, axisLow, axisScale, bestPlane](unsigned int primitive) {
+                return std::min((int)((centers[primitive][bestAxis] - axisLow) * axisScale), BIN_COUNT - 1) <= bestPlane;
+            });
+        const unsigned int leftCount = (unsigned int)(middle - &this->Primitives[node.first]);
+        const unsigned int childIndex = (unsigned int)nodes.size();
+        nodes.push_back(BvhNode{ bestLeft.boxMin, node.first, bestLeft.boxMax, leftCount });
+        nodes.push_back(BvhNode{ bestRight.boxMin, node.first + leftCount, bestRight.boxMax, node.count - leftCount });
+        nodes[index].first = childIndex;
+        nodes[index].count = 0;
+        return true;
+    }
+};
+
+// Closest hit of a ray with a mesh: the distance along the direction, the triangle (index into the index list / 3) and
+// the barycentric coordinates of the second and third corner
+struct RayHit
+{
+    float t;
+    unsigned int triangle;
+    float u, v;
+};
+
+// Triangle BVH of a mesh in its own space, rays of moving objects are transformed into it instead of refitting. The
+// triangles of every leaf are copied into packs of four, one coordinate of the four in a register, so a ray is tested
+// against a whole pack at once (SSE2, the same lanes one after another without it). The primitives of the tree are the packs
+class MeshBvh
+{
+public:
+    void Build(const float* positions, size_t positionStride, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+        JobSystem& jobs = JobSystem::Instance())
+    {
+        PROFILE_SCOPE("mesh bvh build");
+        const size_t triangleCount = (indices ? indexCount : vertexCount) / 3;
+        std::vector<glm::vec3> corners(3 * triangleCount);
+        std::vector<Aabb> bounds(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+            for (int k = 0; k < 3; k++)
+            {
+                size_t vertex = indices ? indices[3 * i + k] : 3 * i + k;
+                const float* position = (const float*)((const char*)positions + positionStride * vertex);
+                corners[3 * i + k] = glm::vec3(position[0], position[1], position[2]);
+                bounds[i].Grow(corners[3 * i + k]);
+            }
+        this->tree.LeafBatch = LANES;
+        this->tree.Build(bounds, jobs);
+        this->triangleCount = triangleCount;
+
+        // every leaf into packs of its own, the lanes left over get empty triangles which no ray hits
+        this->packs.clear();
+        this->packs.reserve(triangleCount / 2 + 1);
+        for (size_t n = 0; n < this->tree.Nodes.size(); n++)
+        {
+            BvhNode& node = this->tree.Nodes[n];
+            if (node.count == 0)
+                continue;
+            const unsigned int firstPack = (unsigned int)this->packs.size();
+            for (unsigned int i = 0; i < node.count; i += LANES)
+            {
+                TrianglePack pack = {};
+                for (unsigned int lane = 0; lane < LANES; lane++)
+                {
+                    pack.index[lane] = ~0u;
+                    if (i + lane >= node.count)
+                        continue;
+                    const unsigned int triangle = this->tree.Primitives[node.first + i + lane];
+                    const glm::vec3* corner = &corners[3 * triangle];
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        pack.corner[axis][lane] = corner[0][axis];
+                        pack.edge1[axis][lane] = corner[1][axis] - corner[0][axis];
+                        pack.edge2[axis][lane] = corner[2][axis] - corner[0][axis];
+                    }
+                    pack.index[lane] = triangle;
+                }
+                this->packs.push_back(pack);
+            }
+            node.first = firstPack;
+            node.count = (unsigned int)this->packs.size() - firstPack;
+        }
+        this->tree.Primitives.resize(this->packs.size());
+        for (size_t i = 0; i < this->packs.size(); i++)
+            this->tree.Primitives[i] = (unsigned int)i;
+    }
+
+    const Bvh& Tree() const
+    {
+        return this->tree;
+    }
+    size_t Triangles() const
+    {
+        return this->triangleCount;
+    }
+    size_t Packs() const
+    {
+        return this->packs.size();
+    }
+
+    // Closest hit before tMax, both sides of the triangles count (Moller-Trumbore)
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float tMax, RayHit& hit) const
+    {
+        bool found = false;
+        const std::vector<TrianglePack>& packs = this->packs;
+#if MESH_BVH_SSE
+        const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+        const __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), epsilon = _mm_set1_ps(1e-12f), signBit = _mm_set1_ps(-0.0f);
+        this->tree.Raycast(origin, direction, tMax, [&](unsigned int primitive, float& closest) {
+            const TrianglePack& pack = packs[primitive];
+            const __m128 e1x = _mm_loadu_ps(pack.edge1[0]), e1y = _mm_loadu_ps(pack.edge1[1]), e1z = _mm_loadu_ps(pack.edge1[2]);
+            const __m128 e2x = _mm_loadu_ps(pack.edge2[0]), e2y = _mm_loadu_ps(pack.edge2[1]), e2z = _mm_loadu_ps(pack.edge2[2]);
+            const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 mask = _mm_cmpge_ps(_mm_andnot_ps(signBit, determinant), epsilon);
+            if (_mm_movemask_ps(mask) == 0)
+                return;
+            const __m128 inverse = _mm_div_ps(one, determinant);
+            const __m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(pack.corner[0]));
+            const __m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(pack.corner[1]));
+            const __m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(pack.corner[2]));
+            const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+            const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+            const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(closest))));
+            int lanes = _mm_movemask_ps(mask);
+            if (lanes == 0)
+                return;
+            alignas(16) float ts[LANES], us[LANES], vs[LANES];
+            _mm_store_ps(ts, t);
+            _mm_store_ps(us, u);
+            _mm_store_ps(vs, v);
+            for (unsigned int lane = 0; lane < LANES; lane++)
+                if ((lanes >> lane) & 1 && ts[lane] < closest)
+                {
+                    closest = ts[lane];
+                    hit.t = ts[lane];
+                    hit.triangle = pack.index[lane];
+                    hit.u = us[lane];
+                    hit.v = vs[lane];
+                    found = true;
+                }
+        });
+#else
+        this->tree.Raycast(origin, direction, tMax, [&](unsigned int primitive, float& closest) {
+            const TrianglePack& pack = packs[primitive];
+            for (unsigned int lane = 0; lane < LANES; lane++)
+            {
+                const glm::vec3 edge1(pack.edge1[0][lane], pack.edge1[1][lane], pack.edge1[2][lane]);
+                const glm::vec3 edge2(pack.edge2[0][lane], pack.edge2[1][lane], pack.edge2[2][lane]);
+                glm::vec3 p = glm::cross(direction, edge2);
+                float determinant = glm::dot(edge1, p);
+                if (std::fabs(determinant) < 1e-12f)
+                    continue;
+                float inverse = 1.0f / determinant;
+                glm::vec3 s = origin - glm::vec3(pack.corner[0][lane], pack.corner[1][lane], pack.corner[2][lane]);
+                float u = glm::dot(s, p) * inverse;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+                glm::vec3 q = glm::cross(s, edge1);
+                float v = glm::dot(direction, q) * inverse;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+                float t = glm::dot(edge2, q) * inverse;
+                if (t < 0.0f || t >= closest)
+                    continue;
+                closest = t;
+                hit.t = t;
+                hit.triangle = pack.index[lane];
+                hit.u = u;
+                hit.v = v;
+                found = true;
+            }
+        });
+#endif
+        return found;
+    }
+
+private:
+    static const unsigned int LANES = 4;
+
+    // four triangles, corner and edges coordinate by coordinate. Loaded unaligned: std::vector only guarantees the
+    // alignment of operator new (8 bytes on x86 before C++17), not that of an over-aligned type
+    struct TrianglePack
+    {
+        float corner[3][LANES];
+        float edge1[3][LANES];
+        float edge2[3][LANES];
+        unsigned int index[LANES];      // ~0 in an empty lane
+    };
+
+    Bvh tree;
+    std::vector<TrianglePack> packs;
+    size_t triangleCount = 0;
+};
+
+#endif
@@ -105,6 +105,15 @@ public:
         this->updateCameraVectors();
     }
 
+    // Places the camera directly, e.g. when it follows a recorded or scripted path
+    void SetPose(glm::vec3 position, GLfloat yaw, GLfloat pitch)
+    {
+        this->Position = position;
+        this->Yaw = yaw;
+        this->Pitch = pitch;
+        this->updateCameraVectors();
+    }
+
     // Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(GLfloat yoffset)
     {
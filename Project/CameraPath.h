@@ -0,0 +1,144 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Log.h"
+
+// Camera state at a point in time
+struct CameraKeyframe
+{
+    float time;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float zoom;
+};
+
+// Camera movement over time, either recorded from an interactive session or scripted. Stored as text,
+// one keyframe per line: "time posX posY posZ yaw pitch zoom", lines starting with '#' are comments.
+class CameraPath
+{
+public:
+    std::vector<CameraKeyframe> Keyframes;
+
+    void Add(float time, const Camera& camera)
+    {
+        CameraKeyframe k = { time, camera.Position, camera.Yaw, camera.Pitch, camera.Zoom };
+        this->Keyframes.push_back(k);
+    }
+
+    float Duration() const
+    {
+        return this->Keyframes.empty() ? 0.0f : this->Keyframes.back().time - this->Keyframes.front().time;
+    }
+
+    // Linear interpolation between the surrounding keyframes, clamped to the ends of the path
+    CameraKeyframe Sample(float time) const
+    {
+        if (this->Keyframes.empty())
+        {
+            CameraKeyframe k = { time, glm::vec3(0.0f, 0.0f, 3.0f), YAW, PITCH, ZOOM };
+            return k;
+        }
+        time += this->Keyframes.front().time;
+        if (time <= this->Keyframes.front().time)
+            return this->Keyframes.front();
+        if (time >= this->Keyframes.back().time)
+            return this->Keyframes.back();
+        size_t i = 1;
+        while (this->Keyframes[i].time < time)
+            i++;
+        const CameraKeyframe& a = this->Keyframes[i - 1];
+        const CameraKeyframe& b = this->Keyframes[i];
+        float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1.0f;
+        CameraKeyframe k;
+        k.time = time;
+        k.position = glm::mix(a.position, b.position, t);
+        k.yaw = a.yaw + (b.yaw - a.yaw) * t;
+        k.pitch = a.pitch + (b.pitch - a.pitch) * t;
+        k.zoom = a.zoom + (b.zoom - a.zoom) * t;
+        return k;
+    }
+
+    void Apply(float time, Camera& camera) const
+    {
+        CameraKeyframe k = this->Sample(time);
+        camera.SetPose(k.position, k.yaw, k.pitch);
+        camera.Zoom = k.zoom;
+    }
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file.is_open())
+        {
+            LOG_ERROR << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESFULLY_READ: " << path;
+            return false;
+        }
+        this->Keyframes.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream in(line);
+            CameraKeyframe k;
+            if (!(in >> k.time >> k.position.x >> k.position.y >> k.position.z >> k.yaw >> k.pitch >> k.zoom))
+            {
+                LOG_ERROR << "ERROR::CAMERA_PATH::BAD_KEYFRAME: " << line;
+                return false;
+            }
+            if (!this->Keyframes.empty() && k.time < this->Keyframes.back().time)
+            {
+                LOG_ERROR << "ERROR::CAMERA_PATH::KEYFRAMES_NOT_SORTED: " << line;
+                return false;
+            }
+            this->Keyframes.push_back(k);
+        }
+        return !this->Keyframes.empty();
+    }
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        file << "# time posX posY posZ yaw pitch zoom\n";
+        for (size_t i = 0; i < this->Keyframes.size(); i++)
+        {
+            const CameraKeyframe& k = this->Keyframes[i];
+            file << k.time << " " << k.position.x << " " << k.position.y << " " << k.position.z << " "
+                << k.yaw << " " << k.pitch << " " << k.zoom << "\n";
+        }
+        return true;
+    }
+
+    // Scripted path: one circle around `center` at `height` above it, always looking at the center
+    static CameraPath Orbit(glm::vec3 center, float radius, float height, float duration)
+    {
+        CameraPath path;
+        const int steps = 64;
+        for (int i = 0; i <= steps; i++)
+        {
+            float angle = 2.0f * 3.14159265f * i / steps;
+            glm::vec3 position = center + glm::vec3(radius * cos(angle), height, radius * sin(angle));
+            glm::vec3 direction = glm::normalize(center - position);
+            // yaw keeps growing instead of wrapping so interpolation never turns the long way round
+            CameraKeyframe k = { duration * i / steps, position, glm::degrees(angle) + 180.0f,
+                (float)glm::degrees(asin(direction.y)), ZOOM };
+            path.Keyframes.push_back(k);
+        }
+        return path;
+    }
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef CONE_STEP_MAP_H
+#define CONE_STEP_MAP_H
+
+// Cone step mapping for the parallax shader. Offline, every texel of a depth map gets the widest cone
+// (apex on the surface at the texel, opening towards the top of the height field) which contains no
+// other part of the surface. A ray inside such a cone cannot hit anything, so the shader can jump to
+// where the ray leaves the cone instead of marching through fixed layers.
+// The baked texture keeps the depth in red and the square root of the cone ratio (texture space distance
+// per unit of depth, at most 1) in green, the root gives the narrow cones near walls more precision.
+//   app --bake-cone-map      writes ../textures/toy_box_cone.png from ../textures/toy_box_disp.png
+// The parallax quad uses the baked map when the file exists, otherwise the linear march.
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include "stb_image.h"
+#include "GoldenImage.h"
+#include "JobSystem.h"
+#include "Log.h"
+
+struct ConeStepMap
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> depth;       // 0 at the top of the surface, 1 at the bottom
+    std::vector<float> cone;        // empty for a plain depth map
+
+    bool HasCones() const
+    {
+        return !this->cone.empty();
+    }
+
+    // Bilinear with clamp to edge, like the texture units do (without the mipmaps)
+    float Depth(const glm::vec2& uv) const
+    {
+        return this->sample(this->depth, uv);
+    }
+    float Cone(const glm::vec2& uv) const
+    {
+        return this->sample(this->cone, uv);
+    }
+
+private:
+    float sample(const std::vector<float>& texels, const glm::vec2& uv) const
+    {
+        float x = uv.x * this->width - 0.5f, y = uv.y * this->height - 0.5f;
+        int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+        float fx = x - x0, fy = y - y0;
+        float a = this->texel(texels, x0, y0), b = this->texel(texels, x0 + 1, y0);
+        float c = this->texel(texels, x0, y0 + 1), d = this->texel(texels, x0 + 1, y0 + 1);
+        return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fy;
+    }
+    float texel(const std::vector<float>& texels, int x, int y) const
+    {
+        x = x < 0 ? 0 : x >= this->width ? this->width - 1 : x;
+        y = y < 0 ? 0 : y >= this->height ? this->height - 1 : y;
+        return texels[y * this->width + x];
+    }
+};
+
+// Reads the first channel as depth and, when there is one, the second as the baked cone ratio
+inline bool loadConeStepMap(const std::string& path, ConeStepMap& map)
+{
+    int components = 0;
+    unsigned char* data = stbi_load(path.c_str(), &map.width, &map.height, &components, 0);
+    if (!data)
+    {
+        LOG_ERROR << "ERROR::CONE_STEP_MAP::NOT_LOADED: " << path;
+        return false;
+    }
+    size_t count = (size_t)map.width * map.height;
+    map.depth.resize(count);
+    map.cone.clear();
+    if (components >= 2)
+        map.cone.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        map.depth[i] = data[i * components] / 255.0f;
+        if (components >= 2)
+        {
+            float root = data[i * components + 1] / 255.0f;
+            map.cone[i] = root * root;
+        }
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+// Exhaustive search in growing square rings around every texel. A ring at distance r can only narrow the
+// cone if r / depth is below the best ratio so far, the search stops at the first one which cannot.
+inline void bakeCones(ConeStepMap& map)
+{
+    PROFILE_SCOPE("bakeCones");
+    const int width = map.width, height = map.height;
+    const float texelU = 1.0f / width, texelV = 1.0f / height;
+    const float texelSize = texelU < texelV ? texelU : texelV;
+    map.cone.assign((size_t)width * height, 1.0f);
+    JobSystem::Instance().ParallelFor(height, 4, [&map, width, height, texelU, texelV, texelSize](size_t begin, size_t end)
+    {
+        for (int y = (int)begin; y < (int)end; y++)
+            for (int x = 0; x < width; x++)
+            {
+                float depth = map.depth[y * width + x];
+                float best = 1.0f;
+                for (int r = 1; r <= width + height && r * texelSize < best * depth; r++)
+                    for (int qy = y - r; qy <= y + r; qy++)
+                    {
+                        if (qy < 0 || qy >= height)
+                            continue;
+                        // full rows at the top and the bottom of the ring, only both ends in between
+                        int step = qy == y - r || qy == y + r ? 1 : 2 * r;
+                        for (int qx = x - r; qx <= x + r; qx += step)
+                        {
+                            if (qx < 0 || qx >= width)
+                                continue;
+                            float rise = depth - map.depth[qy * width + qx];
+                            if (rise <= 0.0f)
+                                continue;
+                            float du = (qx - x) * texelU, dv = (qy - y) * texelV;
+                            float ratio = std::sqrt(du * du + dv * dv) / rise;
+                            best = ratio < best ? ratio : best;
+                        }
+                    }
+                map.cone[y * width + x] = best;
+            }
+    });
+}
+
+// Rounds the root of the cone ratio down, a quantized cone must not be wider than the baked one
+inline bool writeConeStepMap(const std::string& path, const ConeStepMap& map)
+{
+    std::vector<unsigned char> rgb((size_t)map.width * map.height * 3, 0);
+    for (size_t i = 0; i < map.depth.size(); i++)
+    {
+        rgb[i * 3] = (unsigned char)(map.depth[i] * 255.0f + 0.5f);
+        rgb[i * 3 + 1] = (unsigned char)std::floor(std::sqrt(map.cone[i]) * 255.0f);
+    }
+    if (!writePng(path, map.width, map.height, rgb))
+    {
+        LOG_ERROR << "ERROR::CONE_STEP_MAP::FILE_NOT_WRITTEN: " << path;
+        return false;
+    }
+    return true;
+}
+
+inline bool bakeConeStepMap(const std::string& depthPath, const std::string& outputPath)
+{
+    stbi_set_flip_vertically_on_load(false);    // rows are written back in the order of the file
+    ConeStepMap map;
+    if (!loadConeStepMap(depthPath, map))
+        return false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bakeCones(map);
+    double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!writeConeStepMap(outputPath, map))
+        return false;
+    double coneSum = 0.0;
+    for (size_t i = 0; i < map.cone.size(); i++)
+        coneSum += map.cone[i];
+    LOG_INFO << "Cone step map " << outputPath << ": " << map.width << "x" << map.height << " baked in " << bakeMs
+        << " ms, mean cone ratio " << coneSum / map.cone.size();
+    return true;
+}
+
+// CPU versions of both paths of parallax.frag (keep them in sync), for the step counts of the benchmark
+struct ParallaxTrace
+{
+    glm::vec2 texCoords;
+    int fetches;            // dependent depth map reads
+};
+
+inline ParallaxTrace traceParallaxLinear(const ConeStepMap& map, glm::vec2 texCoords, const glm::vec3& viewDir, float heightScale)
+{
+    const float minLayers = 8.0f, maxLayers = 32.0f;
+    float numLayers = maxLayers + (minLayers - maxLayers) * std::fabs(viewDir.z);
+    float layerDepth = 1.0f / numLayers;
+    float currentLayerDepth = 0.0f;
+    glm::vec2 deltaTexCoords = glm::vec2(viewDir) / viewDir.z * heightScale / numLayers;
+    ParallaxTrace trace = { texCoords, 1 };
+    float currentDepthMapValue = map.Depth(trace.texCoords);
+    while (currentLayerDepth < currentDepthMapValue)
+    {
+        trace.texCoords -= deltaTexCoords;
+        currentDepthMapValue = map.Depth(trace.texCoords);
+        currentLayerDepth += layerDepth;
+        trace.fetches++;
+    }
+    glm::vec2 prevTexCoords = trace.texCoords + deltaTexCoords;
+    float afterDepth = currentDepthMapValue - currentLayerDepth;
+    float beforeDepth = map.Depth(prevTexCoords) - currentLayerDepth + layerDepth;
+    trace.fetches++;
+    float weight = afterDepth / (afterDepth - beforeDepth);
+    trace.texCoords = prevTexCoords * weight + trace.texCoords * (1.0f - weight);
+    return trace;
+}
+
+inline ParallaxTrace traceParallaxCone(const ConeStepMap& map, glm::vec2 texCoords, const glm::vec3& viewDir, float heightScale)
+{
+    const float minSteps = 4.0f, maxSteps = 16.0f;
+    const float minStep = 0.002f;
+    int numSteps = (int)(maxSteps + (minSteps - maxSteps) * std::fabs(viewDir.z));
+    glm::vec2 P = glm::vec2(viewDir) / viewDir.z * heightScale;
+    float rayRatio = glm::length(P);
+    float depth = 0.0f;
+    ParallaxTrace trace = { texCoords, 0 };
+    for (int i = 0; i < numSteps; i++)
+    {
+        glm::vec2 position = texCoords - P * depth;
+        float surface = map.Depth(position), coneRatio = map.Cone(position);
+        trace.fetches++;
+        float step = coneRatio * (surface - depth) / (coneRatio + rayRatio);
+        if (step < minStep)
+            break;
+        depth += step;
+    }
+    trace.texCoords = texCoords - P * depth;
+    return trace;
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+// Lightweight CPU scope profiler.
+//   PROFILE_SCOPE("name")      - times the enclosing block (name must be a string literal)
+//   PROFILE_FUNCTION()         - same with the function name
+//   PROFILE_THREAD_NAME("name")- label of the calling thread in the trace
+// Every thread writes complete scopes into its own ring buffer without locks, the export reads
+// all buffers into a Chrome trace JSON while the threads keep writing: every slot is a seqlock,
+// the export skips the slots overwritten while it read them. Define CPU_PROFILER_ENABLED 0 to
+// compile all of it out.
+
+#ifndef CPU_PROFILER_ENABLED
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+#if CPU_PROFILER_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_PROFILER_TSC 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define CPU_PROFILER_TSC 1
+#else
+#define CPU_PROFILER_TSC 0
+#endif
+
+struct CpuProfileEvent
+{
+    const char* name;
+    unsigned long long begin;   // ticks, see CpuProfiler::Now()
+    unsigned long long end;
+};
+
+// Single producer ring buffer owned by one thread, the oldest events are overwritten once the buffer
+// is full. A slot's sequence is 2 * index + 1 while the writer fills it with event `index` and
+// 2 * index + 2 once it is complete, a reader keeps what it read only if the sequence was the
+// complete one before and after.
+struct CpuProfileBuffer
+{
+    static const size_t CAPACITY = 1 << 16;     // must be a power of two
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence{ 0 };
+        std::atomic<const char*> name{ NULL };
+        std::atomic<unsigned long long> begin{ 0 };
+        std::atomic<unsigned long long> end{ 0 };
+    };
+
+    CpuProfileBuffer(unsigned int threadIndex) : slots(CAPACITY), written(0), threadIndex(threadIndex)
+    {
+    }
+
+    void Push(const char* name, unsigned long long begin, unsigned long long end)
+    {
+        size_t index = written.load(std::memory_order_relaxed);
+        Slot& slot = slots[index & (CAPACITY - 1)];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.begin.store(begin, std::memory_order_relaxed);
+        slot.end.store(end, std::memory_order_relaxed);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+        written.store(index + 1, std::memory_order_release);
+    }
+
+    // Event `index` if its slot still holds it, complete
+    bool Read(size_t index, CpuProfileEvent& e) const
+    {
+        const Slot& slot = slots[index & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != 2 * index + 2)
+            return false;
+        e.name = slot.name.load(std::memory_order_relaxed);
+        e.begin = slot.begin.load(std::memory_order_relaxed);
+        e.end = slot.end.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == 2 * index + 2;
+    }
+
+    std::vector<Slot> slots;
+    std::atomic<size_t> written;
+    unsigned int threadIndex;
+    std::string threadName;     // guarded by the profiler's mutex
+};
+
+class CpuProfiler
+{
+public:
+    static CpuProfiler& Instance()
+    {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    static unsigned long long Now()
+    {
+#if CPU_PROFILER_TSC
+        return __rdtsc();
+#else
+        return (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // Buffer of the calling thread, registered on first use (the only place which takes a lock)
+    static CpuProfileBuffer& ThreadBuffer()
+    {
+        CpuProfileBuffer*& buffer = threadBuffer();
+        if (buffer == NULL)
+            buffer = Instance().registerThread();
+        return *buffer;
+    }
+
+    static void SetThreadName(const char* name)
+    {
+        CpuProfileBuffer& buffer = ThreadBuffer();
+        std::lock_guard<std::mutex> lock(Instance().mutex);
+        buffer.threadName = name;
+    }
+
+    // Chrome trace event format, open with chrome://tracing or https://ui.perfetto.dev
+    bool WriteChromeTrace(const std::string& path)
+    {
+        std::ofstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        double nsPerTick = calibrate();
+        std::vector<CpuProfileBuffer*> threads;
+        std::vector<std::string> threadNames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads = buffers;
+            for (size_t t = 0; t < threads.size(); t++)
+                threadNames.push_back(threads[t]->threadName.empty() ? "thread " + std::to_string(threads[t]->threadIndex) : threads[t]->threadName);
+        }
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (size_t t = 0; t < threads.size(); t++)
+        {
+            CpuProfileBuffer& b = *threads[t];
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b.threadIndex
+                << ",\"args\":{\"name\":\"" << threadNames[t] << "\"}}";
+            first = false;
+
+            size_t written = b.written.load(std::memory_order_acquire);
+            size_t count = written < CpuProfileBuffer::CAPACITY ? written : CpuProfileBuffer::CAPACITY;
+            for (size_t i = written - count; i < written; i++)
+            {
+                // the owner keeps writing while we read, drop slots it has overwritten meanwhile
+                CpuProfileEvent e;
+                if (!b.Read(i, e))
+                    continue;
+                file << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b.threadIndex
+                    << ",\"ts\":" << toMicroseconds(e.begin, nsPerTick) << ",\"dur\":" << (e.end - e.begin) * nsPerTick / 1000.0 << "}";
+            }
+        }
+        file << "\n]}\n";
+        return true;
+    }
+
+    // Average cost of an empty profiled scope in nanoseconds. The scopes go to a scratch buffer the
+    // export does not see, the trace of the calling thread keeps its events
+    double MeasureOverheadNs(unsigned int iterations = 1000000);
+
+private:
+    std::mutex mutex;
+    std::vector<CpuProfileBuffer*> buffers;     // never freed, events stay readable after a thread exits
+    unsigned long long startTicks;
+    std::chrono::steady_clock::time_point startTime;
+
+    CpuProfiler() : startTicks(Now()), startTime(std::chrono::steady_clock::now())
+    {
+    }
+
+    static CpuProfileBuffer*& threadBuffer()
+    {
+        static thread_local CpuProfileBuffer* buffer = NULL;
+        return buffer;
+    }
+
+    CpuProfileBuffer* registerThread()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CpuProfileBuffer* buffer = new CpuProfileBuffer((unsigned int)buffers.size());
+        buffers.push_back(buffer);
+        return buffer;
+    }
+
+    // Nanoseconds per tick, measured against steady_clock over the whole run so far
+    double calibrate() const
+    {
+#if CPU_PROFILER_TSC
+        unsigned long long ticks = Now() - startTicks;
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+        return ticks > 0 ? ns / ticks : 1.0;
+#else
+        return (double)std::chrono::steady_clock::period::num * 1e9 / std::chrono::steady_clock::period::den;
+#endif
+    }
+
+    double toMicroseconds(unsigned long long ticks, double nsPerTick) const
+    {
+        return ticks > startTicks ? (ticks - startTicks) * nsPerTick / 1000.0 : 0.0;
+    }
+};
+
+class CpuProfileScope
+{
+public:
+    explicit CpuProfileScope(const char* name) : name(name), begin(CpuProfiler::Now())
+    {
+    }
+    ~CpuProfileScope()
+    {
+        CpuProfiler::ThreadBuffer().Push(name, begin, CpuProfiler::Now());
+    }
+private:
+    const char* name;
+    unsigned long long begin;
+};
+
+inline double CpuProfiler::MeasureOverheadNs(unsigned int iterations)
+{
+    CpuProfileBuffer scratch(~0u);      // not registered
+    CpuProfileBuffer*& buffer = threadBuffer();
+    CpuProfileBuffer* own = buffer;
+    buffer = &scratch;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        CpuProfileScope scope("overhead");
+    }
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    buffer = own;
+    return ns / iterations;
+}
+
+#define CPU_PROFILE_CONCAT2(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name) CpuProfiler::SetThreadName(name)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+// Dynamic resolution: the scene is rendered at Scale times the size of the window and stretched onto it, the controller
+// moves Scale between MinScale and MaxScale so the frame time stays within the budget. Over the budget the scale drops at
+// once by the share of pixels which is too much (the cost of a frame is taken as proportional to its pixels), under the
+// budget by a margin for RaiseDelay frames in a row it grows by RaiseStep. Frame times measured before a change took
+// effect are ignored for SettleFrames frames, the GPU timings arrive a few frames late.
+//   resolution.Update(lastFrameMs);
+//   render into resolution.Width(windowWidth) x resolution.Height(windowHeight), then ResolutionTarget::Upscale
+// The last HISTORY_SIZE frames (time, scale) are kept for tuning, WriteCsv exports them.
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "Log.h"
+
+struct ResolutionSample
+{
+    unsigned long long frame;
+    double frameMs;             // as measured
+    double smoothedMs;          // what the controller decided on
+    float scale;                // the frame was rendered at
+};
+
+class ResolutionController
+{
+public:
+    static const int HISTORY_SIZE = 512;
+
+    double BudgetMs = 16.67;
+    float MinScale = 0.5f;
+    float MaxScale = 1.0f;
+    float Headroom = 0.15f;         // the scale only grows while the frames are this much under the budget
+    int RaiseDelay = 30;
+    float RaiseStep = 0.05f;
+    int SettleFrames = 4;
+    float Smoothing = 0.25f;        // weight of the newest frame time
+
+    void Reset()
+    {
+        this->scale = this->MaxScale;
+        this->smoothedMs = 0.0;
+        this->framesUnder = 0;
+        this->settle = this->SettleFrames;
+        this->frame = 0;
+        this->changes = 0;
+        this->historySize = 0;
+    }
+
+    // The time of the last frame rendered at Scale(), returns the scale of the next one
+    float Update(double frameMs)
+    {
+        ResolutionSample& sample = this->history[this->frame % HISTORY_SIZE];
+        sample.frame = this->frame++;
+        sample.frameMs = frameMs;
+        sample.scale = this->scale;
+        this->historySize = std::min(this->historySize + 1, HISTORY_SIZE);
+        if (this->settle > 0)
+        {
+            this->settle--;
+            this->smoothedMs = frameMs;
+            sample.smoothedMs = frameMs;
+            return this->scale;
+        }
+        this->smoothedMs += this->Smoothing * (frameMs - this->smoothedMs);
+        sample.smoothedMs = this->smoothedMs;
+        float next = this->scale;
+        if (this->smoothedMs > this->BudgetMs)
+        {
+            this->framesUnder = 0;
+            next = this->scale * (float)std::sqrt(this->BudgetMs / this->smoothedMs);
+        }
+        else if (this->smoothedMs < (1.0 - this->Headroom) * this->BudgetMs && ++this->framesUnder >= this->RaiseDelay)
+        {
+            this->framesUnder = 0;
+            next = this->scale + this->RaiseStep;
+        }
+        next = std::min(std::max(next, this->MinScale), this->MaxScale);
+        if (std::fabs(next - this->scale) > 1e-4f)
+        {
+            this->scale = next;
+            this->settle = this->SettleFrames;
+            this->changes++;
+        }
+        return this->scale;
+    }
+
+    float Scale() const
+    {
+        return this->scale;
+    }
+    double SmoothedMs() const
+    {
+        return this->smoothedMs;
+    }
+    // How often the scale moved since Reset
+    unsigned int Changes() const
+    {
+        return this->changes;
+    }
+    int Width(int fullWidth) const
+    {
+        return std::max(1, (int)(fullWidth * this->scale + 0.5f));
+    }
+    int Height(int fullHeight) const
+    {
+        return std::max(1, (int)(fullHeight * this->scale + 0.5f));
+    }
+
+    // The last frames, 0 is the oldest one kept
+    int HistorySize() const
+    {
+        return this->historySize;
+    }
+    const ResolutionSample& History(int i) const
+    {
+        return this->history[(this->frame - this->historySize + i) % HISTORY_SIZE];
+    }
+
+    // "scale 0.75, 18.20 / 16.67 ms"
+    std::string Summary() const
+    {
+        std::stringstream out;
+        out << std::fixed << std::setprecision(2) << "scale " << this->scale << ", " << this->smoothedMs << " / " << this->BudgetMs << " ms";
+        return out.str();
+    }
+
+    bool WriteCsv(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        file << std::fixed << std::setprecision(4);
+        file << "frame,frame_ms,smoothed_ms,scale\n";
+        for (int i = 0; i < this->historySize; i++)
+        {
+            const ResolutionSample& sample = this->History(i);
+            file << sample.frame << "," << sample.frameMs << "," << sample.smoothedMs << "," << sample.scale << "\n";
+        }
+        return true;
+    }
+
+private:
+    float scale = 1.0f;
+    double smoothedMs = 0.0;
+    int framesUnder = 0;
+    int settle = 0;
+    unsigned long long frame = 0;
+    unsigned int changes = 0;
+    ResolutionSample history[HISTORY_SIZE];
+    int historySize = 0;
+};
+
+// Color + depth/stencil target of the scene at the largest scale, a frame at a smaller one uses its bottom left corner
+class ResolutionTarget
+{
+public:
+    GLuint FBO = 0;
+    GLuint Color = 0;
+    GLuint DepthStencil = 0;
+
+    // Can be called in the middle of a frame, the texture bound before is bound again
+    bool Create(int width, int height)
+    {
+        GLint boundTexture = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+        glGenFramebuffers(1, &this->FBO);
+        glGenTextures(1, &this->Color);
+        glBindTexture(GL_TEXTURE_2D, this->Color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, boundTexture);
+        glGenRenderbuffers(1, &this->DepthStencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->DepthStencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->Color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->DepthStencil);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete)
+            LOG_ERROR << "ERROR::FRAMEBUFFER::RESOLUTION_TARGET_NOT_COMPLETE";
+        return complete;
+    }
+
+    void Delete()
+    {
+        glDeleteFramebuffers(1, &this->FBO);
+        glDeleteTextures(1, &this->Color);
+        glDeleteRenderbuffers(1, &this->DepthStencil);
+        this->FBO = this->Color = this->DepthStencil = 0;
+    }
+
+    // The width x height corner stretched over the whole of framebuffer (bilinear), which stays bound
+    void Upscale(int width, int height, unsigned int framebuffer, int targetWidth, int targetHeight) const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, targetWidth, targetHeight);
+    }
+};
+
+#endif
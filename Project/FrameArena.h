@@ -0,0 +1,186 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+// Linear (bump) allocator for memory which only lives for one frame: allocating is a pointer increment,
+// nothing is freed individually, Reset() drops everything at once. Every thread has its own scratch
+// arena (FrameArena::Scratch()), reset by the thread at the start of its frame, so no locking is needed.
+// Threads without frames (the job workers) only allocate within a ScratchScope, rewinding to an empty
+// arena resets it.
+//   ArenaVector<int> visible(ArenaAllocator<int>(FrameArena::Scratch()));
+// Memory used after a Reset must not be touched any more. When a frame needs more than the arena holds
+// an overflow block is taken from the heap and the next Reset grows the arena to the whole high water
+// mark, so the steady state allocates nothing. The blocks come from operator new, the allocation
+// tracker counts them.
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+class FrameArena
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 256 * 1024;
+
+    explicit FrameArena(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity), used(0), highWater(0)
+    {
+        this->memory = (unsigned char*)::operator new(capacity);
+    }
+
+    ~FrameArena()
+    {
+        this->releaseOverflow();
+        ::operator delete(this->memory);
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Arena of the calling thread
+    static FrameArena& Scratch()
+    {
+        static thread_local FrameArena arena;
+        return arena;
+    }
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        size_t start = (this->used + alignment - 1) & ~(alignment - 1);
+        if (start + size <= this->capacity)
+        {
+            this->used = start + size;
+            this->highWater = this->used > this->highWater ? this->used : this->highWater;
+            return this->memory + start;
+        }
+        // does not fit: a heap block until the next Reset, which grows the arena instead
+        this->highWater += size + alignment;
+        void* block = ::operator new(size + alignment);
+        this->overflow.push_back(block);
+        return (void*)(((size_t)block + alignment - 1) & ~(alignment - 1));
+    }
+
+    template <typename T>
+    T* Allocate(size_t count)
+    {
+        return (T*)this->Allocate(count * sizeof(T), alignof(T));
+    }
+
+    void Reset()
+    {
+        if (!this->overflow.empty())
+        {
+            this->releaseOverflow();
+            ::operator delete(this->memory);
+            this->capacity = this->highWater * 2;
+            this->memory = (unsigned char*)::operator new(this->capacity);
+        }
+        this->used = 0;
+    }
+
+    // Position to return to, for scopes which hand their memory back before the end of the frame. The
+    // overflow blocks do not advance used, so the mark counts them too.
+    struct Marker
+    {
+        size_t used;
+        size_t overflow;
+    };
+    Marker Mark() const
+    {
+        Marker mark = { this->used, this->overflow.size() };
+        return mark;
+    }
+    // Frees the overflow blocks taken since the mark. Back at an empty arena (no overflow outstanding at the
+    // mark either) they are folded into the arena, as by Reset.
+    void Rewind(const Marker& mark)
+    {
+        if (mark.used == 0 && mark.overflow == 0)
+        {
+            this->Reset();
+            return;
+        }
+        for (size_t i = mark.overflow; i < this->overflow.size(); i++)
+            ::operator delete(this->overflow[i]);
+        this->overflow.resize(mark.overflow);
+        this->used = mark.used;
+    }
+
+    size_t Used() const
+    {
+        return this->used;
+    }
+    size_t Capacity() const
+    {
+        return this->capacity;
+    }
+
+private:
+    unsigned char* memory;
+    size_t capacity;
+    size_t used;
+    size_t highWater;                   // largest need of a frame so far, overflow included
+    std::vector<void*> overflow;
+
+    void releaseOverflow()
+    {
+        for (size_t i = 0; i < this->overflow.size(); i++)
+            ::operator delete(this->overflow[i]);
+        this->overflow.clear();
+    }
+};
+
+// Gives the scratch arena memory allocated in the scope back when it ends
+class ScratchScope
+{
+public:
+    ScratchScope() : arena(FrameArena::Scratch()), mark(FrameArena::Scratch().Mark())
+    {
+    }
+    ~ScratchScope()
+    {
+        this->arena.Rewind(this->mark);
+    }
+private:
+    FrameArena& arena;
+    FrameArena::Marker mark;
+};
+
+// STL allocator on top of an arena, deallocate does nothing
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(FrameArena& arena) : arena(&arena)
+    {
+    }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        return this->arena->template Allocate<T>(count);
+    }
+    void deallocate(T*, size_t)
+    {
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return this->arena == other.arena;
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const
+    {
+        return this->arena != other.arena;
+    }
+
+    FrameArena* arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif
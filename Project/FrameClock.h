@@ -0,0 +1,175 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+// Time of one frame, taken once at its start so every pass of the frame sees the same values
+struct FrameTime
+{
+    unsigned long long index;
+    double time;            // seconds since the clock was reset, wall clock or simulated
+    double delta;           // seconds since the previous frame, clamped to MaxDelta
+};
+
+class FrameClock
+{
+public:
+    // a longer frame (breakpoint, window drag) is treated as this long, the simulation would otherwise try to catch up
+    double MaxDelta;
+
+    FrameClock() : MaxDelta(0.25), started(false), startTime(0.0)
+    {
+        this->current.index = 0;
+        this->current.time = 0.0;
+        this->current.delta = 0.0;
+    }
+
+    // The next Tick starts again at time 0
+    void Reset()
+    {
+        this->started = false;
+        this->current.index = 0;
+        this->current.time = 0.0;
+        this->current.delta = 0.0;
+    }
+
+    const FrameTime& Tick(double now)
+    {
+        if (!this->started)
+        {
+            this->started = true;
+            this->startTime = now;
+            this->current.index = 0;
+            this->current.time = 0.0;
+            this->current.delta = 0.0;
+            return this->current;
+        }
+        double time = now - this->startTime;
+        double delta = time - this->current.time;
+        this->current.index++;
+        this->current.delta = delta < 0.0 ? 0.0 : (delta > this->MaxDelta ? this->MaxDelta : delta);
+        this->current.time = time;
+        return this->current;
+    }
+
+    const FrameTime& Current() const
+    {
+        return this->current;
+    }
+
+private:
+    bool started;
+    double startTime;
+    FrameTime current;
+};
+
+// Accumulates frame time and hands it out in steps of constant length, whatever the frame rate is.
+// What is left over is the fraction of a step the rendered state lies between the last two steps.
+class FixedTimestep
+{
+public:
+    double Step;
+    int MaxSteps;           // per frame, the rest of a longer frame is dropped
+
+    FixedTimestep(double step, int maxSteps = 8) : Step(step), MaxSteps(maxSteps), accumulator(0.0)
+    {
+    }
+
+    void Reset()
+    {
+        this->accumulator = 0.0;
+    }
+
+    // Number of steps to simulate for a frame of `delta` seconds
+    int Advance(double delta)
+    {
+        this->accumulator += delta;
+        int steps = (int)std::floor(this->accumulator / this->Step);
+        if (steps > this->MaxSteps)
+        {
+            steps = this->MaxSteps;
+            this->accumulator = this->Step * steps;
+        }
+        this->accumulator -= this->Step * steps;
+        return steps;
+    }
+
+    // 0..1, how far the frame is between the previous and the current step
+    float Alpha() const
+    {
+        return (float)(this->accumulator / this->Step);
+    }
+
+private:
+    double accumulator;
+};
+
+// Everything that moves in the scene. The simulation produces one per step, a frame renders the
+// interpolation of the last two, so the shadow and the main pass always agree on it.
+struct AnimationState
+{
+    double time;                // simulated seconds
+    float nMapAngle;            // degrees, normal mapped quad
+    float parallaxAngle;        // degrees, parallax mapped quad
+    float mirrorAngle;          // degrees, reflecting and refracting cubes
+    glm::vec3 cameraPosition;
+};
+
+inline AnimationState interpolateAnimation(const AnimationState& a, const AnimationState& b, float alpha)
+{
+    AnimationState s;
+    s.time = a.time + (b.time - a.time) * alpha;
+    s.nMapAngle = a.nMapAngle + (b.nMapAngle - a.nMapAngle) * alpha;
+    s.parallaxAngle = a.parallaxAngle + (b.parallaxAngle - a.parallaxAngle) * alpha;
+    s.mirrorAngle = a.mirrorAngle + (b.mirrorAngle - a.mirrorAngle) * alpha;
+    s.cameraPosition = glm::mix(a.cameraPosition, b.cameraPosition, alpha);
+    return s;
+}
+
+// Owner of the animation state, advanced only in fixed steps
+class SceneAnimation
+{
+public:
+    AnimationState Previous;
+    AnimationState Current;
+
+    SceneAnimation()
+    {
+        this->Reset(glm::vec3(0.0f));
+    }
+
+    void Reset(glm::vec3 cameraPosition)
+    {
+        this->Current.time = 0.0;
+        this->Current.cameraPosition = cameraPosition;
+        this->Evaluate(this->Current);
+        this->Previous = this->Current;
+    }
+
+    // The camera moves by itself during the step (input), everything else follows the time
+    void Update(double step, glm::vec3 cameraPosition)
+    {
+        this->Previous = this->Current;
+        this->Current.time += step;
+        this->Current.cameraPosition = cameraPosition;
+        this->Evaluate(this->Current);
+    }
+
+    AnimationState Interpolated(float alpha) const
+    {
+        return interpolateAnimation(this->Previous, this->Current, alpha);
+    }
+
+private:
+    void Evaluate(AnimationState& state) const
+    {
+        float t = (float)state.time;
+        state.nMapAngle = t * -10.0f;
+        state.parallaxAngle = std::sin(t) * 10.0f + 90.0f;
+        state.mirrorAngle = t * 20.0f;
+    }
+};
+
+#endif
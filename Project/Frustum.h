@@ -0,0 +1,62 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// View frustum as six planes (inside where dot(plane.xyz, p) + plane.w >= 0), taken from a
+// projection * view matrix (Gribb & Hartmann)
+class Frustum
+{
+public:
+    glm::vec4 Planes[6];
+
+    Frustum(const glm::mat4& viewProjection)
+    {
+        glm::mat4 m = glm::transpose(viewProjection);     // rows of the matrix
+        this->Planes[0] = m[3] + m[0];      // left
+        this->Planes[1] = m[3] - m[0];      // right
+        this->Planes[2] = m[3] + m[1];      // bottom
+        this->Planes[3] = m[3] - m[1];      // top
+        this->Planes[4] = m[3] + m[2];      // near
+        this->Planes[5] = m[3] - m[2];      // far
+        for (int i = 0; i < 6; i++)
+            this->Planes[i] /= glm::length(glm::vec3(this->Planes[i]));
+    }
+
+    // Conservative: true for every sphere which is at least partly inside
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (int i = 0; i < 6; i++)
+            if (glm::dot(glm::vec3(this->Planes[i]), center) + this->Planes[i].w < -radius)
+                return false;
+        return true;
+    }
+
+    // Conservative as well: only the corner farthest along each plane normal is tested
+    bool IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal = glm::vec3(this->Planes[i]);
+            glm::vec3 corner(normal.x >= 0.0f ? boxMax.x : boxMin.x, normal.y >= 0.0f ? boxMax.y : boxMin.y, normal.z >= 0.0f ? boxMax.z : boxMin.z);
+            if (glm::dot(normal, corner) + this->Planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // True when the whole box is inside
+    bool ContainsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal = glm::vec3(this->Planes[i]);
+            glm::vec3 corner(normal.x >= 0.0f ? boxMin.x : boxMax.x, normal.y >= 0.0f ? boxMin.y : boxMax.y, normal.z >= 0.0f ? boxMin.z : boxMax.z);
+            if (glm::dot(normal, corner) + this->Planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
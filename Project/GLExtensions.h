@@ -0,0 +1,95 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <string>
+#include <cstring>
+
+#include <glad/glad.h>
+
+// GLAD is generated for the plain 3.3 core profile, entry points of newer versions and extensions
+// which are used when available are loaded here by hand.
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC_EXT)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC_EXT)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC_EXT)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_EXT)(GLuint count);
+
+struct GLExtensions
+{
+    bool loaded = false;
+    // GL 4.1 / ARB_get_program_binary
+    bool programBinary = false;
+    PFNGLGETPROGRAMBINARYPROC_EXT GetProgramBinary = NULL;
+    PFNGLPROGRAMBINARYPROC_EXT ProgramBinary = NULL;
+    PFNGLPROGRAMPARAMETERIPROC_EXT ProgramParameteri = NULL;
+    // KHR_parallel_shader_compile / ARB_parallel_shader_compile
+    bool parallelShaderCompile = false;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_EXT MaxShaderCompilerThreads = NULL;
+    // Driver identification, also part of the program binary cache key
+    std::string vendor, renderer, version;
+};
+
+inline GLExtensions& glExtensions()
+{
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Must be called once after gladLoadGLLoader with the same loader (e.g. glfwGetProcAddress)
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLExtensions& ext = glExtensions();
+    ext.vendor = (const char*)glGetString(GL_VENDOR);
+    ext.renderer = (const char*)glGetString(GL_RENDERER);
+    ext.version = (const char*)glGetString(GL_VERSION);
+
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        ext.GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC_EXT)load("glGetProgramBinary");
+        ext.ProgramBinary = (PFNGLPROGRAMBINARYPROC_EXT)load("glProgramBinary");
+        ext.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC_EXT)load("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        // drivers without any binary format would reject everything we store
+        ext.programBinary = ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri && formats > 0;
+    }
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_EXT)load("glMaxShaderCompilerThreadsKHR");
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_EXT)load("glMaxShaderCompilerThreadsARB");
+    ext.parallelShaderCompile = ext.MaxShaderCompilerThreads != NULL;
+    if (ext.parallelShaderCompile)
+        ext.MaxShaderCompilerThreads(0xFFFFFFFF);   // let the driver pick as many threads as it wants
+    ext.loaded = true;
+}
+
+#endif
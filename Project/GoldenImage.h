@@ -0,0 +1,291 @@
+#ifndef GOLDEN_IMAGE_H
+#define GOLDEN_IMAGE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+
+// Reference images for the performance suite: the last frame of a scene is read back, written as PNG
+// and compared against a checked-in golden image so optimizations which change the output are caught.
+
+// Bottom-up GL rows are flipped so the image is stored top-down like any other picture
+inline std::vector<unsigned char> readFramebufferRGB(int width, int height)
+{
+    std::vector<unsigned char> pixels(width * height * 3), image(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    for (int y = 0; y < height; y++)
+        std::copy(pixels.begin() + y * width * 3, pixels.begin() + (y + 1) * width * 3, image.begin() + (height - 1 - y) * width * 3);
+    return image;
+}
+
+namespace png_detail
+{
+    inline unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+    {
+        static unsigned int table[256];
+        if (table[1] == 0)
+        {
+            for (unsigned int n = 0; n < 256; n++)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+        }
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    // Least significant bit first, as deflate wants it
+    struct BitWriter
+    {
+        std::vector<unsigned char> bytes;
+        unsigned int buffer = 0;
+        int count = 0;
+
+        void Write(unsigned int bits, int length)
+        {
+            buffer |= bits << count;
+            count += length;
+            while (count >= 8)
+            {
+                bytes.push_back((unsigned char)buffer);
+                buffer >>= 8;
+                count -= 8;
+            }
+        }
+        // Huffman codes are defined most significant bit first
+        void WriteCode(unsigned int code, int length)
+        {
+            unsigned int reversed = 0;
+            for (int i = 0; i < length; i++)
+                reversed |= ((code >> i) & 1) << (length - 1 - i);
+            Write(reversed, length);
+        }
+        void Flush()
+        {
+            if (count > 0)
+                bytes.push_back((unsigned char)buffer);
+            buffer = 0;
+            count = 0;
+        }
+    };
+
+    inline void writeLiteral(BitWriter& out, unsigned int symbol)
+    {
+        if (symbol < 144)
+            out.WriteCode(0x30 + symbol, 8);
+        else if (symbol < 256)
+            out.WriteCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            out.WriteCode(symbol - 256, 7);
+        else
+            out.WriteCode(0xC0 + symbol - 280, 8);
+    }
+
+    inline void writeMatch(BitWriter& out, int length, int distance)
+    {
+        static const int lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const int lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const int distanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+            4097, 6145, 8193, 12289, 16385, 24577 };
+        static const int distanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+        int l = 28;
+        while (lengthBase[l] > length)
+            l--;
+        writeLiteral(out, 257 + l);
+        out.Write(length - lengthBase[l], lengthExtra[l]);
+        int d = 29;
+        while (distanceBase[d] > distance)
+            d--;
+        out.WriteCode(d, 5);
+        out.Write(distance - distanceBase[d], distanceExtra[d]);
+    }
+
+    // zlib stream of one deflate block with the fixed Huffman codes and hash chain LZ77 matching
+    inline std::vector<unsigned char> zlibCompress(const std::vector<unsigned char>& data)
+    {
+        const int WINDOW = 32768, HASH_SIZE = 1 << 15, MAX_CHAIN = 32, MIN_MATCH = 3, MAX_MATCH = 258;
+        std::vector<int> head(HASH_SIZE, -1), previous(data.size(), -1);
+        BitWriter out;
+        out.bytes.push_back(0x78);
+        out.bytes.push_back(0x01);
+        out.Write(1, 1);        // final block
+        out.Write(1, 2);        // fixed Huffman codes
+
+        const int size = (int)data.size();
+        int i = 0;
+        while (i < size)
+        {
+            int bestLength = 0, bestDistance = 0;
+            if (i + MIN_MATCH <= size)
+            {
+                unsigned int hash = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (HASH_SIZE - 1);
+                int candidate = head[hash];
+                for (int chain = 0; candidate >= 0 && i - candidate <= WINDOW && chain < MAX_CHAIN; chain++)
+                {
+                    int length = 0;
+                    while (length < MAX_MATCH && i + length < size && data[candidate + length] == data[i + length])
+                        length++;
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = i - candidate;
+                        if (length == MAX_MATCH)
+                            break;
+                    }
+                    candidate = previous[candidate];
+                }
+                previous[i] = head[hash];
+                head[hash] = i;
+            }
+            if (bestLength >= MIN_MATCH)
+            {
+                writeMatch(out, bestLength, bestDistance);
+                // the skipped positions still go into the hash chains
+                for (int k = 1; k < bestLength && i + k + MIN_MATCH <= size; k++)
+                {
+                    unsigned int hash = ((data[i + k] << 10) ^ (data[i + k + 1] << 5) ^ data[i + k + 2]) & (HASH_SIZE - 1);
+                    previous[i + k] = head[hash];
+                    head[hash] = i + k;
+                }
+                i += bestLength;
+            }
+            else
+                writeLiteral(out, data[i++]);
+        }
+        writeLiteral(out, 256);
+        out.Flush();
+
+        unsigned int a = 1, b = 0;
+        for (size_t k = 0; k < data.size(); k++)
+        {
+            a = (a + data[k]) % 65521;
+            b = (b + a) % 65521;
+        }
+        unsigned int adler = (b << 16) | a;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.bytes.push_back((unsigned char)(adler >> shift));
+        return out.bytes;
+    }
+
+    inline int paeth(int a, int b, int c)
+    {
+        int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+    }
+
+    inline void writeChunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data)
+    {
+        std::vector<unsigned char> chunk(type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        unsigned int length = (unsigned int)data.size(), crc = crc32(&chunk[0], chunk.size());
+        unsigned char header[4] = { (unsigned char)(length >> 24), (unsigned char)(length >> 16), (unsigned char)(length >> 8), (unsigned char)length };
+        unsigned char footer[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+        file.write((const char*)header, 4);
+        file.write((const char*)&chunk[0], chunk.size());
+        file.write((const char*)footer, 4);
+    }
+}
+
+// 8 bit RGB PNG, every row gets the filter with the smallest sum of absolute differences
+inline bool writePng(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb)
+{
+    using namespace png_detail;
+    const int stride = width * 3;
+    std::vector<unsigned char> filtered;
+    filtered.reserve((stride + 1) * height);
+    std::vector<unsigned char> candidate(stride), best(stride);
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char* row = &rgb[y * stride];
+        const unsigned char* up = y > 0 ? &rgb[(y - 1) * stride] : NULL;
+        long bestCost = -1;
+        int bestFilter = 0;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            long cost = 0;
+            for (int x = 0; x < stride; x++)
+            {
+                int a = x >= 3 ? row[x - 3] : 0, b = up ? up[x] : 0, c = up && x >= 3 ? up[x - 3] : 0;
+                int predicted = filter == 0 ? 0 : filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : paeth(a, b, c);
+                candidate[x] = (unsigned char)(row[x] - predicted);
+                cost += candidate[x] < 128 ? candidate[x] : 256 - candidate[x];
+            }
+            if (bestCost < 0 || cost < bestCost)
+            {
+                bestCost = cost;
+                bestFilter = filter;
+                best.swap(candidate);
+            }
+        }
+        filtered.push_back((unsigned char)bestFilter);
+        filtered.insert(filtered.end(), best.begin(), best.end());
+    }
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+    const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    file.write((const char*)signature, 8);
+    unsigned char ihdr[13] = { (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+        (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+        8, 2, 0, 0, 0 };
+    writeChunk(file, "IHDR", std::vector<unsigned char>(ihdr, ihdr + 13));
+    writeChunk(file, "IDAT", zlibCompress(filtered));
+    writeChunk(file, "IEND", std::vector<unsigned char>());
+    return file.good();
+}
+
+struct ImageDiff
+{
+    bool compared = false;          // false when the golden image is missing or has another size
+    int maxDifference = 0;          // largest channel difference, 0..255
+    double meanDifference = 0.0;
+    double mismatchedRatio = 0.0;   // share of pixels with a channel differing by more than the threshold
+};
+
+inline ImageDiff compareWithGolden(const std::string& goldenPath, int width, int height, const std::vector<unsigned char>& rgb, int threshold)
+{
+    ImageDiff diff;
+    int goldenWidth, goldenHeight, channels;
+    stbi_set_flip_vertically_on_load(false);
+    unsigned char* golden = stbi_load(goldenPath.c_str(), &goldenWidth, &goldenHeight, &channels, 3);
+    stbi_set_flip_vertically_on_load(true);     // the application loads its textures flipped
+    if (golden == NULL)
+        return diff;
+    if (goldenWidth == width && goldenHeight == height)
+    {
+        diff.compared = true;
+        size_t mismatched = 0, total = 0;
+        for (int i = 0; i < width * height; i++)
+        {
+            int pixelMax = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                int d = std::abs((int)rgb[i * 3 + c] - (int)golden[i * 3 + c]);
+                pixelMax = d > pixelMax ? d : pixelMax;
+                total += d;
+            }
+            diff.maxDifference = pixelMax > diff.maxDifference ? pixelMax : diff.maxDifference;
+            if (pixelMax > threshold)
+                mismatched++;
+        }
+        diff.meanDifference = (double)total / (width * height * 3);
+        diff.mismatchedRatio = (double)mismatched / (width * height);
+    }
+    stbi_image_free(golden);
+    return diff;
+}
+
+#endif
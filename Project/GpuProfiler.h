@@ -0,0 +1,492 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Log.h"
+
+// Timing of one profiled pass in one frame
+struct GpuPassTiming
+{
+    const char* name;
+    int depth;                  // nesting level, 0 for top level passes
+    unsigned long long frame;
+    double startMs;             // relative to the first timestamp of the profiler
+    double durationMs;
+};
+
+// Scoped GPU timers built on GL_TIMESTAMP queries (glQueryCounter), which unlike GL_TIME_ELAPSED
+// can be nested. Queries of a frame are read back FRAME_LATENCY frames later, by then the GPU
+// has normally finished them and reading the result does not stall the pipeline.
+class GpuProfiler
+{
+public:
+    static const int FRAME_LATENCY = 3;
+    static const size_t MAX_HISTORY = 200000;      // stored pass timings for trace export
+
+    GpuProfiler() : supported(false), enabled(true), frameIndex(0), baseTime(0), stalls(0), overlayVAO(0), overlayVBO(0), overlayFont(0), overlayText(0), overlayShader(NULL)
+    {
+    }
+    ~GpuProfiler()
+    {
+        delete overlayShader;       // no GL calls, the context is gone by the time a global is destroyed
+    }
+
+    // Needs a current GL context
+    void Init()
+    {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        supported = bits > 0;
+        history.reserve(MAX_HISTORY);       // reserved once, growing it would allocate in the middle of a run
+        if (!supported)
+            LOG_WARNING << "GPU profiler: timestamp queries are not supported";
+    }
+
+    // Frees the queries and the overlay, needs the context current. The profiler can be used again after Init()
+    void Delete()
+    {
+        for (int i = 0; i < FRAME_LATENCY; i++)
+        {
+            for (size_t q = 0; q < frames[i].scopes.size(); q++)
+                glDeleteQueries(2, frames[i].scopes[q].queries);
+            frames[i] = FrameQueries();
+        }
+        if (overlayShader != NULL)
+        {
+            glDeleteVertexArrays(1, &overlayVAO);
+            glDeleteBuffers(1, &overlayVBO);
+            glDeleteTextures(1, &overlayFont);
+            delete overlayShader;
+        }
+        overlayVAO = overlayVBO = overlayFont = 0;
+        overlayShader = NULL;
+    }
+
+    void SetEnabled(bool value)
+    {
+        enabled = value;
+    }
+    bool IsEnabled() const
+    {
+        return enabled && supported;
+    }
+
+    void BeginFrame()
+    {
+        if (!IsEnabled())
+            return;
+        FrameQueries& f = frames[frameIndex % FRAME_LATENCY];
+        collect(f);                 // the slot still holds the frame from FRAME_LATENCY frames ago
+        f.frame = frameIndex;
+        f.used = 0;
+        f.open.clear();
+        f.recording = true;
+        Begin("frame");
+    }
+
+    void EndFrame()
+    {
+        if (!IsEnabled())
+            return;
+        End();
+        frames[frameIndex % FRAME_LATENCY].recording = false;
+        frameIndex++;
+    }
+
+    void Begin(const char* name)
+    {
+        if (!IsEnabled())
+            return;
+        FrameQueries& f = frames[frameIndex % FRAME_LATENCY];
+        if (!f.recording)
+            return;
+        if (f.used == f.scopes.size())
+        {
+            Scope scope;
+            glGenQueries(2, scope.queries);
+            f.scopes.push_back(scope);
+        }
+        Scope& scope = f.scopes[f.used];
+        scope.name = name;
+        scope.depth = (int)f.open.size();
+        glQueryCounter(scope.queries[0], GL_TIMESTAMP);
+        f.open.push_back(f.used);
+        f.used++;
+    }
+
+    void End()
+    {
+        if (!IsEnabled())
+            return;
+        FrameQueries& f = frames[frameIndex % FRAME_LATENCY];
+        if (!f.recording || f.open.empty())
+            return;
+        glQueryCounter(f.scopes[f.open.back()].queries[1], GL_TIMESTAMP);
+        f.open.pop_back();
+    }
+
+    // Reads back every frame still in flight, e.g. before exporting at the end of a run
+    void Flush()
+    {
+        if (!IsEnabled())
+            return;
+        for (int i = 0; i < FRAME_LATENCY; i++)
+            collect(frames[(frameIndex + i) % FRAME_LATENCY]);      // oldest first
+    }
+
+    // Drops everything collected so far, e.g. between two benchmark runs
+    void Reset()
+    {
+        Flush();
+        frameIndex = 0;
+        baseTime = 0;
+        stalls = 0;
+        lastFrame.clear();
+        history.clear();
+        averages.clear();
+    }
+
+    // Pass timings of the most recent frame read back
+    const std::vector<GpuPassTiming>& LastFrame() const
+    {
+        return lastFrame;
+    }
+    // Average duration of a pass over the last AVERAGE_FRAMES read back frames
+    double AverageMs(const char* name) const
+    {
+        std::map<std::string, Average, std::less<> >::const_iterator it = averages.find(name);
+        return it == averages.end() ? 0.0 : it->second.value;
+    }
+    // How often a readback had to wait for the GPU
+    unsigned long long Stalls() const
+    {
+        return stalls;
+    }
+    const std::vector<GpuPassTiming>& History() const
+    {
+        return history;
+    }
+
+    // One line per pass of the last frame: "name avg ms"
+    std::string Summary() const
+    {
+        std::stringstream out;
+        out << std::fixed << std::setprecision(2);
+        for (size_t i = 0; i < lastFrame.size(); i++)
+            out << (i ? " | " : "") << lastFrame[i].name << " " << AverageMs(lastFrame[i].name) << "ms";
+        return out.str();
+    }
+
+    // Chrome trace event format, open with chrome://tracing or https://ui.perfetto.dev
+    bool WriteChromeTrace(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        file << std::fixed << std::setprecision(3);
+        file << "{\"traceEvents\":[\n";
+        for (size_t i = 0; i < history.size(); i++)
+        {
+            const GpuPassTiming& t = history[i];
+            file << (i ? ",\n" : "") << "{\"name\":\"" << t.name << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":\"GPU\",\"ts\":"
+                << t.startMs * 1000.0 << ",\"dur\":" << t.durationMs * 1000.0 << ",\"args\":{\"frame\":" << t.frame << "}}";
+        }
+        file << "\n]}\n";
+        return true;
+    }
+
+    bool WriteCsv(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        file << std::fixed << std::setprecision(4);
+        file << "frame,pass,depth,start_ms,duration_ms\n";
+        for (size_t i = 0; i < history.size(); i++)
+        {
+            const GpuPassTiming& t = history[i];
+            file << t.frame << "," << t.name << "," << t.depth << "," << t.startMs << "," << t.durationMs << "\n";
+        }
+        return true;
+    }
+
+    // Bar per pass of the last frame in the top left corner, full bar width = budgetMs, labeled with
+    // the pass name and its average time
+    void DrawOverlay(int viewportWidth, int viewportHeight, float budgetMs = 16.67f)
+    {
+        if (!IsEnabled() || lastFrame.empty())
+            return;
+        if (overlayShader == NULL)
+            createOverlay();
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean stencilTest = glIsEnabled(GL_STENCIL_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_STENCIL_TEST);
+        glBindVertexArray(overlayVAO);
+
+        const float rowHeight = 14.0f, width = 300.0f, margin = 10.0f;
+        overlayShader->Use(0);
+        for (size_t i = 0; i < lastFrame.size(); i++)
+        {
+            float y = margin + i * (rowHeight + 2.0f);
+            float x = margin + lastFrame[i].depth * 8.0f;
+            float fill = (float)(AverageMs(lastFrame[i].name) / budgetMs);
+            fill = fill > 1.0f ? 1.0f : fill;
+            drawRect(x, y, width, rowHeight, viewportWidth, viewportHeight, glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+            drawRect(x, y, width * fill, rowHeight, viewportWidth, viewportHeight, glm::vec4(passColor(lastFrame[i].name), 0.9f));
+        }
+        // labels right of the bars, in a second loop so the variant is switched once
+        overlayShader->Use(overlayText);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, overlayFont);
+        for (size_t i = 0; i < lastFrame.size(); i++)
+        {
+            char label[MAX_LABEL + 1];
+            snprintf(label, sizeof(label), "%s %.2fms", lastFrame[i].name, AverageMs(lastFrame[i].name));
+            float y = margin + i * (rowHeight + 2.0f) + (rowHeight - GLYPH_HEIGHT) * 0.5f;
+            float x = margin + lastFrame[i].depth * 8.0f + width + 6.0f;
+            drawText(label, x, y, viewportWidth, viewportHeight, glm::vec4(1.0f));
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (stencilTest)
+            glEnable(GL_STENCIL_TEST);
+    }
+
+private:
+    static const int AVERAGE_FRAMES = 30;
+    static const int MAX_LABEL = 32;        // glyphs per label, must match overlay.frag
+    static const int GLYPH_WIDTH = 6;       // font atlas cell, 5x7 glyph plus spacing
+    static const int GLYPH_HEIGHT = 8;
+
+    struct Scope
+    {
+        GLuint queries[2];
+        const char* name;
+        int depth;
+    };
+    struct FrameQueries
+    {
+        FrameQueries() : frame(0), used(0), recording(false)
+        {
+        }
+        std::vector<Scope> scopes;      // pooled, only the first `used` belong to the frame
+        std::vector<size_t> open;       // stack of scopes without End()
+        unsigned long long frame;
+        size_t used;
+        bool recording;
+    };
+    struct Average
+    {
+        Average() : value(0.0), samples(0)
+        {
+        }
+        double value;
+        int samples;
+    };
+
+    bool supported;
+    bool enabled;
+    FrameQueries frames[FRAME_LATENCY];
+    unsigned long long frameIndex;
+    GLuint64 baseTime;
+    unsigned long long stalls;
+    std::vector<GpuPassTiming> lastFrame;
+    std::vector<GpuPassTiming> history;
+    std::map<std::string, Average, std::less<> > averages;     // looked up with the pass name, no std::string per lookup
+
+    GLuint overlayVAO, overlayVBO;
+    GLuint overlayFont;                 // GL_R8 atlas, one row of glyph cells
+    unsigned int overlayText;           // TEXT variant bit of the overlay shader
+    Shader* overlayShader;
+
+    void collect(FrameQueries& f)
+    {
+        if (f.used == 0 || f.recording)
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(f.scopes[0].queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            stalls++;               // the result call below waits for the GPU
+        lastFrame.clear();
+        for (size_t i = 0; i < f.used; i++)
+        {
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(f.scopes[i].queries[0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(f.scopes[i].queries[1], GL_QUERY_RESULT, &end);
+            if (baseTime == 0)
+                baseTime = start;
+            GpuPassTiming t;
+            t.name = f.scopes[i].name;
+            t.depth = f.scopes[i].depth;
+            t.frame = f.frame;
+            t.startMs = (start - baseTime) / 1000000.0;
+            t.durationMs = end > start ? (end - start) / 1000000.0 : 0.0;
+            lastFrame.push_back(t);
+            if (history.size() < MAX_HISTORY)
+                history.push_back(t);
+            // running average, exact for the first AVERAGE_FRAMES samples
+            std::map<std::string, Average, std::less<> >::iterator average = averages.find(t.name);
+            if (average == averages.end())
+                average = averages.insert(std::make_pair(std::string(t.name), Average())).first;
+            Average& a = average->second;
+            if (a.samples < AVERAGE_FRAMES)
+                a.samples++;
+            a.value += (t.durationMs - a.value) / a.samples;
+        }
+        f.used = 0;
+    }
+
+    static glm::vec3 passColor(const char* name)
+    {
+        unsigned int h = 2166136261u;
+        for (const char* c = name; *c; c++)
+            h = (h ^ (unsigned char)*c) * 16777619u;
+        return glm::vec3(0.4f + 0.6f * ((h & 0xFF) / 255.0f), 0.4f + 0.6f * (((h >> 8) & 0xFF) / 255.0f), 0.4f + 0.6f * (((h >> 16) & 0xFF) / 255.0f));
+    }
+
+    // Characters of the overlay font, a glyph index is the position in this string plus one (0 is blank)
+    static const char* fontCharacters()
+    {
+        return "0123456789abcdefghijklmnopqrstuvwxyz.-_/:()";
+    }
+    // 5x7 glyphs in the order of fontCharacters(), rows top to bottom, bit 4 is the leftmost pixel
+    static const unsigned char* fontGlyphs()
+    {
+        static const unsigned char glyphs[][7] =
+        {
+            { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+            { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+            { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+            { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+            { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+            { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F }, { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E },  // a b
+            { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E }, { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F },  // c d
+            { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E }, { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 },  // e f
+            { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E }, { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },  // g h
+            { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E }, { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C },  // i j
+            { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 }, { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },  // k l
+            { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11 }, { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },  // m n
+            { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E }, { 0x00, 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10 },  // o p
+            { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x01 }, { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },  // q r
+            { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E }, { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 },  // s t
+            { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D }, { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04 },  // u v
+            { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A }, { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11 },  // w x
+            { 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E }, { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F },  // y z
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },  // . -
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },  // _ /
+            { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },  // : (
+            { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }                                                 // )
+        };
+        return &glyphs[0][0];
+    }
+    // Glyph index of a character, upper case is drawn as lower case and unknown characters as blanks
+    static int glyphIndex(char c)
+    {
+        if (c >= 'A' && c <= 'Z')
+            c = c - 'A' + 'a';
+        const char* found = c != '\0' ? strchr(fontCharacters(), c) : NULL;
+        return found != NULL ? (int)(found - fontCharacters()) + 1 : 0;
+    }
+
+    void createOverlay()
+    {
+        std::vector<std::string> features;
+        features.push_back("TEXT");
+        overlayShader = new Shader("../shaders/overlay.ver", "../shaders/overlay.frag", features);
+        overlayText = overlayShader->Feature("TEXT");
+        overlayShader->Use(overlayText);
+        overlayShader->setSampler("font", 0);
+
+        // font atlas, cell 0 stays blank
+        const int glyphCount = (int)strlen(fontCharacters()) + 1;
+        std::vector<unsigned char> atlas(glyphCount * GLYPH_WIDTH * GLYPH_HEIGHT, 0);
+        for (int g = 1; g < glyphCount; g++)
+            for (int row = 0; row < 7; row++)
+                for (int column = 0; column < 5; column++)
+                    if (fontGlyphs()[(g - 1) * 7 + row] & (0x10 >> column))
+                        atlas[row * glyphCount * GLYPH_WIDTH + g * GLYPH_WIDTH + column] = 255;
+        glGenTextures(1, &overlayFont);
+        glBindTexture(GL_TEXTURE_2D, overlayFont);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, glyphCount * GLYPH_WIDTH, GLYPH_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, &atlas[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        float quad[] = { 0.0f, 0.0f,  1.0f, 0.0f,  1.0f, 1.0f,  0.0f, 0.0f,  1.0f, 1.0f,  0.0f, 1.0f };
+        glGenVertexArrays(1, &overlayVAO);
+        glGenBuffers(1, &overlayVBO);
+        glBindVertexArray(overlayVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, overlayVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // x, y, w, h in pixels from the top left corner
+    void drawRect(float x, float y, float w, float h, int viewportWidth, int viewportHeight, const glm::vec4& color)
+    {
+        glm::vec4 rect(x / viewportWidth * 2.0f - 1.0f, 1.0f - (y + h) / viewportHeight * 2.0f, w / viewportWidth * 2.0f, h / viewportHeight * 2.0f);
+        overlayShader->setVec4("rect", rect);
+        overlayShader->setVec4("color", color);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    // One quad per label, the TEXT variant picks the glyph of each cell, needs the font bound to unit 0
+    void drawText(const char* text, float x, float y, int viewportWidth, int viewportHeight, const glm::vec4& color)
+    {
+        GLint glyphs[MAX_LABEL];
+        int length = 0;
+        for (; length < MAX_LABEL && text[length] != '\0'; length++)
+            glyphs[length] = glyphIndex(text[length]);
+        if (length == 0)
+            return;
+        glUniform1iv(glGetUniformLocation(overlayShader->Program, "text"), length, glyphs);
+        overlayShader->setInt("textLength", length);
+        drawRect(x, y, (float)(length * GLYPH_WIDTH), (float)GLYPH_HEIGHT, viewportWidth, viewportHeight, color);
+    }
+};
+
+// Times the enclosing block
+class GpuScope
+{
+public:
+    GpuScope(GpuProfiler& profiler, const char* name) : profiler(profiler)
+    {
+        profiler.Begin(name);
+    }
+    ~GpuScope()
+    {
+        profiler.End();
+    }
+private:
+    GpuProfiler& profiler;
+};
+
+#define GPU_SCOPE_CONCAT2(a, b) a##b
+#define GPU_SCOPE_CONCAT(a, b) GPU_SCOPE_CONCAT2(a, b)
+#define GPU_SCOPE(profiler, name) GpuScope GPU_SCOPE_CONCAT(gpuScope, __LINE__)(profiler, name)
+
+#endif
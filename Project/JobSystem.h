@@ -0,0 +1,367 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+// Task parallelism for CPU work.
+//   JobCounter done;
+//   jobs.Run([]() { ... }, &done);                 - any worker may take it
+//   jobs.RunAfter(done, []() { ... }, &next);       - starts once `done` reaches zero
+//   jobs.RunOnMainThread([]() { ... }, &next);      - GL work, executed by the main thread in Wait/PumpMainThread
+//   jobs.Wait(next);                                - the waiting thread executes jobs meanwhile
+//   jobs.ParallelFor(count, grain, [](size_t begin, size_t end) { ... });
+// Every worker owns a deque: it pushes and pops its own jobs at the back (the most recent data is still
+// in its cache) while idle workers steal the oldest jobs from the front of the others. The deques are
+// rings which only grow and ParallelFor keeps its chunks in the scratch arena, so once warmed up
+// running jobs does not touch the heap.
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+#include "CpuProfiler.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
+
+class JobSystem;
+
+// Number of unfinished jobs of a group. Jobs started with RunAfter wait on it without blocking a thread.
+class JobCounter
+{
+public:
+    JobCounter() : value(0), finishing(0)
+    {
+    }
+
+    // Once true the jobs are done with the counter too, the waiting thread may destroy it
+    bool Done() const
+    {
+        return this->value.load() == 0 && this->finishing.load() == 0;
+    }
+
+private:
+    friend class JobSystem;
+    struct Continuation
+    {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+
+    std::atomic<int> value;
+    std::atomic<int> finishing;                 // threads still in JobSystem::finish, which touches the counter after the value
+    std::mutex mutex;
+    std::vector<Continuation> continuations;   // started when the value drops to zero
+};
+
+class JobSystem
+{
+public:
+    // The process wide system, hardware threads - 1 workers (the main thread helps while it waits)
+    static JobSystem& Instance()
+    {
+        static JobSystem jobs((int)std::thread::hardware_concurrency() - 1);
+        return jobs;
+    }
+
+    // The thread which creates the system is its main thread. Queue 0 takes the jobs of every thread
+    // which is not a worker.
+    explicit JobSystem(int workerCount) : queues(workerCount < 0 ? 1 : workerCount + 1), stopping(false), queued(0), stolen(0),
+        mainThread(std::this_thread::get_id())
+    {
+        for (size_t i = 1; i < this->queues.size(); i++)
+            this->workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->sleepMutex);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+        for (size_t i = 0; i < this->workers.size(); i++)
+            this->workers[i].join();
+    }
+
+    int WorkerCount() const
+    {
+        return (int)this->workers.size();
+    }
+
+    // Jobs taken from another worker's deque since the start
+    unsigned long long StolenJobs() const
+    {
+        return this->stolen.load(std::memory_order_relaxed);
+    }
+
+    void Run(std::function<void()> function, JobCounter* counter = NULL)
+    {
+        if (counter)
+            counter->value.fetch_add(1, std::memory_order_relaxed);
+        this->push(Job{ std::move(function), counter });
+    }
+
+    void RunAfter(JobCounter& dependency, std::function<void()> function, JobCounter* counter = NULL)
+    {
+        if (counter)
+            counter->value.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(dependency.mutex);
+            //a finish which has not taken the continuations yet takes this one too
+            if (dependency.value.load() != 0)
+            {
+                JobCounter::Continuation continuation = { std::move(function), counter };
+                dependency.continuations.push_back(std::move(continuation));
+                return;
+            }
+        }
+        this->push(Job{ std::move(function), counter });
+    }
+
+    // For jobs which need the GL context: only the main thread executes them
+    void RunOnMainThread(std::function<void()> function, JobCounter* counter = NULL)
+    {
+        if (counter)
+            counter->value.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(this->mainJobs.mutex);
+        this->mainJobs.PushBack(Job{ std::move(function), counter });
+    }
+
+    // Executes the main thread jobs queued so far, returns how many
+    int PumpMainThread()
+    {
+        int count = 0;
+        Job job;
+        while (this->popMainJob(job))
+        {
+            this->execute(job);
+            count++;
+        }
+        return count;
+    }
+
+    // Executes jobs until the counter reaches zero. Jobs for the main thread only run when the main thread
+    // waits, other threads must not wait for them.
+    void Wait(JobCounter& counter)
+    {
+        PROFILE_SCOPE("JobSystem::Wait");
+        bool onMainThread = std::this_thread::get_id() == this->mainThread;
+        size_t self = this->queueIndex();
+        Job job;
+        while (!counter.Done())
+        {
+            if ((onMainThread && this->popMainJob(job)) || this->take(self, job))
+                this->execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Calls function(begin, end) for chunks of at most `grain` items and returns when all are done.
+    // The calling thread takes part, so it is safe to nest.
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& function)
+    {
+        grain = grain < 1 ? 1 : grain;
+        if (count <= grain || this->workers.empty())
+        {
+            if (count > 0)
+                function(0, count);
+            return;
+        }
+        // a job only captures the pointer to its chunk, small enough for std::function to store without allocating
+        ScratchScope scratch;
+        size_t chunkCount = (count - 1) / grain;
+        ParallelChunk* chunks = FrameArena::Scratch().Allocate<ParallelChunk>(chunkCount);
+        JobCounter done;
+        for (size_t c = 0; c < chunkCount; c++)
+        {
+            ParallelChunk* chunk = &chunks[c];
+            chunk->function = &function;
+            chunk->begin = (c + 1) * grain;
+            chunk->end = chunk->begin + grain < count ? chunk->begin + grain : count;
+            this->Run([chunk]() { (*chunk->function)(chunk->begin, chunk->end); }, &done);
+        }
+        function(0, grain);
+        this->Wait(done);
+    }
+
+private:
+    struct Job
+    {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+
+    struct ParallelChunk
+    {
+        const std::function<void(size_t, size_t)>* function;
+        size_t begin;
+        size_t end;
+    };
+
+    // Ring of jobs, grows when full and never shrinks. Padded, neighbouring queues are locked by
+    // different threads all the time.
+    struct alignas(64) JobQueue
+    {
+        std::mutex mutex;
+        std::vector<Job> ring;
+        size_t head;
+        size_t count;
+
+        JobQueue() : ring(64), head(0), count(0)
+        {
+        }
+
+        void PushBack(Job job)
+        {
+            if (this->count == this->ring.size())
+            {
+                std::vector<Job> larger(this->ring.size() * 2);
+                for (size_t i = 0; i < this->count; i++)
+                    larger[i] = std::move(this->ring[(this->head + i) % this->ring.size()]);
+                this->ring.swap(larger);
+                this->head = 0;
+            }
+            this->ring[(this->head + this->count) % this->ring.size()] = std::move(job);
+            this->count++;
+        }
+        void PopBack(Job& job)
+        {
+            this->count--;
+            job = std::move(this->ring[(this->head + this->count) % this->ring.size()]);
+        }
+        void PopFront(Job& job)
+        {
+            job = std::move(this->ring[this->head]);
+            this->head = (this->head + 1) % this->ring.size();
+            this->count--;
+        }
+    };
+
+    std::vector<JobQueue> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::atomic<int> queued;                    // jobs in all deques, idle workers sleep while it is zero
+    std::atomic<unsigned long long> stolen;
+    std::thread::id mainThread;
+    JobQueue mainJobs;
+
+    // Deque of the calling thread, 0 for threads which are no workers of this system
+    size_t queueIndex() const
+    {
+        return currentSystem() == this ? currentQueue() : 0;
+    }
+    static const JobSystem*& currentSystem()
+    {
+        static thread_local const JobSystem* system = NULL;
+        return system;
+    }
+    static size_t& currentQueue()
+    {
+        static thread_local size_t queue = 0;
+        return queue;
+    }
+
+    void push(Job job)
+    {
+        JobQueue& queue = this->queues[this->queueIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.PushBack(std::move(job));
+        }
+        this->queued.fetch_add(1, std::memory_order_release);
+        {
+            // taking the lock orders the notification after a worker's check of `queued`
+            std::lock_guard<std::mutex> lock(this->sleepMutex);
+        }
+        this->wake.notify_one();
+    }
+
+    // Own deque from the back, then the others from the front
+    bool take(size_t self, Job& job)
+    {
+        if (this->queued.load(std::memory_order_acquire) == 0)
+            return false;
+        for (size_t i = 0; i < this->queues.size(); i++)
+        {
+            size_t index = (self + i) % this->queues.size();
+            JobQueue& queue = this->queues[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.count == 0)
+                continue;
+            if (i == 0)
+                queue.PopBack(job);
+            else
+            {
+                queue.PopFront(job);
+                this->stolen.fetch_add(1, std::memory_order_relaxed);
+            }
+            this->queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    bool popMainJob(Job& job)
+    {
+        std::lock_guard<std::mutex> lock(this->mainJobs.mutex);
+        if (this->mainJobs.count == 0)
+            return false;
+        this->mainJobs.PopFront(job);
+        return true;
+    }
+
+    void execute(Job& job)
+    {
+        job.function();
+        job.function = nullptr;
+        if (job.counter)
+            this->finish(*job.counter);
+    }
+
+    // Done() stays false until the last access to the counter, the finishing count is raised before the value drops
+    void finish(JobCounter& counter)
+    {
+        counter.finishing.fetch_add(1);
+        if (counter.value.fetch_sub(1) != 1)
+        {
+            counter.finishing.fetch_sub(1);
+            return;
+        }
+        std::vector<JobCounter::Continuation> continuations;
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            continuations.swap(counter.continuations);
+        }
+        counter.finishing.fetch_sub(1);
+        for (size_t i = 0; i < continuations.size(); i++)
+            this->push(Job{ std::move(continuations[i].function), continuations[i].counter });
+    }
+
+    void workerLoop(size_t queue)
+    {
+        PROFILE_THREAD_NAME("job worker");
+        allocationWorkerThread() = true;
+        currentSystem() = this;
+        currentQueue() = queue;
+        Job job;
+        for (;;)
+        {
+            if (this->take(queue, job))
+            {
+                this->execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(this->sleepMutex);
+            this->wake.wait(lock, [this]() { return this->stopping || this->queued.load(std::memory_order_acquire) > 0; });
+            if (this->stopping)
+                return;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,461 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Asynchronous logging.
+//   LOG_DEBUG << "text " << value;     - also LOG_INFO, LOG_WARNING, LOG_ERROR
+// A message is formatted on the calling thread into fixed size records (no allocation) and pushed
+// into a lock-free multi producer ring; a background thread writes the records in batches to the
+// console and an optional file. A full ring drops the message instead of blocking, the writer
+// reports how many were lost. Levels below LOG_MIN_LEVEL are compiled out, Logger::SetLevel filters
+// the rest at run time.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+
+struct LogRecord
+{
+    static const size_t MAX_TEXT = 488;         // longer messages continue in further records, pushed together
+
+    int level;
+    unsigned int thread;
+    double time;                                // seconds since the logger started
+    unsigned short length;
+    bool first;                                 // false for the continuation of a long message
+    bool last;                                  // false when the message continues in the next record
+    char text[MAX_TEXT];
+};
+
+// Bounded ring of D. Vyukov: every slot carries a sequence number which tells producers and the
+// consumer whose turn it is, so producers only contend on one compare-exchange of the write position.
+class LogRing
+{
+public:
+    static const size_t CAPACITY = 1 << 12;     // must be a power of two
+
+    LogRing() : slots(CAPACITY), enqueuePos(0), dequeuePos(0)
+    {
+        for (size_t i = 0; i < CAPACITY; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Any thread, false when the ring is full
+    bool TryPush(const LogRecord& record)
+    {
+        return TryPush(&record, 1);
+    }
+
+    // Claims `count` consecutive slots in one compare-exchange, so the records of a long message are
+    // never interleaved with those of other producers. The consumer frees slots in order: when the
+    // last one is free for its position, the ones before it are as well.
+    bool TryPush(const LogRecord* records, size_t count)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            size_t sequence = slots[pos & (CAPACITY - 1)].sequence.load(std::memory_order_acquire);
+            size_t lastSequence = slots[(pos + count - 1) & (CAPACITY - 1)].sequence.load(std::memory_order_acquire);
+            long long diff = (long long)sequence - (long long)pos;
+            long long lastDiff = (long long)lastSequence - (long long)(pos + count - 1);
+            if (diff == 0 && lastDiff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0 || (diff == 0 && lastDiff < 0))
+                return false;
+            else
+                pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            Slot& slot = slots[(pos + i) & (CAPACITY - 1)];
+            std::memcpy(&slot.record, &records[i], offsetof(LogRecord, text) + records[i].length);
+            slot.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Consumer thread only
+    bool TryPop(LogRecord& record)
+    {
+        Slot& slot = slots[dequeuePos & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+            return false;
+        std::memcpy(&record, &slot.record, offsetof(LogRecord, text) + slot.record.length);
+        slot.sequence.store(dequeuePos + CAPACITY, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+
+    size_t Pushed() const
+    {
+        return enqueuePos.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+    std::vector<Slot> slots;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) size_t dequeuePos;
+};
+
+class Logger
+{
+public:
+    static Logger& Instance()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    static const char* LevelName(int level)
+    {
+        static const char* names[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+        return level >= 0 && level < LOG_LEVEL_OFF ? names[level] : "";
+    }
+
+    void SetLevel(int level)
+    {
+        this->level.store(level, std::memory_order_relaxed);
+    }
+    bool Enabled(int level) const
+    {
+        return level >= this->level.load(std::memory_order_relaxed);
+    }
+
+    void SetConsole(bool enabled)
+    {
+        std::lock_guard<std::mutex> lock(this->sinkMutex);
+        this->console = enabled;
+    }
+
+    // Messages are appended to `path` as well, an empty path closes the file
+    bool SetFile(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(this->sinkMutex);
+        if (this->file != NULL)
+            std::fclose(this->file);
+        this->file = path.empty() ? NULL : std::fopen(path.c_str(), "a");
+        return path.empty() || this->file != NULL;
+    }
+
+    // The records of one message, the first one carries time and thread
+    void Push(LogRecord* records, size_t count)
+    {
+        records[0].time = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->startTime).count();
+        records[0].thread = threadIndex();
+        if (!this->ring.TryPush(records, count))
+            this->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Blocks until everything logged so far is written
+    void Flush()
+    {
+        size_t target = this->ring.Pushed();
+        while (this->running.load(std::memory_order_acquire) && this->written.load(std::memory_order_acquire) < target)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    size_t Dropped() const
+    {
+        return this->dropped.load(std::memory_order_relaxed);
+    }
+
+    // Writes what is left and stops the writer thread, later messages are lost
+    void Shutdown()
+    {
+        if (!this->running.exchange(false))
+            return;
+        this->writer.join();
+        std::lock_guard<std::mutex> lock(this->sinkMutex);
+        if (this->file != NULL)
+            std::fclose(this->file);
+        this->file = NULL;
+    }
+
+private:
+    LogRing ring;
+    std::atomic<int> level;
+    std::atomic<size_t> written;        // records taken off the ring, failed pushes never get a slot
+    std::atomic<size_t> dropped;
+    std::atomic<bool> running;
+    std::chrono::steady_clock::time_point startTime;
+    std::mutex sinkMutex;               // only the writer and the rare SetFile/SetConsole take it
+    bool console;
+    FILE* file;
+    std::thread writer;
+
+    Logger() : level(LOG_MIN_LEVEL), written(0), dropped(0), running(true), startTime(std::chrono::steady_clock::now()),
+        console(true), file(NULL)
+    {
+        this->writer = std::thread(&Logger::writerLoop, this);
+    }
+    ~Logger()
+    {
+        this->Shutdown();
+    }
+
+    static unsigned int threadIndex()
+    {
+        static std::atomic<unsigned int> next(0);
+        static thread_local unsigned int index = next.fetch_add(1);
+        return index;
+    }
+
+    void writerLoop()
+    {
+        std::string batch;
+        batch.reserve(64 * 1024);
+        LogRecord record;
+        size_t reportedDrops = 0;
+        for (;;)
+        {
+            // read the flag first, so a stop request still drains everything pushed before it
+            bool stopping = !this->running.load(std::memory_order_acquire);
+            size_t count = 0;
+            batch.clear();
+            while (count < 4096 && this->ring.TryPop(record))
+            {
+                if (record.first)
+                {
+                    char prefix[48];
+                    int n = std::snprintf(prefix, sizeof(prefix), "[%10.4f t%u] %-7s ", record.time, record.thread, LevelName(record.level));
+                    batch.append(prefix, n);
+                }
+                batch.append(record.text, record.length);
+                if (record.last)
+                    batch.push_back('\n');
+                count++;
+            }
+            size_t drops = this->dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops)
+            {
+                char line[64];
+                int n = std::snprintf(line, sizeof(line), "[logger] %zu messages dropped, the ring was full\n", drops - reportedDrops);
+                batch.append(line, n);
+                reportedDrops = drops;
+            }
+            if (!batch.empty())
+            {
+                std::lock_guard<std::mutex> lock(this->sinkMutex);
+                if (this->console)
+                {
+                    std::fwrite(batch.data(), 1, batch.size(), stdout);
+                    std::fflush(stdout);
+                }
+                if (this->file != NULL)
+                {
+                    std::fwrite(batch.data(), 1, batch.size(), this->file);
+                    std::fflush(this->file);
+                }
+            }
+            this->written.fetch_add(count, std::memory_order_release);
+            if (count == 0)
+            {
+                if (stopping)
+                    return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+    }
+};
+
+// One message, formatted in place and handed to the logger when the statement ends
+class LogLine
+{
+public:
+    static const size_t MAX_RECORDS = 8;        // about 3.9 KB of text, the rest is cut off with a marker
+
+    explicit LogLine(int level) : count(1), truncated(false)
+    {
+        this->records[0].level = level;
+        this->records[0].length = 0;
+        this->records[0].first = true;
+        this->records[0].last = true;
+    }
+    ~LogLine()
+    {
+        if (this->truncated)
+        {
+            static const char marker[] = " [truncated]";
+            LogRecord& record = this->records[this->count - 1];
+            std::memcpy(record.text + LogRecord::MAX_TEXT - (sizeof(marker) - 1), marker, sizeof(marker) - 1);
+        }
+        Logger::Instance().Push(this->records, this->count);
+    }
+
+    LogLine& operator<<(const char* text)
+    {
+        this->append(text != NULL ? text : "(null)", text != NULL ? std::strlen(text) : 6);
+        return *this;
+    }
+    LogLine& operator<<(const std::string& text)
+    {
+        this->append(text.data(), text.size());
+        return *this;
+    }
+    LogLine& operator<<(char c)
+    {
+        this->append(&c, 1);
+        return *this;
+    }
+    LogLine& operator<<(bool value)
+    {
+        return *this << (value ? "true" : "false");
+    }
+    LogLine& operator<<(int value) { return this->integer(value < 0, value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value); }
+    LogLine& operator<<(long value) { return this->integer(value < 0, value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value); }
+    LogLine& operator<<(long long value) { return this->integer(value < 0, value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value); }
+    LogLine& operator<<(unsigned int value) { return this->integer(false, value); }
+    LogLine& operator<<(unsigned long value) { return this->integer(false, value); }
+    LogLine& operator<<(unsigned long long value) { return this->integer(false, value); }
+    // Six significant digits like std::cout; snprintf("%g") costs several times a whole message, so
+    // ordinary magnitudes are printed as integer and fraction and only the rest goes through it
+    LogLine& operator<<(double value)
+    {
+        double magnitude = value < 0.0 ? -value : value;
+        if (magnitude >= 1e-3 && magnitude < 1e9)
+        {
+            int decimals = 5;
+            for (double limit = 10.0; magnitude >= limit && decimals > 0; limit *= 10.0)
+                decimals--;
+            for (double limit = 1.0; magnitude < limit; limit *= 0.1)
+                decimals++;             // leading zeros of 0.00x are not significant
+            unsigned long long scale = 1;
+            for (int i = 0; i < decimals; i++)
+                scale *= 10;
+            unsigned long long scaled = (unsigned long long)(magnitude * scale + 0.5);
+            unsigned long long whole = scaled / scale, fraction = scaled % scale;
+            while (decimals > 0 && fraction % 10 == 0)
+            {
+                fraction /= 10;
+                decimals--;
+            }
+            this->integer(value < 0.0, whole);
+            if (decimals > 0)
+            {
+                char digits[8];
+                for (int i = decimals - 1; i >= 0; i--, fraction /= 10)
+                    digits[i] = (char)('0' + fraction % 10);
+                this->append(".", 1);
+                this->append(digits, decimals);
+            }
+            return *this;
+        }
+        char buffer[32];
+        int n = std::snprintf(buffer, sizeof(buffer), "%g", value);
+        this->append(buffer, n > 0 ? (size_t)n : 0);
+        return *this;
+    }
+    LogLine& operator<<(float value) { return *this << (double)value; }
+
+private:
+    LogRecord records[MAX_RECORDS];     // only the first `count` are used, the rest is never touched
+    size_t count;
+    bool truncated;
+
+    // A full record continues in the next one (shader info logs are long), all of them are pushed at the end
+    void append(const char* text, size_t length)
+    {
+        for (;;)
+        {
+            LogRecord& record = this->records[this->count - 1];
+            size_t space = LogRecord::MAX_TEXT - record.length;
+            size_t part = length < space ? length : space;
+            std::memcpy(record.text + record.length, text, part);
+            record.length += (unsigned short)part;
+            if (part == length)
+                return;
+            if (this->count == MAX_RECORDS)
+            {
+                this->truncated = true;
+                return;
+            }
+            text += part;
+            length -= part;
+            record.last = false;
+            LogRecord& next = this->records[this->count++];
+            next.level = record.level;
+            next.length = 0;
+            next.first = false;
+            next.last = true;
+        }
+    }
+
+    // Integers are the common case on hot paths, printed without going through snprintf
+    LogLine& integer(bool negative, unsigned long long magnitude)
+    {
+        char buffer[24];
+        char* end = buffer + sizeof(buffer);
+        char* digits = end;
+        do
+        {
+            *--digits = (char)('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (negative)
+            *--digits = '-';
+        this->append(digits, end - digits);
+        return *this;
+    }
+};
+
+// Turns the << chain into void so the macros can be an expression: no dangling else around them,
+// and a disabled level costs one load (& binds weaker than <<, ?: weaker than &)
+struct LogVoidify
+{
+    void operator&(LogLine&)
+    {
+    }
+};
+
+#define LOG_AT(level) !Logger::Instance().Enabled(level) ? (void)0 : LogVoidify() & LogLine(level)
+#define LOG_DISABLED(level) true ? (void)0 : LogVoidify() & LogLine(level)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG LOG_AT(LOG_LEVEL_DEBUG)
+#else
+#define LOG_DEBUG LOG_DISABLED(LOG_LEVEL_DEBUG)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO LOG_AT(LOG_LEVEL_INFO)
+#else
+#define LOG_INFO LOG_DISABLED(LOG_LEVEL_INFO)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING LOG_AT(LOG_LEVEL_WARNING)
+#else
+#define LOG_WARNING LOG_DISABLED(LOG_LEVEL_WARNING)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR LOG_AT(LOG_LEVEL_ERROR)
+#else
+#define LOG_ERROR LOG_DISABLED(LOG_LEVEL_ERROR)
+#endif
+
+#endif
@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Bvh.h"
 #include "shader.h" //shader.h   shader_s.h
 
 #include <string>
@@ -23,10 +24,8 @@ struct Vertex {
     glm::vec2 TexCoords;
 
     //  
-    glm::vec3 Tangent;
-
-    //   (,      )
-    glm::vec3 Bitangent;
+    // (with the sign of the bitangent, packed as GL_INT_2_10_10_10_REV by packTangent, TangentSpace.h)
+    unsigned int Tangent;
 };
 
 struct Texture {
@@ -42,6 +41,10 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // axis aligned bounds of the vertices, for culling
+    glm::vec3 BoundsMin, BoundsMax;
+    // triangles for ray queries, empty until BuildBvh
+    MeshBvh TriangleBvh;
 
     // 
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
@@ -49,22 +52,63 @@ public:
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        computeBounds();
 
         // ,       ,      
         setupMesh();
+        nameSamplers();
     }
 
     //  mesh-
     void Draw(Shader& shader)
     {
         //   
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); //      
+            //       
+            glUniform1i(glGetUniformLocation(shader.Program, samplerNames[i].c_str()), i);
+            //   
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+
+        //  mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        //          
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void BuildBvh()
+    {
+        if (!vertices.empty())
+            TriangleBvh.Build(&vertices[0].Position.x, sizeof(Vertex), vertices.size(), indices.data(), indices.size());
+    }
+
+private:
+    void computeBounds()
+    {
+        BoundsMin = BoundsMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        for (size_t i = 1; i < vertices.size(); i++)
+        {
+            BoundsMin = glm::min(BoundsMin, vertices[i].Position);
+            BoundsMax = glm::max(BoundsMax, vertices[i].Position);
+        }
+    }
+
+    // uniform name of every texture, built once so drawing does not assemble strings
+    vector<string> samplerNames;
+
+    void nameSamplers()
+    {
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); //      
             //    ( N  diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -76,25 +120,10 @@ public:
                 number = std::to_string(normalNr++); //  unsigned int  
             else if (name == "texture_height")
                 number = std::to_string(heightNr++); //  unsigned int  
-
-            //std::cout << name << number << std::endl;
-
-            //       
-            glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-            //   
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerNames.push_back(name + number);
         }
-
-        //  mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        //          
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
     //    
     unsigned int VBO, EBO;
 
@@ -134,11 +163,7 @@ private:
 
         //   
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-
-        //   
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
 
         glBindVertexArray(0);
     }
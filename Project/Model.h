@@ -12,6 +12,11 @@
 
 #include "mesh.h"
 #include "shader.h"
+#include "CpuProfiler.h"
+#include "JobSystem.h"
+#include "TextureLoader.h"
+#include "TangentSpace.h"
+#include "Log.h"
 
 #include <string>
 #include <fstream>
@@ -45,13 +50,23 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // triangle hierarchies of all meshes, for ray queries
+    void BuildBvhs()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].BuildBvh();
+    }
+
 private:
+    vector<aiMesh*> sceneMeshes;    // meshes of all nodes in node order, while loading
+
     //     Assimp       meshes.
     void loadModel(string const& path)
     {
+        PROFILE_SCOPE("Model::loadModel");
         //     ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
         //   
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) //   0
         {
@@ -63,6 +78,19 @@ private:
 
         //     ASSIMP
         processNode(scene->mRootNode, scene);
+
+        // vertices of every mesh are converted on the job workers, all textures are decoded there as well
+        // (uploaded by this thread meanwhile), only the buffers are set up here afterwards
+        vector<vector<Vertex> > meshVertices(sceneMeshes.size());
+        vector<vector<unsigned int> > meshIndices(sceneMeshes.size());
+        JobSystem::Instance().ParallelFor(sceneMeshes.size(), 1, [this, &meshVertices, &meshIndices](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                processMesh(sceneMeshes[i], meshVertices[i], meshIndices[i]);
+        });
+        preloadMaterialTextures(scene);
+        for (size_t i = 0; i < sceneMeshes.size(); i++)
+            meshes.push_back(Mesh(meshVertices[i], meshIndices[i], processMaterial(sceneMeshes[i], scene)));
+        sceneMeshes.clear();
     }
 
     //   .    ,   ,         (   ).
@@ -74,7 +102,7 @@ private:
             //       
             //     ;  -     
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(mesh);
         }
         //  ,      (  ),        
         for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -84,12 +112,11 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // geometry only, no GL and no shared state: runs on the job workers
+    void processMesh(aiMesh* mesh, vector<Vertex>& vertices, vector<unsigned int>& indices) const
     {
-        //   
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         //     
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -118,16 +145,6 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            //  
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            //  
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
             vertices.push_back(vertex);
         }
         //       ( -   )     
@@ -138,6 +155,21 @@ private:
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+        // tangents of our own instead of aiProcess_CalcTangentSpace, packed with the sign of the bitangent
+        if (vertices.empty())
+            return;
+        TangentMeshView view = { &vertices[0].Position.x, sizeof(Vertex), &vertices[0].Normal.x, sizeof(Vertex),
+            &vertices[0].TexCoords.x, sizeof(Vertex), vertices.size(), indices.data(), indices.size() };
+        vector<glm::vec4> tangents;
+        generateTangents(view, tangents);
+        for (size_t i = 0; i < vertices.size(); i++)
+            vertices[i].Tangent = packTangent(tangents[i]);
+    }
+
+    // textures of the mesh's material, all of them in textures_loaded after preloadMaterialTextures
+    vector<Texture> processMaterial(aiMesh* mesh, const aiScene* scene)
+    {
+        vector<Texture> textures;
         //  
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         //        .      'texture_diffuseN',
@@ -160,8 +192,46 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        //  mesh-,     
-        return Mesh(vertices, indices, textures);
+        return textures;
+    }
+
+    // every texture of the scene's materials which is not loaded yet, decoded in parallel. Same order as
+    // loadMaterialTextures would load them, so a file used with several types keeps the type it is found with first.
+    void preloadMaterialTextures(const aiScene* scene)
+    {
+        PROFILE_SCOPE("Model::preloadMaterialTextures");
+        const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+        const char* typeNames[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+        vector<Texture> pending;
+        vector<string> paths;
+        for (size_t m = 0; m < sceneMeshes.size(); m++)
+        {
+            aiMaterial* material = scene->mMaterials[sceneMeshes[m]->mMaterialIndex];
+            for (int t = 0; t < 4; t++)
+                for (unsigned int i = 0; i < material->GetTextureCount(types[t]); i++)
+                {
+                    aiString str;
+                    material->GetTexture(types[t], i, &str);
+                    bool known = false;
+                    for (size_t j = 0; j < textures_loaded.size() && !known; j++)
+                        known = textures_loaded[j].path == str.C_Str();
+                    for (size_t j = 0; j < pending.size() && !known; j++)
+                        known = pending[j].path == str.C_Str();
+                    if (known)
+                        continue;
+                    Texture texture;
+                    texture.type = typeNames[t];
+                    texture.path = str.C_Str();
+                    pending.push_back(texture);
+                    paths.push_back(this->directory + '/' + texture.path);
+                }
+        }
+        vector<unsigned int> ids = loadTextures(paths);
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            pending[i].id = ids[i];
+            textures_loaded.push_back(pending[i]);
+        }
     }
 
     //         ,      .
@@ -201,41 +271,11 @@ private:
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
+    PROFILE_SCOPE("TextureFromFile");
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    DecodedImage image = decodeImage(filename);
+    return uploadTexture(image);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,291 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+// Occlusion culling of many small objects behind big ones, three ways:
+//  - OCCLUSION_HIZ: HiZPyramid::Build reduces the depth buffer to a pyramid of the farthest depth per texel, on the GPU down to
+//    READBACK_WIDTH, then read back and finished on the CPU. Occluded tests a bounding box against the level where it covers
+//    2x2 texels at most, projected with the camera of the frame the depth comes from. A frame has two phases: the objects are
+//    tested against the pyramid of the last frame and the ones it does not hide are drawn, then the pyramid is built from this
+//    depth and the objects culled before are tested again, the ones which came into view are drawn late instead of popping up
+//    a frame later. GL 3.3 has no compute shaders to test on the GPU, the read back waits for it once per frame.
+//  - OCCLUSION_CONDITIONAL: the boxes are drawn into GL_ANY_SAMPLES_PASSED queries after the occluders and every object is drawn
+//    inside glBeginConditionalRender, the GPU drops the hidden ones. Exact and without a read back, but every object still
+//    costs its draw call and its box.
+//  - OCCLUSION_SOFTWARE: SoftwareOcclusion rasterizes the big occluders on the CPU and the objects are culled on the update thread,
+//    before anything reaches GL, for machines where the GPU is the slow part (see SoftwareOcclusion.h).
+//   for each object: if (pyramid.Occluded(boxMin, boxMax)) keep it for later, else draw it
+//   pyramid.Build(sceneFBO, projectionMat * viewMat);
+//   for each object kept: if (!pyramid.Occluded(boxMin, boxMax)) draw it
+
+#include <vector>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Log.h"
+
+enum OcclusionMode
+{
+    OCCLUSION_OFF,
+    OCCLUSION_HIZ,
+    OCCLUSION_CONDITIONAL,
+    OCCLUSION_SOFTWARE,
+    OCCLUSION_MODE_COUNT
+};
+
+inline const char* occlusionModeName(int mode)
+{
+    static const char* names[OCCLUSION_MODE_COUNT] = { "off", "hiz", "conditional", "software" };
+    return mode >= 0 && mode < OCCLUSION_MODE_COUNT ? names[mode] : "unknown";
+}
+
+// Axis aligned bounds of the unit cube (-0.5 to 0.5, the container mesh) under a model matrix
+inline void modelBounds(const glm::mat4& modelMat, glm::vec3& boxMin, glm::vec3& boxMax)
+{
+    glm::vec3 center = glm::vec3(modelMat[3]);
+    glm::vec3 extent = 0.5f * (glm::abs(glm::vec3(modelMat[0])) + glm::abs(glm::vec3(modelMat[1])) + glm::abs(glm::vec3(modelMat[2])));
+    boxMin = center - extent;
+    boxMax = center + extent;
+}
+
+// Objects tested and culled over the measured frames of a scene
+struct OcclusionStats
+{
+    unsigned long long tested = 0;
+    unsigned long long culled = 0;
+    unsigned long long falseCulls = 0;          // culled but visible, checked with queries by --occlusion-benchmark
+    unsigned long long occluderTriangles = 0;   // OCCLUSION_SOFTWARE: rasterized on the CPU and the time it took
+    double rasterMs = 0.0;
+
+    void Reset()
+    {
+        this->tested = this->culled = this->falseCulls = this->occluderTriangles = 0;
+        this->rasterMs = 0.0;
+    }
+    double CulledPercent() const
+    {
+        return this->tested > 0 ? 100.0 * this->culled / this->tested : 0.0;
+    }
+    double TrianglesPerMs() const
+    {
+        return this->rasterMs > 0.0 ? this->occluderTriangles / this->rasterMs : 0.0;
+    }
+};
+
+class HiZPyramid
+{
+public:
+    static const int READBACK_WIDTH = 128;      // the GPU halves the depth until a level is this wide or narrower
+
+    HiZPyramid() : width(0), height(0), depthTexture(0), depthFBO(0), levelFBO(0), emptyVAO(0), valid(false), shader(NULL)
+    {
+    }
+
+    bool Create(int screenWidth, int screenHeight)
+    {
+        this->width = screenWidth;
+        this->height = screenHeight;
+        glGenTextures(1, &this->depthTexture);
+        glBindTexture(GL_TEXTURE_2D, this->depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, screenWidth, screenHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenFramebuffers(1, &this->depthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, this->depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        //levels on the GPU, halved (rounded down) until the read back width, then the rest down to 1x1 on the CPU
+        glm::ivec2 size(screenWidth, screenHeight);
+        do
+        {
+            size = glm::max(size / 2, glm::ivec2(1));
+            this->gpuSizes.push_back(size);
+        } while (size.x > READBACK_WIDTH);
+        this->levelTextures.resize(this->gpuSizes.size());
+        glGenTextures((GLsizei)this->levelTextures.size(), &this->levelTextures[0]);
+        for (size_t level = 0; level < this->levelTextures.size(); level++)
+        {
+            glBindTexture(GL_TEXTURE_2D, this->levelTextures[level]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, this->gpuSizes[level].x, this->gpuSizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &this->levelFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->levelFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->levelTextures[0], 0);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        this->cpuSizes.push_back(size);
+        while (size.x > 1 || size.y > 1)
+        {
+            size = glm::max(size / 2, glm::ivec2(1));
+            this->cpuSizes.push_back(size);
+        }
+        this->cpuLevels.resize(this->cpuSizes.size());
+        for (size_t level = 0; level < this->cpuLevels.size(); level++)
+            this->cpuLevels[level].resize(this->cpuSizes[level].x * this->cpuSizes[level].y);
+        glGenVertexArrays(1, &this->emptyVAO);
+        this->shader = new Shader("../shaders/hiz.ver", "../shaders/hiz.frag");
+        if (!complete)
+            LOG_ERROR << "ERROR::FRAMEBUFFER::HIZ_PYRAMID_NOT_COMPLETE";
+        return complete;
+    }
+
+    void Delete()
+    {
+        glDeleteFramebuffers(1, &this->depthFBO);
+        glDeleteFramebuffers(1, &this->levelFBO);
+        glDeleteTextures(1, &this->depthTexture);
+        if (!this->levelTextures.empty())
+            glDeleteTextures((GLsizei)this->levelTextures.size(), &this->levelTextures[0]);
+        glDeleteVertexArrays(1, &this->emptyVAO);
+        delete this->shader;
+        this->shader = NULL;
+        this->levelTextures.clear();
+        this->depthFBO = this->levelFBO = this->depthTexture = this->emptyVAO = 0;
+    }
+
+    // Nothing to test against until the next Build (a new scene, a cut of the camera)
+    void Invalidate()
+    {
+        this->valid = false;
+    }
+
+    // After the occluders of a frame: the depth of framebuffer into the pyramid, waits for the GPU. Leaves framebuffer bound
+    // with the full viewport and the state the renderer keeps (depth, stencil and blending on)
+    void Build(unsigned int framebuffer, const glm::mat4& viewProjection)
+    {
+        this->Build(framebuffer, this->width, this->height, viewProjection);
+    }
+
+    // The same for a frame rendered smaller (dynamic resolution): its sourceWidth x sourceHeight corner is stretched over
+    // the pyramid, the viewport left is that corner
+    void Build(unsigned int framebuffer, int sourceWidth, int sourceHeight, const glm::mat4& viewProjection)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->depthFBO);
+        glBlitFramebuffer(0, 0, sourceWidth, sourceHeight, 0, 0, this->width, this->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_STENCIL_TEST);
+        glDisable(GL_BLEND);
+        this->shader->Use();
+        glBindVertexArray(this->emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->levelFBO);
+        unsigned int source = this->depthTexture;
+        for (size_t level = 0; level < this->levelTextures.size(); level++)
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->levelTextures[level], 0);
+            glViewport(0, 0, this->gpuSizes[level].x, this->gpuSizes[level].y);
+            glBindTexture(GL_TEXTURE_2D, source);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            source = this->levelTextures[level];
+        }
+        glReadPixels(0, 0, this->cpuSizes[0].x, this->cpuSizes[0].y, GL_RED, GL_FLOAT, &this->cpuLevels[0][0]);
+        for (size_t level = 1; level < this->cpuLevels.size(); level++)
+            reduce(level);
+        this->viewProjection = viewProjection;
+        this->valid = true;
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, sourceWidth, sourceHeight);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_STENCIL_TEST);
+        glEnable(GL_BLEND);
+    }
+
+    // True when the whole box is behind the depth of the last Build. Boxes crossing the near plane or the edges of
+    // that frame's view are never occluded, nothing is known about them
+    bool Occluded(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        if (!this->valid)
+            return false;
+        glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+        float nearestDepth = 1.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 clip = this->viewProjection * glm::vec4(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y,
+                corner & 4 ? boxMax.z : boxMin.z, 1.0f);
+            if (clip.w <= 1e-4f)
+                return false;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+            ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+            nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+        }
+        if (ndcMin.x < -1.0f || ndcMin.y < -1.0f || ndcMax.x > 1.0f || ndcMax.y > 1.0f)
+            return false;
+        //screen pixels to texels of the read back level the way the GPU levels folded them, then up the CPU levels
+        //until the rectangle is 2x2 texels at most
+        const int shift = (int)this->gpuSizes.size();
+        glm::ivec2 texelMin = glm::min(toPixel(ndcMin) >> shift, this->cpuSizes[0] - 1);
+        glm::ivec2 texelMax = glm::min(toPixel(ndcMax) >> shift, this->cpuSizes[0] - 1);
+        size_t level = 0;
+        while (level + 1 < this->cpuLevels.size() && (texelMax.x - texelMin.x > 1 || texelMax.y - texelMin.y > 1))
+        {
+            level++;
+            texelMin = glm::min(texelMin >> 1, this->cpuSizes[level] - 1);
+            texelMax = glm::min(texelMax >> 1, this->cpuSizes[level] - 1);
+        }
+        const std::vector<float>& texels = this->cpuLevels[level];
+        float farthestDepth = 0.0f;
+        for (int y = texelMin.y; y <= texelMax.y; y++)
+            for (int x = texelMin.x; x <= texelMax.x; x++)
+                farthestDepth = std::max(farthestDepth, texels[y * this->cpuSizes[level].x + x]);
+        return nearestDepth > farthestDepth;
+    }
+
+private:
+    int width, height;
+    unsigned int depthTexture;
+    unsigned int depthFBO;
+    unsigned int levelFBO;
+    unsigned int emptyVAO;
+    std::vector<unsigned int> levelTextures;
+    std::vector<glm::ivec2> gpuSizes;
+    std::vector<glm::ivec2> cpuSizes;           // the first one is the read back level
+    std::vector<std::vector<float> > cpuLevels;
+    bool valid;
+    glm::mat4 viewProjection;                   // of the frame the levels come from
+    Shader* shader;
+
+    glm::ivec2 toPixel(const glm::vec2& ndc) const
+    {
+        glm::ivec2 pixel = glm::ivec2((ndc * 0.5f + 0.5f) * glm::vec2((float)this->width, (float)this->height));
+        return glm::clamp(pixel, glm::ivec2(0), glm::ivec2(this->width - 1, this->height - 1));
+    }
+
+    // Same folding as hiz.frag: the last texel of an odd row or column takes three
+    void reduce(size_t level)
+    {
+        const glm::ivec2 source = this->cpuSizes[level - 1];
+        const glm::ivec2 size = this->cpuSizes[level];
+        const std::vector<float>& above = this->cpuLevels[level - 1];
+        std::vector<float>& texels = this->cpuLevels[level];
+        for (int y = 0; y < size.y; y++)
+            for (int x = 0; x < size.x; x++)
+            {
+                int lastX = std::min(2 * x + 1, source.x - 1), lastY = std::min(2 * y + 1, source.y - 1);
+                if (2 * x + 3 == source.x)
+                    lastX = source.x - 1;
+                if (2 * y + 3 == source.y)
+                    lastY = source.y - 1;
+                float depth = 0.0f;
+                for (int sy = 2 * y; sy <= lastY; sy++)
+                    for (int sx = 2 * x; sx <= lastX; sx++)
+                        depth = std::max(depth, above[sy * source.x + sx]);
+                texels[y * size.x + x] = depth;
+            }
+    }
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef OUTLINE_H
+#define OUTLINE_H
+
+// Outlines of the objects marked in the stencil buffer of the frame.
+//   OUTLINE_STENCIL - every object is drawn a second time, scaled up a little, where the stencil does not mark it
+//   OUTLINE_SCREEN  - ScreenSpaceOutline: the marked pixels become seeds and a full screen pass draws the outline
+//                     around all of them, whatever their number
+// Up to DIRECT_WIDTH pixels the nearest seed is searched for along the rows and then along the columns, wider outlines
+// spread it over the frame by jump flooding (Rong & Tan), a pass per power of two up to the width. The passes only
+// cover the rectangle of the frame around the outlined objects (OutlineBounds).
+
+#include <cmath>
+#include <climits>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Log.h"
+
+enum OutlineMode
+{
+    OUTLINE_STENCIL,
+    OUTLINE_SCREEN,
+    OUTLINE_MODE_COUNT
+};
+
+inline const char* outlineModeName(int mode)
+{
+    static const char* names[OUTLINE_MODE_COUNT] = { "stencil", "screen" };
+    return mode >= 0 && mode < OUTLINE_MODE_COUNT ? names[mode] : "?";
+}
+
+// Pixels of a frame covered by the bounding boxes of the outlined objects
+struct OutlineBounds
+{
+    glm::ivec2 min = glm::ivec2(INT_MAX);
+    glm::ivec2 max = glm::ivec2(INT_MIN);       // exclusive
+
+    // A box reaching behind the camera covers all of the frame
+    void Add(const glm::mat4& viewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax, int frameWidth, int frameHeight)
+    {
+        glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y,
+                corner & 4 ? boxMax.z : boxMin.z, 1.0f);
+            if (clip.w <= 1e-4f)
+            {
+                ndcMin = glm::vec2(-1.0f);
+                ndcMax = glm::vec2(1.0f);
+                break;
+            }
+            ndcMin = glm::min(ndcMin, glm::vec2(clip) / clip.w);
+            ndcMax = glm::max(ndcMax, glm::vec2(clip) / clip.w);
+        }
+        const glm::vec2 size((float)frameWidth, (float)frameHeight);
+        this->min = glm::min(this->min, glm::ivec2(glm::floor((glm::clamp(ndcMin, -1.0f, 1.0f) * 0.5f + 0.5f) * size)));
+        this->max = glm::max(this->max, glm::ivec2(glm::ceil((glm::clamp(ndcMax, -1.0f, 1.0f) * 0.5f + 0.5f) * size)));
+    }
+
+    bool Empty() const
+    {
+        return this->max.x <= this->min.x || this->max.y <= this->min.y;
+    }
+};
+
+class ScreenSpaceOutline
+{
+public:
+    static const int DIRECT_WIDTH = 3;
+
+    ScreenSpaceOutline() : depthStencil(0), emptyVAO(0), seedShader(NULL), rowsShader(NULL), floodShader(NULL), outlineShader(NULL),
+        jumpFloodFeature(0)
+    {
+        this->seedFBOs[0] = this->seedFBOs[1] = this->seeds[0] = this->seeds[1] = 0;
+    }
+
+    // width x height is the largest frame. Can be called in the middle of a frame, the texture bound before is bound again
+    bool Create(int width, int height)
+    {
+        GLint boundTexture = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+        glGenTextures(2, this->seeds);
+        glGenFramebuffers(2, this->seedFBOs);
+        bool complete = true;
+        for (int i = 0; i < 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, this->seeds[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16I, width, height, 0, GL_RG_INTEGER, GL_SHORT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, this->seedFBOs[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->seeds[i], 0);
+            //the first one takes a copy of the frame's stencil, the seeds are drawn where it marks an object
+            if (i == 0)
+            {
+                glGenRenderbuffers(1, &this->depthStencil);
+                glBindRenderbuffer(GL_RENDERBUFFER, this->depthStencil);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+                glBindRenderbuffer(GL_RENDERBUFFER, 0);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthStencil);
+            }
+            complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, boundTexture);
+        glGenVertexArrays(1, &this->emptyVAO);
+        this->seedShader = new Shader("../shaders/postprocess.ver", "../shaders/outline_seed.frag");
+        this->rowsShader = new Shader("../shaders/postprocess.ver", "../shaders/outline_rows.frag");
+        this->floodShader = new Shader("../shaders/postprocess.ver", "../shaders/outline_flood.frag");
+        this->outlineShader = new Shader("../shaders/postprocess.ver", "../shaders/outline_screen.frag", { "JUMP_FLOOD" });
+        this->jumpFloodFeature = this->outlineShader->Feature("JUMP_FLOOD");
+        this->outlineShader->Prepare(this->jumpFloodFeature);
+        if (!complete)
+            LOG_ERROR << "ERROR::FRAMEBUFFER::OUTLINE_TARGET_NOT_COMPLETE";
+        return complete;
+    }
+
+    void Delete()
+    {
+        glDeleteFramebuffers(2, this->seedFBOs);
+        glDeleteTextures(2, this->seeds);
+        glDeleteRenderbuffers(1, &this->depthStencil);
+        glDeleteVertexArrays(1, &this->emptyVAO);
+        delete this->seedShader;
+        delete this->rowsShader;
+        delete this->floodShader;
+        delete this->outlineShader;
+        this->seedShader = this->rowsShader = this->floodShader = this->outlineShader = NULL;
+        this->seedFBOs[0] = this->seedFBOs[1] = this->seeds[0] = this->seeds[1] = this->depthStencil = this->emptyVAO = 0;
+    }
+
+    // Outlines what the stencil of framebuffer marks with stencilRef, in its frameWidth x frameHeight corner. The marks
+    // have to be within bounds. Leaves framebuffer bound with that viewport and the state the renderer keeps (depth,
+    // stencil and blending on, the stencil test passing everything)
+    void Draw(unsigned int framebuffer, int frameWidth, int frameHeight, const OutlineBounds& bounds, int stencilRef, const glm::vec3& color,
+        float outlineWidth)
+    {
+        static const GLint noSeed[4] = { -1, -1, -1, -1 };
+        const int radius = (int)std::ceil(outlineWidth);
+        const glm::ivec2 rectMin = glm::max(bounds.min - radius - 1, glm::ivec2(0));
+        const glm::ivec2 rectMax = glm::min(bounds.max + radius + 1, glm::ivec2(frameWidth, frameHeight));
+        if (bounds.Empty() || rectMax.x <= rectMin.x || rectMax.y <= rectMin.y)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, frameWidth, frameHeight);
+            return;
+        }
+        //the passes read around the rectangle, the seeds outside it have to be empty
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->seedFBOs[0]);
+        glBlitFramebuffer(rectMin.x, rectMin.y, rectMax.x, rectMax.y, rectMin.x, rectMin.y, rectMax.x, rectMax.y, GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->seedFBOs[1]);
+        glClearBufferiv(GL_COLOR, 0, noSeed);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->seedFBOs[0]);
+        glClearBufferiv(GL_COLOR, 0, noSeed);
+        glViewport(0, 0, frameWidth, frameHeight);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(rectMin.x, rectMin.y, rectMax.x - rectMin.x, rectMax.y - rectMin.y);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glStencilFunc(GL_EQUAL, stencilRef, 0xFF);
+        glBindVertexArray(this->emptyVAO);
+        this->seedShader->Use();
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+
+        glActiveTexture(GL_TEXTURE0);
+        const bool jumpFlood = outlineWidth > DIRECT_WIDTH;
+        int source = 0;
+        if (jumpFlood)
+        {
+            //steps from the largest power of two within the width down to 1 reach every pixel up to twice as far
+            this->floodShader->Use();
+            this->floodShader->setVec2("frameSize", (float)frameWidth, (float)frameHeight);
+            for (int step = 1 << (int)std::floor(std::log2(outlineWidth)); step >= 1; step /= 2)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, this->seedFBOs[1 - source]);
+                glBindTexture(GL_TEXTURE_2D, this->seeds[source]);
+                this->floodShader->setInt("stepSize", step);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                source = 1 - source;
+            }
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, this->seedFBOs[1]);
+            glBindTexture(GL_TEXTURE_2D, this->seeds[0]);
+            this->rowsShader->Use();
+            this->rowsShader->setVec2("frameSize", (float)frameWidth, (float)frameHeight);
+            this->rowsShader->setInt("radius", radius);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            source = 1;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glEnable(GL_BLEND);
+        glStencilFunc(GL_NOTEQUAL, stencilRef, 0xFF);
+        glBindTexture(GL_TEXTURE_2D, this->seeds[source]);
+        this->outlineShader->Use(jumpFlood ? this->jumpFloodFeature : 0);
+        this->outlineShader->setVec2("frameSize", (float)frameWidth, (float)frameHeight);
+        this->outlineShader->setVec3("outlineColor", color);
+        this->outlineShader->setFloat("outlineWidth", outlineWidth);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+
+        glDisable(GL_SCISSOR_TEST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+private:
+    GLuint seeds[2];            // 0 holds the seeds, 1 the nearest ones of the rows, or both ping-pong in the jump flooding
+    GLuint seedFBOs[2];
+    GLuint depthStencil;
+    GLuint emptyVAO;
+    Shader* seedShader;
+    Shader* rowsShader;
+    Shader* floodShader;
+    Shader* outlineShader;
+    unsigned int jumpFloodFeature;
+};
+
+#endif
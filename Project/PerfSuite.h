@@ -0,0 +1,292 @@
+#ifndef PERF_SUITE_H
+#define PERF_SUITE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <ctime>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+#include "GoldenImage.h"
+#include "Log.h"
+
+// Performance regression suite: every scene of the suite is rendered headless, its metrics are
+// compared against checked-in baselines and its last frame against a golden image.
+//
+// Baselines are a text file, one "key value" pair per line:
+//   renderer <GL_RENDERER the baselines were recorded on>
+//   settings <resolution, frame counts and time step of the recording>
+//   tolerance <metric> <allowed relative increase, e.g. 0.25>
+//   <scene>.<metric> <value>
+// Only increases count as regressions, improvements always pass. Timings, memory, shaded fragments
+// and golden images are only compared when renderer and settings match the ones of the baselines,
+// the draw and state counters on any renderer with the same settings (culling depends on the
+// resolution). A --suite run without settings of its own records with the ones of the baselines.
+
+struct PerfSceneResult
+{
+    std::string scene;
+    std::string skipReason;             // non-empty when the scene could not run
+    std::map<std::string, double> metrics;
+    ImageDiff image;
+    std::string imagePath;              // where the last frame was written
+};
+
+struct PerfCheck
+{
+    std::string scene;
+    std::string metric;
+    double value;
+    double baseline;
+    double limit;
+    std::string status;                 // pass, fail, missing_baseline or skipped_environment
+};
+
+// The settings line of the baselines
+inline std::string perfSuiteSettings(int width, int height, int frames, int warmupFrames, float timeStep, float simulationStep)
+{
+    std::ostringstream settings;
+    settings << std::setprecision(9);      // the steps read back to the same floats
+    settings << width << "x" << height << " frames " << frames << " warmup " << warmupFrames << " step " << timeStep << " sim " << simulationStep;
+    return settings.str();
+}
+
+// Reads a settings line written by perfSuiteSettings, the values stay untouched when it is malformed
+inline bool parsePerfSuiteSettings(const std::string& line, int& width, int& height, int& frames, int& warmupFrames, float& timeStep,
+    float& simulationStep)
+{
+    std::istringstream in(line);
+    int w, h, f, warmup;
+    float step, sim;
+    char x;
+    std::string framesKey, warmupKey, stepKey, simKey;
+    if (!(in >> w >> x >> h >> framesKey >> f >> warmupKey >> warmup >> stepKey >> step >> simKey >> sim) || x != 'x'
+        || framesKey != "frames" || warmupKey != "warmup" || stepKey != "step" || simKey != "sim")
+        return false;
+    width = w;
+    height = h;
+    frames = f;
+    warmupFrames = warmup;
+    timeStep = step;
+    simulationStep = sim;
+    return true;
+}
+
+inline bool isTimingMetric(const std::string& metric)
+{
+    return metric.find("_ms") != std::string::npos;
+}
+
+// Metrics which change with the renderer, the resolution or the host: timings, the resident memory of the
+// process, the size of the render targets and the fragments they shade
+inline bool isEnvironmentMetric(const std::string& metric)
+{
+    return isTimingMetric(metric) || metric == "memory_mb" || metric == "gpu_memory_mb" || metric == "shaded_fragments";
+}
+
+class PerfBaselines
+{
+public:
+    std::string Renderer;
+    std::string Settings;
+    std::map<std::string, double> Values;       // "<scene>.<metric>"
+    std::map<std::string, double> Tolerances;   // "<metric>"
+
+    PerfBaselines()
+    {
+        this->Tolerances["frame_ms_p50"] = 0.20;
+        this->Tolerances["frame_ms_p95"] = 0.30;
+        this->Tolerances["frame_ms_p99"] = 0.50;
+        this->Tolerances["gpu_frame_ms_p50"] = 0.20;
+        this->Tolerances["draw_calls"] = 0.0;
+        this->Tolerances["state_changes"] = 0.0;
+        this->Tolerances["uniform_uploads"] = 0.0;
+        this->Tolerances["memory_mb"] = 0.10;
+        this->Tolerances["gpu_memory_mb"] = 0.05;
+        this->Tolerances["shaded_fragments"] = 0.01;
+        this->Tolerances["image_mismatch"] = 0.001;     // absolute share of differing pixels
+    }
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream in(line);
+            std::string key;
+            in >> key;
+            if (key == "renderer" || key == "settings")
+            {
+                std::getline(in >> std::ws, key == "renderer" ? this->Renderer : this->Settings);
+                continue;
+            }
+            std::string metric;
+            double value;
+            if (key == "tolerance" && in >> metric >> value)
+                this->Tolerances[metric] = value;
+            else if (in >> value)
+                this->Values[key] = value;
+            else
+                LOG_ERROR << "ERROR::PERF_SUITE::BAD_BASELINE_LINE: " << line;
+        }
+        return true;
+    }
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        file << "# Performance baselines, regenerate with --suite --update-baselines\n";
+        file << "renderer " << this->Renderer << "\n";
+        file << "settings " << this->Settings << "\n";
+        for (std::map<std::string, double>::const_iterator it = this->Tolerances.begin(); it != this->Tolerances.end(); ++it)
+            file << "tolerance " << it->first << " " << it->second << "\n";
+        file << std::fixed << std::setprecision(4);
+        for (std::map<std::string, double>::const_iterator it = this->Values.begin(); it != this->Values.end(); ++it)
+            file << it->first << " " << it->second << "\n";
+        return true;
+    }
+
+    double Tolerance(const std::string& metric) const
+    {
+        std::map<std::string, double>::const_iterator it = this->Tolerances.find(metric);
+        return it == this->Tolerances.end() ? 0.0 : it->second;
+    }
+};
+
+inline std::vector<PerfCheck> checkAgainstBaselines(const std::vector<PerfSceneResult>& results, const PerfBaselines& baselines,
+    const std::string& renderer, const std::string& settings)
+{
+    std::vector<PerfCheck> checks;
+    const bool sameSettings = settings == baselines.Settings;
+    const bool sameEnvironment = sameSettings && renderer == baselines.Renderer;
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        const PerfSceneResult& result = results[r];
+        if (!result.skipReason.empty())
+            continue;
+        for (std::map<std::string, double>::const_iterator it = result.metrics.begin(); it != result.metrics.end(); ++it)
+        {
+            PerfCheck check;
+            check.scene = result.scene;
+            check.metric = it->first;
+            check.value = it->second;
+            check.baseline = 0.0;
+            check.limit = 0.0;
+            std::map<std::string, double>::const_iterator b = baselines.Values.find(result.scene + "." + it->first);
+            if (b == baselines.Values.end())
+                check.status = "missing_baseline";
+            else
+            {
+                check.baseline = b->second;
+                check.limit = b->second * (1.0 + baselines.Tolerance(it->first));
+                if (!sameSettings || (isEnvironmentMetric(it->first) && !sameEnvironment))
+                    check.status = "skipped_environment";
+                else
+                    check.status = check.value <= check.limit ? "pass" : "fail";
+            }
+            checks.push_back(check);
+        }
+
+        PerfCheck image;
+        image.scene = result.scene;
+        image.metric = "image_mismatch";
+        image.value = result.image.mismatchedRatio;
+        image.baseline = 0.0;
+        image.limit = baselines.Tolerance("image_mismatch");
+        if (!sameEnvironment)
+            image.status = "skipped_environment";      // another size or rasterizer, the golden image does not apply
+        else if (!result.image.compared)
+            image.status = "missing_baseline";
+        else
+            image.status = image.value <= image.limit ? "pass" : "fail";
+        checks.push_back(image);
+    }
+    return checks;
+}
+
+// Missing baselines fail as well, a scene which is not covered is not being watched
+inline bool perfChecksPassed(const std::vector<PerfCheck>& checks)
+{
+    for (size_t i = 0; i < checks.size(); i++)
+        if (checks[i].status == "fail" || checks[i].status == "missing_baseline")
+            return false;
+    return true;
+}
+
+inline bool writePerfReport(const std::string& path, const std::vector<PerfSceneResult>& results, const std::vector<PerfCheck>& checks,
+    const std::string& renderer, bool passed)
+{
+    std::ofstream file(path.c_str());
+    if (!file.is_open())
+        return false;
+    file << std::fixed << std::setprecision(4);
+    file << "{\n  \"timestamp\": " << (long long)std::time(NULL) << ",\n  \"renderer\": \"" << renderer << "\",\n  \"passed\": "
+        << (passed ? "true" : "false") << ",\n  \"scenes\": {";
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        const PerfSceneResult& result = results[r];
+        file << (r ? "," : "") << "\n    \"" << result.scene << "\": {";
+        if (!result.skipReason.empty())
+        {
+            file << "\"skipped\": \"" << result.skipReason << "\"}";
+            continue;
+        }
+        file << "\n      \"metrics\": {";
+        bool first = true;
+        for (size_t c = 0; c < checks.size(); c++)
+        {
+            const PerfCheck& check = checks[c];
+            if (check.scene != result.scene)
+                continue;
+            file << (first ? "" : ",") << "\n        \"" << check.metric << "\": {\"value\": " << check.value << ", \"baseline\": " << check.baseline
+                << ", \"limit\": " << check.limit << ", \"status\": \"" << check.status << "\"}";
+            first = false;
+        }
+        file << "\n      },\n      \"image\": {\"compared\": " << (result.image.compared ? "true" : "false") << ", \"max_difference\": "
+            << result.image.maxDifference << ", \"mean_difference\": " << result.image.meanDifference << ", \"path\": \"" << result.imagePath << "\"}\n    }";
+    }
+    file << "\n  }\n}\n";
+    return true;
+}
+
+// Resident memory of the whole process in megabytes
+inline double processMemoryMb()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize / (1024.0 * 1024.0);
+    return 0.0;
+#else
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return std::atof(line.c_str() + 6) / 1024.0;
+    return 0.0;
+#endif
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef PICKING_H
+#define PICKING_H
+
+// Picking on the CPU: a ray from the cursor through the projection and the view, first into a BVH over the world bounds
+// of the objects, then in the space of every object it enters into the triangle BVH of its mesh (Bvh.h)
+//   picker.Add(&mesh.TriangleBvh, modelMat);       // once per object, then picker.Build()
+//   picker.Move(object, modelMat);                 // objects which moved, then picker.Refit()
+//   cursorRay(x, y, width, height, projectionMat, viewMat, origin, direction);
+//   if (picker.Pick(origin, direction, hit)) the object, its triangle and where on it
+// A pick allocates nothing, the meshes are not copied and have to outlive the picker.
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+#include "CpuProfiler.h"
+
+// Ray through the pixel (x, y) of a window of width x height pixels (the origin is the top left, like the cursor), starting
+// on the near plane. The direction has unit length
+inline void cursorRay(double x, double y, int width, int height, const glm::mat4& projectionMat, const glm::mat4& viewMat,
+    glm::vec3& origin, glm::vec3& direction)
+{
+    const float ndcX = (float)(2.0 * x / width - 1.0), ndcY = (float)(1.0 - 2.0 * y / height);
+    const glm::mat4 inverseViewProjection = glm::inverse(projectionMat * viewMat);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
+
+// The object hit (index of Add), its triangle (index into the index list / 3), the barycentric coordinates of the second
+// and third corner, the distance along the ray and the point in world space
+struct PickHit
+{
+    unsigned int object;
+    unsigned int triangle;
+    float u, v;
+    float t;
+    glm::vec3 position;
+};
+
+class ObjectPicker
+{
+public:
+    void Clear()
+    {
+        this->objects.clear();
+        this->bounds.clear();
+        this->tree = Bvh();
+    }
+
+    unsigned int Add(const MeshBvh* mesh, const glm::mat4& modelMat)
+    {
+        Object object;
+        object.mesh = mesh;
+        this->objects.push_back(object);
+        this->bounds.push_back(Aabb());
+        this->Move((unsigned int)this->objects.size() - 1, modelMat);
+        return (unsigned int)this->objects.size() - 1;
+    }
+
+    // New transform of an object, the hierarchy sees it after Refit (or Build)
+    void Move(unsigned int object, const glm::mat4& modelMat)
+    {
+        Object& moved = this->objects[object];
+        moved.inverseModelMat = glm::inverse(modelMat);
+        const std::vector<BvhNode>& nodes = moved.mesh->Tree().Nodes;
+        this->bounds[object] = nodes.empty() ? Aabb() : transformBounds(modelMat, nodes[0].boundsMin, nodes[0].boundsMax);
+    }
+
+    void Build(JobSystem& jobs = JobSystem::Instance())
+    {
+        this->tree.Build(this->bounds, jobs);
+    }
+
+    void Refit()
+    {
+        this->tree.Refit(this->bounds);
+    }
+
+    size_t Objects() const
+    {
+        return this->objects.size();
+    }
+
+    // Closest hit of the ray with any object. The ray goes into object space with the direction unnormalized, so the
+    // distances of every object stay the ones along the world space ray
+    bool Pick(const glm::vec3& origin, const glm::vec3& direction, PickHit& hit) const
+    {
+        PROFILE_SCOPE("pick");
+        bool found = false;
+        float tMax = 1e30f;
+        const std::vector<Object>& objects = this->objects;
+        this->tree.Raycast(origin, direction, tMax, [&](unsigned int object, float& closest) {
+            const Object& candidate = objects[object];
+            const glm::vec3 localOrigin = glm::vec3(candidate.inverseModelMat * glm::vec4(origin, 1.0f));
+            const glm::vec3 localDirection = glm::vec3(candidate.inverseModelMat * glm::vec4(direction, 0.0f));
+            RayHit meshHit;
+            if (!candidate.mesh->Raycast(localOrigin, localDirection, closest, meshHit))
+                return;
+            closest = meshHit.t;
+            hit.object = object;
+            hit.triangle = meshHit.triangle;
+            hit.u = meshHit.u;
+            hit.v = meshHit.v;
+            hit.t = meshHit.t;
+            found = true;
+        });
+        if (found)
+            hit.position = origin + hit.t * direction;
+        return found;
+    }
+
+private:
+    struct Object
+    {
+        const MeshBvh* mesh;
+        glm::mat4 inverseModelMat;
+    };
+
+    std::vector<Object> objects;
+    std::vector<Aabb> bounds;       // world space, per object
+    Bvh tree;
+};
+
+#endif
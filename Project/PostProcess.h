@@ -0,0 +1,273 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+// Post-processing: the scene is rendered into SceneFBO (half float, so emission brighter than 1 survives) and Apply runs
+// the chain into the window or another framebuffer:
+//   bloom down  - the first level of the pyramid (half size) fuses the bright pass into its 13 tap downsample, every
+//                 further level halves the one above
+//   bloom up    - back up the pyramid, each level blurred with a tent and added onto the one above by blending
+//   composite   - scene + bloom, tone mapping, and the stretch of a frame rendered smaller (dynamic resolution) in one pass
+//   sharpen     - needs the neighbours of the composited image, so composite goes into the intermediate target first
+// Every stage is timed by the GPU profiler under its name. The settings are read every frame, anything can be switched
+// at runtime; with nothing enabled the scene should be rendered straight into the output instead.
+
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "GpuProfiler.h"
+#include "Log.h"
+
+struct PostProcessSettings
+{
+    bool bloom = false;
+    float bloomThreshold = 1.0f;        // brightness where the bloom starts, the scene is not clamped before
+    float bloomKnee = 0.5f;             // soft transition below the threshold
+    float bloomIntensity = 0.6f;
+    int bloomLevels = 5;                // at most PostProcessChain::MAX_BLOOM_LEVELS
+    bool toneMapping = false;
+    float exposure = 1.0f;
+    bool sharpen = false;
+    float sharpness = 0.5f;
+
+    bool Enabled() const
+    {
+        return this->bloom || this->toneMapping || this->sharpen;
+    }
+};
+
+class PostProcessChain
+{
+public:
+    static const int MAX_BLOOM_LEVELS = 6;
+
+    GLuint SceneFBO = 0;
+
+    PostProcessChain() : sceneDepthStencil(0), bloomLevelCount(0), emptyVAO(0), downsample(NULL), upsample(NULL), composite(NULL),
+        sharpen(NULL), brightPassFeature(0), bloomFeature(0), toneMappingFeature(0)
+    {
+    }
+
+    // width x height is the output and the largest frame. Can be called in the middle of a frame, the texture bound
+    // before is bound again
+    bool Create(int width, int height)
+    {
+        GLint boundTexture = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+        bool complete = createTarget(this->scene, width, height, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+        glGenRenderbuffers(1, &this->sceneDepthStencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->sceneDepthStencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->scene.fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->sceneDepthStencil);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        this->SceneFBO = this->scene.fbo;
+        complete = createTarget(this->intermediate, width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE) && complete;
+        //half size and below, a level smaller than 2 texels would only smear the whole screen
+        int levelWidth = width / 2, levelHeight = height / 2;
+        this->bloomLevelCount = 0;
+        while (this->bloomLevelCount < MAX_BLOOM_LEVELS && levelWidth >= 2 && levelHeight >= 2)
+        {
+            complete = createTarget(this->bloomLevels[this->bloomLevelCount++], levelWidth, levelHeight, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT) && complete;
+            levelWidth /= 2;
+            levelHeight /= 2;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, boundTexture);
+        glGenVertexArrays(1, &this->emptyVAO);
+
+        this->downsample = new Shader("../shaders/postprocess.ver", "../shaders/bloom_down.frag", { "BRIGHT_PASS" });
+        this->upsample = new Shader("../shaders/postprocess.ver", "../shaders/bloom_up.frag");
+        this->composite = new Shader("../shaders/postprocess.ver", "../shaders/composite.frag", { "BLOOM", "TONE_MAPPING" });
+        this->sharpen = new Shader("../shaders/postprocess.ver", "../shaders/sharpen.frag");
+        this->brightPassFeature = this->downsample->Feature("BRIGHT_PASS");
+        this->bloomFeature = this->composite->Feature("BLOOM");
+        this->toneMappingFeature = this->composite->Feature("TONE_MAPPING");
+        this->downsample->Prepare(this->brightPassFeature);
+        for (unsigned int mask = 1; mask <= (this->bloomFeature | this->toneMappingFeature); mask++)
+            this->composite->Prepare(mask);
+        this->composite->Use();
+        this->composite->setSampler("scene", 0);
+        this->composite->setSampler("bloom", 1);
+        glUseProgram(0);
+        if (!complete)
+            LOG_ERROR << "ERROR::FRAMEBUFFER::POST_PROCESS_TARGET_NOT_COMPLETE";
+        return complete;
+    }
+
+    void Delete()
+    {
+        deleteTarget(this->scene);
+        deleteTarget(this->intermediate);
+        for (int level = 0; level < this->bloomLevelCount; level++)
+            deleteTarget(this->bloomLevels[level]);
+        glDeleteRenderbuffers(1, &this->sceneDepthStencil);
+        glDeleteVertexArrays(1, &this->emptyVAO);
+        delete this->downsample;
+        delete this->upsample;
+        delete this->composite;
+        delete this->sharpen;
+        this->downsample = this->upsample = this->composite = this->sharpen = NULL;
+        this->SceneFBO = this->sceneDepthStencil = this->emptyVAO = 0;
+        this->bloomLevelCount = 0;
+    }
+
+    bool Created() const
+    {
+        return this->SceneFBO != 0;
+    }
+    int BloomLevels() const
+    {
+        return this->bloomLevelCount;
+    }
+
+    // The sourceWidth x sourceHeight corner of SceneFBO through the chain into the whole of framebuffer (outputWidth x
+    // outputHeight, the size of Create). Leaves framebuffer bound with its viewport and the state the renderer keeps
+    // (depth, stencil and blending on)
+    void Apply(const PostProcessSettings& settings, int sourceWidth, int sourceHeight, unsigned int framebuffer, int outputWidth,
+        int outputHeight, GpuProfiler& profiler)
+    {
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_STENCIL_TEST);
+        glDisable(GL_BLEND);
+        glBindVertexArray(this->emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+        const glm::vec2 uvScale((float)sourceWidth / this->scene.width, (float)sourceHeight / this->scene.height);
+
+        const int levels = settings.bloom ? std::min(settings.bloomLevels, this->bloomLevelCount) : 0;
+        if (levels > 0)
+        {
+            {
+                GPU_SCOPE(profiler, "bloom down");
+                const Target* source = &this->scene;
+                for (int level = 0; level < levels; level++)
+                {
+                    this->downsample->Use(level == 0 ? this->brightPassFeature : 0);
+                    this->downsample->setVec2("texelSize", 1.0f / source->width, 1.0f / source->height);
+                    this->downsample->setVec2("uvScale", level == 0 ? uvScale : glm::vec2(1.0f));
+                    if (level == 0)
+                    {
+                        this->downsample->setFloat("threshold", settings.bloomThreshold);
+                        this->downsample->setFloat("knee", std::max(settings.bloomKnee, 1e-4f));
+                    }
+                    draw(this->bloomLevels[level], source->texture);
+                    source = &this->bloomLevels[level];
+                }
+            }
+            {
+                GPU_SCOPE(profiler, "bloom up");
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                this->upsample->Use();
+                this->upsample->setFloat("radius", 1.0f);
+                for (int level = levels - 1; level > 0; level--)
+                {
+                    this->upsample->setVec2("texelSize", 1.0f / this->bloomLevels[level].width, 1.0f / this->bloomLevels[level].height);
+                    draw(this->bloomLevels[level - 1], this->bloomLevels[level].texture);
+                }
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glDisable(GL_BLEND);
+            }
+        }
+
+        {
+            GPU_SCOPE(profiler, "composite");
+            this->composite->Use((levels > 0 ? this->bloomFeature : 0) | (settings.toneMapping ? this->toneMappingFeature : 0));
+            this->composite->setVec2("uvScale", uvScale);
+            this->composite->setFloat("bloomIntensity", settings.bloomIntensity);
+            this->composite->setFloat("exposure", settings.exposure);
+            if (levels > 0)
+            {
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, this->bloomLevels[0].texture);
+                glActiveTexture(GL_TEXTURE0);
+            }
+            if (settings.sharpen)
+                draw(this->intermediate, this->scene.texture);
+            else
+                draw(framebuffer, outputWidth, outputHeight, this->scene.texture);
+        }
+
+        if (settings.sharpen)
+        {
+            GPU_SCOPE(profiler, "sharpen");
+            this->sharpen->Use();
+            this->sharpen->setVec2("texelSize", 1.0f / this->intermediate.width, 1.0f / this->intermediate.height);
+            this->sharpen->setFloat("sharpness", settings.sharpness);
+            draw(framebuffer, outputWidth, outputHeight, this->intermediate.texture);
+        }
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_STENCIL_TEST);
+        glEnable(GL_BLEND);
+    }
+
+private:
+    struct Target
+    {
+        GLuint fbo = 0;
+        GLuint texture = 0;
+        int width = 0, height = 0;
+    };
+
+    Target scene;
+    GLuint sceneDepthStencil;
+    Target intermediate;                        // composite -> sharpen
+    Target bloomLevels[MAX_BLOOM_LEVELS];       // 0 is half size
+    int bloomLevelCount;
+    GLuint emptyVAO;
+    Shader* downsample;
+    Shader* upsample;
+    Shader* composite;
+    Shader* sharpen;
+    unsigned int brightPassFeature;
+    unsigned int bloomFeature;
+    unsigned int toneMappingFeature;
+
+    static bool createTarget(Target& target, int width, int height, GLint internalFormat, GLenum format, GLenum type)
+    {
+        target.width = width;
+        target.height = height;
+        glGenTextures(1, &target.texture);
+        glBindTexture(GL_TEXTURE_2D, target.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenFramebuffers(1, &target.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    static void deleteTarget(Target& target)
+    {
+        glDeleteFramebuffers(1, &target.fbo);
+        glDeleteTextures(1, &target.texture);
+        target = Target();
+    }
+
+    // Full screen pass of the current shader reading texture from unit 0
+    static void draw(GLuint framebuffer, int width, int height, GLuint texture)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    static void draw(const Target& target, GLuint texture)
+    {
+        draw(target.fbo, target.width, target.height, texture);
+    }
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef REFLECTION_PROBE_H
+#define REFLECTION_PROBE_H
+
+// Cubemap of the scene around a point, rendered at run time for reflecting and refracting surfaces. All six faces
+// every frame would be six more scene passes, so the updates are amortized: only stale faces are rendered, at most
+// FacesPerFrame of them in a frame, and the cubemap is small. In PROBE_UPDATE_ALWAYS mode every face turns stale
+// again once all are current (one face per frame refreshes the probe every six frames), in PROBE_UPDATE_ON_MOTION
+// mode only after Invalidate, when something near the probe moved. The first capture after Reset renders all faces.
+//   int faces[6];
+//   int count = probe.BeginUpdate(faces);
+//   for (int i = 0; i < count; i++) { probe.BindFace(faces[i]); draw with probe.FaceView(faces[i]), ReflectionProbe::Projection() }
+//   probe.EndUpdate(sceneFBO, width, height);
+// With prefiltering the mipmaps are rebuilt each time all six faces have been rendered again, so distant mirrors
+// sample a filtered probe instead of shimmering.
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Log.h"
+
+enum ProbeUpdateMode
+{
+    PROBE_UPDATE_ALWAYS,
+    PROBE_UPDATE_ON_MOTION
+};
+
+class ReflectionProbe
+{
+public:
+    glm::vec3 Position = glm::vec3(0.0f);
+    int FacesPerFrame = 1;
+    ProbeUpdateMode UpdateMode = PROBE_UPDATE_ALWAYS;
+
+    ReflectionProbe() : size(0), prefilter(false), texture(0), FBO(0), depthStencil(0), staleFaces(0), nextFace(0), captureAll(false),
+        updatedFaces(0), facesSinceMipmaps(0)
+    {
+    }
+
+    bool Create(int faceSize, bool prefilterMips)
+    {
+        this->size = faceSize;
+        this->prefilter = prefilterMips;
+        glGenTextures(1, &this->texture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, this->texture);
+        for (int face = 0; face < 6; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, faceSize, faceSize, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, prefilterMips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        if (prefilterMips)
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);     // allocates the chain, filled after the first capture
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        glGenRenderbuffers(1, &this->depthStencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depthStencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, faceSize, faceSize);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenFramebuffers(1, &this->FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, this->texture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthStencil);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete)
+            LOG_ERROR << "ERROR::FRAMEBUFFER::REFLECTION_PROBE_NOT_COMPLETE";
+        this->Reset();
+        return complete;
+    }
+
+    void Delete()
+    {
+        glDeleteFramebuffers(1, &this->FBO);
+        glDeleteRenderbuffers(1, &this->depthStencil);
+        glDeleteTextures(1, &this->texture);
+        this->FBO = this->depthStencil = this->texture = 0;
+    }
+
+    unsigned int Texture() const
+    {
+        return this->texture;
+    }
+    // Faces rendered by the last update, 0 to 6
+    int UpdatedFaces() const
+    {
+        return this->updatedFaces;
+    }
+
+    // Everything stale, the next update renders all faces at once (first capture, a new scene)
+    void Reset()
+    {
+        this->staleFaces = ALL_FACES;
+        this->captureAll = true;
+    }
+    // Everything stale, rendered over the next frames within the budget
+    void Invalidate()
+    {
+        this->staleFaces = ALL_FACES;
+    }
+
+    // Faces to render this frame, oldest first
+    int BeginUpdate(int* faces)
+    {
+        if (this->UpdateMode == PROBE_UPDATE_ALWAYS && this->staleFaces == 0)
+            this->staleFaces = ALL_FACES;
+        int budget = this->captureAll ? 6 : this->FacesPerFrame;
+        int count = 0;
+        for (int i = 0; i < 6 && count < budget; i++)
+        {
+            int face = (this->nextFace + i) % 6;
+            if (this->staleFaces & (1 << face))
+                faces[count++] = face;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            this->staleFaces &= ~(1 << faces[i]);
+            this->facesSinceMipmaps |= 1 << faces[i];
+        }
+        if (count > 0)
+            this->nextFace = (faces[count - 1] + 1) % 6;
+        this->captureAll = false;
+        this->updatedFaces = count;
+        return count;
+    }
+
+    // Render target of one face, cleared
+    void BindFace(int face)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->texture, 0);
+        glViewport(0, 0, this->size, this->size);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+
+    // Looking out of the probe through a face, oriented the way cubemaps are sampled
+    glm::mat4 FaceView(int face) const
+    {
+        static const glm::vec3 directions[6] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+        static const glm::vec3 ups[6] = { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+            glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+        return glm::lookAt(this->Position, this->Position + directions[face], ups[face]);
+    }
+    static glm::mat4 Projection(float nearPlane = 0.1f, float farPlane = 100.0f)
+    {
+        return glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+    }
+
+    // After the faces of BeginUpdate: the mipmaps once every face is new, then back to the target of the frame
+    void EndUpdate(unsigned int framebuffer, int width, int height)
+    {
+        if (this->prefilter && this->facesSinceMipmaps == ALL_FACES)
+        {
+            this->facesSinceMipmaps = 0;
+            glBindTexture(GL_TEXTURE_CUBE_MAP, this->texture);
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+private:
+    static const int ALL_FACES = 0x3F;
+
+    int size;
+    bool prefilter;
+    unsigned int texture;
+    unsigned int FBO;
+    unsigned int depthStencil;
+    int staleFaces;             // bit per face
+    int nextFace;               // round robin start of the next update
+    bool captureAll;
+    int updatedFaces;
+    int facesSinceMipmaps;      // bit per face rendered after the last mipmap build
+};
+
+#endif
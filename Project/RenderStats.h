@@ -0,0 +1,304 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <glad/glad.h>
+
+// Counters of the GL work a frame submits. They are collected by swapping glad's function pointers
+// for wrappers which count and forward to the driver, so every call site (Mesh, Model, the profiler
+// overlay, ...) is covered without touching it. Calls are counted, not effective changes: binding
+// the texture which is already bound counts as well.
+struct RenderStats
+{
+    unsigned long long drawCalls = 0;
+    unsigned long long vertices = 0;            // submitted vertices, all instances
+    unsigned long long programBinds = 0;
+    unsigned long long textureBinds = 0;        // glBindTexture and glActiveTexture
+    unsigned long long vertexArrayBinds = 0;
+    unsigned long long framebufferBinds = 0;
+    unsigned long long fixedFunctionChanges = 0; // enable/disable, depth, stencil, blend and viewport state
+    unsigned long long uniformUploads = 0;
+    unsigned long long uniformLookups = 0;      // glGetUniformLocation
+    // bytes given to glBufferData / glTexImage2D / glTexImage3D / glRenderbufferStorage, deletes are not subtracted
+    unsigned long long bufferBytes = 0;
+    unsigned long long textureBytes = 0;
+
+    unsigned long long StateChanges() const
+    {
+        return programBinds + textureBinds + vertexArrayBinds + framebufferBinds + fixedFunctionChanges;
+    }
+};
+
+inline RenderStats& renderStats()
+{
+    static RenderStats stats;
+    return stats;
+}
+
+namespace render_stats_hooks
+{
+    static PFNGLDRAWARRAYSPROC drawArrays;
+    static PFNGLDRAWELEMENTSPROC drawElements;
+    static PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced;
+    static PFNGLDRAWELEMENTSINSTANCEDPROC drawElementsInstanced;
+    static PFNGLUSEPROGRAMPROC useProgram;
+    static PFNGLBINDTEXTUREPROC bindTexture;
+    static PFNGLACTIVETEXTUREPROC activeTexture;
+    static PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+    static PFNGLBINDFRAMEBUFFERPROC bindFramebuffer;
+    static PFNGLENABLEPROC enable;
+    static PFNGLDISABLEPROC disable;
+    static PFNGLDEPTHFUNCPROC depthFunc;
+    static PFNGLDEPTHMASKPROC depthMask;
+    static PFNGLSTENCILFUNCPROC stencilFunc;
+    static PFNGLSTENCILMASKPROC stencilMask;
+    static PFNGLSTENCILOPPROC stencilOp;
+    static PFNGLBLENDFUNCPROC blendFunc;
+    static PFNGLVIEWPORTPROC viewport;
+    static PFNGLGETUNIFORMLOCATIONPROC getUniformLocation;
+    static PFNGLUNIFORM1IPROC uniform1i;
+    static PFNGLUNIFORM1FPROC uniform1f;
+    static PFNGLUNIFORM2FPROC uniform2f;
+    static PFNGLUNIFORM2FVPROC uniform2fv;
+    static PFNGLUNIFORM3FPROC uniform3f;
+    static PFNGLUNIFORM3FVPROC uniform3fv;
+    static PFNGLUNIFORM4FPROC uniform4f;
+    static PFNGLUNIFORM4FVPROC uniform4fv;
+    static PFNGLUNIFORMMATRIX2FVPROC uniformMatrix2fv;
+    static PFNGLUNIFORMMATRIX3FVPROC uniformMatrix3fv;
+    static PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv;
+    static PFNGLBUFFERDATAPROC bufferData;
+    static PFNGLTEXIMAGE2DPROC texImage2D;
+    static PFNGLTEXIMAGE3DPROC texImage3D;
+    static PFNGLRENDERBUFFERSTORAGEPROC renderbufferStorage;
+
+    static unsigned int bytesPerTexel(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_RED: case GL_R8: return 1;
+        case GL_RG: case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+        case GL_RGB: case GL_RGB8: case GL_SRGB: case GL_SRGB8: case GL_DEPTH_COMPONENT24: return 3;
+        case GL_RGB16F: return 6;
+        case GL_RGBA16F: return 8;
+        case GL_RGB32F: return 12;
+        case GL_RGBA32F: return 16;
+        default: return 4;
+        }
+    }
+
+    static void APIENTRY DrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        renderStats().drawCalls++;
+        renderStats().vertices += count;
+        drawArrays(mode, first, count);
+    }
+    static void APIENTRY DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+    {
+        renderStats().drawCalls++;
+        renderStats().vertices += count;
+        drawElements(mode, count, type, indices);
+    }
+    static void APIENTRY DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+    {
+        renderStats().drawCalls++;
+        renderStats().vertices += (unsigned long long)count * instances;
+        drawArraysInstanced(mode, first, count, instances);
+    }
+    static void APIENTRY DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances)
+    {
+        renderStats().drawCalls++;
+        renderStats().vertices += (unsigned long long)count * instances;
+        drawElementsInstanced(mode, count, type, indices, instances);
+    }
+    static void APIENTRY UseProgram(GLuint program) { renderStats().programBinds++; useProgram(program); }
+    static void APIENTRY BindTexture(GLenum target, GLuint texture) { renderStats().textureBinds++; bindTexture(target, texture); }
+    static void APIENTRY ActiveTexture(GLenum unit) { renderStats().textureBinds++; activeTexture(unit); }
+    static void APIENTRY BindVertexArray(GLuint vao) { renderStats().vertexArrayBinds++; bindVertexArray(vao); }
+    static void APIENTRY BindFramebuffer(GLenum target, GLuint fbo) { renderStats().framebufferBinds++; bindFramebuffer(target, fbo); }
+    static void APIENTRY Enable(GLenum cap) { renderStats().fixedFunctionChanges++; enable(cap); }
+    static void APIENTRY Disable(GLenum cap) { renderStats().fixedFunctionChanges++; disable(cap); }
+    static void APIENTRY DepthFunc(GLenum func) { renderStats().fixedFunctionChanges++; depthFunc(func); }
+    static void APIENTRY DepthMask(GLboolean flag) { renderStats().fixedFunctionChanges++; depthMask(flag); }
+    static void APIENTRY StencilFunc(GLenum func, GLint ref, GLuint mask) { renderStats().fixedFunctionChanges++; stencilFunc(func, ref, mask); }
+    static void APIENTRY StencilMask(GLuint mask) { renderStats().fixedFunctionChanges++; stencilMask(mask); }
+    static void APIENTRY StencilOp(GLenum fail, GLenum zfail, GLenum zpass) { renderStats().fixedFunctionChanges++; stencilOp(fail, zfail, zpass); }
+    static void APIENTRY BlendFunc(GLenum src, GLenum dst) { renderStats().fixedFunctionChanges++; blendFunc(src, dst); }
+    static void APIENTRY Viewport(GLint x, GLint y, GLsizei w, GLsizei h) { renderStats().fixedFunctionChanges++; viewport(x, y, w, h); }
+    static GLint APIENTRY GetUniformLocation(GLuint program, const GLchar* name) { renderStats().uniformLookups++; return getUniformLocation(program, name); }
+    static void APIENTRY Uniform1i(GLint l, GLint v) { renderStats().uniformUploads++; uniform1i(l, v); }
+    static void APIENTRY Uniform1f(GLint l, GLfloat v) { renderStats().uniformUploads++; uniform1f(l, v); }
+    static void APIENTRY Uniform2f(GLint l, GLfloat x, GLfloat y) { renderStats().uniformUploads++; uniform2f(l, x, y); }
+    static void APIENTRY Uniform2fv(GLint l, GLsizei n, const GLfloat* v) { renderStats().uniformUploads++; uniform2fv(l, n, v); }
+    static void APIENTRY Uniform3f(GLint l, GLfloat x, GLfloat y, GLfloat z) { renderStats().uniformUploads++; uniform3f(l, x, y, z); }
+    static void APIENTRY Uniform3fv(GLint l, GLsizei n, const GLfloat* v) { renderStats().uniformUploads++; uniform3fv(l, n, v); }
+    static void APIENTRY Uniform4f(GLint l, GLfloat x, GLfloat y, GLfloat z, GLfloat w) { renderStats().uniformUploads++; uniform4f(l, x, y, z, w); }
+    static void APIENTRY Uniform4fv(GLint l, GLsizei n, const GLfloat* v) { renderStats().uniformUploads++; uniform4fv(l, n, v); }
+    static void APIENTRY UniformMatrix2fv(GLint l, GLsizei n, GLboolean t, const GLfloat* v) { renderStats().uniformUploads++; uniformMatrix2fv(l, n, t, v); }
+    static void APIENTRY UniformMatrix3fv(GLint l, GLsizei n, GLboolean t, const GLfloat* v) { renderStats().uniformUploads++; uniformMatrix3fv(l, n, t, v); }
+    static void APIENTRY UniformMatrix4fv(GLint l, GLsizei n, GLboolean t, const GLfloat* v) { renderStats().uniformUploads++; uniformMatrix4fv(l, n, t, v); }
+    static void APIENTRY BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+    {
+        renderStats().bufferBytes += size;
+        bufferData(target, size, data, usage);
+    }
+    static void APIENTRY TexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei w, GLsizei h, GLint border, GLenum format, GLenum type, const void* pixels)
+    {
+        renderStats().textureBytes += (unsigned long long)w * h * bytesPerTexel(internalFormat);
+        texImage2D(target, level, internalFormat, w, h, border, format, type, pixels);
+    }
+    static void APIENTRY TexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei w, GLsizei h, GLsizei d, GLint border, GLenum format, GLenum type,
+        const void* pixels)
+    {
+        renderStats().textureBytes += (unsigned long long)w * h * d * bytesPerTexel(internalFormat);
+        texImage3D(target, level, internalFormat, w, h, d, border, format, type, pixels);
+    }
+    static void APIENTRY RenderbufferStorage(GLenum target, GLenum internalFormat, GLsizei w, GLsizei h)
+    {
+        renderStats().textureBytes += (unsigned long long)w * h * bytesPerTexel(internalFormat);
+        renderbufferStorage(target, internalFormat, w, h);
+    }
+}
+
+// Call once after gladLoadGLLoader, before any GL object is created
+inline void installRenderStatsHooks()
+{
+    using namespace render_stats_hooks;
+    if (useProgram != NULL)
+        return;
+#define RENDER_STATS_HOOK(original, wrapper, name) original = glad_##name; glad_##name = wrapper
+    RENDER_STATS_HOOK(drawArrays, DrawArrays, glDrawArrays);
+    RENDER_STATS_HOOK(drawElements, DrawElements, glDrawElements);
+    RENDER_STATS_HOOK(drawArraysInstanced, DrawArraysInstanced, glDrawArraysInstanced);
+    RENDER_STATS_HOOK(drawElementsInstanced, DrawElementsInstanced, glDrawElementsInstanced);
+    RENDER_STATS_HOOK(useProgram, UseProgram, glUseProgram);
+    RENDER_STATS_HOOK(bindTexture, BindTexture, glBindTexture);
+    RENDER_STATS_HOOK(activeTexture, ActiveTexture, glActiveTexture);
+    RENDER_STATS_HOOK(bindVertexArray, BindVertexArray, glBindVertexArray);
+    RENDER_STATS_HOOK(bindFramebuffer, BindFramebuffer, glBindFramebuffer);
+    RENDER_STATS_HOOK(enable, Enable, glEnable);
+    RENDER_STATS_HOOK(disable, Disable, glDisable);
+    RENDER_STATS_HOOK(depthFunc, DepthFunc, glDepthFunc);
+    RENDER_STATS_HOOK(depthMask, DepthMask, glDepthMask);
+    RENDER_STATS_HOOK(stencilFunc, StencilFunc, glStencilFunc);
+    RENDER_STATS_HOOK(stencilMask, StencilMask, glStencilMask);
+    RENDER_STATS_HOOK(stencilOp, StencilOp, glStencilOp);
+    RENDER_STATS_HOOK(blendFunc, BlendFunc, glBlendFunc);
+    RENDER_STATS_HOOK(viewport, Viewport, glViewport);
+    RENDER_STATS_HOOK(getUniformLocation, GetUniformLocation, glGetUniformLocation);
+    RENDER_STATS_HOOK(uniform1i, Uniform1i, glUniform1i);
+    RENDER_STATS_HOOK(uniform1f, Uniform1f, glUniform1f);
+    RENDER_STATS_HOOK(uniform2f, Uniform2f, glUniform2f);
+    RENDER_STATS_HOOK(uniform2fv, Uniform2fv, glUniform2fv);
+    RENDER_STATS_HOOK(uniform3f, Uniform3f, glUniform3f);
+    RENDER_STATS_HOOK(uniform3fv, Uniform3fv, glUniform3fv);
+    RENDER_STATS_HOOK(uniform4f, Uniform4f, glUniform4f);
+    RENDER_STATS_HOOK(uniform4fv, Uniform4fv, glUniform4fv);
+    RENDER_STATS_HOOK(uniformMatrix2fv, UniformMatrix2fv, glUniformMatrix2fv);
+    RENDER_STATS_HOOK(uniformMatrix3fv, UniformMatrix3fv, glUniformMatrix3fv);
+    RENDER_STATS_HOOK(uniformMatrix4fv, UniformMatrix4fv, glUniformMatrix4fv);
+    RENDER_STATS_HOOK(bufferData, BufferData, glBufferData);
+    RENDER_STATS_HOOK(texImage2D, TexImage2D, glTexImage2D);
+    RENDER_STATS_HOOK(texImage3D, TexImage3D, glTexImage3D);
+    RENDER_STATS_HOOK(renderbufferStorage, RenderbufferStorage, glRenderbufferStorage);
+#undef RENDER_STATS_HOOK
+}
+
+// Fragments which passed the depth and stencil tests between Begin and End, once per frame (GL_SAMPLES_PASSED queries do not
+// nest). Like the GPU profiler it reads a query back LATENCY frames later, when the GPU is normally done with it. Fragments of
+// frames begun with measured set add up in Measured, e.g. the shaded fragments of the color pass with and without the depth
+// pre-pass. Other occlusion queries of the frame go between Pause and Resume, only one of them can be active.
+class FragmentCounter
+{
+public:
+    static const int LATENCY = 3;
+    static const int PARTS = 2;     // queries per frame, a frame pauses the count once at most
+
+    FragmentCounter() : next(0), measured(0), measuredFrames(0)
+    {
+        for (int i = 0; i < LATENCY; i++)
+        {
+            for (int part = 0; part < PARTS; part++)
+                this->queries[i][part] = 0;
+            this->parts[i] = 0;
+            this->pending[i] = this->pendingMeasured[i] = false;
+        }
+    }
+
+    // Needs a current GL context
+    void Init()
+    {
+        glGenQueries(LATENCY * PARTS, &this->queries[0][0]);
+    }
+    void Delete()
+    {
+        glDeleteQueries(LATENCY * PARTS, &this->queries[0][0]);
+    }
+
+    void Begin(bool measuredFrame)
+    {
+        this->collect(this->next);
+        this->pendingMeasured[this->next] = measuredFrame;
+        this->parts[this->next] = 1;
+        glBeginQuery(GL_SAMPLES_PASSED, this->queries[this->next][0]);
+    }
+    void Pause()
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+    }
+    void Resume()
+    {
+        if (this->parts[this->next] < PARTS)
+            glBeginQuery(GL_SAMPLES_PASSED, this->queries[this->next][this->parts[this->next]++]);
+    }
+    void End()
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+        this->pending[this->next] = true;
+        this->next = (this->next + 1) % LATENCY;
+    }
+
+    // Reads back the frames still in flight
+    void Flush()
+    {
+        for (int i = 0; i < LATENCY; i++)
+            this->collect((this->next + i) % LATENCY);
+    }
+    void Reset()
+    {
+        this->Flush();
+        this->measured = 0;
+        this->measuredFrames = 0;
+    }
+
+    double MeasuredPerFrame() const
+    {
+        return this->measuredFrames > 0 ? (double)this->measured / this->measuredFrames : 0.0;
+    }
+
+private:
+    GLuint queries[LATENCY][PARTS];
+    int parts[LATENCY];             // begun in the frame of a slot
+    bool pending[LATENCY];
+    bool pendingMeasured[LATENCY];
+    int next;
+    unsigned long long measured;
+    unsigned long long measuredFrames;
+
+    void collect(int slot)
+    {
+        if (!this->pending[slot])
+            return;
+        this->pending[slot] = false;
+        if (!this->pendingMeasured[slot])
+            return;
+        for (int part = 0; part < this->parts[slot]; part++)
+        {
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(this->queries[slot][part], GL_QUERY_RESULT, &samples);
+            this->measured += samples;
+        }
+        this->measuredFrames++;
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+
+// Hand-over of frame snapshots from the update thread to the render thread. Two slots: while the
+// render thread submits frame N from one, the update thread fills frame N+1 into the other. A slot
+// is never reused before it was rendered, so every snapshot is rendered exactly once and in order.
+template <typename T>
+class FramePipeline
+{
+public:
+    FramePipeline() : writeIndex(0), readIndex(0), closed(false)
+    {
+        this->state[0] = this->state[1] = FREE;
+    }
+
+    // Update thread: the slot to fill, NULL once the pipeline is closed
+    T* BeginWrite()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->changed.wait(lock, [this]() { return this->closed || this->state[this->writeIndex] == FREE; });
+        return this->closed ? NULL : &this->slots[this->writeIndex];
+    }
+    void EndWrite()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->state[this->writeIndex] = READY;
+        this->writeIndex ^= 1;
+        this->changed.notify_all();
+    }
+
+    // Render thread: the next snapshot, NULL when the pipeline is closed and everything was rendered
+    const T* BeginRead()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->changed.wait(lock, [this]() { return this->closed || this->state[this->readIndex] == READY; });
+        return this->state[this->readIndex] == READY ? &this->slots[this->readIndex] : NULL;
+    }
+    void EndRead()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->state[this->readIndex] = FREE;
+        this->readIndex ^= 1;
+        this->changed.notify_all();
+    }
+
+    // No more snapshots, the render thread still gets the ones already written
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->closed = true;
+        this->changed.notify_all();
+    }
+
+private:
+    enum SlotState { FREE, READY };
+    T slots[2];
+    SlotState state[2];
+    int writeIndex, readIndex;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+enum PipelineStage
+{
+    PIPELINE_UPDATE,
+    PIPELINE_RENDER
+};
+
+// Busy time of both stages against the wall clock. Whatever the stages spent at the same time is
+// overlap: 0% means they ran one after the other, 100% that the shorter stage was completely hidden.
+class PipelineStats
+{
+public:
+    PipelineStats()
+    {
+        this->Reset();
+    }
+
+    void Reset()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->busyMs[PIPELINE_UPDATE] = this->busyMs[PIPELINE_RENDER] = 0.0;
+        this->frames[PIPELINE_UPDATE] = this->frames[PIPELINE_RENDER] = 0;
+        this->start = std::chrono::steady_clock::now();
+    }
+
+    void Add(PipelineStage stage, double ms)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->busyMs[stage] += ms;
+        this->frames[stage]++;
+    }
+
+    // Per frame averages since the last Reset
+    double UpdateMs() const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->frames[PIPELINE_UPDATE] ? this->busyMs[PIPELINE_UPDATE] / this->frames[PIPELINE_UPDATE] : 0.0;
+    }
+    double RenderMs() const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->frames[PIPELINE_RENDER] ? this->busyMs[PIPELINE_RENDER] / this->frames[PIPELINE_RENDER] : 0.0;
+    }
+
+    // 0..1
+    double Overlap() const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->start).count();
+        double update = this->busyMs[PIPELINE_UPDATE], render = this->busyMs[PIPELINE_RENDER];
+        double shorter = update < render ? update : render;
+        if (shorter <= 0.0)
+            return 0.0;
+        double overlap = (update + render - wallMs) / shorter;
+        return overlap < 0.0 ? 0.0 : (overlap > 1.0 ? 1.0 : overlap);
+    }
+
+    std::string Summary() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << "update " << this->UpdateMs() << " ms, render " << this->RenderMs()
+            << " ms, overlap " << std::setprecision(0) << this->Overlap() * 100.0 << "%";
+        return out.str();
+    }
+
+private:
+    mutable std::mutex mutex;
+    double busyMs[2];
+    unsigned long long frames[2];
+    std::chrono::steady_clock::time_point start;
+};
+
+// Adds the lifetime of the scope to one stage
+class PipelineStageTimer
+{
+public:
+    PipelineStageTimer(PipelineStats& stats, PipelineStage stage) : stats(stats), stage(stage), start(std::chrono::steady_clock::now())
+    {
+    }
+    ~PipelineStageTimer()
+    {
+        this->stats.Add(this->stage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->start).count());
+    }
+private:
+    PipelineStats& stats;
+    PipelineStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -5,152 +5,509 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <direct.h>
+#define SHADER_MKDIR(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define SHADER_MKDIR(path) mkdir(path, 0755)
+#endif
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GLExtensions.h"
+#include "CpuProfiler.h"
+#include "Log.h"
+
+// One compiled permutation. While pending the compile/link has been issued but its status
+// was not queried yet, which lets the driver work on several programs at once.
+struct ShaderProgramVariant
+{
+    GLuint program = 0;
+    GLuint vertex = 0;
+    GLuint fragment = 0;
+    bool pending = false;
+    unsigned long long binaryKey = 0;   // program binary cache key, 0 when the cache is not used
+    std::string defines;
+};
+
+// Startup statistics of all shaders, see Shader::Stats()
+struct ShaderStats
+{
+    unsigned int compiled = 0;          // programs compiled and linked from source
+    unsigned int failed = 0;            // programs whose compile or link failed
+    unsigned int fromBinary = 0;        // programs restored from the program binary cache
+    unsigned int rejectedBinaries = 0;  // cached binaries the driver refused (driver update etc.)
+};
+
+// Compiled permutations of one vertex/fragment pair. Shared between copies of a Shader
+// so a variant compiled through one copy is reused by all of them.
+struct ShaderVariants
+{
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string vertexCode;                     // sources with #include directives already resolved
+    std::string fragmentCode;
+    std::vector<std::string> features;          // bit i of a variant mask enables #define features[i]
+    std::map<unsigned int, ShaderProgramVariant> programs;    // variant mask -> program
+    std::map<std::string, GLint> samplers;      // texture units re-applied to every new variant
+};
+
 class Shader
 {
 public:
     GLuint Program;
-    // Constructor generates the shader on the fly
-    Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
-    {
-        // 1. Retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensures ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::badbit);
-        try
-        {
-            // Open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // Read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // Convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-        }
-        const GLchar* vShaderCode = vertexCode.c_str();
-        const GLchar* fShaderCode = fragmentCode.c_str();
-        // 2. Compile shaders
-        GLuint vertex, fragment;
-        GLint success;
-        GLchar infoLog[512];
-        // Vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        // Print compile errors if any
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-        }
-        // Fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // Print compile errors if any
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-        if (!success)
+    // Constructor loads the sources; variants are compiled lazily on first use.
+    // features - list of #define keys which can be switched on per variant (at most 32)
+    Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const std::vector<std::string>& features = std::vector<std::string>())
+    {
+        PROFILE_SCOPE("Shader::Shader");
+        this->variants = std::make_shared<ShaderVariants>();
+        this->variants->vertexPath = vertexPath;
+        this->variants->fragmentPath = fragmentPath;
+        this->variants->features = features;
+        if (features.size() > 32)
+            LOG_ERROR << "ERROR::SHADER::TOO_MANY_FEATURES " << fragmentPath;
+        // 1. Retrieve the vertex/fragment source code from filePath, resolving #include "file"
+        std::vector<std::string> vertexFiles, fragmentFiles;
+        this->variants->vertexCode = loadSource(vertexPath, vertexFiles);
+        this->variants->fragmentCode = loadSource(fragmentPath, fragmentFiles);
+        // 2. Issue the compile of the variant without any features, its status is checked on first use
+        this->features = 0;
+        this->Program = beginVariant(0).program;
+    }
+    // Uses the current shader
+    void Use()
+    {
+        finishVariant(this->variants->programs[this->features]);
+        glUseProgram(this->Program);
+    }
+    // Selects the variant with the given feature mask (compiling it on first request) and uses it
+    void Use(unsigned int featureMask)
+    {
+        this->Select(featureMask);
+        this->Use();
+    }
+    // Makes the variant current without binding it, uniform setters will target it after Use()
+    void Select(unsigned int featureMask)
+    {
+        if (featureMask != this->features || this->Program == 0)
         {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+            this->features = featureMask;
+            this->Program = variant(featureMask);
         }
-        // Shader Program
-        this->Program = glCreateProgram();
-        glAttachShader(this->Program, vertex);
-        glAttachShader(this->Program, fragment);
-        glLinkProgram(this->Program);
-        // Print linking errors if any
-        glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
-        if (!success)
+    }
+    // Starts compiling a variant in the background of the driver without making it current
+    void Prepare(unsigned int featureMask)
+    {
+        beginVariant(featureMask);
+    }
+    // Waits for every issued variant of this shader to finish linking
+    void Finish()
+    {
+        for (std::map<unsigned int, ShaderProgramVariant>::iterator it = this->variants->programs.begin(); it != this->variants->programs.end(); ++it)
+            finishVariant(it->second);
+    }
+    // Finishes the issued variants the driver is done with and returns how many are still linking. With parallel shader
+    // compile the driver reports that without blocking (GL_COMPLETION_STATUS_KHR), so the caller can poll while it links
+    // the others in the background, without it every variant is waited for
+    int FinishCompleted()
+    {
+        const bool parallel = glExtensions().parallelShaderCompile;
+        int linking = 0;
+        for (std::map<unsigned int, ShaderProgramVariant>::iterator it = this->variants->programs.begin(); it != this->variants->programs.end(); ++it)
         {
-            glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+            if (!it->second.pending)
+                continue;
+            GLint completed = GL_TRUE;
+            if (parallel)
+                glGetProgramiv(it->second.program, GL_COMPLETION_STATUS_KHR, &completed);
+            if (completed)
+                finishVariant(it->second);
+            else
+                linking++;
         }
-        // Delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+        return linking;
     }
-    // Uses the current shader
-    void Use()
+    // Returns the variant bit of a feature key, 0 if the shader was not created with this key
+    unsigned int Feature(const std::string& key) const
     {
-        glUseProgram(this->Program);
+        for (unsigned int i = 0; i < this->variants->features.size(); i++)
+            if (this->variants->features[i] == key)
+                return 1u << i;
+        LOG_ERROR << "ERROR::SHADER::UNKNOWN_FEATURE " << key;
+        return 0;
     }
-    // utility uniform functions
+    unsigned int Features() const
+    {
+        return this->features;
+    }
+    // Number of variants compiled so far
+    size_t VariantCount() const
+    {
+        return this->variants->programs.size();
+    }
+    // Directory of the program binary cache, an empty string disables the cache
+    static std::string& BinaryCacheDirectory()
+    {
+        static std::string directory = "../shader_cache/";
+        return directory;
+    }
+    static ShaderStats& Stats()
+    {
+        static ShaderStats stats;
+        return stats;
+    }
+    // Binds a sampler to a texture unit in the current variant, in the variants linked before (prepared
+    // ones) and in every variant compiled later
+    void setSampler(const std::string& name, int unit)
+    {
+        this->variants->samplers[name] = unit;
+        glUniform1i(glGetUniformLocation(Program, name.c_str()), unit);
+        for (std::map<unsigned int, ShaderProgramVariant>::iterator it = this->variants->programs.begin(); it != this->variants->programs.end(); ++it)
+            if (!it->second.pending && it->second.program != this->Program)
+                applySamplers(it->second.program);
+    }
+    // utility uniform functions, the names are C strings so a literal does not build a std::string per call
     // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+    void setBool(const GLchar* name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(Program, name.c_str()), (int)value);
+        glUniform1i(glGetUniformLocation(Program, name), (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+    void setInt(const GLchar* name, int value) const
     {
-        glUniform1i(glGetUniformLocation(Program, name.c_str()), value);
+        glUniform1i(glGetUniformLocation(Program, name), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void setFloat(const GLchar* name, float value) const
     {
-        glUniform1f(glGetUniformLocation(Program, name.c_str()), value);
+        glUniform1f(glGetUniformLocation(Program, name), value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(const GLchar* name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(Program, name.c_str()), 1, &value[0]);
+        glUniform2fv(glGetUniformLocation(Program, name), 1, &value[0]);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(const GLchar* name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(Program, name.c_str()), x, y);
+        glUniform2f(glGetUniformLocation(Program, name), x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(const GLchar* name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(Program, name.c_str()), 1, &value[0]);
+        glUniform3fv(glGetUniformLocation(Program, name), 1, &value[0]);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(const GLchar* name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(Program, name.c_str()), x, y, z);
+        glUniform3f(glGetUniformLocation(Program, name), x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(const GLchar* name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(Program, name.c_str()), 1, &value[0]);
+        glUniform4fv(glGetUniformLocation(Program, name), 1, &value[0]);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    void setVec4(const GLchar* name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(Program, name.c_str()), x, y, z, w);
+        glUniform4f(glGetUniformLocation(Program, name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(const GLchar* name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(Program, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(glGetUniformLocation(Program, name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(const GLchar* name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(Program, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(glGetUniformLocation(Program, name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(const GLchar* name, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(glGetUniformLocation(Program, name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+private:
+    std::shared_ptr<ShaderVariants> variants;
+    unsigned int features;
+
+    // Returns the linked program of a variant, compiling it the first time it is requested
+    GLuint variant(unsigned int featureMask)
+    {
+        ShaderProgramVariant& v = beginVariant(featureMask);
+        finishVariant(v);
+        return v.program;
+    }
+
+    // Creates the program of a variant: restored from the binary cache if possible,
+    // otherwise compile and link are issued without waiting for them
+    ShaderProgramVariant& beginVariant(unsigned int featureMask)
     {
-        glUniformMatrix4fv(glGetUniformLocation(Program, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        std::map<unsigned int, ShaderProgramVariant>::iterator it = this->variants->programs.find(featureMask);
+        if (it != this->variants->programs.end())
+            return it->second;
+        ShaderProgramVariant& v = this->variants->programs[featureMask];
+
+        for (unsigned int i = 0; i < this->variants->features.size(); i++)
+            if (featureMask & (1u << i))
+                v.defines += "#define " + this->variants->features[i] + "\n";
+        std::string vertexCode = injectDefines(this->variants->vertexCode, v.defines);
+        std::string fragmentCode = injectDefines(this->variants->fragmentCode, v.defines);
+
+        GLExtensions& ext = glExtensions();
+        if (ext.programBinary && !BinaryCacheDirectory().empty())
+        {
+            std::string key = vertexCode + '\0' + fragmentCode + '\0' + ext.vendor + '\0' + ext.renderer + '\0' + ext.version;
+            v.binaryKey = hash(key);
+            if (loadBinary(v))
+            {
+                Stats().fromBinary++;
+                applySamplers(v.program);
+                return v;
+            }
+        }
+
+        const GLchar* vShaderCode = vertexCode.c_str();
+        const GLchar* fShaderCode = fragmentCode.c_str();
+        // Vertex Shader
+        v.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(v.vertex, 1, &vShaderCode, NULL);
+        glCompileShader(v.vertex);
+        // Fragment Shader
+        v.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(v.fragment, 1, &fShaderCode, NULL);
+        glCompileShader(v.fragment);
+        // Shader Program
+        v.program = glCreateProgram();
+        glAttachShader(v.program, v.vertex);
+        glAttachShader(v.program, v.fragment);
+        if (v.binaryKey != 0)
+            ext.ProgramParameteri(v.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(v.program);
+        v.pending = true;
+        return v;
+    }
+
+    // Waits for an issued compile, reports errors and stores the result in the binary cache
+    void finishVariant(ShaderProgramVariant& v)
+    {
+        if (!v.pending)
+            return;
+        PROFILE_SCOPE("Shader::finishVariant");
+        v.pending = false;
+        GLint success;
+        GLchar infoLog[1024];
+        bool compiled = true;
+        // Print compile errors if any
+        glGetShaderiv(v.vertex, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            compiled = false;
+            glGetShaderInfoLog(v.vertex, 1024, NULL, infoLog);
+            LOG_ERROR << "ERROR::SHADER::VERTEX::COMPILATION_FAILED " << this->variants->vertexPath << "\n" << v.defines << infoLog;
+        }
+        glGetShaderiv(v.fragment, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            compiled = false;
+            glGetShaderInfoLog(v.fragment, 1024, NULL, infoLog);
+            LOG_ERROR << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED " << this->variants->fragmentPath << "\n" << v.defines << infoLog;
+        }
+        // Print linking errors if any
+        glGetProgramiv(v.program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(v.program, 1024, NULL, infoLog);
+            LOG_ERROR << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog;
+        }
+        // Delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(v.vertex);
+        glDeleteShader(v.fragment);
+        v.vertex = v.fragment = 0;
+        if (compiled && success)
+            Stats().compiled++;
+        else
+            Stats().failed++;
+
+        if (success && v.binaryKey != 0)
+            saveBinary(v);
+        applySamplers(v.program);
+    }
+
+    // New variant gets the texture units already assigned to its siblings
+    void applySamplers(GLuint program)
+    {
+        if (this->variants->samplers.empty())
+            return;
+        GLint previous;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+        glUseProgram(program);
+        for (std::map<std::string, GLint>::iterator s = this->variants->samplers.begin(); s != this->variants->samplers.end(); ++s)
+            glUniform1i(glGetUniformLocation(program, s->first.c_str()), s->second);
+        glUseProgram(previous);
+    }
+
+    // ---------------------------------- program binary cache ----------------------------------
+    // File layout: magic, binary format, length, driver blob. The key (file name) hashes the final
+    // sources together with GL vendor/renderer/version, so a driver update just misses the cache.
+    static const unsigned int BINARY_MAGIC = 0x4E424853;    // "SHBN"
+
+    static unsigned long long hash(const std::string& data)
+    {
+        unsigned long long h = 14695981039346656037ULL;     // 64-bit FNV-1a
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            h ^= (unsigned char)data[i];
+            h *= 1099511628211ULL;
+        }
+        return h == 0 ? 1 : h;
+    }
+
+    static std::string binaryPath(unsigned long long key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", key);
+        return BinaryCacheDirectory() + name;
+    }
+
+    bool loadBinary(ShaderProgramVariant& v)
+    {
+        std::ifstream file(binaryPath(v.binaryKey).c_str(), std::ios::binary);
+        if (!file.is_open())
+            return false;
+        unsigned int header[3] = { 0, 0, 0 };
+        file.read((char*)header, sizeof(header));
+        if (!file || header[0] != BINARY_MAGIC || header[2] == 0)
+            return false;
+        std::vector<char> blob(header[2]);
+        file.read(&blob[0], blob.size());
+        if (!file)
+            return false;
+
+        v.program = glCreateProgram();
+        glExtensions().ProgramBinary(v.program, (GLenum)header[1], &blob[0], (GLsizei)blob.size());
+        GLint success;
+        glGetProgramiv(v.program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // rejected blobs are simply recompiled from source and overwritten
+            glDeleteProgram(v.program);
+            v.program = 0;
+            Stats().rejectedBinaries++;
+            return false;
+        }
+        return true;
+    }
+
+    void saveBinary(const ShaderProgramVariant& v)
+    {
+        GLint length = 0;
+        glGetProgramiv(v.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> blob(length);
+        GLenum format = 0;
+        glExtensions().GetProgramBinary(v.program, length, NULL, &format, &blob[0]);
+
+        std::string path = binaryPath(v.binaryKey);
+        std::ofstream file(path.c_str(), std::ios::binary);
+        if (!file.is_open())
+        {
+            SHADER_MKDIR(BinaryCacheDirectory().c_str());
+            file.open(path.c_str(), std::ios::binary);
+            if (!file.is_open())
+                return;
+        }
+        unsigned int header[3] = { BINARY_MAGIC, (unsigned int)format, (unsigned int)length };
+        file.write((const char*)header, sizeof(header));
+        file.write(&blob[0], blob.size());
+    }
+
+    // Inserts the variant #defines right after the #version line, which must stay first
+    static std::string injectDefines(const std::string& code, const std::string& defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t version = code.find("#version");
+        if (version == std::string::npos)
+            return defines + "#line 1 0\n" + code;
+        size_t lineEnd = code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return code + "\n" + defines;
+        // keep compiler messages pointing at the original line numbers
+        int versionLine = 1;
+        for (size_t i = 0; i < version; i++)
+            if (code[i] == '\n')
+                versionLine++;
+        return code.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(versionLine + 1) + " 0\n" + code.substr(lineEnd + 1);
+    }
+
+    // Reads a shader file and recursively replaces #include "file" lines (paths relative to the including file).
+    // Every file gets its own source string number in #line directives: files[n] is the name behind "n(line)" in compiler logs.
+    static std::string loadSource(const std::string& path, std::vector<std::string>& files)
+    {
+        for (unsigned int i = 0; i < files.size(); i++)
+            if (files[i] == path)
+                return "";                      // already included once, works as an include guard
+        int fileIndex = (int)files.size();
+        files.push_back(path);
+
+        std::string code;
+        std::ifstream shaderFile;
+        // ensures ifstream objects can throw exceptions:
+        shaderFile.exceptions(std::ifstream::badbit);
+        try
+        {
+            shaderFile.open(path.c_str());
+            if (!shaderFile.is_open())
+                throw std::ifstream::failure("can't open " + path);
+            std::stringstream shaderStream;
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
+            code = shaderStream.str();
+        }
+        catch (const std::ifstream::failure&)
+        {
+            LOG_ERROR << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path;
+            return "";
+        }
+
+        std::string directory;
+        size_t slash = path.find_last_of("/\\");
+        if (slash != std::string::npos)
+            directory = path.substr(0, slash + 1);
+
+        std::stringstream source(code);
+        std::string result, line;
+        int lineNumber = 0;
+        while (std::getline(source, line))
+        {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+            {
+                size_t open = line.find('"', start);
+                size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+                if (close == std::string::npos)
+                {
+                    LOG_ERROR << "ERROR::SHADER::BAD_INCLUDE " << path << ":" << lineNumber;
+                    continue;
+                }
+                std::string included = directory + line.substr(open + 1, close - open - 1);
+                result += "#line 1 " + std::to_string(files.size()) + "\n";
+                result += loadSource(included, files);
+                result += "\n#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            }
+            else
+                result += line + "\n";
+        }
+        return result;
     }
 };
 
@@ -0,0 +1,75 @@
+#ifndef SHADING_LOD_H
+#define SHADING_LOD_H
+
+// Shading level of detail: relief and normal mapping only pay off while a surface covers a good part of
+// the screen. Every object keeps its level of the last frame and changes to a finer or a coarser one only
+// once its screen size is clearly past the threshold (hysteresis), so a surface right at a threshold does
+// not flicker between two shader variants.
+//   level = shadingLod.Select(level, ShadingLod::ScreenSize(center, radius, normal, cameraPosition, projectionMat));
+// Sizes are fractions of the viewport height, the levels stay the same at every render resolution.
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+enum ShadingLevel
+{
+    SHADING_RELIEF = 0,         // parallax occlusion and normal map, soft shadows
+    SHADING_NORMAL_MAP = 1,     // normal map only
+    SHADING_PLAIN = 2,          // Blinn-Phong with the vertex normal, a single shadow map tap
+    SHADING_LEVEL_COUNT = 3
+};
+
+inline const char* shadingLevelName(int level)
+{
+    static const char* names[SHADING_LEVEL_COUNT] = { "relief", "normal", "plain" };
+    return level >= 0 && level < SHADING_LEVEL_COUNT ? names[level] : "auto";
+}
+
+class ShadingLod
+{
+public:
+    float ReliefSize = 0.25f;       // smallest screen size with relief
+    float NormalMapSize = 0.08f;    // smallest screen size with a normal map
+    float Hysteresis = 0.2f;        // relative margin on both sides of a threshold
+    int ForcedLevel = -1;           // every object at this level (benchmarks), -1 picks by screen size
+
+    // Diameter of a bounding sphere on screen as a fraction of the viewport height
+    static float ScreenSize(const glm::vec3& center, float radius, const glm::vec3& cameraPosition, const glm::mat4& projectionMat)
+    {
+        float distance = glm::length(center - cameraPosition);
+        if (distance <= radius)
+            return 1.0f;
+        return radius * projectionMat[1][1] / distance;
+    }
+
+    // Flat surfaces shrink with the square root of the cosine of the view angle, the side length of their
+    // foreshortened area
+    static float ScreenSize(const glm::vec3& center, float radius, const glm::vec3& normal, const glm::vec3& cameraPosition,
+        const glm::mat4& projectionMat)
+    {
+        float cosine = std::fabs(glm::dot(glm::normalize(cameraPosition - center), normal));
+        return ScreenSize(center, radius, cameraPosition, projectionMat) * std::sqrt(cosine);
+    }
+
+    ShadingLevel Select(ShadingLevel current, float screenSize) const
+    {
+        if (this->ForcedLevel >= 0 && this->ForcedLevel < SHADING_LEVEL_COUNT)
+            return (ShadingLevel)this->ForcedLevel;
+        int level = current;
+        while (level > SHADING_RELIEF && screenSize > this->threshold(level - 1) * (1.0f + this->Hysteresis))
+            level--;
+        while (level < SHADING_PLAIN && screenSize < this->threshold(level) * (1.0f - this->Hysteresis))
+            level++;
+        return (ShadingLevel)level;
+    }
+
+private:
+    // Smallest screen size of a level
+    float threshold(int level) const
+    {
+        return level == SHADING_RELIEF ? this->ReliefSize : this->NormalMapSize;
+    }
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+// Occlusion culling without a GPU: a few big occluders are rasterized into a small depth buffer on the CPU and the
+// bounding boxes of everything else are tested against it before anything is submitted to GL. Both sides are
+// conservative, so a box is only reported hidden when it is: an occluder writes a pixel only where a triangle covers
+// all of it, with the farthest depth of the triangle inside the pixel, and a box is tested on every pixel it touches
+// with its nearest depth. Triangles crossing the near plane are left out.
+//   occlusion.BeginFrame(projectionMat * viewMat);
+//   occlusion.AddOccluder(&vertices[0].Position.x, sizeof(Vertex), vertices.size(), indices, indexCount, modelMat);
+//   occlusion.Rasterize();
+//   if (!occlusion.Occluded(boxMin, boxMax)) draw it
+// AddOccluder transforms the triangles and sorts them into tiles of TILE_WIDTH x TILE_HEIGHT pixels, Rasterize clears
+// and fills the tiles on the job system, four pixels at a time in SSE registers. Both sides of a triangle are drawn, a
+// low poly proxy which stays inside its mesh is the cheaper occluder.
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_OCCLUSION_SSE 1
+#include <emmintrin.h>
+#else
+#define SOFTWARE_OCCLUSION_SSE 0
+#endif
+
+#include "CpuProfiler.h"
+#include "JobSystem.h"
+
+class SoftwareOcclusion
+{
+public:
+    static const int TILE_WIDTH = 32;       // a multiple of 4, the SSE loops never cross a tile
+    static const int TILE_HEIGHT = 16;
+
+    SoftwareOcclusion() : width(0), height(0), stride(0), tilesX(0), tilesY(0)
+    {
+    }
+
+    void Create(int bufferWidth, int bufferHeight, size_t maxTriangles = 4096)
+    {
+        this->width = bufferWidth;
+        this->height = bufferHeight;
+        this->tilesX = (bufferWidth + TILE_WIDTH - 1) / TILE_WIDTH;
+        this->tilesY = (bufferHeight + TILE_HEIGHT - 1) / TILE_HEIGHT;
+        this->stride = this->tilesX * TILE_WIDTH;
+        this->depth.assign((size_t)this->stride * this->tilesY * TILE_HEIGHT, 1.0f);
+        this->bins.assign((size_t)this->tilesX * this->tilesY, std::vector<unsigned int>());
+        for (size_t i = 0; i < this->bins.size(); i++)
+            this->bins[i].reserve(maxTriangles / 4);
+        this->triangles.reserve(maxTriangles);
+        this->clip.reserve(3 * maxTriangles);
+    }
+
+    int Width() const
+    {
+        return this->width;
+    }
+    int Height() const
+    {
+        return this->height;
+    }
+    // Triangles of the occluders of this frame which reached the screen
+    size_t Triangles() const
+    {
+        return this->triangles.size();
+    }
+
+    void BeginFrame(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        this->triangles.clear();
+        for (size_t i = 0; i < this->bins.size(); i++)
+            this->bins[i].clear();
+    }
+
+    // positions - xyz with stride bytes between vertices, indices - 3 per triangle, NULL for a plain triangle list
+    void AddOccluder(const float* positions, size_t positionStride, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+        const glm::mat4& modelMat)
+    {
+        glm::mat4 modelViewProjection = this->viewProjection * modelMat;
+        this->clip.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            const float* position = (const float*)((const char*)positions + positionStride * i);
+            this->clip[i] = modelViewProjection * glm::vec4(position[0], position[1], position[2], 1.0f);
+        }
+        size_t corners = indices ? indexCount : vertexCount;
+        for (size_t i = 0; i + 2 < corners; i += 3)
+        {
+            if (indices)
+                this->addTriangle(this->clip[indices[i]], this->clip[indices[i + 1]], this->clip[indices[i + 2]]);
+            else
+                this->addTriangle(this->clip[i], this->clip[i + 1], this->clip[i + 2]);
+        }
+    }
+
+    void Rasterize(JobSystem& jobs = JobSystem::Instance())
+    {
+        PROFILE_SCOPE("software occlusion");
+        jobs.ParallelFor(this->bins.size(), 4, [this](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++)
+                this->rasterizeTile(tile);
+        });
+    }
+
+    // True when the box is behind the occluders everywhere on screen. Boxes crossing the near plane are never occluded
+    bool Occluded(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        glm::vec2 screenMin(1e30f), screenMax(-1e30f);
+        float nearestDepth = 1.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 c = this->viewProjection * glm::vec4(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y,
+                corner & 4 ? boxMax.z : boxMin.z, 1.0f);
+            if (c.z < -c.w)
+                return false;
+            glm::vec3 screen = toScreen(c);
+            screenMin = glm::min(screenMin, glm::vec2(screen));
+            screenMax = glm::max(screenMax, glm::vec2(screen));
+            nearestDepth = std::min(nearestDepth, screen.z);
+        }
+        int x0 = std::max((int)std::floor(screenMin.x), 0), x1 = std::min((int)std::ceil(screenMax.x), this->width) - 1;
+        int y0 = std::max((int)std::floor(screenMin.y), 0), y1 = std::min((int)std::ceil(screenMax.y), this->height) - 1;
+        if (x0 > x1 || y0 > y1)
+            return false;
+#if SOFTWARE_OCCLUSION_SSE
+        const __m128 nearest = _mm_set1_ps(nearestDepth);
+        const __m128i first = _mm_set1_epi32(x0 - 1), last = _mm_set1_epi32(x1 + 1);
+        for (int y = y0; y <= y1; y++)
+        {
+            const float* row = &this->depth[(size_t)y * this->stride];
+            for (int x = x0 & ~3; x <= x1; x += 4)
+            {
+                __m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+                __m128 inside = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(lanes, first), _mm_cmplt_epi32(lanes, last)));
+                __m128 visible = _mm_and_ps(_mm_cmple_ps(nearest, _mm_loadu_ps(row + x)), inside);
+                if (_mm_movemask_ps(visible))
+                    return false;
+            }
+        }
+#else
+        for (int y = y0; y <= y1; y++)
+            for (int x = x0; x <= x1; x++)
+                if (nearestDepth <= this->depth[(size_t)y * this->stride + x])
+                    return false;
+#endif
+        return true;
+    }
+
+private:
+    // Edge functions and depth plane over pixel coordinates, set up for the pixel centers: an edge function is not
+    // negative where the whole pixel is inside the edge, the depth plane gives the farthest depth in the pixel
+    struct Triangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthX, depthY, depthC, depthMax;
+        int minX, minY, maxX, maxY;
+    };
+
+    int width, height, stride;
+    int tilesX, tilesY;
+    glm::mat4 viewProjection;
+    std::vector<float> depth;                       // stride x whole tiles, 1 is the far plane
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<unsigned int> > bins;   // triangles of every tile
+    std::vector<glm::vec4> clip;                    // vertices of the occluder being added
+
+    // Pixels with the origin in the lower left corner like GL, depth 0 to 1
+    glm::vec3 toScreen(const glm::vec4& c) const
+    {
+        glm::vec3 ndc = glm::vec3(c) / c.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * this->width, (ndc.y * 0.5f + 0.5f) * this->height, ndc.z * 0.5f + 0.5f);
+    }
+
+    void addTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+    {
+        if (c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w)
+            return;
+        glm::vec3 p[3] = { toScreen(c0), toScreen(c1), toScreen(c2) };
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(p[1], p[2]);
+            area = -area;
+        }
+        Triangle t;
+        t.minX = std::max((int)std::floor(std::min(std::min(p[0].x, p[1].x), p[2].x)), 0);
+        t.maxX = std::min((int)std::ceil(std::max(std::max(p[0].x, p[1].x), p[2].x)), this->width - 1);
+        t.minY = std::max((int)std::floor(std::min(std::min(p[0].y, p[1].y), p[2].y)), 0);
+        t.maxY = std::min((int)std::ceil(std::max(std::max(p[0].y, p[1].y), p[2].y)), this->height - 1);
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec3& a = p[e];
+            const glm::vec3& b = p[(e + 1) % 3];
+            float A = a.y - b.y, B = b.x - a.x, C = a.x * b.y - a.y * b.x;
+            t.edgeA[e] = A;
+            t.edgeB[e] = B;
+            t.edgeC[e] = C + 0.5f * (A + B) - 0.5f * (std::fabs(A) + std::fabs(B));
+        }
+        float dx1 = p[1].x - p[0].x, dy1 = p[1].y - p[0].y, dx2 = p[2].x - p[0].x, dy2 = p[2].y - p[0].y;
+        float dz1 = p[1].z - p[0].z, dz2 = p[2].z - p[0].z;
+        t.depthX = (dz1 * dy2 - dz2 * dy1) / area;
+        t.depthY = (dz2 * dx1 - dz1 * dx2) / area;
+        t.depthC = p[0].z - t.depthX * p[0].x - t.depthY * p[0].y + 0.5f * (t.depthX + t.depthY)
+            + 0.5f * (std::fabs(t.depthX) + std::fabs(t.depthY));
+        t.depthMax = std::max(std::max(p[0].z, p[1].z), p[2].z);
+
+        unsigned int index = (unsigned int)this->triangles.size();
+        this->triangles.push_back(t);
+        for (int ty = t.minY / TILE_HEIGHT; ty <= t.maxY / TILE_HEIGHT; ty++)
+            for (int tx = t.minX / TILE_WIDTH; tx <= t.maxX / TILE_WIDTH; tx++)
+                this->bins[ty * this->tilesX + tx].push_back(index);
+    }
+
+    void rasterizeTile(size_t tile)
+    {
+        const int tileX = (int)(tile % this->tilesX) * TILE_WIDTH, tileY = (int)(tile / this->tilesX) * TILE_HEIGHT;
+        for (int y = tileY; y < tileY + TILE_HEIGHT; y++)
+            std::fill_n(&this->depth[(size_t)y * this->stride + tileX], TILE_WIDTH, 1.0f);
+        const std::vector<unsigned int>& bin = this->bins[tile];
+        for (size_t i = 0; i < bin.size(); i++)
+        {
+            const Triangle& t = this->triangles[bin[i]];
+            const int x0 = std::max(t.minX, tileX) & ~3, x1 = std::min(t.maxX, tileX + TILE_WIDTH - 1);
+            const int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, tileY + TILE_HEIGHT - 1);
+#if SOFTWARE_OCCLUSION_SSE
+            const __m128 a0 = _mm_set1_ps(t.edgeA[0]), a1 = _mm_set1_ps(t.edgeA[1]), a2 = _mm_set1_ps(t.edgeA[2]);
+            const __m128 depthX = _mm_set1_ps(t.depthX), depthMax = _mm_set1_ps(t.depthMax), zero = _mm_setzero_ps();
+            for (int y = y0; y <= y1; y++)
+            {
+                float* row = &this->depth[(size_t)y * this->stride];
+                const __m128 c0 = _mm_set1_ps(t.edgeB[0] * y + t.edgeC[0]), c1 = _mm_set1_ps(t.edgeB[1] * y + t.edgeC[1]);
+                const __m128 c2 = _mm_set1_ps(t.edgeB[2] * y + t.edgeC[2]), depthRow = _mm_set1_ps(t.depthY * y + t.depthC);
+                __m128 xs = _mm_add_ps(_mm_set1_ps((float)x0), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+                for (int x = x0; x <= x1; x += 4, xs = _mm_add_ps(xs, _mm_set1_ps(4.0f)))
+                {
+                    __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, xs), c0), zero),
+                        _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, xs), c1), zero), _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, xs), c2), zero)));
+                    if (!_mm_movemask_ps(inside))
+                        continue;
+                    __m128 z = _mm_min_ps(_mm_add_ps(_mm_mul_ps(depthX, xs), depthRow), depthMax);
+                    __m128 stored = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(stored, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+                }
+            }
+#else
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                {
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++)
+                        inside = inside && t.edgeA[e] * x + t.edgeB[e] * y + t.edgeC[e] >= 0.0f;
+                    float& stored = this->depth[(size_t)y * this->stride + x];
+                    if (inside)
+                        stored = std::min(stored, std::min(t.depthX * x + t.depthY * y + t.depthC, t.depthMax));
+                }
+#endif
+        }
+    }
+};
+
+#endif
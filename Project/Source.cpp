@@ -2,6 +2,11 @@
 #include <cmath>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cassert>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,8 +15,47 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+//before the headers which include the tracker themselves
+#define ALLOCATION_TRACKER_IMPLEMENTATION
+#include "AllocationTracker.h"
+#include "GLExtensions.h"
 #include "Shader.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "FrameClock.h"
+#include "Frustum.h"
+#include "Bvh.h"
+#include "RenderThread.h"
+#include "JobSystem.h"
+#include "TextureLoader.h"
+#include "ConeStepMap.h"
+#include "ShadingLod.h"
+#include "TangentSpace.h"
+#include "ReflectionProbe.h"
+#include "OcclusionCulling.h"
+#include "SoftwareOcclusion.h"
+#include "Picking.h"
+#include "DynamicResolution.h"
+#include "PostProcess.h"
+#include "Outline.h"
+#include "TextureArray.h"
+#include "TextureStreaming.h"
+#include "Model.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "Log.h"
+#include "Benchmark.h"
+#include "BenchmarkLog.h"
+#include "BenchmarkJobs.h"
+#include "BenchmarkParallax.h"
+#include "BenchmarkOcclusion.h"
+#include "BenchmarkBvh.h"
+#include "BenchmarkPicking.h"
+#include "BenchmarkOutline.h"
+#include "BenchmarkTangent.h"
+#include "BenchmarkProfiler.h"
+#include "RenderStats.h"
+#include "PerfSuite.h"
 #include "stb_image.h"
 
 //====================GLOBAL==========================
@@ -30,14 +74,94 @@ glm::vec3 mirrorCubePos(-2.5f, 1.5f, 2.0f);
 bool globalSpotlightSwitch = false;
 bool showLampsAndTheirLight = false;
 const int numberOfPointLights = 2;
-// Deltatime-time between current frame and last frame
-GLfloat deltaTime = 0.0f;
-GLfloat lastFrame = 0.0f;
+//timing: the clock is read once per frame, the animations and the camera advance in fixed steps
+FrameClock frameClock;
+SceneAnimation animation;
+//profiling
+GpuProfiler gpuProfiler;
+bool showProfilerOverlay = false;
+int shadingLodOverride = -1;    //F5 forces every shading level in turn, -1 picks them by screen size
+bool depthPrepassSwitch = false;    //F6, depth of the opaque objects first, then each of their pixels is shaded once
+OcclusionMode occlusionModeSwitch = OCCLUSION_HIZ;     //F7 cycles, culling of the container grid (OcclusionCulling.h)
+bool dynamicResolutionSwitch = false;   //F8, the render resolution follows the frame time (DynamicResolution.h)
+PostProcessSettings postProcessSettings;    //F9 bloom, F10 tone mapping, F11 sharpening (PostProcess.h)
+OutlineMode outlineModeSwitch = OUTLINE_SCREEN;     //F12, how the containers are outlined (Outline.h)
+//scenes of the benchmark and the performance suite
+enum SceneKind {
+    SCENE_MAIN,         //everything above
+    SCENE_BACKPACK,     //the model of Assimp.cpp
+    SCENE_STRESS,       //main scene plus a block of 1000 containers, one draw call each
+    SCENE_OCCLUSION     //the stress scene with walls around the block, most of it hidden behind them
+};
+//one container of the stress grid which survived frustum culling
+struct StressCube {
+    glm::mat4 modelMat;
+    unsigned int diffuseMap;    //index into the two diffuse maps
+    ShadingLevel shading;
+};
+const std::vector<StressCube> noCubes;      //for the scenes without walls
+//the stress grid drawn instanced (--texture-arrays): its two diffuse maps are layers of one texture array, every cube is an
+//instance which picks its layer, so the cubes of one shader variant are one draw call instead of a bind and a draw each
+struct GridInstance {
+    glm::mat4 modelMat;
+    float layer;
+};
+struct GridBatching {
+    GLuint vao = 0;             //the container vertices plus the instance attributes, 0 draws a cube at a time
+    GLuint instanceBuffer = 0;
+    size_t capacity = 0;        //instances, more cubes are drawn in several chunks
+    GLuint diffuseArray = 0;
+    float layers[2] = { 0.0f, 0.0f };   //of the two diffuse maps
+    unsigned int feature = 0;   //TEXTURE_ARRAY variant of the default shader
+};
+//cubes of the stress grid drawn in the measured frames and the draw calls it took
+struct GridDrawStats {
+    unsigned long long cubes = 0;
+    unsigned long long drawCalls = 0;
+};
+//everything the render thread needs for one frame, written by the update thread (main thread)
+struct FrameSnapshot {
+    size_t sceneIndex;
+    SceneKind scene;
+    int frameIndex;             //within the scene
+    bool sceneEnd;              //last frame of a headless scene
+    double time;                //frame clock
+    AnimationState animation;   //interpolated between the last two simulation steps
+    glm::mat4 viewMat;
+    glm::mat4 projectionMat;
+    glm::vec3 cameraPosition;
+    glm::vec3 cameraFront;
+    bool pointLights;
+    bool spotlight;
+    bool profilerOverlay;
+    bool exportTraces;
+    ShadingLevel nMapShading;
+    ShadingLevel parallaxShading;
+    bool depthPrepass;
+    OcclusionMode occlusion;
+    bool dynamicResolution;
+    PostProcessSettings postProcess;
+    OutlineMode outline;
+    bool probeInvalidated;      //something the reflection probe sees changed
+    unsigned long long allocations;             //heap allocations of the update stage
+    std::vector<glm::vec3> sortedWindows;       //back to front
+    std::vector<StressCube> stressCubes;        //visible ones
+    unsigned int shadowCasters;                 //bit per ShadowCaster in the light frustum
+    std::vector<StressCube> softwareCulledCubes;    //OCCLUSION_SOFTWARE: the grid cubes culled by the update stage
+    std::vector<unsigned char> hiddenMeshes;        //OCCLUSION_SOFTWARE: a flag per backpack mesh, hidden behind the others
+    size_t occluderTriangles;                       //OCCLUSION_SOFTWARE: rasterized this frame and the time it took
+    double softwareRasterMs;
+};
+//the snapshot being rendered, the draw functions read it instead of the camera the input keeps changing
+const FrameSnapshot* frameSnapshot = NULL;
+GridDrawStats gridDrawStats;        //render thread, reset when the measured frames start
+bool exportTracesRequested = false;     //F4, the traces belong to the render thread
+bool pickRequested = false;     //left mouse button, the update stage casts a ray from the cursor into the scene
 //====================================================
 //======================================FUNCTIONS======================================================================================================================================================
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
-    std::cout<<key<<std::endl;
+    LOG_DEBUG << "key " << key;
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
     if (key >= 0 && key < 1024)
@@ -50,9 +174,53 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         else if (action == GLFW_RELEASE)
             keys[key] = false;
     }
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
+        showProfilerOverlay = !showProfilerOverlay;
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS)
+        exportTracesRequested = true;
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+    {
+        shadingLodOverride = shadingLodOverride + 1 < SHADING_LEVEL_COUNT ? shadingLodOverride + 1 : -1;
+        LOG_INFO << "Shading LOD: " << shadingLevelName(shadingLodOverride);
+    }
+    if (key == GLFW_KEY_F6 && action == GLFW_PRESS)
+    {
+        depthPrepassSwitch = !depthPrepassSwitch;
+        LOG_INFO << "Depth pre-pass " << (depthPrepassSwitch ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F7 && action == GLFW_PRESS)
+    {
+        occlusionModeSwitch = (OcclusionMode)((occlusionModeSwitch + 1) % OCCLUSION_MODE_COUNT);
+        LOG_INFO << "Occlusion culling: " << occlusionModeName(occlusionModeSwitch);
+    }
+    if (key == GLFW_KEY_F8 && action == GLFW_PRESS)
+    {
+        dynamicResolutionSwitch = !dynamicResolutionSwitch;
+        LOG_INFO << "Dynamic resolution " << (dynamicResolutionSwitch ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+    {
+        postProcessSettings.bloom = !postProcessSettings.bloom;
+        LOG_INFO << "Bloom " << (postProcessSettings.bloom ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
+    {
+        postProcessSettings.toneMapping = !postProcessSettings.toneMapping;
+        LOG_INFO << "Tone mapping " << (postProcessSettings.toneMapping ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+    {
+        postProcessSettings.sharpen = !postProcessSettings.sharpen;
+        LOG_INFO << "Sharpening " << (postProcessSettings.sharpen ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+    {
+        outlineModeSwitch = (OutlineMode)((outlineModeSwitch + 1) % OUTLINE_MODE_COUNT);
+        LOG_INFO << "Outline: " << outlineModeName(outlineModeSwitch);
+    }
 }
 
-void do_movements(){
+void do_movements(GLfloat deltaTime){
     if (keys[GLFW_KEY_W])
         camera.ProcessKeyboard(FORWARD, deltaTime);
     if (keys[GLFW_KEY_S])
@@ -88,6 +256,12 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        pickRequested = true;
+}
+
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(yoffset);
@@ -95,63 +269,35 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 unsigned int loadTexture(char const* path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    PROFILE_SCOPE("loadTexture");
+    DecodedImage image = decodeImage(path);
+    return uploadTexture(image);
 }
 
 unsigned int loadCubemap(std::vector<std::string> faces)
 {
+    PROFILE_SCOPE("loadCubemap");
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
+    //the faces are decoded in parallel, uploaded in order
+    std::vector<DecodedImage> images(faces.size());
+    JobSystem::Instance().ParallelFor(faces.size(), 1, [&faces, &images](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            images[i] = decodeImage(faces[i]);
+    });
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
+        if (images[i].data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
+                0, GL_RGB, images[i].width, images[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, images[i].data
             );
-            stbi_image_free(data);
+            freeImage(images[i]);
         }
         else
-        {
-            std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
+            LOG_ERROR << "Cubemap tex failed to load at path: " << faces[i];
     }
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -162,16 +308,31 @@ unsigned int loadCubemap(std::vector<std::string> faces)
     return textureID;
 }
 
+//objects of the depth pre-pass are shaded where their depth already is, without writing it again
+void beginPrepassedShading()
+{
+    if (!frameSnapshot->depthPrepass)
+        return;
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+}
+
+void endPrepassedShading()
+{
+    if (!frameSnapshot->depthPrepass)
+        return;
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
+
 void drawFloor(const glm::mat4 projectionMat, const unsigned int planeVAO, Shader myShader, const unsigned int floorTexture)
 {
     glm::mat4 modelMat = glm::mat4(1.0f);
-    glm::mat4 viewMat = camera.GetViewMatrix();
-
-    glStencilMask(0x00);
+    glm::mat4 viewMat = frameSnapshot->viewMat;
 
+    myShader.Use();
     myShader.setMat4("viewMat", viewMat);
     myShader.setMat4("projectionMat", projectionMat);
-    myShader.Use();
     glBindVertexArray(planeVAO);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, floorTexture);
@@ -189,22 +350,91 @@ void drawFloor(const glm::mat4 projectionMat, const unsigned int planeVAO, Shade
     glBindTexture(GL_TEXTURE_2D, 0);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, 0);
-
-    glStencilMask(0xFF);
 }
 
-void drawNMap(const glm::mat4 projectionMat, const unsigned int nMapVAO, Shader shader, const unsigned int diffuseMap, const unsigned int normalMap)
+//the normal and the parallax mapped quads, for the draws and for the shading LOD
+glm::mat4 nMapModelMat(const AnimationState& state)
 {
-    glm::mat4 viewMat = camera.GetViewMatrix();
-    shader.Use();
-    shader.setMat4("projectionMat", projectionMat);
-    shader.setMat4("viewMat", viewMat);
     glm::mat4 modelMat = glm::mat4(1.0f);
     modelMat = glm::translate(modelMat, glm::vec3(5.0f, 0.5f, 2.0f));
-    modelMat = glm::rotate(modelMat, glm::radians((float)glfwGetTime() * -10.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
+    modelMat = glm::rotate(modelMat, glm::radians(state.nMapAngle), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
+    modelMat = glm::scale(modelMat, glm::vec3(0.7f));
+    return modelMat;
+}
+
+glm::mat4 parallaxModelMat(const AnimationState& state)
+{
+    glm::mat4 modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(5.0f, 0.5f, 0.0f));
+    modelMat = glm::rotate(modelMat, glm::radians(state.parallaxAngle), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
+    modelMat = glm::scale(modelMat, glm::vec3(0.7f));
+    return modelMat;
+}
+
+//the reflecting cube (0) and the refracting one above it (1)
+glm::mat4 mirrorCubeModelMat(const AnimationState& state, int cube)
+{
+    glm::mat4 modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, cube == 0 ? mirrorCubePos : mirrorCubePos + glm::vec3(0.0f, 1.0f, 1.0f));
+    modelMat = glm::rotate(modelMat, glm::radians(state.mirrorAngle), glm::normalize(glm::vec3(-1.0, 1.0, -1.0)));
     modelMat = glm::scale(modelMat, glm::vec3(0.7f));
+    return modelMat;
+}
+
+//the orthographic box of the directional light's shadow map
+glm::mat4 directLightSpaceMatrix(float nearPlane, float farPlane)
+{
+    glm::mat4 lightProjection, lightView;
+    //lightProjection = glm::perspective(glm::radians(45.0f), (GLfloat)SHADOW_WIDTH / (GLfloat)SHADOW_HEIGHT, near_plane, far_plane); // обратите внимание, что если вы используете матрицу перспективной проекции, вам придется изменить положение света, так как текущего положения света недостаточно для отображения всей сцены
+    lightProjection = glm::ortho(-15.0f, 20.0f, -15.0f, 20.0f, nearPlane, farPlane);
+    lightView = glm::lookAt(-directLightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
+    return lightProjection * lightView;
+}
+
+//objects of the shadow pass, a bounding volume hierarchy over them is refitted every frame since the quads and the mirror
+//cubes turn, the ones outside of the light frustum are not drawn
+enum ShadowCaster
+{
+    CASTER_FLOOR,
+    CASTER_CONTAINERS,      //five of them
+    CASTER_MIRROR = CASTER_CONTAINERS + 5,
+    CASTER_REFRACTION_CUBE,
+    CASTER_NMAP,
+    CASTER_PARALLAX,
+    CASTER_COUNT
+};
+
+void shadowCasterBounds(const AnimationState& state, const glm::vec3* cubePositions, std::vector<Aabb>& bounds)
+{
+    bounds.resize(CASTER_COUNT);
+    bounds[CASTER_FLOOR].boxMin = glm::vec3(-10.0f, -0.51f, -10.0f);
+    bounds[CASTER_FLOOR].boxMax = glm::vec3(10.0f, -0.51f, 10.0f);
+    for (int i = 0; i < 5; i++)
+        bounds[CASTER_CONTAINERS + i] = transformBounds(glm::translate(glm::mat4(1.0f), cubePositions[i]), glm::vec3(-0.5f), glm::vec3(0.5f));
+    for (int i = 0; i < 2; i++)
+        bounds[CASTER_MIRROR + i] = transformBounds(mirrorCubeModelMat(state, i), glm::vec3(-0.5f), glm::vec3(0.5f));
+    bounds[CASTER_NMAP] = transformBounds(nMapModelMat(state), glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f));
+    bounds[CASTER_PARALLAX] = transformBounds(parallaxModelMat(state), glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f));
+}
+
+//level of a quad (-1..1 in x and y, facing +z) which kept `current` in the last frame
+ShadingLevel quadShading(const ShadingLod& lod, ShadingLevel current, const glm::mat4& modelMat, const glm::vec3& cameraPosition, const glm::mat4& projectionMat)
+{
+    glm::vec3 center = glm::vec3(modelMat[3]);
+    glm::vec3 normal = glm::normalize(glm::vec3(modelMat[2]));
+    float radius = glm::length(glm::vec3(modelMat[0]) + glm::vec3(modelMat[1]));
+    return lod.Select(current, ShadingLod::ScreenSize(center, radius, normal, cameraPosition, projectionMat));
+}
+
+void drawNMap(const glm::mat4 projectionMat, const unsigned int nMapVAO, Shader shader, const unsigned int features, const glm::mat4& modelMat,
+    const unsigned int diffuseMap, const unsigned int normalMap)
+{
+    glm::mat4 viewMat = frameSnapshot->viewMat;
+    shader.Use(features);
+    shader.setMat4("projectionMat", projectionMat);
+    shader.setMat4("viewMat", viewMat);
     shader.setMat4("modelMat", modelMat);
-    shader.setVec3("viewPos", camera.Position);
+    shader.setVec3("viewPos", frameSnapshot->cameraPosition);
     shader.setVec3("lightPos", -directLightPos);
     //shader.setVec3("lightAmbient", glm::vec3(0.05f));
     //shader.setVec3("lightDiffuse", glm::vec3(0.7f));
@@ -218,19 +448,15 @@ void drawNMap(const glm::mat4 projectionMat, const unsigned int nMapVAO, Shader
     glBindVertexArray(0);
 }
 
-void drawParallax(const glm::mat4 projectionMat, const unsigned int parallaxVAO, Shader shader, const unsigned int diffuseMap,
-    const unsigned int normalMap, const unsigned int heightMap)
+void drawParallax(const glm::mat4 projectionMat, const unsigned int parallaxVAO, Shader shader, const unsigned int features, const glm::mat4& modelMat,
+    const unsigned int diffuseMap, const unsigned int normalMap, const unsigned int heightMap)
 {
-    glm::mat4 viewMat = camera.GetViewMatrix();
-    shader.Use();
+    glm::mat4 viewMat = frameSnapshot->viewMat;
+    shader.Use(features);
     shader.setMat4("projectionMat", projectionMat);
     shader.setMat4("viewMat", viewMat);
-    glm::mat4 modelMat = glm::mat4(1.0f);
-    modelMat = glm::translate(modelMat, glm::vec3(5.0f, 0.5f, 0.0f));
-    modelMat = glm::rotate(modelMat, glm::radians(sin((float)glfwGetTime()) * 10.0f + 90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-    modelMat = glm::scale(modelMat, glm::vec3(0.7f));
     shader.setMat4("modelMat", modelMat);
-    shader.setVec3("viewPos", camera.Position);
+    shader.setVec3("viewPos", frameSnapshot->cameraPosition);
     shader.setVec3("lightPos", -directLightPos);
     shader.setFloat("heightScale", 0.1f);
     glActiveTexture(GL_TEXTURE0);
@@ -244,10 +470,12 @@ void drawParallax(const glm::mat4 projectionMat, const unsigned int parallaxVAO,
     glBindVertexArray(0);
 }
 
+//the containers mark themselves in the stencil, with OUTLINE_SCREEN the outline is drawn around the marks at the end of the
+//frame (ScreenSpaceOutline), with OUTLINE_STENCIL they are drawn again scaled up where they are not marked
 void drawCubesAndOutline(const glm::mat4 projectionMat, const unsigned int containerVAO, Shader myShader, Shader outlineShader, glm::vec3* cubePositions,
-    const unsigned int diffuseMap, const unsigned int specularMap, const unsigned int emissionMap)
+    const unsigned int diffuseMap, const unsigned int specularMap, const unsigned int emissionMap, const OutlineMode outline)
 {
-    glm::mat4 viewMat = camera.GetViewMatrix();
+    glm::mat4 viewMat = frameSnapshot->viewMat;
 
     myShader.Use();
     myShader.setMat4("viewMat", viewMat);
@@ -260,22 +488,28 @@ void drawCubesAndOutline(const glm::mat4 projectionMat, const unsigned int conta
     glBindTexture(GL_TEXTURE_2D, emissionMap);
 
     //Draw figures
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilMask(0xFF);
-
-    glBindVertexArray(containerVAO);
-    for (unsigned int i = 0; i < 5; i++)
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
     {
-        glm::mat4 modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, cubePositions[i]);
-        myShader.setMat4("modelMat", modelMat);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        GPU_SCOPE(gpuProfiler, "containers");
+        beginPrepassedShading();
+        glBindVertexArray(containerVAO);
+        for (unsigned int i = 0; i < 5; i++)
+        {
+            glm::mat4 modelMat = glm::mat4(1.0f);
+            modelMat = glm::translate(modelMat, cubePositions[i]);
+            myShader.setMat4("modelMat", modelMat);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+        }
+        glBindVertexArray(0);
+        endPrepassedShading();
     }
-    glBindVertexArray(0);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    if (outline != OUTLINE_STENCIL)
+        return;
 
     //draw outline
+    GPU_SCOPE(gpuProfiler, "outline");
     glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-    glStencilMask(0x00);
     //glDisable(GL_DEPTH_TEST);
     outlineShader.Use();
     float scale = 1.005f;
@@ -296,13 +530,12 @@ void drawCubesAndOutline(const glm::mat4 projectionMat, const unsigned int conta
     glBindVertexArray(0);
 
     glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilMask(0xFF);
 }
 
 void drawLamps(const glm::mat4 projectionMat, const unsigned int lightVAO, Shader lampShader, const glm::vec3* pointLightPositions, const glm::vec3 ambientColor,
     const glm::vec3 diffuseColor)
 {
-    glm::mat4 viewMat = camera.GetViewMatrix();
+    glm::mat4 viewMat = frameSnapshot->viewMat;
     glm::mat4 modelMat = glm::mat4(1.0f);
 
     lampShader.Use();
@@ -323,16 +556,12 @@ void drawLamps(const glm::mat4 projectionMat, const unsigned int lightVAO, Shade
     glBindVertexArray(0);
 }
 
-void drawSkyboxAndCubes(const glm::mat4 projectionMat, const unsigned int skyboxVAO, const unsigned int mirrorVAO, Shader skyboxShader, Shader mirrorShader,
-    const unsigned int cubemapTexture)
+void drawSkybox(const glm::mat4 projectionMat, const unsigned int skyboxVAO, Shader skyboxShader, const unsigned int cubemapTexture)
 {
-    glm::mat4 viewMat = glm::mat4(1.0f);
-    glm::mat4 modelMat = glm::mat4(1.0f);
-
     //draw skybox
     glDepthFunc(GL_LEQUAL);
     skyboxShader.Use();
-    viewMat = glm::mat4(glm::mat3(camera.GetViewMatrix()));     //we will F' up view matrix to get rid of translation, but we will only do it for skybox
+    glm::mat4 viewMat = glm::mat4(glm::mat3(frameSnapshot->viewMat));     //we will F' up view matrix to get rid of translation, but we will only do it for skybox
     skyboxShader.setMat4("viewMat", viewMat);
     skyboxShader.setMat4("projectionMat", projectionMat);
     glBindVertexArray(skyboxVAO);
@@ -341,163 +570,1611 @@ void drawSkyboxAndCubes(const glm::mat4 projectionMat, const unsigned int skybox
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
     glDepthFunc(GL_LESS);
-    viewMat = camera.GetViewMatrix();               //here we are "restoring" the "right" view matrix
+}
+
+//environmentMap is the reflection probe around the cubes, or the skybox without one
+void drawMirrorCubes(const glm::mat4 projectionMat, const unsigned int mirrorVAO, Shader mirrorShader, const unsigned int environmentMap)
+{
+    glm::mat4 viewMat = frameSnapshot->viewMat;
+
+    //draw mirror cube
+    mirrorShader.Use(0);
+    mirrorShader.setMat4("modelMat", mirrorCubeModelMat(frameSnapshot->animation, 0));
+    mirrorShader.setMat4("viewMat", viewMat);
+    mirrorShader.setMat4("projectionMat", projectionMat);
+    mirrorShader.setVec3("cameraPos", frameSnapshot->cameraPosition);
+    glBindVertexArray(mirrorVAO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glBindVertexArray(0);
+
+    mirrorShader.Use(mirrorShader.Feature("REFRACT"));
+    mirrorShader.setMat4("modelMat", mirrorCubeModelMat(frameSnapshot->animation, 1));
+    mirrorShader.setMat4("viewMat", viewMat);
+    mirrorShader.setMat4("projectionMat", projectionMat);
+    mirrorShader.setVec3("cameraPos", frameSnapshot->cameraPosition);
+    glBindVertexArray(mirrorVAO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glBindVertexArray(0);
+}
+
+//windows come sorted back to front from the update thread
+void drawWindows(const glm::mat4 projectionMat, const unsigned int transparentVAO, Shader windowShader, const std::vector<glm::vec3>& sortedWindows,
+    const unsigned int windowTexture)
+{
+    glm::mat4 viewMat = frameSnapshot->viewMat;
+    glm::mat4 modelMat = glm::mat4(1.0f);
+
+    //draw windows
+    windowShader.Use();
+    glBindVertexArray(transparentVAO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, windowTexture);
+    //windowShader.setVec3("cameraPos", frameSnapshot->cameraPosition);
+    windowShader.setMat4("viewMat", viewMat);
+    windowShader.setMat4("projectionMat", projectionMat);
+    for (size_t i = 0; i < sortedWindows.size(); i++)
+    {
+        modelMat = glm::mat4(1.0f);
+        modelMat = glm::translate(modelMat, sortedWindows[i]);
+        windowShader.setMat4("modelMat", modelMat);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    glBindVertexArray(0);
+}
+
+//the casters in the light frustum only (FrameSnapshot::shadowCasters)
+void drawSceneForShadows(Shader shader, const unsigned int planeVAO, const unsigned int containerVAO, const unsigned int mirrorVAO,
+    const unsigned int nMapVAO, glm::vec3 *cubePositions)
+{
+    const unsigned int casters = frameSnapshot->shadowCasters;
+    //we will only need our floor
+    glm::mat4 modelMat = glm::mat4(1.0f);
+    if (casters & (1u << CASTER_FLOOR))
+    {
+        modelMat = glm::translate(modelMat, glm::vec3(0.0f, -0.01f, 0.0f));
+        shader.setMat4("modelMat", modelMat);
+        glBindVertexArray(planeVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    //and cubes
+    glBindVertexArray(containerVAO);
+    for (unsigned int i = 0; i < 5; i++)
+    {
+        if (!(casters & (1u << (CASTER_CONTAINERS + i))))
+            continue;
+        modelMat = glm::mat4(1.0f);
+        modelMat = glm::translate(modelMat, cubePositions[i]);
+        shader.setMat4("modelMat", modelMat);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+    glBindVertexArray(0);
+    //and mirror cube, and refraction cube
+    for (int i = 0; i < 2; i++)
+    {
+        if (!(casters & (1u << (CASTER_MIRROR + i))))
+            continue;
+        shader.setMat4("modelMat", mirrorCubeModelMat(frameSnapshot->animation, i));
+        glBindVertexArray(mirrorVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glBindVertexArray(0);
+    }
+    //and normal mapping
+    if (casters & (1u << CASTER_NMAP))
+    {
+        shader.setMat4("modelMat", nMapModelMat(frameSnapshot->animation));
+        glBindVertexArray(nMapVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+    }
+    //and parallax mapping
+    if (casters & (1u << CASTER_PARALLAX))
+    {
+        shader.setMat4("modelMat", parallaxModelMat(frameSnapshot->animation));
+        glBindVertexArray(nMapVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+    }
+}
+
+//depth only, the matrices of the color pass: floor, containers, normal mapped quad and stress grid. The parallax quad discards
+//fragments and keeps its own depth test, the rest of the scene is cheap to shade
+void drawDepthPrepass(const glm::mat4 projectionMat, Shader shader, const unsigned int depthPrepassFeature, const unsigned int planeVAO,
+    const unsigned int containerVAO, const unsigned int nMapVAO, glm::vec3* cubePositions, const std::vector<StressCube>& occluders,
+    const std::vector<StressCube>& stressCubes)
+{
+    shader.Use(depthPrepassFeature);
+    shader.setMat4("projectionMat", projectionMat);
+    shader.setMat4("viewMat", frameSnapshot->viewMat);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glm::mat4 modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(0.0f, -0.01f, 0.0f));
+    shader.setMat4("modelMat", modelMat);
+    glBindVertexArray(planeVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(containerVAO);
+    for (unsigned int i = 0; i < 5; i++)
+    {
+        modelMat = glm::mat4(1.0f);
+        modelMat = glm::translate(modelMat, cubePositions[i]);
+        shader.setMat4("modelMat", modelMat);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+    for (size_t i = 0; i < occluders.size(); i++)
+    {
+        shader.setMat4("modelMat", occluders[i].modelMat);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+    for (size_t i = 0; i < stressCubes.size(); i++)
+    {
+        shader.setMat4("modelMat", stressCubes[i].modelMat);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+    shader.setMat4("modelMat", nMapModelMat(frameSnapshot->animation));
+    glBindVertexArray(nMapVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+//the bounding box of every grid cube (the cube itself) into its own query, depth tested against everything drawn so far but
+//leaving no trace, the cubes are drawn under these queries afterwards (glBeginConditionalRender)
+void drawOcclusionQueries(const glm::mat4 projectionMat, Shader shader, const unsigned int depthPrepassFeature, const unsigned int containerVAO,
+    const std::vector<StressCube>& cubes, const std::vector<GLuint>& queries)
+{
+    shader.Use(depthPrepassFeature);
+    shader.setMat4("projectionMat", projectionMat);
+    shader.setMat4("viewMat", frameSnapshot->viewMat);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(containerVAO);
+    for (size_t i = 0; i < cubes.size(); i++)
+    {
+        shader.setMat4("modelMat", cubes[i].modelMat);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[i]);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+}
+
+//the instance attributes of the bound instance buffer from instance first on, for the bound VAO
+void pointGridInstances(const size_t first)
+{
+    const size_t offset = first * sizeof(GridInstance);
+    for (GLuint column = 0; column < 4; column++)
+        glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(GridInstance), (GLvoid*)(offset + column * sizeof(glm::vec4)));
+    glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(GridInstance), (GLvoid*)(offset + offsetof(GridInstance, layer)));
+}
+
+//one instanced draw per shader variant (levels with the same variant share it), its instances in the order of the draws a cube
+//at a time: level by level, in grid order within a level.
+//With conditional rendering every cube still needs its own draw, which points the instance attributes at it instead of
+//binding its texture
+void drawStressGridInstances(const glm::mat4 projectionMat, Shader myShader, const unsigned int* levelFeatures,
+    const std::vector<StressCube>& cubes, const GridBatching& batching, const GLuint* conditionQueries)
+{
+    glBindVertexArray(batching.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, batching.instanceBuffer);
+    for (size_t chunk = 0; chunk < cubes.size(); chunk += batching.capacity)
+    {
+        const size_t chunkEnd = std::min(cubes.size(), chunk + batching.capacity);
+        GridInstance* instances = (GridInstance*)glMapBufferRange(GL_ARRAY_BUFFER, 0, batching.capacity * sizeof(GridInstance),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (instances == NULL)
+            break;
+        size_t variantCounts[SHADING_LEVEL_COUNT] = {};
+        size_t count = 0;
+        for (int level = 0; level < SHADING_LEVEL_COUNT; level++)
+        {
+            int variantLevel = 0;
+            while (levelFeatures[variantLevel] != levelFeatures[level])
+                variantLevel++;
+            if (variantLevel != level)
+                continue;
+            for (int shading = level; shading < SHADING_LEVEL_COUNT; shading++)
+            {
+                if (levelFeatures[shading] != levelFeatures[level])
+                    continue;
+                for (size_t i = chunk; i < chunkEnd; i++)
+                    if (cubes[i].shading == shading)
+                    {
+                        instances[count].modelMat = cubes[i].modelMat;
+                        instances[count++].layer = batching.layers[cubes[i].diffuseMap];
+                        variantCounts[level]++;
+                    }
+            }
+        }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+
+        size_t first = 0;
+        for (int level = 0; level < SHADING_LEVEL_COUNT; level++)
+        {
+            if (variantCounts[level] == 0)
+                continue;
+            myShader.Use(levelFeatures[level]);
+            myShader.setMat4("viewMat", frameSnapshot->viewMat);
+            myShader.setMat4("projectionMat", projectionMat);
+            if (conditionQueries)
+            {
+                size_t instance = first;
+                for (int shading = level; shading < SHADING_LEVEL_COUNT; shading++)
+                {
+                    if (levelFeatures[shading] != levelFeatures[level])
+                        continue;
+                    for (size_t i = chunk; i < chunkEnd; i++)
+                        if (cubes[i].shading == shading)
+                        {
+                            pointGridInstances(instance++);
+                            glBeginConditionalRender(conditionQueries[i], GL_QUERY_WAIT);
+                            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, 1);
+                            glEndConditionalRender();
+                        }
+                }
+                gridDrawStats.drawCalls += variantCounts[level];
+            }
+            else
+            {
+                pointGridInstances(first);
+                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)variantCounts[level]);
+                gridDrawStats.drawCalls++;
+            }
+            first += variantCounts[level];
+        }
+    }
+    gridDrawStats.cubes += cubes.size();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+//levelFeatures - variant of the default shader per shading level
+//batching - draws the cubes instanced when set up (batching.vao), levelFeatures have to include its variant then
+//conditionQueries - with conditional rendering, the query of every cube (drawOcclusionQueries), the GPU skips the hidden ones
+void drawStressGrid(const glm::mat4 projectionMat, const unsigned int containerVAO, Shader myShader, const unsigned int* levelFeatures,
+    const std::vector<StressCube>& cubes, const unsigned int* diffuseMaps, const unsigned int specularMap, const unsigned int emissionMap,
+    const GridBatching& batching, const GLuint* conditionQueries = NULL)
+{
+    glm::mat4 viewMat = frameSnapshot->viewMat;
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, specularMap);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, emissionMap);
+    if (batching.vao != 0)
+    {
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, batching.diffuseArray);
+        glActiveTexture(GL_TEXTURE0);
+        drawStressGridInstances(projectionMat, myShader, levelFeatures, cubes, batching, conditionQueries);
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(containerVAO);
+    //one pass per shading level, the cubes keep the grid order within a pass
+    for (int level = 0; level < SHADING_LEVEL_COUNT; level++)
+    {
+        bool used = false;
+        for (size_t i = 0; i < cubes.size(); i++)
+        {
+            if (cubes[i].shading != level)
+                continue;
+            if (!used)
+            {
+                myShader.Use(levelFeatures[level]);
+                myShader.setMat4("viewMat", viewMat);
+                myShader.setMat4("projectionMat", projectionMat);
+                used = true;
+            }
+            glBindTexture(GL_TEXTURE_2D, diffuseMaps[cubes[i].diffuseMap]);
+            myShader.setMat4("modelMat", cubes[i].modelMat);
+            if (conditionQueries)
+                glBeginConditionalRender(conditionQueries[i], GL_QUERY_WAIT);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            if (conditionQueries)
+                glEndConditionalRender();
+        }
+    }
+    gridDrawStats.cubes += cubes.size();
+    gridDrawStats.drawCalls += cubes.size();
+    glBindVertexArray(0);
+}
+
+//the first draw with a variant compiles it in some drivers (llvmpipe builds one per variant and render state, and only once
+//fragments reach it), the frame which switches to it would stall. draw(projectionMat) issues a draw with every variant the frames
+//can switch to, once at startup into a small target of its own. The variants of the lighting and depth pre-pass switches the
+//frames start with, beginPrepassedShading sets the depth state of the pre-pass. The color pass of the frames counts its fragments
+//(FragmentCounter), llvmpipe builds that into the variant as well. Needs the GL context, leaves framebuffer 0 bound
+void warmUpVariants(const std::function<void(const glm::mat4&)>& draw, bool depthPrepass, int renderWidth, int renderHeight)
+{
+    PROFILE_SCOPE("warm up shader variants");
+    const int size = 16;
+    OffscreenTarget target;
+    if (!target.Create(size, size))
+        return;
+    FrameSnapshot snapshot = FrameSnapshot();
+    snapshot.depthPrepass = depthPrepass;
+    snapshot.cameraPosition = glm::vec3(0.0f, 0.0f, 3.0f);
+    snapshot.viewMat = glm::lookAt(snapshot.cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const FrameSnapshot* frame = frameSnapshot;
+    frameSnapshot = &snapshot;
+    const glm::mat4 projectionMat = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+    glViewport(0, 0, size, size);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    GLuint fragments = 0;
+    glGenQueries(1, &fragments);
+    glBeginQuery(GL_SAMPLES_PASSED, fragments);
+    draw(projectionMat);
+    glEndQuery(GL_SAMPLES_PASSED);
+    glDeleteQueries(1, &fragments);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, renderWidth, renderHeight);
+    target.Delete();
+    frameSnapshot = frame;
+}
+
+void drawBackpack(const glm::mat4 projectionMat, Model& backpack, Shader modelShader)
+{
+    modelShader.Use();
+    modelShader.setMat4("projection", projectionMat);
+    modelShader.setMat4("view", frameSnapshot->viewMat);
+    modelShader.setMat4("model", glm::mat4(1.0f));
+    const std::vector<unsigned char>& hiddenMeshes = frameSnapshot->hiddenMeshes;
+    for (size_t i = 0; i < backpack.meshes.size(); i++)
+        if (i >= hiddenMeshes.size() || !hiddenMeshes[i])
+            backpack.meshes[i].Draw(modelShader);
+}
+
+//cell of the stress grid, (x * 10 + y) * 5 + z for 20 x 10 x 5 cubes
+glm::vec3 stressCellPosition(unsigned int cell)
+{
+    return glm::vec3(-9.5f + cell / 50, 0.0f + cell / 5 % 10, -6.0f - cell % 5);
+}
+const float STRESS_CUBE_RADIUS = 0.6f * 0.8660254f;        //bounding sphere of the scaled cube
+
+//bounding volume hierarchy over the cells of the stress grid, the boxes around their bounding spheres
+void buildStressGridBvh(Bvh& bvh)
+{
+    std::vector<Aabb> bounds(20 * 10 * 5);
+    for (unsigned int cell = 0; cell < bounds.size(); cell++)
+    {
+        bounds[cell].boxMin = stressCellPosition(cell) - glm::vec3(STRESS_CUBE_RADIUS);
+        bounds[cell].boxMax = stressCellPosition(cell) + glm::vec3(STRESS_CUBE_RADIUS);
+    }
+    bvh.Build(bounds);
+}
+
+//the stress grid with the cubes outside of the view frustum dropped, the visible ones get their shading level
+//(shadingLevels holds the level of every cell of the grid in the last frame)
+void cullStressGrid(const Bvh& gridBvh, const glm::mat4& projectionMat, const glm::mat4& viewMat, const glm::vec3& cameraPosition,
+    const ShadingLod& shadingLod, std::vector<ShadingLevel>& shadingLevels, std::vector<StressCube>& cubes)
+{
+    PROFILE_SCOPE("cull stress grid");
+    //the cells in view from the hierarchy, then sorted back into grid order so the draw order stays the same. They live
+    //in the scratch arena of this thread and are reserved for the whole grid
+    ScratchScope scratch;
+    ArenaVector<unsigned int> cells{ ArenaAllocator<unsigned int>(FrameArena::Scratch()) };
+    cells.reserve(20 * 10 * 5);
+    const Frustum frustum(projectionMat * viewMat);
+    gridBvh.QueryFrustum(frustum, [&frustum, &cells](unsigned int cell) {
+        if (frustum.IntersectsSphere(stressCellPosition(cell), STRESS_CUBE_RADIUS))
+            cells.push_back(cell);
+    });
+    std::sort(cells.begin(), cells.end());
+
+    //everything the jobs read behind one reference, a job function with more captures no longer fits into std::function
+    //without allocating
+    struct GridView
+    {
+        const unsigned int* cells;
+        glm::vec3 cameraPosition;
+        glm::mat4 projectionMat;
+        const ShadingLod& shadingLod;
+        std::vector<ShadingLevel>& shadingLevels;
+    } view = { cells.data(), cameraPosition, projectionMat, shadingLod, shadingLevels };
+    cubes.clear();
+    cubes.reserve(20 * 10 * 5);     //the whole grid, so the snapshot never grows when more of it comes into view
+    cubes.resize(cells.size());
+    JobSystem::Instance().ParallelFor(cells.size(), 64, [&view, &cubes](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const unsigned int cell = view.cells[i];
+            const glm::vec3 position = stressCellPosition(cell);
+            StressCube& cube = cubes[i];
+            cube.modelMat = glm::mat4(1.0f);
+            cube.modelMat = glm::translate(cube.modelMat, position);
+            cube.modelMat = glm::scale(cube.modelMat, glm::vec3(0.6f));
+            cube.diffuseMap = (cell / 50 + cell / 5 % 10 + cell % 5) % 2;     //neighbours use different textures so every cube changes state as well
+            ShadingLevel& level = view.shadingLevels[cell];
+            level = view.shadingLod.Select(level, ShadingLod::ScreenSize(position, STRESS_CUBE_RADIUS, view.cameraPosition, view.projectionMat));
+            cube.shading = level;
+        }
+    });
+}
+
+//OCCLUSION_SOFTWARE: the floor, the containers and the occluders are rasterized into the software depth buffer, the grid cubes
+//it hides move from cubes to culled before the render stage sees them. Returns the time of the rasterization in ms
+double softwareOcclusionCull(SoftwareOcclusion& occlusion, const glm::mat4& viewProjection, const float* planeVertices, const float* cubeVertices,
+    const glm::vec3* cubePositions, const std::vector<StressCube>& occluders, std::vector<StressCube>& cubes, std::vector<StressCube>& culled)
+{
+    PROFILE_SCOPE("software occlusion cull");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    occlusion.BeginFrame(viewProjection);
+    occlusion.AddOccluder(planeVertices, 8 * sizeof(float), 6, NULL, 0, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.01f, 0.0f)));
+    for (int i = 0; i < 5; i++)
+        occlusion.AddOccluder(cubeVertices, 8 * sizeof(float), 36, NULL, 0, glm::translate(glm::mat4(1.0f), cubePositions[i]));
+    for (size_t i = 0; i < occluders.size(); i++)
+        occlusion.AddOccluder(cubeVertices, 8 * sizeof(float), 36, NULL, 0, occluders[i].modelMat);
+    occlusion.Rasterize();
+    double rasterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    culled.clear();
+    culled.reserve(20 * 10 * 5);
+    size_t kept = 0;
+    for (size_t i = 0; i < cubes.size(); i++)
+    {
+        glm::vec3 boxMin, boxMax;
+        modelBounds(cubes[i].modelMat, boxMin, boxMax);
+        if (occlusion.Occluded(boxMin, boxMax))
+            culled.push_back(cubes[i]);
+        else
+            cubes[kept++] = cubes[i];
+    }
+    cubes.resize(kept);
+    return rasterMs;
+}
+
+//OCCLUSION_SOFTWARE in the backpack scene: the meshes occlude each other, hidden gets a flag per mesh. Returns the time of
+//the rasterization in ms
+double softwareOcclusionCull(SoftwareOcclusion& occlusion, const glm::mat4& viewProjection, const Model& model, std::vector<unsigned char>& hidden)
+{
+    PROFILE_SCOPE("software occlusion cull");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    occlusion.BeginFrame(viewProjection);
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        const Mesh& mesh = model.meshes[i];
+        if (!mesh.vertices.empty() && !mesh.indices.empty())
+            occlusion.AddOccluder(&mesh.vertices[0].Position.x, sizeof(Vertex), mesh.vertices.size(), &mesh.indices[0], mesh.indices.size(), glm::mat4(1.0f));
+    }
+    occlusion.Rasterize();
+    double rasterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    hidden.resize(model.meshes.size());
+    for (size_t i = 0; i < model.meshes.size(); i++)
+        hidden[i] = occlusion.Occluded(model.meshes[i].BoundsMin, model.meshes[i].BoundsMax);
+    return rasterMs;
+}
+
+//walls of the occlusion scene around the stress grid (x -9.8 to 9.8, z -5.7 to -10.3), lower than the grid so its top rows
+//stay in view
+std::vector<StressCube> occlusionWalls()
+{
+    const glm::vec3 centers[4] = { glm::vec3(0.0f, 3.0f, -4.8f), glm::vec3(0.0f, 3.0f, -10.8f), glm::vec3(-10.2f, 3.0f, -7.8f),
+        glm::vec3(10.2f, 3.0f, -7.8f) };
+    const glm::vec3 sizes[4] = { glm::vec3(21.0f, 7.0f, 0.4f), glm::vec3(21.0f, 7.0f, 0.4f), glm::vec3(0.4f, 7.0f, 5.6f),
+        glm::vec3(0.4f, 7.0f, 5.6f) };
+    std::vector<StressCube> walls(4);
+    for (int i = 0; i < 4; i++)
+    {
+        walls[i].modelMat = glm::mat4(1.0f);
+        walls[i].modelMat = glm::translate(walls[i].modelMat, centers[i]);
+        walls[i].modelMat = glm::scale(walls[i].modelMat, sizes[i]);
+        walls[i].diffuseMap = 1;
+        walls[i].shading = SHADING_RELIEF;
+    }
+    return walls;
+}
+
+//triangle hierarchies of the meshes which can be picked
+struct PickMeshes
+{
+    MeshBvh cube;
+    MeshBvh plane;
+    MeshBvh quad;
+};
+
+//objects of a scene for the picker: the main scene in the order of ShadowCaster, then the cells of the stress grid and the
+//walls. The backpack scene has the meshes of the model
+void buildPicker(ObjectPicker& picker, SceneKind scene, const AnimationState& state, const PickMeshes& meshes, const glm::vec3* cubePositions,
+    const std::vector<StressCube>& walls, const Model* backpack)
+{
+    picker.Clear();
+    if (scene == SCENE_BACKPACK)
+    {
+        for (size_t i = 0; i < backpack->meshes.size(); i++)
+            picker.Add(&backpack->meshes[i].TriangleBvh, glm::mat4(1.0f));
+        picker.Build();
+        return;
+    }
+    picker.Add(&meshes.plane, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.01f, 0.0f)));
+    for (int i = 0; i < 5; i++)
+        picker.Add(&meshes.cube, glm::translate(glm::mat4(1.0f), cubePositions[i]));
+    for (int i = 0; i < 2; i++)
+        picker.Add(&meshes.cube, mirrorCubeModelMat(state, i));
+    picker.Add(&meshes.quad, nMapModelMat(state));
+    picker.Add(&meshes.quad, parallaxModelMat(state));
+    if (scene == SCENE_STRESS || scene == SCENE_OCCLUSION)
+        for (unsigned int cell = 0; cell < 20 * 10 * 5; cell++)
+            picker.Add(&meshes.cube, glm::scale(glm::translate(glm::mat4(1.0f), stressCellPosition(cell)), glm::vec3(0.6f)));
+    if (scene == SCENE_OCCLUSION)
+        for (size_t i = 0; i < walls.size(); i++)
+            picker.Add(&meshes.cube, walls[i].modelMat);
+    picker.Build();
+}
+
+//the mirror cubes and the quads turn, the rest of the picker stays where buildPicker put it
+void movePicker(ObjectPicker& picker, SceneKind scene, const AnimationState& state)
+{
+    if (scene == SCENE_BACKPACK)
+        return;
+    for (int i = 0; i < 2; i++)
+        picker.Move(CASTER_MIRROR + i, mirrorCubeModelMat(state, i));
+    picker.Move(CASTER_NMAP, nMapModelMat(state));
+    picker.Move(CASTER_PARALLAX, parallaxModelMat(state));
+    picker.Refit();
+}
+
+//what an object of buildPicker is, for the log
+std::string pickedObjectName(SceneKind scene, unsigned int object)
+{
+    if (scene == SCENE_BACKPACK)
+        return "backpack mesh " + std::to_string(object);
+    if (object == CASTER_FLOOR)
+        return "floor";
+    if (object < CASTER_MIRROR)
+        return "container " + std::to_string(object - CASTER_CONTAINERS);
+    if (object == CASTER_MIRROR)
+        return "mirror cube";
+    if (object == CASTER_REFRACTION_CUBE)
+        return "refraction cube";
+    if (object == CASTER_NMAP)
+        return "normal mapped quad";
+    if (object == CASTER_PARALLAX)
+        return "parallax quad";
+    if (object < CASTER_COUNT + 20 * 10 * 5)
+        return "stress cube " + std::to_string(object - CASTER_COUNT);
+    return "wall " + std::to_string(object - CASTER_COUNT - 20 * 10 * 5);
+}
+
+//back to front for blending
+void sortWindows(const std::vector<glm::vec3>& windows, const glm::vec3& cameraPosition, std::vector<glm::vec3>& sortedWindows)
+{
+    PROFILE_SCOPE("sort windows");
+    sortedWindows = windows;
+    std::sort(sortedWindows.begin(), sortedWindows.end(), [&cameraPosition](const glm::vec3& a, const glm::vec3& b) {
+        return glm::length(cameraPosition - a) > glm::length(cameraPosition - b);
+    });
+}
+
+//every benchmark scene is flown around once per run
+CameraPath sceneOrbit(SceneKind scene, float duration)
+{
+    if (scene == SCENE_BACKPACK)
+        return CameraPath::Orbit(glm::vec3(0.0f), 5.0f, 1.0f, duration);
+    if (scene == SCENE_STRESS)
+        return CameraPath::Orbit(glm::vec3(0.0f, 2.0f, -4.0f), 12.0f, 3.0f, duration);
+    if (scene == SCENE_OCCLUSION)       //around the walls, never between them
+        return CameraPath::Orbit(glm::vec3(0.0f, 2.0f, -7.8f), 20.0f, 4.0f, duration);
+    return CameraPath::Orbit(glm::vec3(0.0f, 0.5f, 0.0f), 7.0f, 2.0f, duration);
+}
+/*
+unsigned int quadVAO = 0;
+unsigned int quadVBO;
+void renderQuad()
+{
+    if (quadVAO == 0)
+    {
+        float quadVertices[] = {
+            // координаты        // текстурные координаты
+            -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+            -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+             1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+             1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+        };
+        glGenVertexArrays(1, &quadVAO);
+        glGenBuffers(1, &quadVBO);
+        glBindVertexArray(quadVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    }
+    glBindVertexArray(quadVAO);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+}*/
+//=====================================================================================================================================================================================================
+
+//shader uniform names of a point light, built once instead of every frame
+struct PointLightUniforms {
+    std::string position, constant, linear, quadratic, ambient, diffuse, specular;
+};
+//what the scenes are made of: set up by main before the first frame, only read by the two stages
+struct SceneResources {
+    const float* vertices;                  //container cube, position, texture coordinates and normal
+    const float* planeVertices;
+    glm::vec3* cubePositions;
+    const glm::vec3* pointLightPositions;
+    std::vector<glm::vec3> windows;
+    std::vector<StressCube> walls;          //around the grid of the occlusion scene
+    Model* backpack;                        //NULL unless a scene shows it
+    Shader* modelShader;
+    Shader* myShader;
+    Shader* outlineShader;
+    Shader* lampShader;
+    Shader* windowShader;
+    Shader* skyboxShader;
+    Shader* mirrorShader;
+    Shader* simpleDepthShader;
+    Shader* nMapShader;
+    Shader* parallaxShader;
+    unsigned int containerVAO, planeVAO, transparentVAO, lightVAO, skyboxVAO, mirrorVAO, nMapVAO;
+    unsigned int shadowMapFBO, shadowMap, shadowWidth, shadowHeight;
+    unsigned int cubemapTexture, diffuseMap, specularMap, emissionMap, floorTexture, windowTexture;
+    unsigned int nMapDiffuseMap, nMapNormalMap, parallaxDiffuse, parallaxNormal, parallaxHeight, parallaxCone;
+    unsigned int stressDiffuseMaps[2];
+    //shader features, and the variants of the shading levels (ShadingLod.h)
+    unsigned int pointLightsFeature, spotlightFeature, singleTapShadowsFeature, depthPrepassFeature;
+    unsigned int nMapLevelFeatures[SHADING_LEVEL_COUNT];
+    unsigned int parallaxLevelFeatures[SHADING_LEVEL_COUNT];
+    PointLightUniforms pointLightUniforms[numberOfPointLights];
+    GridBatching gridBatching;
+};
+//the update stage, main thread: what it keeps from one frame to the next
+struct UpdateStage {
+    UpdateStage(const BenchmarkOptions& options, PipelineStats& pipelineStats, const std::vector<std::string>& sceneNames)
+        : options(options), pipelineStats(pipelineStats), sceneNames(sceneNames), sceneRuns(sceneNames.size(), true),
+        simulation(options.simulationStep), stressShading(20 * 10 * 5, SHADING_RELIEF), lightFrustum(directLightSpaceMatrix(1.0f, 20.0f))
+    {
+        this->probeSeenQuads[0] = this->probeSeenQuads[1] = glm::mat4(1.0f);
+    }
+    const BenchmarkOptions& options;
+    PipelineStats& pipelineStats;
+    const std::vector<std::string>& sceneNames;
+    std::vector<bool> sceneRuns;            //false for a scene which cannot run
+    GLFWwindow* window = NULL;
+    int renderWidth = 0, renderHeight = 0;
+    int totalFrames = 0;                    //of a headless scene, warm up included
+    //the scene and frame it is at
+    SceneKind currentScene = SCENE_MAIN;
+    size_t sceneIndex = 0;
+    int frameIndex = 0;
+    FixedTimestep simulation;
+    CameraPath cameraPath, recordedPath;
+    //shading levels of the last frame, the LOD only moves them past a margin
+    ShadingLod shadingLod;
+    ShadingLevel nMapShading = SHADING_RELIEF, parallaxShading = SHADING_RELIEF;
+    std::vector<ShadingLevel> stressShading;
+    //bounding volume hierarchies: the static grid cells, and the shadow casters refitted every frame
+    Bvh stressGridBvh, shadowCasterBvh;
+    std::vector<Aabb> shadowCasterBoxes;
+    const Frustum lightFrustum;
+    //picking with the left mouse button, the objects of the scene are put into the picker when it starts
+    PickMeshes pickMeshes;
+    ObjectPicker picker;
+    //what the reflection probe saw last frame, with --probe-update motion its faces are only rendered again after a change
+    glm::vec3 probePosition;
+    glm::mat4 probeProjection;
+    glm::mat4 probeSeenQuads[2];
+    glm::vec3 probeSeenCamera = glm::vec3(0.0f), probeSeenCameraFront = glm::vec3(0.0f);
+    bool probeSeenPointLights = false, probeSeenSpotlight = false;
+    //OCCLUSION_SOFTWARE, the occluders rasterized at a small resolution with the aspect of the frame
+    SoftwareOcclusion softwareOcclusion;
+};
+//the render stage, render thread (or the main thread with --single-thread): what it keeps from one frame to the next, and the
+//results of the scenes
+struct RenderStage {
+    RenderStage(const BenchmarkOptions& options, PipelineStats& pipelineStats, const std::vector<std::string>& sceneNames)
+        : options(options), pipelineStats(pipelineStats), sceneNames(sceneNames), occlusionQueries(20 * 10 * 5),
+        suiteResults(sceneNames.size()), occlusionRuns(sceneNames.size())
+    {
+        this->probeSnapshot.depthPrepass = false;
+        this->unoccludedCubes.reserve(20 * 10 * 5);
+        this->occludedCubes.reserve(20 * 10 * 5);
+        this->disoccludedCubes.reserve(20 * 10 * 5);
+    }
+    const BenchmarkOptions& options;
+    PipelineStats& pipelineStats;
+    const std::vector<std::string>& sceneNames;
+    GLFWwindow* window = NULL;
+    int renderWidth = 0, renderHeight = 0;
+    unsigned int sceneFBO = 0;              //0, or the offscreen target of a headless run
+    double shaderStartupMs = 0.0;
+    //frame times and heap allocations, the window title the main thread shows
+    std::vector<double> frameTimesMs;       //of the measured frames
+    double lastFrameEnd = 0.0, lastTitleUpdate = 0.0;
+    double lastFrameWorkMs = 0.0;           //CPU time of the last frame, up to the present
+    unsigned long long frameAllocations = 0, measuredAllocations = 0, workerAllocationsSeen = 0;
+    RenderStats measuredStatsStart;
+    FragmentCounter shadedFragments;        //fragments of the color pass which pass the depth test
+    std::mutex titleMutex;
+    std::string windowTitle;
+    TextureStreamer textureStreamer;
+    //the mirror cubes reflect the scene around them: one probe halfway between the two, rendered without them (ReflectionProbe.h)
+    bool probeEnabled = false;
+    ReflectionProbe reflectionProbe;
+    glm::mat4 probeProjection;
+    FrameSnapshot probeSnapshot;            //the frame seen from the probe, only what the draw functions read
+    std::vector<glm::vec3> probeWindows;    //the windows do not move, sorted once for the probe
+    //occlusion culling of the container grid (OcclusionCulling.h): the depth pyramid of the last frame, or a query per cube
+    HiZPyramid hiZPyramid;
+    std::vector<GLuint> occlusionQueries;
+    size_t pendingQueries = 0;              //queries of the last conditional frame, read before they are issued again
+    bool pendingQueriesMeasured = false;
+    OcclusionStats occlusionStats;
+    //the grid cubes in view by the pyramid of the last frame: not hidden, hidden (tested again once this frame's depth is
+    //in), and the hidden ones which came into view
+    std::vector<StressCube> unoccludedCubes, occludedCubes, disoccludedCubes;
+    //the screen-space outline of the containers, drawn from the marks they leave in the stencil
+    ScreenSpaceOutline screenOutline;
+    //dynamic resolution: the target is created the first time it is switched on, the controller starts over every time
+    ResolutionController resolution;
+    ResolutionTarget resolutionTarget;
+    bool resolutionActive = false;
+    double measuredScaleSum = 0.0;
+    //post-processing, created the first time a stage is switched on
+    PostProcessChain postProcess;
+    std::vector<PerfSceneResult> suiteResults;
+    std::vector<OcclusionBenchmarkRun> occlusionRuns;
+};
+
+//update stage: input, simulation, culling and sorting. Everything the render stage needs goes into the snapshot, returns
+//false when there is nothing left to render
+bool updateFrame(UpdateStage& stage, const SceneResources& resources, FrameSnapshot& snapshot)
+{
+    PROFILE_SCOPE("update");
+    PipelineStageTimer stageTimer(stage.pipelineStats, PIPELINE_UPDATE);
+    FrameArena::Scratch().Reset();
+    unsigned long long allocationsBefore = threadAllocationCount();
+    while (stage.sceneIndex < stage.sceneNames.size() && !stage.sceneRuns[stage.sceneIndex])
+        stage.sceneIndex++;
+    if (glfwWindowShouldClose(stage.window) || stage.sceneIndex >= stage.sceneNames.size())
+        return false;
+    if (stage.frameIndex == 0)
+    {
+        //every scene starts from the same state
+        const std::string& sceneName = stage.sceneNames[stage.sceneIndex];
+        stage.currentScene = sceneName == "backpack" ? SCENE_BACKPACK : sceneName == "stress" ? SCENE_STRESS
+            : sceneName == "occlusion" ? SCENE_OCCLUSION : SCENE_MAIN;
+        if (stage.options.occlusionBenchmark)
+            occlusionModeSwitch = (OcclusionMode)stage.sceneIndex;
+        camera = Camera(glm::vec3(0.0f, 0.0f, 3.0f));
+        frameClock.Reset();
+        stage.simulation.Reset();
+        animation.Reset(camera.Position);
+        if (stage.options.headless && stage.options.cameraPath.empty())
+            stage.cameraPath = sceneOrbit(stage.currentScene, stage.totalFrames * stage.options.timeStep);
+        stage.nMapShading = stage.parallaxShading = SHADING_RELIEF;
+        std::fill(stage.stressShading.begin(), stage.stressShading.end(), SHADING_RELIEF);
+        buildPicker(stage.picker, stage.currentScene, animation.Current, stage.pickMeshes, resources.cubePositions, resources.walls, resources.backpack);
+    }
+
+    const FrameTime& frameTime = frameClock.Tick(stage.options.headless ? stage.frameIndex * (double)stage.options.timeStep : glfwGetTime());
+
+    glfwPollEvents();
+    //the camera holds the interpolated position of the last frame, the simulation continues from its own
+    camera.Position = animation.Current.cameraPosition;
+    int steps = stage.simulation.Advance(frameTime.delta);
+    for (int i = 0; i < steps; i++)
+    {
+        if (!stage.options.headless)
+            do_movements((GLfloat)stage.simulation.Step);
+        animation.Update(stage.simulation.Step, camera.Position);
+    }
+    snapshot.animation = animation.Interpolated(stage.simulation.Alpha());
+    camera.Position = snapshot.animation.cameraPosition;
+    if (stage.options.headless)
+        stage.cameraPath.Apply((float)snapshot.animation.time, camera);
+    if (!stage.options.recordCameraPath.empty())
+        stage.recordedPath.Add((float)snapshot.animation.time, camera);
+
+    snapshot.sceneIndex = stage.sceneIndex;
+    snapshot.scene = stage.currentScene;
+    snapshot.frameIndex = stage.frameIndex;
+    snapshot.sceneEnd = stage.options.headless && stage.frameIndex + 1 == stage.totalFrames;
+    snapshot.time = frameTime.time;
+    snapshot.viewMat = camera.GetViewMatrix();
+    snapshot.projectionMat = glm::perspective(glm::radians(camera.Zoom), (GLfloat)stage.renderWidth / (GLfloat)stage.renderHeight, 0.1f, 100.0f);
+    snapshot.cameraPosition = camera.Position;
+    snapshot.cameraFront = camera.Front;
+    snapshot.pointLights = showLampsAndTheirLight;
+    snapshot.spotlight = globalSpotlightSwitch;
+    snapshot.profilerOverlay = showProfilerOverlay;
+    snapshot.depthPrepass = depthPrepassSwitch;
+    snapshot.occlusion = occlusionModeSwitch;
+    snapshot.dynamicResolution = dynamicResolutionSwitch;
+    snapshot.postProcess = postProcessSettings;
+    snapshot.outline = outlineModeSwitch;
+    snapshot.exportTraces = exportTracesRequested;
+    exportTracesRequested = false;
+    stage.shadingLod.ForcedLevel = shadingLodOverride;
+    stage.nMapShading = quadShading(stage.shadingLod, stage.nMapShading, nMapModelMat(snapshot.animation), snapshot.cameraPosition, snapshot.projectionMat);
+    stage.parallaxShading = quadShading(stage.shadingLod, stage.parallaxShading, parallaxModelMat(snapshot.animation), snapshot.cameraPosition, snapshot.projectionMat);
+    snapshot.nMapShading = stage.nMapShading;
+    snapshot.parallaxShading = stage.parallaxShading;
+    //the probe sees the two animated quads (the mirror cubes are left out of it), the lamps and, with the spotlight on, the camera.
+    //A quad moving under two texels of a probe face does not count
+    snapshot.probeInvalidated = snapshot.pointLights != stage.probeSeenPointLights || snapshot.spotlight != stage.probeSeenSpotlight
+        || (snapshot.spotlight && (snapshot.cameraPosition != stage.probeSeenCamera || snapshot.cameraFront != stage.probeSeenCameraFront));
+    const glm::mat4 probeQuads[2] = { nMapModelMat(snapshot.animation), parallaxModelMat(snapshot.animation) };
+    for (int i = 0; i < 2; i++)
+    {
+        glm::vec3 center = glm::vec3(probeQuads[i][3]);
+        float radius = glm::length(glm::vec3(probeQuads[i][0]) + glm::vec3(probeQuads[i][1]));
+        if (probeQuads[i] != stage.probeSeenQuads[i] && ShadingLod::ScreenSize(center, radius, stage.probePosition, stage.probeProjection) * stage.options.probeSize > 2.0f)
+            snapshot.probeInvalidated = true;
+        stage.probeSeenQuads[i] = probeQuads[i];
+    }
+    stage.probeSeenCamera = snapshot.cameraPosition;
+    stage.probeSeenCameraFront = snapshot.cameraFront;
+    stage.probeSeenPointLights = snapshot.pointLights;
+    stage.probeSeenSpotlight = snapshot.spotlight;
+    sortWindows(resources.windows, camera.Position, snapshot.sortedWindows);
+    if (pickRequested)
+    {
+        //through the cursor, or the middle of the window while the cursor turns the camera
+        pickRequested = false;
+        int windowWidth, windowHeight;
+        glfwGetWindowSize(stage.window, &windowWidth, &windowHeight);
+        double cursorX = windowWidth / 2.0, cursorY = windowHeight / 2.0;
+        if (glfwGetInputMode(stage.window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+            glfwGetCursorPos(stage.window, &cursorX, &cursorY);
+        std::chrono::steady_clock::time_point pickStart = std::chrono::steady_clock::now();
+        glm::vec3 rayOrigin, rayDirection;
+        cursorRay(cursorX, cursorY, windowWidth, windowHeight, snapshot.projectionMat, snapshot.viewMat, rayOrigin, rayDirection);
+        movePicker(stage.picker, stage.currentScene, snapshot.animation);
+        PickHit hit;
+        bool picked = stage.picker.Pick(rayOrigin, rayDirection, hit);
+        double pickUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+        if (picked)
+            LOG_INFO << "Picked " << pickedObjectName(stage.currentScene, hit.object) << ", triangle " << hit.triangle << " at u " << hit.u
+                << " v " << hit.v << ", distance " << hit.t << " (" << pickUs << " us)";
+        else
+            LOG_INFO << "Picked nothing (" << pickUs << " us)";
+    }
+    //shadow casters in the light frustum, the quads and the mirror cubes turn
+    shadowCasterBounds(snapshot.animation, resources.cubePositions, stage.shadowCasterBoxes);
+    stage.shadowCasterBvh.Refit(stage.shadowCasterBoxes);
+    snapshot.shadowCasters = 0;
+    unsigned int& shadowCasters = snapshot.shadowCasters;
+    stage.shadowCasterBvh.QueryFrustum(stage.lightFrustum, [&shadowCasters](unsigned int caster) { shadowCasters |= 1u << caster; });
+    if (stage.currentScene == SCENE_STRESS || stage.currentScene == SCENE_OCCLUSION)
+        cullStressGrid(stage.stressGridBvh, snapshot.projectionMat, snapshot.viewMat, snapshot.cameraPosition, stage.shadingLod, stage.stressShading, snapshot.stressCubes);
+    else
+        snapshot.stressCubes.clear();
+    snapshot.softwareCulledCubes.clear();
+    snapshot.hiddenMeshes.clear();
+    snapshot.occluderTriangles = 0;
+    snapshot.softwareRasterMs = 0.0;
+    if (occlusionModeSwitch == OCCLUSION_SOFTWARE && stage.currentScene != SCENE_MAIN)
+    {
+        if (stage.currentScene == SCENE_BACKPACK)
+            snapshot.softwareRasterMs = softwareOcclusionCull(stage.softwareOcclusion, snapshot.projectionMat * snapshot.viewMat, *resources.backpack,
+                snapshot.hiddenMeshes);
+        else
+            snapshot.softwareRasterMs = softwareOcclusionCull(stage.softwareOcclusion, snapshot.projectionMat * snapshot.viewMat, resources.planeVertices, resources.vertices,
+                resources.cubePositions, stage.currentScene == SCENE_OCCLUSION ? resources.walls : noCubes, snapshot.stressCubes, snapshot.softwareCulledCubes);
+        snapshot.occluderTriangles = stage.softwareOcclusion.Triangles();
+    }
+
+    stage.frameIndex++;
+    if (stage.options.headless && stage.frameIndex == stage.totalFrames)
+    {
+        stage.sceneIndex++;
+        stage.frameIndex = 0;
+    }
+    snapshot.allocations = threadAllocationCount() - allocationsBefore;
+    return true;
+}
+
+//conditional rendering: the results of the queries issued last frame, available long ago
+void collectOcclusionQueries(RenderStage& stage)
+{
+    if (stage.pendingQueriesMeasured)
+        for (size_t i = 0; i < stage.pendingQueries; i++)
+        {
+            GLuint passed = 0;
+            glGetQueryObjectuiv(stage.occlusionQueries[i], GL_QUERY_RESULT, &passed);
+            stage.occlusionStats.tested++;
+            if (!passed)
+                stage.occlusionStats.culled++;
+        }
+    stage.pendingQueries = 0;
+}
+
+//the mipmaps the textures need at the size of what they are on, the render stage asks before anything is drawn with them
+void streamTextures(RenderStage& stage, const SceneResources& resources, const FrameSnapshot& snapshot, int frameHeight)
+{
+    const SceneKind scene = snapshot.scene;
+    const bool gridScene = scene == SCENE_STRESS || scene == SCENE_OCCLUSION;
+    //pixels across one repeat of a texture, repeatSize world units wide at position
+    auto texturePixels = [&snapshot, frameHeight](const glm::vec3& position, float repeatSize) {
+        return ShadingLod::ScreenSize(position, 0.5f * repeatSize, snapshot.cameraPosition, snapshot.projectionMat) * frameHeight;
+    };
+    if (scene != SCENE_BACKPACK)
+    {
+        float containers = 0.0f;
+        for (unsigned int i = 0; i < 5; i++)
+            containers = std::max(containers, texturePixels(resources.cubePositions[i], 1.0f));
+        stage.textureStreamer.Require(resources.diffuseMap, containers);
+        stage.textureStreamer.Require(resources.specularMap, containers);
+        stage.textureStreamer.Require(resources.emissionMap, containers);
+        //the floor repeats every 2 units, its nearest point counts
+        const glm::vec3 floorPoint(glm::clamp(snapshot.cameraPosition.x, -10.0f, 10.0f), -0.5f, glm::clamp(snapshot.cameraPosition.z, -10.0f, 10.0f));
+        stage.textureStreamer.Require(resources.floorTexture, texturePixels(floorPoint, 2.0f));
+        for (size_t i = 0; i < snapshot.sortedWindows.size(); i++)
+            stage.textureStreamer.Require(resources.windowTexture, texturePixels(snapshot.sortedWindows[i], 1.0f));
+        const float nMap = texturePixels(glm::vec3(nMapModelMat(snapshot.animation)[3]), 1.4f);
+        stage.textureStreamer.Require(resources.nMapDiffuseMap, nMap);
+        stage.textureStreamer.Require(resources.nMapNormalMap, nMap);
+        const float parallax = texturePixels(glm::vec3(parallaxModelMat(snapshot.animation)[3]), 1.4f);
+        stage.textureStreamer.Require(resources.parallaxDiffuse, parallax);
+        stage.textureStreamer.Require(resources.parallaxNormal, parallax);
+        stage.textureStreamer.Require(resources.parallaxHeight, parallax);
+        stage.textureStreamer.Require(resources.parallaxCone, parallax);
+    }
+    if (gridScene)
+    {
+        //a grid cube or wall is stretched over by one repeat, the nearest of each diffuse map counts
+        float grid[2] = { 0.0f, 0.0f };
+        for (size_t i = 0; i < snapshot.stressCubes.size(); i++)
+        {
+            const StressCube& cube = snapshot.stressCubes[i];
+            grid[cube.diffuseMap] = std::max(grid[cube.diffuseMap], texturePixels(glm::vec3(cube.modelMat[3]), glm::length(glm::vec3(cube.modelMat[0]))));
+        }
+        if (scene == SCENE_OCCLUSION)
+            for (size_t i = 0; i < resources.walls.size(); i++)
+                grid[resources.walls[i].diffuseMap] = std::max(grid[resources.walls[i].diffuseMap],
+                    texturePixels(glm::vec3(resources.walls[i].modelMat[3]), glm::length(glm::vec3(resources.walls[i].modelMat[0]))));
+        for (int map = 0; map < 2; map++)
+            stage.textureStreamer.Require(resources.stressDiffuseMaps[map], grid[map]);
+        stage.textureStreamer.Require(resources.specularMap, std::max(grid[0], grid[1]));
+        stage.textureStreamer.Require(resources.emissionMap, std::max(grid[0], grid[1]));
+    }
+    stage.textureStreamer.Update();
+}
+
+//last frame of a headless scene: its statistics are logged and kept for the benchmark or the performance suite
+void endScene(RenderStage& stage, const SceneResources& resources, const FrameSnapshot& snapshot, bool postProcessing)
+{
+    const SceneKind scene = snapshot.scene;
+    const bool gridScene = scene == SCENE_STRESS || scene == SCENE_OCCLUSION;
+#if TRACK_ALLOCATIONS
+    //after the warm up every frame has to run without touching the heap
+    LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": " << (double)stage.measuredAllocations / stage.options.frames
+        << " heap allocations per measured frame";
+    if (stage.measuredAllocations != 0)
+    {
+        LOG_ERROR << "ERROR::ALLOCATIONS::STEADY_STATE: " << stage.measuredAllocations << " heap allocations in " << stage.options.frames << " measured frames";
+        Logger::Instance().Flush();
+    }
+    assert(stage.measuredAllocations == 0);
+#endif
+    gpuProfiler.Flush();
+    stage.shadedFragments.Flush();
+    collectOcclusionQueries(stage);
+    if (stage.resolutionActive)
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": dynamic resolution at " << stage.measuredScaleSum / stage.options.frames
+            << " of " << stage.renderWidth << "x" << stage.renderHeight << " on average, " << stage.resolution.Changes() << " changes, " << stage.resolution.Summary();
+    if (stage.options.textureStreaming)
+    {
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": texture streaming " << stage.textureStreamer.Summary();
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": resident mipmaps " << stage.textureStreamer.Residency();
+        if (stage.textureStreamer.WriteCsv("texture_streaming.csv"))
+            LOG_INFO << "Texture streaming history written to texture_streaming.csv";
+    }
+    if (postProcessing)
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": post-processing " << gpuProfiler.AverageMs("post-process") << " ms on the GPU (bloom down "
+            << gpuProfiler.AverageMs("bloom down") << ", bloom up " << gpuProfiler.AverageMs("bloom up") << ", composite "
+            << gpuProfiler.AverageMs("composite") << ", sharpen " << gpuProfiler.AverageMs("sharpen") << ")";
+    if (gridScene)
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": " << (double)gridDrawStats.cubes / stage.options.frames << " grid cubes per frame in "
+            << (double)gridDrawStats.drawCalls / stage.options.frames << " draw calls"
+            << (resources.gridBatching.vao != 0 ? " (instanced from the texture array)" : " (a texture bind and a draw each)");
+    if (gridScene && snapshot.occlusion != OCCLUSION_OFF)
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": occlusion culling (" << occlusionModeName(snapshot.occlusion) << ") hid "
+            << stage.occlusionStats.CulledPercent() << "% of " << (double)stage.occlusionStats.tested / stage.options.frames << " grid cubes in view per frame";
+    else if (scene == SCENE_BACKPACK && snapshot.occlusion == OCCLUSION_SOFTWARE)
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": occlusion culling (software) hid " << stage.occlusionStats.CulledPercent()
+            << "% of the meshes";
+    if (snapshot.occlusion == OCCLUSION_SOFTWARE && scene != SCENE_MAIN)
+        LOG_INFO << "Scene " << stage.sceneNames[snapshot.sceneIndex] << ": " << (double)stage.occlusionStats.occluderTriangles / stage.options.frames
+            << " occluder triangles per frame rasterized on the CPU, " << stage.occlusionStats.TrianglesPerMs() << " triangles/ms";
+    if (stage.options.occlusionBenchmark)
+    {
+        TimingSummary frameSummary = summarizeTimings(stage.frameTimesMs);
+        stage.occlusionRuns[snapshot.sceneIndex].frameMsP50 = frameSummary.p50;
+        stage.occlusionRuns[snapshot.sceneIndex].frameMsP95 = frameSummary.p95;
+        stage.occlusionRuns[snapshot.sceneIndex].culledPercent = stage.occlusionStats.CulledPercent();
+        stage.occlusionRuns[snapshot.sceneIndex].falseCulledPercent = stage.occlusionStats.culled > 0
+            ? 100.0 * stage.occlusionStats.falseCulls / stage.occlusionStats.culled : 0.0;
+        stage.occlusionRuns[snapshot.sceneIndex].trianglesPerMs = stage.occlusionStats.TrianglesPerMs();
+        stage.occlusionRuns[snapshot.sceneIndex].drawCalls = (double)(renderStats().drawCalls - stage.measuredStatsStart.drawCalls) / stage.options.frames;
+    }
+    else if (!stage.options.suite && writeBenchmarkJson(stage.options.output, stage.options, stage.frameTimesMs, gpuProfiler, stage.pipelineStats, stage.shaderStartupMs))
+    {
+        TimingSummary frameSummary = summarizeTimings(stage.frameTimesMs);
+        LOG_INFO << "Benchmark: " << frameSummary.count << " frames at " << stage.renderWidth << "x" << stage.renderHeight
+            << ", frame ms p50 " << frameSummary.p50 << " p95 " << frameSummary.p95 << " p99 " << frameSummary.p99
+            << ", written to " << stage.options.output;
+    }
+    if (stage.options.suite)
+    {
+        //per frame averages of the measured frames
+        PerfSceneResult& result = stage.suiteResults[snapshot.sceneIndex];
+        const RenderStats& stats = renderStats();
+        TimingSummary frameSummary = summarizeTimings(stage.frameTimesMs);
+        std::vector<double> gpuFrameMs;
+        for (size_t i = 0; i < gpuProfiler.History().size(); i++)
+            if (gpuProfiler.History()[i].depth == 0 && gpuProfiler.History()[i].frame >= (unsigned long long)stage.options.warmupFrames)
+                gpuFrameMs.push_back(gpuProfiler.History()[i].durationMs);
+        result.metrics["frame_ms_p50"] = frameSummary.p50;
+        result.metrics["frame_ms_p95"] = frameSummary.p95;
+        result.metrics["frame_ms_p99"] = frameSummary.p99;
+        if (!gpuFrameMs.empty())
+            result.metrics["gpu_frame_ms_p50"] = summarizeTimings(gpuFrameMs).p50;
+        result.metrics["draw_calls"] = (double)(stats.drawCalls - stage.measuredStatsStart.drawCalls) / stage.options.frames;
+        result.metrics["state_changes"] = (double)(stats.StateChanges() - stage.measuredStatsStart.StateChanges()) / stage.options.frames;
+        result.metrics["uniform_uploads"] = (double)(stats.uniformUploads - stage.measuredStatsStart.uniformUploads) / stage.options.frames;
+        result.metrics["memory_mb"] = processMemoryMb();
+        result.metrics["gpu_memory_mb"] = (stats.bufferBytes + stats.textureBytes) / (1024.0 * 1024.0);
+        result.metrics["shaded_fragments"] = stage.shadedFragments.MeasuredPerFrame();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, stage.sceneFBO);
+        std::vector<unsigned char> image = readFramebufferRGB(stage.renderWidth, stage.renderHeight);
+        std::string goldenPath = stage.options.goldenDirectory + result.scene + ".png";
+        result.imagePath = stage.options.updateBaselines ? goldenPath : result.scene + ".png";
+        if (!stage.options.updateBaselines)
+            result.image = compareWithGolden(goldenPath, stage.renderWidth, stage.renderHeight, image, 8);
+        if (!writePng(result.imagePath, stage.renderWidth, stage.renderHeight, image))
+            LOG_ERROR << "ERROR::PERF_SUITE::IMAGE_NOT_WRITTEN: " << result.imagePath;
+        LOG_INFO << "Scene " << result.scene << ": frame ms p50 " << frameSummary.p50 << ", " << result.metrics["draw_calls"]
+            << " draw calls, " << result.metrics["state_changes"] << " state changes, "
+            << result.metrics["shaded_fragments"] << " shaded fragments per frame" << (snapshot.depthPrepass ? " (depth pre-pass)" : "") << ", "
+            << stage.pipelineStats.Summary();
+    }
+}
+
+//render stage: all of the GL work
+void renderFrame(RenderStage& stage, const SceneResources& resources, const FrameSnapshot& snapshot)
+{
+    PROFILE_SCOPE("frame");
+    PipelineStageTimer stageTimer(stage.pipelineStats, PIPELINE_RENDER);
+    FrameArena::Scratch().Reset();
+    unsigned long long allocationsBefore = threadAllocationCount();
+    frameSnapshot = &snapshot;
+    const SceneKind scene = snapshot.scene;
+    const bool gridScene = scene == SCENE_STRESS || scene == SCENE_OCCLUSION;
+    const bool measuredFrame = snapshot.frameIndex >= stage.options.warmupFrames;
+    if (snapshot.frameIndex == 0)
+    {
+        stage.frameTimesMs.clear();
+        gpuProfiler.Reset();
+        stage.shadedFragments.Reset();
+        stage.hiZPyramid.Invalidate();
+        stage.occlusionStats.Reset();
+        stage.pendingQueries = 0;
+        stage.pipelineStats.Reset();
+        stage.measuredAllocations = 0;
+        stage.measuredScaleSum = 0.0;
+        stage.resolution.Reset();
+    }
+    if (snapshot.frameIndex == stage.options.warmupFrames)
+    {
+        stage.measuredStatsStart = renderStats();
+        gridDrawStats = GridDrawStats();
+        stage.textureStreamer.ResetStats();
+    }
+    if (snapshot.exportTraces)
+    {
+        gpuProfiler.WriteChromeTrace("gpu_trace.json");
+        gpuProfiler.WriteCsv("gpu_timings.csv");
+        LOG_INFO << "GPU timings written to gpu_trace.json and gpu_timings.csv";
+#if CPU_PROFILER_ENABLED
+        CpuProfiler::Instance().WriteChromeTrace("cpu_trace.json");
+        LOG_INFO << "CPU scopes written to cpu_trace.json";
+#endif
+        if (stage.resolutionActive && stage.resolution.WriteCsv("resolution_history.csv"))
+            LOG_INFO << "Dynamic resolution history written to resolution_history.csv";
+        if (stage.options.textureStreaming && stage.textureStreamer.WriteCsv("texture_streaming.csv"))
+            LOG_INFO << "Texture streaming history written to texture_streaming.csv";
+    }
+
+    double frameStart = glfwGetTime();
+    gpuProfiler.BeginFrame();
+
+    //with dynamic resolution the scene goes into the corner of the resolution target and is stretched onto sceneFBO at
+    //the end. The controller sees the longer of the CPU and the GPU time of a frame, the GPU one is a few frames old
+    if (snapshot.dynamicResolution != stage.resolutionActive)
+    {
+        stage.resolutionActive = snapshot.dynamicResolution && (stage.resolutionTarget.FBO != 0 || stage.resolutionTarget.Create(stage.renderWidth, stage.renderHeight));
+        stage.resolution.Reset();
+    }
+    else if (stage.resolutionActive)
+    {
+        const std::vector<GpuPassTiming>& gpuFrame = gpuProfiler.LastFrame();
+        stage.resolution.Update(std::max(stage.lastFrameWorkMs, gpuFrame.empty() ? 0.0 : gpuFrame[0].durationMs));
+    }
+    //with post-processing the scene goes into the half float target of the chain, which writes sceneFBO at the end and
+    //does the stretch of dynamic resolution on the way
+    const bool postProcessing = snapshot.postProcess.Enabled() && (stage.postProcess.Created() || stage.postProcess.Create(stage.renderWidth, stage.renderHeight));
+    const unsigned int frameFBO = postProcessing ? stage.postProcess.SceneFBO : stage.resolutionActive ? stage.resolutionTarget.FBO : stage.sceneFBO;
+    const int frameWidth = stage.resolutionActive ? stage.resolution.Width(stage.renderWidth) : stage.renderWidth;
+    const int frameHeight = stage.resolutionActive ? stage.resolution.Height(stage.renderHeight) : stage.renderHeight;
+    if (measuredFrame)
+        stage.measuredScaleSum += stage.resolutionActive ? stage.resolution.Scale() : 1.0;
+
+    //the mipmaps the textures need at the size of what they are on, before anything is drawn with them
+    if (stage.options.textureStreaming)
+        streamTextures(stage, resources, snapshot, frameHeight);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, frameFBO);
+    glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    // Create transformation
+    glm::mat4 projectionMat = snapshot.projectionMat;
+    glm::mat4 viewMat = snapshot.viewMat;
+    glm::mat4 modelMat = glm::mat4(1.0f);
+    
+    unsigned int lightingFeatures = 0;
+    if (snapshot.pointLights)
+        lightingFeatures |= resources.pointLightsFeature;
+    if (snapshot.spotlight)
+        lightingFeatures |= resources.spotlightFeature;
+    glm::vec3 lightColor = glm::vec3(1.0f);
+    glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f); // decrease the influence
+    glm::vec3 ambientColor = lightColor * glm::vec3(0.2f); // low influence
+    //the default shader variants drawn this frame: the stress grid draws its small cubes with single tap shadows, and all of
+    //them instanced from the texture array with --texture-arrays
+    const unsigned int gridFeatures = resources.gridBatching.vao != 0 ? resources.gridBatching.feature : 0;
+    const unsigned int stressLevelFeatures[SHADING_LEVEL_COUNT] = { lightingFeatures | gridFeatures, lightingFeatures | gridFeatures,
+        lightingFeatures | resources.singleTapShadowsFeature | gridFeatures };
+    unsigned int lightingVariants[3];
+    int lightingVariantCount = 0;
+    if (gridScene)
+    {
+        lightingVariants[lightingVariantCount++] = stressLevelFeatures[SHADING_PLAIN];
+        if (gridFeatures != 0)
+            lightingVariants[lightingVariantCount++] = stressLevelFeatures[SHADING_RELIEF];
+    }
+    lightingVariants[lightingVariantCount++] = lightingFeatures;
+    for (int variant = 0; variant < lightingVariantCount; variant++)
+    {
+        resources.myShader->Use(lightingVariants[variant]);
+        //passing all sorts of values to the shader
+        resources.myShader->setVec3("viewPos", snapshot.cameraPosition.x, snapshot.cameraPosition.y, snapshot.cameraPosition.z);
+        resources.myShader->setFloat("time", 5.0f * (float)snapshot.animation.time);
+        //Material
+        resources.myShader->setFloat("material.shininess", 64.0f);
+        //Lights
+        //direction light
+        resources.myShader->setVec3("directLight.direction", directLightPos);
+        resources.myShader->setVec3("directLight.ambient", glm::vec3(0.05f));
+        resources.myShader->setVec3("directLight.diffuse", glm::vec3(0.7f));
+        resources.myShader->setVec3("directLight.specular", glm::vec3(1.0f));
+        // four point lights
+        if (snapshot.pointLights)
+        {
+            for (unsigned int i = 0; i < numberOfPointLights; i++)
+            {
+                const PointLightUniforms& light = resources.pointLightUniforms[i];
+                resources.myShader->setVec3(light.position.c_str(), resources.pointLightPositions[i]);
+                resources.myShader->setFloat(light.constant.c_str(), 1.0f);
+                resources.myShader->setFloat(light.linear.c_str(), 0.09f);
+                resources.myShader->setFloat(light.quadratic.c_str(), 0.032f);
+                resources.myShader->setVec3(light.ambient.c_str(), ambientColor);
+                resources.myShader->setVec3(light.diffuse.c_str(), diffuseColor);
+                resources.myShader->setVec3(light.specular.c_str(), glm::vec3(1.0f));
+            }
+        }
+
+        //spotlight
+        if (snapshot.spotlight)
+        {
+            resources.myShader->setVec3("spotlight.position", snapshot.cameraPosition);
+            resources.myShader->setVec3("spotlight.direction", snapshot.cameraFront);
+            resources.myShader->setFloat("spotlight.cutOff", glm::cos(glm::radians(12.5f)));
+            resources.myShader->setFloat("spotlight.outerCutOff", glm::cos(glm::radians(15.5f)));
+            resources.myShader->setFloat("spotlight.constant", 1.0f);          //chose constants for 50 units
+            resources.myShader->setFloat("spotlight.linear", 0.09f);
+            resources.myShader->setFloat("spotlight.quadratic", 0.032f);
+            resources.myShader->setVec3("spotlight.ambient", glm::vec3(0.0f));
+            resources.myShader->setVec3("spotlight.diffuse", glm::vec3(1.0f));
+            resources.myShader->setVec3("spotlight.specular", glm::vec3(1.0f));
+        }
+    }
+
+    //first we draw the scene to make shadow map
+    glm::mat4 lightSpaceMatrix;
+    float near_plane = 1.0f, far_plane = 20.0f;
+    if (scene != SCENE_BACKPACK)
+    {
+        PROFILE_SCOPE("shadow pass");
+        lightSpaceMatrix = directLightSpaceMatrix(near_plane, far_plane);
+    
+        gpuProfiler.Begin("shadow pass");
+        resources.simpleDepthShader->Use();
+        resources.simpleDepthShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+
+        glViewport(0, 0, resources.shadowWidth, resources.shadowHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, resources.shadowMapFBO);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        drawSceneForShadows(*resources.simpleDepthShader, resources.planeVAO, resources.containerVAO, resources.mirrorVAO, resources.nMapVAO, resources.cubePositions);
+        glBindFramebuffer(GL_FRAMEBUFFER, frameFBO);
+        gpuProfiler.End();
+
+        //the shadow map of everything drawn with the default shader from here on, the reflection probe and the main pass
+        for (int variant = 0; variant < lightingVariantCount; variant++)
+        {
+            resources.myShader->Use(lightingVariants[variant]);
+            resources.myShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        }
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, resources.shadowMap);
+    }
+
+    //then the faces of the reflection probe due this frame, seen from the probe at the plain shading level and without the
+    //stress grid, so a face costs the same in every scene. The scope is there in frames without a face as well
+    if (stage.probeEnabled && scene != SCENE_BACKPACK)
+    {
+        PROFILE_SCOPE("reflection probe");
+        GPU_SCOPE(gpuProfiler, "reflection probe");
+        if (snapshot.frameIndex == 0)
+            stage.reflectionProbe.Reset();
+        else if (snapshot.probeInvalidated && stage.reflectionProbe.UpdateMode == PROBE_UPDATE_ON_MOTION)
+            stage.reflectionProbe.Invalidate();
+        int faces[6];
+        int faceCount = stage.reflectionProbe.BeginUpdate(faces);
+        if (faceCount > 0)
+        {
+            stage.probeSnapshot.animation = snapshot.animation;
+            stage.probeSnapshot.cameraPosition = stage.reflectionProbe.Position;
+            frameSnapshot = &stage.probeSnapshot;
+            resources.myShader->Use(lightingFeatures);
+            resources.myShader->setVec3("viewPos", stage.reflectionProbe.Position);
+            for (int i = 0; i < faceCount; i++)
+            {
+                stage.probeSnapshot.viewMat = stage.reflectionProbe.FaceView(faces[i]);
+                stage.reflectionProbe.BindFace(faces[i]);
+                drawFloor(stage.probeProjection, resources.planeVAO, *resources.myShader, resources.floorTexture);
+                drawNMap(stage.probeProjection, resources.nMapVAO, *resources.nMapShader, resources.nMapLevelFeatures[SHADING_PLAIN], nMapModelMat(snapshot.animation), resources.nMapDiffuseMap, resources.nMapNormalMap);
+                drawParallax(stage.probeProjection, resources.nMapVAO, *resources.parallaxShader, resources.parallaxLevelFeatures[SHADING_PLAIN], parallaxModelMat(snapshot.animation),
+                    resources.parallaxDiffuse, resources.parallaxNormal, resources.parallaxHeight);
+                // the containers alone, the screen-space outline is not run on the faces so this mode draws none
+                drawCubesAndOutline(stage.probeProjection, resources.containerVAO, *resources.myShader, *resources.outlineShader, resources.cubePositions, resources.diffuseMap, resources.specularMap, resources.emissionMap, OUTLINE_SCREEN);
+                if (snapshot.pointLights)
+                    drawLamps(stage.probeProjection, resources.lightVAO, *resources.lampShader, resources.pointLightPositions, ambientColor, diffuseColor);
+                drawSkybox(stage.probeProjection, resources.skyboxVAO, *resources.skyboxShader, resources.cubemapTexture);
+                drawWindows(stage.probeProjection, resources.transparentVAO, *resources.windowShader, stage.probeWindows, resources.windowTexture);
+            }
+            frameSnapshot = &snapshot;
+            resources.myShader->Use(lightingFeatures);
+            resources.myShader->setVec3("viewPos", snapshot.cameraPosition);
+        }
+        stage.reflectionProbe.EndUpdate(frameFBO, frameWidth, frameHeight);
+    }
+
+    //then we draw the scene normally
+    if (scene == SCENE_BACKPACK)
+    {
+        PROFILE_SCOPE("main pass");
+        glViewport(0, 0, frameWidth, frameHeight);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        stage.shadedFragments.Begin(measuredFrame);
+        GPU_SCOPE(gpuProfiler, "backpack");
+        drawBackpack(projectionMat, *resources.backpack, *resources.modelShader);
+        if (snapshot.occlusion == OCCLUSION_SOFTWARE && measuredFrame)
+        {
+            stage.occlusionStats.tested += snapshot.hiddenMeshes.size();
+            stage.occlusionStats.culled += std::count(snapshot.hiddenMeshes.begin(), snapshot.hiddenMeshes.end(), 1);
+            stage.occlusionStats.occluderTriangles += snapshot.occluderTriangles;
+            stage.occlusionStats.rasterMs += snapshot.softwareRasterMs;
+        }
+    }
+    else
+    {
+        PROFILE_SCOPE("main pass");
+    
+        glViewport(0, 0, frameWidth, frameHeight);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-    //draw mirror cube
-    mirrorShader.Use();
-    glm::mat4 mirrorModelMat = glm::mat4(1.0f);
-    mirrorModelMat = glm::translate(mirrorModelMat, mirrorCubePos);
-    mirrorModelMat = glm::rotate(mirrorModelMat, glm::radians((float)glfwGetTime() * 20.0f), glm::normalize(glm::vec3(-1.0, 1.0, -1.0)));
-    mirrorModelMat = glm::scale(mirrorModelMat, glm::vec3(0.7f));
-    mirrorShader.setMat4("modelMat", mirrorModelMat);
-    mirrorShader.setMat4("viewMat", viewMat);
-    mirrorShader.setMat4("projectionMat", projectionMat);
-    mirrorShader.setVec3("cameraPos", camera.Position);
-    mirrorShader.setBool("refractFlag", false);
-    glBindVertexArray(mirrorVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+        //the grid cubes to draw first: with the depth pyramid the ones the depth of the last frame does not hide
+        const bool hiZGrid = snapshot.occlusion == OCCLUSION_HIZ && gridScene;
+        const std::vector<StressCube>* gridCubes = &snapshot.stressCubes;
+        if (hiZGrid)
+        {
+            PROFILE_SCOPE("occlusion test");
+            stage.unoccludedCubes.clear();
+            stage.occludedCubes.clear();
+            for (size_t i = 0; i < snapshot.stressCubes.size(); i++)
+            {
+                glm::vec3 boxMin, boxMax;
+                modelBounds(snapshot.stressCubes[i].modelMat, boxMin, boxMax);
+                if (stage.hiZPyramid.Occluded(boxMin, boxMax))
+                    stage.occludedCubes.push_back(snapshot.stressCubes[i]);
+                else
+                    stage.unoccludedCubes.push_back(snapshot.stressCubes[i]);
+            }
+            gridCubes = &stage.unoccludedCubes;
+        }
+        else
+            stage.hiZPyramid.Invalidate();    //a pyramid left from before a mode change is too old
+        //with conditional rendering the cubes are tested against the depth of the color pass, they stay out of the pre-pass
+        const bool conditionalGrid = snapshot.occlusion == OCCLUSION_CONDITIONAL && gridScene;
+        const std::vector<StressCube>& occluders = scene == SCENE_OCCLUSION ? resources.walls : noCubes;
 
-    mirrorShader.Use();
-    mirrorModelMat = glm::mat4(1.0f);
-    mirrorModelMat = glm::translate(mirrorModelMat, mirrorCubePos + glm::vec3(0.0f, 1.0f, 1.0f));
-    mirrorModelMat = glm::rotate(mirrorModelMat, glm::radians((float)glfwGetTime() * 20.0f), glm::normalize(glm::vec3(-1.0, 1.0, -1.0)));
-    mirrorModelMat = glm::scale(mirrorModelMat, glm::vec3(0.7f));
-    mirrorShader.setMat4("modelMat", mirrorModelMat);
-    mirrorShader.setMat4("viewMat", viewMat);
-    mirrorShader.setMat4("projectionMat", projectionMat);
-    mirrorShader.setVec3("cameraPos", camera.Position);
-    mirrorShader.setBool("refractFlag", true);
-    glBindVertexArray(mirrorVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-}
+        if (snapshot.depthPrepass)
+        {
+            GPU_SCOPE(gpuProfiler, "depth pre-pass");
+            drawDepthPrepass(projectionMat, *resources.simpleDepthShader, resources.depthPrepassFeature, resources.planeVAO, resources.containerVAO, resources.nMapVAO, resources.cubePositions, occluders,
+                conditionalGrid ? noCubes : *gridCubes);
+        }
+        stage.shadedFragments.Begin(measuredFrame);
 
-void drawWindows(const glm::mat4 projectionMat, const unsigned int transparentVAO, Shader windowShader, std::vector<glm::vec3> windows,
-    const unsigned int windowTexture)
-{
-    glm::mat4 viewMat = camera.GetViewMatrix();
-    glm::mat4 modelMat = glm::mat4(1.0f);
+        /* nevermind that, just an idea
+        nMapShader.Use();
+        nMapShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, shadowMap);
+        */
 
-    //sorting windows by distance
-    std::multimap<float, glm::vec3> sortedWindows;
-    for (unsigned int i = 0; i < windows.size(); i++)
+        gpuProfiler.Begin("floor");
+        beginPrepassedShading();
+        drawFloor(projectionMat, resources.planeVAO, *resources.myShader, resources.floorTexture);
+        endPrepassedShading();
+        gpuProfiler.End();
+        gpuProfiler.Begin("normal mapping");
+        beginPrepassedShading();
+        drawNMap(projectionMat, resources.nMapVAO, *resources.nMapShader, resources.nMapLevelFeatures[snapshot.nMapShading], nMapModelMat(snapshot.animation), resources.nMapDiffuseMap, resources.nMapNormalMap);
+        endPrepassedShading();
+        gpuProfiler.End();
+        gpuProfiler.Begin("parallax");
+        drawParallax(projectionMat, resources.nMapVAO, *resources.parallaxShader, resources.parallaxLevelFeatures[snapshot.parallaxShading], parallaxModelMat(snapshot.animation),
+            resources.parallaxDiffuse, resources.parallaxNormal, resources.parallaxHeight);
+        gpuProfiler.End();
+        drawCubesAndOutline(projectionMat, resources.containerVAO, *resources.myShader, *resources.outlineShader, resources.cubePositions, resources.diffuseMap, resources.specularMap, resources.emissionMap, snapshot.outline);
+        if (!occluders.empty())
+        {
+            GPU_SCOPE(gpuProfiler, "occluders");
+            beginPrepassedShading();
+            drawStressGrid(projectionMat, resources.containerVAO, *resources.myShader, stressLevelFeatures, occluders, resources.stressDiffuseMaps, resources.specularMap, resources.emissionMap, resources.gridBatching);
+            endPrepassedShading();
+        }
+        if (conditionalGrid)
+        {
+            GPU_SCOPE(gpuProfiler, "occlusion queries");
+            collectOcclusionQueries(stage);
+            stage.shadedFragments.Pause();
+            drawOcclusionQueries(projectionMat, *resources.simpleDepthShader, resources.depthPrepassFeature, resources.containerVAO, snapshot.stressCubes, stage.occlusionQueries);
+            stage.shadedFragments.Resume();
+            stage.pendingQueries = snapshot.stressCubes.size();
+            stage.pendingQueriesMeasured = measuredFrame;
+        }
+        if (gridScene)
+        {
+            GPU_SCOPE(gpuProfiler, "stress grid");
+            if (!conditionalGrid)
+                beginPrepassedShading();
+            drawStressGrid(projectionMat, resources.containerVAO, *resources.myShader, stressLevelFeatures, *gridCubes, resources.stressDiffuseMaps, resources.specularMap, resources.emissionMap,
+                resources.gridBatching, conditionalGrid ? &stage.occlusionQueries[0] : NULL);
+            if (!conditionalGrid)
+                endPrepassedShading();
+        }
+        if (hiZGrid)
+        {
+            //the pyramid of this frame, the cubes hidden by the last one which are in view now are drawn late. They are
+            //not in the depth of the pre-pass
+            {
+                GPU_SCOPE(gpuProfiler, "depth pyramid");
+                stage.hiZPyramid.Build(frameFBO, frameWidth, frameHeight, projectionMat * viewMat);
+            }
+            PROFILE_SCOPE("occlusion test");
+            GPU_SCOPE(gpuProfiler, "disoccluded grid");
+            stage.disoccludedCubes.clear();
+            for (size_t i = 0; i < stage.occludedCubes.size(); i++)
+            {
+                glm::vec3 boxMin, boxMax;
+                modelBounds(stage.occludedCubes[i].modelMat, boxMin, boxMax);
+                if (!stage.hiZPyramid.Occluded(boxMin, boxMax))
+                    stage.disoccludedCubes.push_back(stage.occludedCubes[i]);
+            }
+            drawStressGrid(projectionMat, resources.containerVAO, *resources.myShader, stressLevelFeatures, stage.disoccludedCubes, resources.stressDiffuseMaps, resources.specularMap, resources.emissionMap, resources.gridBatching);
+            if (measuredFrame)
+            {
+                stage.occlusionStats.tested += snapshot.stressCubes.size();
+                stage.occlusionStats.culled += stage.occludedCubes.size() - stage.disoccludedCubes.size();
+            }
+        }
+        if (snapshot.occlusion == OCCLUSION_SOFTWARE && gridScene && measuredFrame)
+        {
+            stage.occlusionStats.tested += snapshot.stressCubes.size() + snapshot.softwareCulledCubes.size();
+            stage.occlusionStats.culled += snapshot.softwareCulledCubes.size();
+            stage.occlusionStats.occluderTriangles += snapshot.occluderTriangles;
+            stage.occlusionStats.rasterMs += snapshot.softwareRasterMs;
+            //the benchmark checks every culled cube against the depth of the GPU, a query which passes is a cube culled
+            //by mistake. The results are waited for right away, it measures accuracy and not frame time
+            if (stage.options.occlusionBenchmark && !snapshot.softwareCulledCubes.empty())
+            {
+                stage.shadedFragments.Pause();
+                drawOcclusionQueries(projectionMat, *resources.simpleDepthShader, resources.depthPrepassFeature, resources.containerVAO, snapshot.softwareCulledCubes, stage.occlusionQueries);
+                stage.shadedFragments.Resume();
+                for (size_t i = 0; i < snapshot.softwareCulledCubes.size(); i++)
+                {
+                    GLuint passed = 0;
+                    glGetQueryObjectuiv(stage.occlusionQueries[i], GL_QUERY_RESULT, &passed);
+                    if (passed)
+                        stage.occlusionStats.falseCulls++;
+                }
+            }
+        }
+        if (snapshot.pointLights)
+        {
+            GPU_SCOPE(gpuProfiler, "lamps");
+            drawLamps(projectionMat, resources.lightVAO, *resources.lampShader, resources.pointLightPositions, ambientColor, diffuseColor);
+        }
+        gpuProfiler.Begin("skybox and mirror cubes");
+        drawSkybox(projectionMat, resources.skyboxVAO, *resources.skyboxShader, resources.cubemapTexture);
+        drawMirrorCubes(projectionMat, resources.mirrorVAO, *resources.mirrorShader, stage.probeEnabled ? stage.reflectionProbe.Texture() : resources.cubemapTexture);
+        gpuProfiler.End();
+        gpuProfiler.Begin("windows");
+        drawWindows(projectionMat, resources.transparentVAO, *resources.windowShader, snapshot.sortedWindows, resources.windowTexture);
+        gpuProfiler.End();
+    }
+    stage.shadedFragments.End();
+    if (scene != SCENE_BACKPACK && snapshot.outline == OUTLINE_SCREEN)
     {
-        float distance = glm::length(camera.Position - windows[i]);
-        sortedWindows.insert(std::make_pair(distance, windows[i]));
+        //the width is given in pixels of the window, a frame rendered smaller gets a thinner outline which is stretched
+        GPU_SCOPE(gpuProfiler, "outline");
+        OutlineBounds outlined;
+        for (unsigned int i = 0; i < 5; i++)
+            outlined.Add(projectionMat * snapshot.viewMat, resources.cubePositions[i] - glm::vec3(0.5f), resources.cubePositions[i] + glm::vec3(0.5f), frameWidth, frameHeight);
+        stage.screenOutline.Draw(frameFBO, frameWidth, frameHeight, outlined, 1, glm::vec3(1.0f, 0.0f, 0.0f), stage.options.outlineWidth * frameWidth / stage.renderWidth);
     }
+    if (postProcessing)
+    {
+        GPU_SCOPE(gpuProfiler, "post-process");
+        stage.postProcess.Apply(snapshot.postProcess, frameWidth, frameHeight, stage.sceneFBO, stage.renderWidth, stage.renderHeight, gpuProfiler);
+    }
+    else if (stage.resolutionActive)
+    {
+        GPU_SCOPE(gpuProfiler, "upscale");
+        stage.resolutionTarget.Upscale(frameWidth, frameHeight, stage.sceneFBO, stage.renderWidth, stage.renderHeight);
+    }
+    gpuProfiler.EndFrame();
 
-
-    //draw windows
-    windowShader.Use();
-    glBindVertexArray(transparentVAO);
+    if (snapshot.profilerOverlay)
+        gpuProfiler.DrawOverlay(stage.renderWidth, stage.renderHeight);
+    if (!stage.options.headless && snapshot.time - stage.lastTitleUpdate > 0.5)
+    {
+        std::lock_guard<std::mutex> lock(stage.titleMutex);
+        stage.windowTitle = "Graphics | " + gpuProfiler.Summary() + " | " + stage.pipelineStats.Summary();
+        if (stage.resolutionActive)
+            stage.windowTitle += " | " + stage.resolution.Summary();
+#if TRACK_ALLOCATIONS
+        stage.windowTitle += " | " + std::to_string(stage.frameAllocations) + " allocations";
+#endif
+        stage.lastTitleUpdate = snapshot.time;
+    }
+    
+    /*//DEBUG
+    // рендеринг на плоскости карты глубины для наглядной отладки
+    // ---------------------------------------------
+    debugDepthQuad.Use();
+    debugDepthQuad.setFloat("near_plane", near_plane);
+    debugDepthQuad.setFloat("far_plane", far_plane);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, windowTexture);
-    //windowShader.setVec3("cameraPos", camera.Position);
-    windowShader.setMat4("viewMat", viewMat);
-    windowShader.setMat4("projectionMat", projectionMat);
-    for (std::map<float, glm::vec3>::reverse_iterator it = sortedWindows.rbegin(); it != sortedWindows.rend(); ++it)
+    glBindTexture(GL_TEXTURE_2D, shadowMap);
+    renderQuad();
+    */
+    if (stage.options.headless)
     {
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, it->second);
-        windowShader.setMat4("modelMat", modelMat);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        //nothing is presented, wait for the GPU so the frame time covers all of the frame's work. With the
+        //update stage running ahead, the time between two finished frames is what the pipeline delivers
+        PROFILE_SCOPE("finish");
+        glFinish();
+        double frameEnd = glfwGetTime();
+        stage.lastFrameWorkMs = (frameEnd - frameStart) * 1000.0;
+        if (measuredFrame)
+            stage.frameTimesMs.push_back((frameEnd - (snapshot.frameIndex == 0 ? frameStart : stage.lastFrameEnd)) * 1000.0);
+        stage.lastFrameEnd = frameEnd;
     }
-    glBindVertexArray(0);
+    else
+    {
+        PROFILE_SCOPE("swap buffers");
+        stage.lastFrameWorkMs = (glfwGetTime() - frameStart) * 1000.0;
+        glfwSwapBuffers(stage.window);
+    }
+    //heap allocations of both stages, and of the job workers since the last frame
+    const unsigned long long workerAllocations = workerAllocationCount();
+    stage.frameAllocations = snapshot.allocations + threadAllocationCount() - allocationsBefore + workerAllocations - stage.workerAllocationsSeen;
+    stage.workerAllocationsSeen = workerAllocations;
+    if (measuredFrame)
+        stage.measuredAllocations += stage.frameAllocations;
+
+    if (snapshot.sceneEnd)
+        endScene(stage, resources, snapshot, postProcessing);
 }
 
-void drawSceneForShadows(Shader shader, const unsigned int planeVAO, const unsigned int containerVAO, const unsigned int mirrorVAO,
-    const unsigned int nMapVAO, glm::vec3 *cubePositions)
+int main(int argc, char** argv)
 {
-    //we will only need our floor
-    glm::mat4 modelMat = glm::mat4(1.0f);
-    modelMat = glm::translate(modelMat, glm::vec3(0.0f, -0.01f, 0.0f));
-    shader.setMat4("modelMat", modelMat);
-    glBindVertexArray(planeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    //and cubes
-    glBindVertexArray(containerVAO);
-    for (unsigned int i = 0; i < 5; i++)
+    PROFILE_THREAD_NAME("main");
+    BenchmarkOptions options;
+    options.width = WIDTH;
+    options.height = HEIGHT;
+    if (!parseBenchmarkOptions(argc, argv, options))
+        return -1;
+    if (!options.logFile.empty() && !Logger::Instance().SetFile(options.logFile))
+        LOG_ERROR << "ERROR::LOG::FILE_NOT_OPENED: " << options.logFile;
+    if (options.suite && !options.updateBaselines && !options.settingsGiven)
     {
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, cubePositions[i]);
-        shader.setMat4("modelMat", modelMat);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        // compared with baselines recorded at other settings, most metrics would be skipped
+        PerfBaselines baselines;
+        if (baselines.Load(options.baselinesPath) && parsePerfSuiteSettings(baselines.Settings, options.width, options.height, options.frames,
+            options.warmupFrames, options.timeStep, options.simulationStep))
+            LOG_INFO << "Performance suite at the settings of the baselines: " << baselines.Settings;
     }
-    glBindVertexArray(0);
-    //and mirror cube
-    glm::mat4 mirrorModelMat = glm::mat4(1.0f);
-    mirrorModelMat = glm::translate(mirrorModelMat, mirrorCubePos);
-    mirrorModelMat = glm::rotate(mirrorModelMat, glm::radians((float)glfwGetTime() * 20.0f), glm::normalize(glm::vec3(-1.0, 1.0, -1.0)));
-    mirrorModelMat = glm::scale(mirrorModelMat, glm::vec3(0.7f));
-    shader.setMat4("modelMat", mirrorModelMat);
-    glBindVertexArray(mirrorVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    //and refraction cube
-    mirrorModelMat = glm::mat4(1.0f);
-    mirrorModelMat = glm::translate(mirrorModelMat, mirrorCubePos + glm::vec3(0.0f, 1.0f, 1.0f));
-    mirrorModelMat = glm::rotate(mirrorModelMat, glm::radians((float)glfwGetTime() * 20.0f), glm::normalize(glm::vec3(-1.0, 1.0, -1.0)));
-    mirrorModelMat = glm::scale(mirrorModelMat, glm::vec3(0.7f));
-    shader.setMat4("modelMat", mirrorModelMat);
-    glBindVertexArray(mirrorVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    //and normal mapping
-    modelMat = glm::mat4(1.0f);
-    modelMat = glm::translate(modelMat, glm::vec3(5.0f, 0.5f, 2.0f));
-    modelMat = glm::rotate(modelMat, glm::radians((float)glfwGetTime() * -10.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-    modelMat = glm::scale(modelMat, glm::vec3(0.7f));
-    shader.setMat4("modelMat", modelMat);
-    glBindVertexArray(nMapVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-    //and parallax mapping
-    modelMat = glm::mat4(1.0f);
-    modelMat = glm::translate(modelMat, glm::vec3(5.0f, 0.5f, 0.0f));
-    modelMat = glm::rotate(modelMat, glm::radians(sin((float)glfwGetTime()) * 10.0f + 90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-    modelMat = glm::scale(modelMat, glm::vec3(0.7f));
-    shader.setMat4("modelMat", modelMat);
-    glBindVertexArray(nMapVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-}
-/*
-unsigned int quadVAO = 0;
-unsigned int quadVBO;
-void renderQuad()
-{
-    if (quadVAO == 0)
+    if (options.logBenchmark)
     {
-        float quadVertices[] = {
-            // координаты        // текстурные координаты
-            -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
-            -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-             1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
-             1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-        };
-        glGenVertexArrays(1, &quadVAO);
-        glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+        runLogBenchmark();
+        return 0;
     }
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
-}*/
-//=====================================================================================================================================================================================================
+    if (options.profilerBenchmark)
+    {
+        runProfilerBenchmark();
+        return 0;
+    }
+    if (options.jobBenchmark)
+    {
+        runJobBenchmark();
+        return 0;
+    }
+    JobSystem::Instance();      //created here, this is the thread which executes the GL jobs
+    if (options.tangentBenchmark)
+    {
+        runTangentBenchmark("../objects/backpack/backpack.obj");
+        return 0;
+    }
+    if (options.softwareOcclusionBenchmark)
+    {
+        runSoftwareOcclusionBenchmark();
+        return 0;
+    }
+    if (options.bvhBenchmark)
+    {
+        runBvhBenchmark();
+        return 0;
+    }
+    if (options.pickBenchmark)
+    {
+        runPickBenchmark("../objects/backpack/backpack.obj");
+        return 0;
+    }
+    if (options.bakeConeMap)
+        return bakeConeStepMap("../textures/toy_box_disp.png", "../textures/toy_box_cone.png") ? 0 : -1;
+    const int renderWidth = options.width, renderHeight = options.height;
+    shadingLodOverride = options.shadingLod;
+    depthPrepassSwitch = options.depthPrepass;
+    dynamicResolutionSwitch = options.dynamicResolution;
+    outlineModeSwitch = options.outline == "stencil" ? OUTLINE_STENCIL : OUTLINE_SCREEN;
+    postProcessSettings.bloom = options.bloom;
+    postProcessSettings.bloomLevels = options.bloomLevels;
+    postProcessSettings.bloomThreshold = options.bloomThreshold;
+    postProcessSettings.bloomIntensity = options.bloomIntensity;
+    postProcessSettings.toneMapping = options.toneMapping;
+    postProcessSettings.exposure = options.exposure;
+    postProcessSettings.sharpen = options.sharpen;
+    occlusionModeSwitch = options.occlusion == "off" ? OCCLUSION_OFF : options.occlusion == "conditional" ? OCCLUSION_CONDITIONAL
+        : options.occlusion == "software" ? OCCLUSION_SOFTWARE : OCCLUSION_HIZ;
 
-int main()
-{
     //Init GLFW
     if (!glfwInit())
         return -1;
@@ -506,15 +2183,21 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    if (options.headless)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (options.contextApi == "egl")
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    else if (options.contextApi == "osmesa")
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Graphics", NULL, NULL);
+    GLFWwindow* window = glfwCreateWindow(renderWidth, renderHeight, "Graphics", NULL, NULL);
     if (window == NULL)
     {
-        std::cout<<"Failed to create GLFW window"<<std::endl;
+        LOG_ERROR << "Failed to create GLFW window";
         glfwTerminate();
         return -1;
     }
@@ -523,38 +2206,90 @@ int main()
     glfwSetKeyCallback(window, key_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+        LOG_ERROR << "Failed to initialize GLAD";
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+    if (options.headless)
+        installRenderStatsHooks();
+    gpuProfiler.Init();
+    //one scene in the window or a headless benchmark, all of them one after another for the performance suite
+    std::vector<std::string> sceneNames;
+    if (options.suite)
+        sceneNames = { "main", "backpack", "stress", "occlusion" };
+    else if (options.occlusionBenchmark)
+        sceneNames = std::vector<std::string>(OCCLUSION_MODE_COUNT, "occlusion");     //once per mode
+    else
+        sceneNames.push_back(options.scene);
+    PipelineStats pipelineStats;
+    UpdateStage update(options, pipelineStats, sceneNames);
+    RenderStage render(options, pipelineStats, sceneNames);
+    render.shadedFragments.Init();
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!options.headless)
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    glViewport(0, 0, width, height);
+    glViewport(0, 0, renderWidth, renderHeight);
 
     glEnable(GL_DEPTH_TEST);
+    //the stencil only marks the outlined objects, drawCubesAndOutline turns the writes on for them
     glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    //Build and compile our shader programs
-    Shader myShader("../shaders/default.ver", "../shaders/default.frag");
+    //Build and compile our shader programs. Every constructor only issues its compile (or restores a cached
+    //program binary), statuses are queried after all of them so the driver can compile in parallel
+    //the parallax quad steps through cones when the cone step map was baked (--bake-cone-map), otherwise it marches in layers
+    const bool coneStepMapping = std::ifstream("../textures/toy_box_cone.png").good();
+    double shaderStartTime = glfwGetTime();
+    Shader myShader("../shaders/default.ver", "../shaders/default.frag", { "POINT_LIGHTS", "SPOTLIGHT", "SINGLE_TAP_SHADOWS", "TEXTURE_ARRAY" });
     Shader outlineShader("../shaders/outline.ver", "../shaders/outline.frag");
     Shader lampShader("../shaders/lamp.ver", "../shaders/lamp.frag");
     Shader windowShader("../shaders/window.ver", "../shaders/window.frag");
     Shader skyboxShader("../shaders/skybox.ver", "../shaders/skybox.frag");
-    Shader mirrorShader("../shaders/mirrorCube.ver", "../shaders/mirrorCube.frag");
+    Shader mirrorShader("../shaders/mirrorCube.ver", "../shaders/mirrorCube.frag", { "REFRACT" });
     //Shader refractionShader("../shaders/refractionCube.ver", "../shaders/refractionCube.frag");
-    Shader simpleDepthShader("../shaders/shadow_mapping.ver", "../shaders/shadow_mapping.frag");
-    Shader nMapShader("../shaders/normal_mapping.ver", "../shaders/normal_mapping.frag");
-    Shader parallaxShader("../shaders/parallax.ver", "../shaders/parallax.frag");
+    Shader simpleDepthShader("../shaders/shadow_mapping.ver", "../shaders/shadow_mapping.frag", { "DEPTH_PREPASS" });
+    Shader nMapShader("../shaders/normal_mapping.ver", "../shaders/normal_mapping.frag", { "PLAIN" });
+    Shader parallaxShader("../shaders/parallax.ver", "../shaders/parallax.frag", { "CONE_STEP_MAPPING", "NORMAL_MAP_ONLY", "PLAIN" });
     //Shader debugDepthQuad("../shaders/3.1.3.debug_quad.ver", "../shaders/3.1.3.debug_quad.frag");    //DEBUG
+    mirrorShader.Prepare(mirrorShader.Feature("REFRACT"));
+    const unsigned int depthPrepassFeature = simpleDepthShader.Feature("DEPTH_PREPASS");
+    simpleDepthShader.Prepare(depthPrepassFeature);
+    //variants of the shading levels (ShadingLod.h), all of them compiled up front so a level change does not stall
+    const unsigned int singleTapShadowsFeature = myShader.Feature("SINGLE_TAP_SHADOWS");
+    const unsigned int nMapLevelFeatures[SHADING_LEVEL_COUNT] = { 0, 0, nMapShader.Feature("PLAIN") };
+    const unsigned int parallaxLevelFeatures[SHADING_LEVEL_COUNT] = { coneStepMapping ? parallaxShader.Feature("CONE_STEP_MAPPING") : 0,
+        parallaxShader.Feature("NORMAL_MAP_ONLY"), parallaxShader.Feature("PLAIN") };
+    myShader.Prepare(singleTapShadowsFeature);
+    for (int level = 0; level < SHADING_LEVEL_COUNT; level++)
+    {
+        nMapShader.Prepare(nMapLevelFeatures[level]);
+        parallaxShader.Prepare(parallaxLevelFeatures[level]);
+    }
+    Shader* allShaders[] = { &myShader, &outlineShader, &lampShader, &windowShader, &skyboxShader, &mirrorShader,
+        &simpleDepthShader, &nMapShader, &parallaxShader };
+    //the variants are finished in the order the driver completes them, the others keep linking meanwhile
+    for (int linking = 1; linking > 0; )
+    {
+        linking = 0;
+        for (Shader* shader : allShaders)
+            linking += shader->FinishCompleted();
+        if (linking > 0)
+            std::this_thread::yield();
+    }
+    const ShaderStats& shaderStats = Shader::Stats();
+    double shaderStartupMs = (glfwGetTime() - shaderStartTime) * 1000.0;
+    LOG_INFO << "Shaders ready in " << shaderStartupMs << " ms ("
+        << (shaderStats.compiled + shaderStats.failed == 0 ? "warm" : "cold") << " start: " << shaderStats.fromBinary << " from binary cache, "
+        << shaderStats.compiled << " compiled, " << shaderStats.failed << " failed, " << shaderStats.rejectedBinaries << " cached binaries rejected"
+        << (glExtensions().parallelShaderCompile ? ", parallel compile" : "") << ")";
 
     float skyboxVertices[] = {
     -1.0f,  1.0f, -1.0f,
@@ -785,85 +2520,38 @@ int main()
     
     //for normal mapping
     unsigned int nMapVAO, nMapVBO;
-    // координаты
-    glm::vec3 nMapPos1(-1.0f, 1.0f, 0.0f);
-    glm::vec3 nMapPos2(-1.0f, -1.0f, 0.0f);
-    glm::vec3 nMapPos3(1.0f, -1.0f, 0.0f);
-    glm::vec3 nMapPos4(1.0f, 1.0f, 0.0f);
-    // текстурные координаты
-    glm::vec2 nMapuv1(0.0f, 1.0f);
-    glm::vec2 nMapuv2(0.0f, 0.0f);
-    glm::vec2 nMapuv3(1.0f, 0.0f);
-    glm::vec2 nMapuv4(1.0f, 1.0f);
-    // вектор нормали
-    glm::vec3 nMapNorm(0.0f, 0.0f, 1.0f);
-
-    // вычисляем касательные/бикасательные векторы обоих треугольников
-    glm::vec3 tangent1, bitangent1;
-    glm::vec3 tangent2, bitangent2;
-    // треугольник 1
-    // ----------
-    glm::vec3 edge1 = nMapPos2 - nMapPos1;
-    glm::vec3 edge2 = nMapPos3 - nMapPos1;
-    glm::vec2 deltaUV1 = nMapuv2 - nMapuv1;
-    glm::vec2 deltaUV2 = nMapuv3 - nMapuv1;
-
-    float nMapf = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-    tangent1.x = nMapf * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-    tangent1.y = nMapf * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-    tangent1.z = nMapf * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-    tangent1 = glm::normalize(tangent1);
-
-    bitangent1.x = nMapf * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-    bitangent1.y = nMapf * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-    bitangent1.z = nMapf * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-    bitangent1 = glm::normalize(bitangent1);
-
-    // треугольник 2
-    // ----------
-    edge1 = nMapPos3 - nMapPos1;
-    edge2 = nMapPos4 - nMapPos1;
-    deltaUV1 = nMapuv3 - nMapuv1;
-    deltaUV2 = nMapuv4 - nMapuv1;
-
-    nMapf = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-    tangent2.x = nMapf * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-    tangent2.y = nMapf * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-    tangent2.z = nMapf * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-    tangent2 = glm::normalize(tangent2);
-
-    bitangent2.x = nMapf * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-    bitangent2.y = nMapf * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-    bitangent2.z = nMapf * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-    bitangent2 = glm::normalize(bitangent2);
-
-    float quadVertices[] = {
-        // координаты                       // нормали                          // текст. координаты  // касательные                      // бикасательные
-        nMapPos1.x, nMapPos1.y, nMapPos1.z, nMapNorm.x, nMapNorm.y, nMapNorm.z, nMapuv1.x, nMapuv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-        nMapPos2.x, nMapPos2.y, nMapPos2.z, nMapNorm.x, nMapNorm.y, nMapNorm.z, nMapuv2.x, nMapuv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-        nMapPos3.x, nMapPos3.y, nMapPos3.z, nMapNorm.x, nMapNorm.y, nMapNorm.z, nMapuv3.x, nMapuv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-        nMapPos1.x, nMapPos1.y, nMapPos1.z, nMapNorm.x, nMapNorm.y, nMapNorm.z, nMapuv1.x, nMapuv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-        nMapPos3.x, nMapPos3.y, nMapPos3.z, nMapNorm.x, nMapNorm.y, nMapNorm.z, nMapuv3.x, nMapuv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-        nMapPos4.x, nMapPos4.y, nMapPos4.z, nMapNorm.x, nMapNorm.y, nMapNorm.z, nMapuv4.x, nMapuv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
+    //corners of the quad (position, normal, texture coordinates), the tangents come from generateTangents
+    Vertex nMapCorners[4] = {
+        { glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, 1.0f), 0 },
+        { glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, 0.0f), 0 },
+        { glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 0.0f), 0 },
+        { glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 1.0f), 0 }
     };
+    const unsigned int nMapIndices[6] = { 0, 1, 2, 0, 2, 3 };
+    TangentMeshView nMapView = { &nMapCorners[0].Position.x, sizeof(Vertex), &nMapCorners[0].Normal.x, sizeof(Vertex),
+        &nMapCorners[0].TexCoords.x, sizeof(Vertex), 4, nMapIndices, 6 };
+    std::vector<glm::vec4> nMapTangents;
+    generateTangents(nMapView, nMapTangents);
+    //drawn without an index buffer
+    Vertex quadVertices[6];
+    for (int i = 0; i < 6; i++)
+    {
+        quadVertices[i] = nMapCorners[nMapIndices[i]];
+        quadVertices[i].Tangent = packTangent(nMapTangents[nMapIndices[i]]);
+    }
     glGenVertexArrays(1, &nMapVAO);
     glGenBuffers(1, &nMapVBO);
     glBindVertexArray(nMapVAO);
     glBindBuffer(GL_ARRAY_BUFFER, nMapVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
     glEnableVertexAttribArray(3);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
-    glEnableVertexAttribArray(4);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
@@ -887,160 +2575,405 @@ int main()
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    unsigned int diffuseMap = loadTexture("../textures/container2.png");
-    unsigned int specularMap = loadTexture("../textures/container2_specular.png");
-    unsigned int emissionMap = loadTexture("../textures/matrix.jpg");
-    unsigned int floorTexture = loadTexture("../textures/metal_floor.jpg");
-    unsigned int windowTexture = loadTexture("../textures/window.png");
-    unsigned int nMapDiffuseMap = loadTexture("../textures/brickwall.jpg");
-    unsigned int nMapNormalMap = loadTexture("../textures/brickwall_normal.jpg");
-    unsigned int parallaxDiffuse = loadTexture("../textures/toy_box_diffuse.png");
-    unsigned int parallaxNormal = loadTexture("../textures/toy_box_normal.png");
-    unsigned int parallaxHeight = loadTexture("../textures/toy_box_disp.png");
-
-    //we need to set up proper texture unit
+    std::vector<std::string> texturePaths = {
+        "../textures/container2.png",
+        "../textures/container2_specular.png",
+        "../textures/matrix.jpg",
+        "../textures/metal_floor.jpg",
+        "../textures/window.png",
+        "../textures/brickwall.jpg",
+        "../textures/brickwall_normal.jpg",
+        "../textures/toy_box_diffuse.png",
+        "../textures/toy_box_normal.png",
+        "../textures/toy_box_disp.png"
+    };
+    if (coneStepMapping)
+        texturePaths.push_back("../textures/toy_box_cone.png");
+    //streamed (--texture-streaming) they start with their small mipmaps, the render stage loads the finer ones it needs
+    TextureStreamer& textureStreamer = render.textureStreamer;
+    textureStreamer.BudgetBytes = (size_t)(options.textureBudgetMb * 1024.0 * 1024.0);
+    textureStreamer.StartSize = options.textureStartSize;
+    std::vector<unsigned int> textures = options.textureStreaming ? textureStreamer.Load(texturePaths) : loadTextures(texturePaths);
+    unsigned int diffuseMap = textures[0];
+    unsigned int specularMap = textures[1];
+    unsigned int emissionMap = textures[2];
+    unsigned int floorTexture = textures[3];
+    unsigned int windowTexture = textures[4];
+    unsigned int nMapDiffuseMap = textures[5];
+    unsigned int nMapNormalMap = textures[6];
+    unsigned int parallaxDiffuse = textures[7];
+    unsigned int parallaxNormal = textures[8];
+    unsigned int parallaxHeight = textures[9];
+    unsigned int parallaxCone = coneStepMapping ? textures[10] : 0;
+
+    //we need to set up proper texture unit(every shader variant compiled later gets the same units)
     myShader.Use();
-    myShader.setInt("material.diffuse", 0);
-    myShader.setInt("material.specular", 1);
-    myShader.setInt("material.emission", 2);
-    myShader.setInt("shadowMap", 3);
+    myShader.setSampler("material.diffuse", 0);
+    myShader.setSampler("material.specular", 1);
+    myShader.setSampler("material.emission", 2);
+    myShader.setSampler("shadowMap", 3);
     windowShader.Use();
-    windowShader.setInt("windowTexture", 0);
+    windowShader.setSampler("windowTexture", 0);
     skyboxShader.Use();
-    skyboxShader.setInt("skybox", 0);
+    skyboxShader.setSampler("skybox", 0);
+    mirrorShader.Use();
+    mirrorShader.setSampler("skybox", 0);
     nMapShader.Use();
-    nMapShader.setInt("diffuseMap", 0);
-    nMapShader.setInt("normalMap", 1);
+    nMapShader.setSampler("diffuseMap", 0);
+    nMapShader.setSampler("normalMap", 1);
     parallaxShader.Use();
-    parallaxShader.setInt("diffuseMap", 0);
-    parallaxShader.setInt("normalMap", 1);
-    parallaxShader.setInt("depthMap", 2);
+    parallaxShader.setSampler("diffuseMap", 0);
+    parallaxShader.setSampler("normalMap", 1);
+    parallaxShader.setSampler("depthMap", 2);
+
+    //--texture-arrays: the stress grid instanced, its two diffuse maps as layers of one texture array
+    TextureArrays materialArrays;
+    GridBatching gridBatching;
+    if (options.textureArrays)
+    {
+        materialArrays.LayerSize = options.textureArraySize;
+        const TextureLayer containerLayer = materialArrays.Add(diffuseMap);
+        const TextureLayer floorLayer = materialArrays.Add(floorTexture);
+        materialArrays.Build();
+        LOG_INFO << "Texture arrays: " << materialArrays.Summary();
+        if (containerLayer.array != floorLayer.array)
+            LOG_WARNING << "The diffuse maps of the stress grid differ in size or format, it is drawn a cube at a time (--texture-array-size resizes them)";
+        else
+        {
+            gridBatching.diffuseArray = materialArrays.Texture(containerLayer.array);
+            gridBatching.layers[0] = (float)containerLayer.layer;
+            gridBatching.layers[1] = (float)floorLayer.layer;
+            gridBatching.feature = myShader.Feature("TEXTURE_ARRAY");
+            gridBatching.capacity = 20 * 10 * 5;
+            glGenVertexArrays(1, &gridBatching.vao);
+            glGenBuffers(1, &gridBatching.instanceBuffer);
+            glBindVertexArray(gridBatching.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (GLvoid*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (GLvoid*)(3 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (GLvoid*)(5 * sizeof(float)));
+            glEnableVertexAttribArray(2);
+            glBindBuffer(GL_ARRAY_BUFFER, gridBatching.instanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, gridBatching.capacity * sizeof(GridInstance), NULL, GL_STREAM_DRAW);
+            //the model matrix takes a location per column
+            for (GLuint attribute = 3; attribute <= 7; attribute++)
+            {
+                glEnableVertexAttribArray(attribute);
+                glVertexAttribDivisor(attribute, 1);
+            }
+            pointGridInstances(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(0);
+            myShader.Use();
+            myShader.setSampler("diffuseLayers", 4);
+            myShader.Prepare(gridBatching.feature);
+            myShader.Prepare(gridBatching.feature | singleTapShadowsFeature);
+        }
+    }
+    if (options.parallaxBenchmark)
+    {
+        runParallaxBenchmark(parallaxShader, nMapVAO, parallaxDiffuse, parallaxNormal, parallaxHeight, parallaxCone,
+            "../textures/toy_box_disp.png", "../textures/toy_box_cone.png", renderWidth, renderHeight);
+        glfwTerminate();
+        return 0;
+    }
+    if (options.outlineBenchmark)
+    {
+        runOutlineBenchmark(outlineShader, containerVAO, renderWidth, renderHeight);
+        glfwTerminate();
+        return 0;
+    }
+    //the cone step map holds the depth as well, the relief level draws the quad with the cone step variant
+    if (coneStepMapping)
+        parallaxHeight = parallaxCone;
+
+    //lighting features of the default shader, a variant without runtime branches is picked every frame
+    const unsigned int pointLightsFeature = myShader.Feature("POINT_LIGHTS");
+    const unsigned int spotlightFeature = myShader.Feature("SPOTLIGHT");
 
     glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture when done to not F up
 
-    while (!glfwWindowShouldClose(window))
+    //headless benchmark: the scene goes into an offscreen target, time advances by a fixed step per frame
+    //and the camera follows a path instead of the input
+    OffscreenTarget offscreen;
+    if (options.headless)
     {
-        // Calculate deltatime of current frame
-        GLfloat currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        glfwPollEvents();
-        do_movements();
+        if (!offscreen.Create(renderWidth, renderHeight))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        render.sceneFBO = offscreen.FBO;
+        if (!options.cameraPath.empty() && !update.cameraPath.Load(options.cameraPath))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        render.frameTimesMs.reserve(options.frames);
+    }
 
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    //the reflection probe of the mirror cubes, halfway between the two
+    ReflectionProbe& reflectionProbe = render.reflectionProbe;
+    const bool probeEnabled = options.probeFaces > 0;
+    const glm::vec3 probePosition = mirrorCubePos + glm::vec3(0.0f, 0.5f, 0.5f);
+    if (probeEnabled)
+    {
+        reflectionProbe.Position = probePosition;
+        reflectionProbe.FacesPerFrame = options.probeFaces;
+        reflectionProbe.UpdateMode = options.probeUpdate == "motion" ? PROBE_UPDATE_ON_MOTION : PROBE_UPDATE_ALWAYS;
+        if (!reflectionProbe.Create(options.probeSize, options.probePrefilter))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        if (options.probePrefilter)
+            glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);     //filtered mip levels across the face edges
+        sortWindows(windows, probePosition, render.probeWindows);
+    }
 
-        // Create transformation
-        glm::mat4 projectionMat = glm::mat4(1.0f);
-        glm::mat4 viewMat = glm::mat4(1.0f);
-        glm::mat4 modelMat = glm::mat4(1.0f);
-        projectionMat = glm::perspective(glm::radians(camera.Zoom), (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
-        viewMat = camera.GetViewMatrix();
-        
-        myShader.Use();
-        //passing all sorts of values to the shader
-        myShader.setVec3("viewPos", camera.Position.x, camera.Position.y, camera.Position.z);
-        myShader.setFloat("time", 5.0 * currentFrame);
-        //Material
-        myShader.setFloat("material.shininess", 64.0f);
-        //Lights
-        glm::vec3 lightColor = glm::vec3(1.0f);
-        glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f); // decrease the influence
-        glm::vec3 ambientColor = lightColor * glm::vec3(0.2f); // low influence
-        //direction light
-        myShader.setVec3("directLight.direction", directLightPos);
-        myShader.setVec3("directLight.ambient", glm::vec3(0.05f));
-        myShader.setVec3("directLight.diffuse", glm::vec3(0.7f));
-        myShader.setVec3("directLight.specular", glm::vec3(1.0f));
-        // four point lights
-        if (showLampsAndTheirLight)
+    if (!render.hiZPyramid.Create(renderWidth, renderHeight) || !render.screenOutline.Create(renderWidth, renderHeight))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    glGenQueries((GLsizei)render.occlusionQueries.size(), &render.occlusionQueries[0]);
+    render.resolution.BudgetMs = options.frameBudgetMs;
+    render.resolution.MinScale = options.minResolutionScale;
+    render.resolution.MaxScale = options.maxResolutionScale;
+    update.softwareOcclusion.Create(256, std::max(256 * renderHeight / renderWidth, 1));
+
+    Model* backpack = NULL;
+    Shader* modelShader = NULL;
+    const unsigned int stressDiffuseMaps[] = { diffuseMap, floorTexture };
+    for (size_t i = 0; i < sceneNames.size(); i++)
+    {
+        render.suiteResults[i].scene = sceneNames[i];
+        if (sceneNames[i] != "backpack")
+            continue;
+        //loaded up front, the update thread has to know whether the scene can run at all
+        backpack = new Model("../objects/backpack/backpack.obj");
+        modelShader = new Shader("../shaders/model_loading.ver", "../shaders/model_loading.frag");
+        if (backpack->meshes.empty())
         {
-            for (unsigned int i = 0; i < numberOfPointLights; i++)
+            LOG_WARNING << "Scene " << sceneNames[i] << " skipped: ../objects/backpack/backpack.obj could not be loaded";
+            render.suiteResults[i].skipReason = "model ../objects/backpack/backpack.obj could not be loaded";
+            update.sceneRuns[i] = false;
+        }
+        else
+            backpack->BuildBvhs();      //for picking
+    }
+    //bounding volume hierarchies and picking meshes of the update stage
+    buildStressGridBvh(update.stressGridBvh);
+    shadowCasterBounds(animation.Current, cubePositions, update.shadowCasterBoxes);
+    update.shadowCasterBvh.Build(update.shadowCasterBoxes);
+    update.pickMeshes.cube.Build(vertices, 8 * sizeof(float), 36, NULL, 0);
+    update.pickMeshes.plane.Build(planeVertices, 8 * sizeof(float), 6, NULL, 0);
+    update.pickMeshes.quad.Build(&nMapCorners[0].Position.x, sizeof(Vertex), 4, nMapIndices, 6);
+    //the variants the shading levels switch between (ShadingLod.h): the normal mapped and parallax quads, and a cube of the stress
+    //grid per level
+    std::vector<StressCube> shadingWarmUpCubes(SHADING_LEVEL_COUNT);
+    for (int level = 0; level < SHADING_LEVEL_COUNT; level++)
+    {
+        shadingWarmUpCubes[level].modelMat = glm::mat4(1.0f);
+        shadingWarmUpCubes[level].diffuseMap = 0;
+        shadingWarmUpCubes[level].shading = (ShadingLevel)level;
+    }
+    warmUpVariants([&](const glm::mat4& projectionMat) {
+        const unsigned int gridFeatures = gridBatching.vao != 0 ? gridBatching.feature : 0;
+        for (int level = 0; level < SHADING_LEVEL_COUNT; level++)
+        {
+            beginPrepassedShading();
+            drawNMap(projectionMat, nMapVAO, nMapShader, nMapLevelFeatures[level], glm::mat4(1.0f), nMapDiffuseMap, nMapNormalMap);
+            endPrepassedShading();
+            drawParallax(projectionMat, nMapVAO, parallaxShader, parallaxLevelFeatures[level], glm::mat4(1.0f), parallaxDiffuse, parallaxNormal,
+                parallaxHeight);
+        }
+        const unsigned int lightingFeatures = (showLampsAndTheirLight ? pointLightsFeature : 0) | (globalSpotlightSwitch ? spotlightFeature : 0);
+        const unsigned int levelFeatures[SHADING_LEVEL_COUNT] = { lightingFeatures | gridFeatures, lightingFeatures | gridFeatures,
+            lightingFeatures | singleTapShadowsFeature | gridFeatures };
+        beginPrepassedShading();
+        drawStressGrid(projectionMat, containerVAO, myShader, levelFeatures, shadingWarmUpCubes, stressDiffuseMaps, specularMap, emissionMap, gridBatching);
+        endPrepassedShading();
+        //the late pass of the occlusion culling draws the grid in the state without the pre-pass
+        if (depthPrepassSwitch)
+            drawStressGrid(projectionMat, containerVAO, myShader, levelFeatures, shadingWarmUpCubes, stressDiffuseMaps, specularMap, emissionMap, gridBatching);
+    }, depthPrepassSwitch, renderWidth, renderHeight);
+
+    SceneResources resources;
+    resources.vertices = vertices;
+    resources.planeVertices = planeVertices;
+    resources.cubePositions = cubePositions;
+    resources.pointLightPositions = pointLightPositions;
+    resources.windows = windows;
+    resources.walls = occlusionWalls();
+    resources.backpack = backpack;
+    resources.modelShader = modelShader;
+    resources.myShader = &myShader;
+    resources.outlineShader = &outlineShader;
+    resources.lampShader = &lampShader;
+    resources.windowShader = &windowShader;
+    resources.skyboxShader = &skyboxShader;
+    resources.mirrorShader = &mirrorShader;
+    resources.simpleDepthShader = &simpleDepthShader;
+    resources.nMapShader = &nMapShader;
+    resources.parallaxShader = &parallaxShader;
+    resources.containerVAO = containerVAO;
+    resources.planeVAO = planeVAO;
+    resources.transparentVAO = transparentVAO;
+    resources.lightVAO = lightVAO;
+    resources.skyboxVAO = skyboxVAO;
+    resources.mirrorVAO = mirrorVAO;
+    resources.nMapVAO = nMapVAO;
+    resources.shadowMapFBO = shadowMapFBO;
+    resources.shadowMap = shadowMap;
+    resources.shadowWidth = SHADOW_WIDTH;
+    resources.shadowHeight = SHADOW_HEIGHT;
+    resources.cubemapTexture = cubemapTexture;
+    resources.diffuseMap = diffuseMap;
+    resources.specularMap = specularMap;
+    resources.emissionMap = emissionMap;
+    resources.floorTexture = floorTexture;
+    resources.windowTexture = windowTexture;
+    resources.nMapDiffuseMap = nMapDiffuseMap;
+    resources.nMapNormalMap = nMapNormalMap;
+    resources.parallaxDiffuse = parallaxDiffuse;
+    resources.parallaxNormal = parallaxNormal;
+    resources.parallaxHeight = parallaxHeight;
+    resources.parallaxCone = parallaxCone;
+    resources.stressDiffuseMaps[0] = stressDiffuseMaps[0];
+    resources.stressDiffuseMaps[1] = stressDiffuseMaps[1];
+    resources.pointLightsFeature = pointLightsFeature;
+    resources.spotlightFeature = spotlightFeature;
+    resources.singleTapShadowsFeature = singleTapShadowsFeature;
+    resources.depthPrepassFeature = depthPrepassFeature;
+    for (int level = 0; level < SHADING_LEVEL_COUNT; level++)
+    {
+        resources.nMapLevelFeatures[level] = nMapLevelFeatures[level];
+        resources.parallaxLevelFeatures[level] = parallaxLevelFeatures[level];
+    }
+    for (unsigned int i = 0; i < numberOfPointLights; i++)
+    {
+        std::string name = "pointLights[" + std::to_string(i) + "]";
+        resources.pointLightUniforms[i].position = name + ".position";
+        resources.pointLightUniforms[i].constant = name + ".constant";
+        resources.pointLightUniforms[i].linear = name + ".linear";
+        resources.pointLightUniforms[i].quadratic = name + ".quadratic";
+        resources.pointLightUniforms[i].ambient = name + ".ambient";
+        resources.pointLightUniforms[i].diffuse = name + ".diffuse";
+        resources.pointLightUniforms[i].specular = name + ".specular";
+    }
+    resources.gridBatching = gridBatching;
+    update.window = render.window = window;
+    update.renderWidth = render.renderWidth = renderWidth;
+    update.renderHeight = render.renderHeight = renderHeight;
+    update.totalFrames = options.warmupFrames + options.frames;
+    update.probePosition = probePosition;
+    update.probeProjection = render.probeProjection = ReflectionProbe::Projection();
+    render.probeEnabled = probeEnabled;
+    render.shaderStartupMs = shaderStartupMs;
+
+    if (options.singleThread)
+    {
+        //both stages one after the other, for comparison
+        FrameSnapshot snapshot;
+        while (updateFrame(update, resources, snapshot))
+        {
+            renderFrame(render, resources, snapshot);
+            std::lock_guard<std::mutex> lock(render.titleMutex);
+            if (!render.windowTitle.empty())
+                glfwSetWindowTitle(window, render.windowTitle.c_str());
+            render.windowTitle.clear();
+        }
+    }
+    else
+    {
+        //the context moves to the render thread, it renders frame N while the main thread updates frame N+1
+        FramePipeline<FrameSnapshot> pipeline;
+        glfwMakeContextCurrent(NULL);
+        std::thread renderThread([&]()
+        {
+            PROFILE_THREAD_NAME("render");
+            glfwMakeContextCurrent(window);
+            while (const FrameSnapshot* snapshot = pipeline.BeginRead())
             {
-                std::string curName = "pointLights[" + std::to_string(i) + std::string(1, ']');
-                myShader.setVec3(curName + ".position", pointLightPositions[i]);
-                myShader.setFloat(curName + ".constant", 1.0f);
-                myShader.setFloat(curName + ".linear", 0.09f);
-                myShader.setFloat(curName + ".quadratic", 0.032f);
-                myShader.setVec3(curName + ".ambient", ambientColor);
-                myShader.setVec3(curName + ".diffuse", diffuseColor);
-                myShader.setVec3(curName + ".specular", glm::vec3(1.0f));
+                renderFrame(render, resources, *snapshot);
+                pipeline.EndRead();
             }
+            glfwMakeContextCurrent(NULL);
+        });
+        while (FrameSnapshot* snapshot = pipeline.BeginWrite())
+        {
+            if (!updateFrame(update, resources, *snapshot))
+                break;
+            pipeline.EndWrite();
+            std::lock_guard<std::mutex> lock(render.titleMutex);
+            if (!render.windowTitle.empty())
+                glfwSetWindowTitle(window, render.windowTitle.c_str());
+            render.windowTitle.clear();
         }
-        myShader.setBool("lampsLightEnabled", showLampsAndTheirLight);
-
-        //spotlight
-        myShader.setBool("spotlight.enabled", globalSpotlightSwitch);
-        myShader.setVec3("spotlight.position", camera.Position);
-        myShader.setVec3("spotlight.direction", camera.Front);
-        myShader.setFloat("spotlight.cutOff", glm::cos(glm::radians(12.5f)));
-        myShader.setFloat("spotlight.outerCutOff", glm::cos(glm::radians(15.5f)));
-        myShader.setFloat("spotlight.constant", 1.0f);          //chose constants for 50 units
-        myShader.setFloat("spotlight.linear", 0.09f);
-        myShader.setFloat("spotlight.quadratic", 0.032f);
-        myShader.setVec3("spotlight.ambient", glm::vec3(0.0f));
-        myShader.setVec3("spotlight.diffuse", glm::vec3(1.0f));
-        myShader.setVec3("spotlight.specular", glm::vec3(1.0f));
-
-        //first we draw the scene to make shadow map
-        glm::mat4 lightProjection, lightView;
-        glm::mat4 lightSpaceMatrix;
-        float near_plane = 1.0f, far_plane = 20.0f;
-        //lightProjection = glm::perspective(glm::radians(45.0f), (GLfloat)SHADOW_WIDTH / (GLfloat)SHADOW_HEIGHT, near_plane, far_plane); // обратите внимание, что если вы используете матрицу перспективной проекции, вам придется изменить положение света, так как текущего положения света недостаточно для отображения всей сцены
-        lightProjection = glm::ortho(-15.0f, 20.0f, -15.0f, 20.0f, near_plane, far_plane);
-        lightView = glm::lookAt(-directLightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-        lightSpaceMatrix = lightProjection * lightView;
-        
-        simpleDepthShader.Use();
-        simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        drawSceneForShadows(simpleDepthShader, planeVAO, containerVAO, mirrorVAO, nMapVAO, cubePositions);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        //then we draw the scene normally
-        
-        glViewport(0, 0, WIDTH, HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-        
-        myShader.Use();
-        myShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, shadowMap);
-
-        /* nevermind that, just an idea
-        nMapShader.Use();
-        nMapShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, shadowMap);
-        */
+        pipeline.Close();
+        renderThread.join();
+        glfwMakeContextCurrent(window);
+    }
+    frameSnapshot = NULL;
 
-        drawFloor(projectionMat, planeVAO, myShader, floorTexture);
-        drawNMap(projectionMat, nMapVAO, nMapShader, nMapDiffuseMap, nMapNormalMap);
-        drawParallax(projectionMat, nMapVAO, parallaxShader, parallaxDiffuse, parallaxNormal, parallaxHeight);
-        drawCubesAndOutline(projectionMat, containerVAO, myShader, outlineShader, cubePositions, diffuseMap, specularMap, emissionMap);
-        if (showLampsAndTheirLight)
-            drawLamps(projectionMat, lightVAO, lampShader, pointLightPositions, ambientColor, diffuseColor);
-        drawSkyboxAndCubes(projectionMat, skyboxVAO, mirrorVAO, skyboxShader, mirrorShader, cubemapTexture);
-        drawWindows(projectionMat, transparentVAO, windowShader, windows, windowTexture);
-        
-        /*//DEBUG
-        // рендеринг на плоскости карты глубины для наглядной отладки
-        // ---------------------------------------------
-        debugDepthQuad.Use();
-        debugDepthQuad.setFloat("near_plane", near_plane);
-        debugDepthQuad.setFloat("far_plane", far_plane);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, shadowMap);
-        renderQuad();
-        */
-        glfwSwapBuffers(window);
+    int exitCode = 0;
+    if (options.suite)
+    {
+        const std::string settings = perfSuiteSettings(renderWidth, renderHeight, options.frames, options.warmupFrames, options.timeStep,
+            options.simulationStep);
+        PerfBaselines baselines;
+        if (options.updateBaselines)
+        {
+            baselines.Renderer = glExtensions().renderer;
+            baselines.Settings = settings;
+            for (size_t r = 0; r < render.suiteResults.size(); r++)
+                for (std::map<std::string, double>::const_iterator it = render.suiteResults[r].metrics.begin(); it != render.suiteResults[r].metrics.end(); ++it)
+                    baselines.Values[render.suiteResults[r].scene + "." + it->first] = it->second;
+            if (baselines.Save(options.baselinesPath))
+                LOG_INFO << "Baselines written to " << options.baselinesPath << ", golden images to " << options.goldenDirectory;
+        }
+        else
+        {
+            if (!baselines.Load(options.baselinesPath))
+                LOG_ERROR << "ERROR::PERF_SUITE::NO_BASELINES: " << options.baselinesPath;
+            else if (baselines.Settings != settings)
+                LOG_WARNING << "Performance suite: baselines were recorded at " << baselines.Settings << ", no metric is compared";
+            else if (baselines.Renderer != glExtensions().renderer)
+                LOG_WARNING << "Performance suite: baselines were recorded on " << baselines.Renderer
+                    << ", timings, memory, shaded fragments and golden images are not compared";
+            std::vector<PerfCheck> checks = checkAgainstBaselines(render.suiteResults, baselines, glExtensions().renderer, settings);
+            bool passed = perfChecksPassed(checks);
+            for (size_t c = 0; c < checks.size(); c++)
+                if (checks[c].status != "pass")
+                    LOG_WARNING << checks[c].scene << "." << checks[c].metric << ": " << checks[c].status << " (" << checks[c].value
+                        << ", baseline " << checks[c].baseline << ", limit " << checks[c].limit << ")";
+            writePerfReport(options.reportPath, render.suiteResults, checks, glExtensions().renderer, passed);
+            LOG_INFO << "Performance suite " << (passed ? "passed" : "FAILED") << ", report written to " << options.reportPath;
+            exitCode = passed ? 0 : 1;
+        }
     }
+    if (options.occlusionBenchmark)
+        logOcclusionBenchmark(render.occlusionRuns);
+    if (options.headless)
+        offscreen.Delete();
+    if (probeEnabled)
+        reflectionProbe.Delete();
+    render.hiZPyramid.Delete();
+    materialArrays.Delete();
+    textureStreamer.Delete();
+    render.screenOutline.Delete();
+    render.postProcess.Delete();
+    gpuProfiler.Delete();
+    glDeleteVertexArrays(1, &gridBatching.vao);
+    glDeleteBuffers(1, &gridBatching.instanceBuffer);
+    glDeleteQueries((GLsizei)render.occlusionQueries.size(), &render.occlusionQueries[0]);
+    delete backpack;
+    delete modelShader;
+    if (!options.recordCameraPath.empty() && update.recordedPath.Save(options.recordCameraPath))
+        LOG_INFO << "Camera path written to " << options.recordCameraPath;
 
     glDeleteVertexArrays(1, &containerVAO);
     glDeleteVertexArrays(1, &planeVAO);
@@ -1052,7 +2985,9 @@ int main()
     glDeleteBuffers(1, &transparentVBO);
     glDeleteBuffers(1, &planeVBO);
     glDeleteBuffers(1, &skyboxVBO);
+    render.shadedFragments.Delete();
 
     glfwTerminate();
-    return 0;
+    Logger::Instance().Shutdown();
+    return exitCode;
 }
\ No newline at end of file
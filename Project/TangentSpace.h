@@ -0,0 +1,275 @@
+#ifndef TANGENT_SPACE_H
+#define TANGENT_SPACE_H
+
+// Per vertex tangents of an indexed triangle list, built the way MikkTSpace builds them: the texture space
+// tangent and bitangent of every triangle are projected into the tangent plane of each of its vertices,
+// weighted by the angle of the triangle at that vertex and summed. Only the sign of the bitangent is kept,
+// shaders rebuild it as sign * cross(normal, tangent). Unlike MikkTSpace no vertex is split, a vertex shared
+// by mirrored halves of a UV layout gets the sum of both (importers split vertices on UV seams already).
+//   TangentMeshView view = { &vertices[0].Position.x, sizeof(Vertex), &vertices[0].Normal.x, sizeof(Vertex),
+//       &vertices[0].TexCoords.x, sizeof(Vertex), vertices.size(), indices.data(), indices.size() };
+//   std::vector<glm::vec4> tangents;
+//   generateTangents(view, tangents);
+//   vertices[i].Tangent = packTangent(tangents[i]);    // 4 bytes instead of a tangent and a bitangent
+// Three passes: the triangles in chunks on the job system, four at a time in SSE registers, then a table of
+// the corners of every vertex (counting sort) and the sums per vertex in chunks again. Every vertex is summed
+// by one job in index order, so the result does not depend on the number of threads.
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TANGENT_SPACE_SSE 1
+#include <emmintrin.h>
+#else
+#define TANGENT_SPACE_SSE 0
+#endif
+
+#include "CpuProfiler.h"
+#include "JobSystem.h"
+
+// Attributes of any interleaved or separate vertex layout, strides in bytes
+struct TangentMeshView
+{
+    const float* positions;         // xyz
+    size_t positionStride;
+    const float* normals;           // xyz, unit length
+    size_t normalStride;
+    const float* texCoords;         // uv
+    size_t texCoordStride;
+    size_t vertexCount;
+    const unsigned int* indices;    // 3 per triangle
+    size_t indexCount;
+};
+
+namespace tangent_space
+{
+    inline const float* attribute(const float* base, size_t stride, unsigned int vertex)
+    {
+        return (const float*)((const char*)base + stride * vertex);
+    }
+
+    // Angle weighted tangent and bitangent of the corners of one triangle, projected into the plane of the normal
+    // at each corner. Nothing for triangles without an area in texture space.
+    inline void triangleCorners(const TangentMeshView& mesh, size_t triangle, glm::vec3* cornerTangents, glm::vec3* cornerBitangents)
+    {
+        glm::vec3 p[3], n[3];
+        glm::vec2 uv[3];
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int vertex = mesh.indices[triangle * 3 + k];
+            const float* position = attribute(mesh.positions, mesh.positionStride, vertex);
+            const float* normal = attribute(mesh.normals, mesh.normalStride, vertex);
+            const float* texCoord = attribute(mesh.texCoords, mesh.texCoordStride, vertex);
+            p[k] = glm::vec3(position[0], position[1], position[2]);
+            n[k] = glm::vec3(normal[0], normal[1], normal[2]);
+            uv[k] = glm::vec2(texCoord[0], texCoord[1]);
+        }
+        glm::vec3 edge1 = p[1] - p[0], edge2 = p[2] - p[0];
+        glm::vec2 deltaUV1 = uv[1] - uv[0], deltaUV2 = uv[2] - uv[0];
+        float area = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+        // the direction is all that counts, the sign keeps mirrored triangles pointing the right way
+        float orientation = area < 0.0f ? -1.0f : 1.0f;
+        glm::vec3 tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * orientation;
+        glm::vec3 bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * orientation;
+        for (int k = 0; k < 3; k++)
+        {
+            cornerTangents[k] = glm::vec3(0.0f);
+            cornerBitangents[k] = glm::vec3(0.0f);
+            if (std::fabs(area) < 1e-20f)
+                continue;
+            glm::vec3 a = p[(k + 1) % 3] - p[k], b = p[(k + 2) % 3] - p[k];
+            float lengths = glm::length(a) * glm::length(b);
+            if (lengths <= 0.0f)
+                continue;
+            float angle = std::acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f));
+            glm::vec3 t = tangent - n[k] * glm::dot(n[k], tangent);
+            glm::vec3 s = bitangent - n[k] * glm::dot(n[k], bitangent);
+            float tLength = glm::length(t), sLength = glm::length(s);
+            if (tLength > 0.0f)
+                cornerTangents[k] = t * (angle / tLength);
+            if (sLength > 0.0f)
+                cornerBitangents[k] = s * (angle / sLength);
+        }
+    }
+
+#if TANGENT_SPACE_SSE
+    struct Vec3x4
+    {
+        __m128 x, y, z;
+    };
+
+    inline Vec3x4 sub(const Vec3x4& a, const Vec3x4& b)
+    {
+        Vec3x4 r = { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+        return r;
+    }
+    inline Vec3x4 mul(const Vec3x4& a, __m128 s)
+    {
+        Vec3x4 r = { _mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s) };
+        return r;
+    }
+    inline __m128 dot(const Vec3x4& a, const Vec3x4& b)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+    }
+    // 1 / length, 0 for zero vectors
+    inline __m128 inverseLength(const Vec3x4& a)
+    {
+        __m128 squared = dot(a, a);
+        __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(squared));
+        return _mm_and_ps(inverse, _mm_cmpgt_ps(squared, _mm_setzero_ps()));
+    }
+
+    // triangleCorners for four triangles at once, one per lane
+    inline void triangleCorners4(const TangentMeshView& mesh, size_t firstTriangle, glm::vec3* cornerTangents, glm::vec3* cornerBitangents)
+    {
+        alignas(16) float values[3][8][4];      // corner, attribute (position xyz, normal xyz, uv), triangle
+        for (int lane = 0; lane < 4; lane++)
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int vertex = mesh.indices[(firstTriangle + lane) * 3 + k];
+                const float* position = attribute(mesh.positions, mesh.positionStride, vertex);
+                const float* normal = attribute(mesh.normals, mesh.normalStride, vertex);
+                const float* texCoord = attribute(mesh.texCoords, mesh.texCoordStride, vertex);
+                for (int c = 0; c < 3; c++)
+                {
+                    values[k][c][lane] = position[c];
+                    values[k][3 + c][lane] = normal[c];
+                }
+                values[k][6][lane] = texCoord[0];
+                values[k][7][lane] = texCoord[1];
+            }
+        Vec3x4 p[3], n[3];
+        __m128 u[3], v[3];
+        for (int k = 0; k < 3; k++)
+        {
+            Vec3x4 position = { _mm_load_ps(values[k][0]), _mm_load_ps(values[k][1]), _mm_load_ps(values[k][2]) };
+            Vec3x4 normal = { _mm_load_ps(values[k][3]), _mm_load_ps(values[k][4]), _mm_load_ps(values[k][5]) };
+            p[k] = position;
+            n[k] = normal;
+            u[k] = _mm_load_ps(values[k][6]);
+            v[k] = _mm_load_ps(values[k][7]);
+        }
+        Vec3x4 edge1 = sub(p[1], p[0]), edge2 = sub(p[2], p[0]);
+        __m128 du1 = _mm_sub_ps(u[1], u[0]), dv1 = _mm_sub_ps(v[1], v[0]);
+        __m128 du2 = _mm_sub_ps(u[2], u[0]), dv2 = _mm_sub_ps(v[2], v[0]);
+        __m128 area = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(du2, dv1));
+        __m128 signBit = _mm_set1_ps(-0.0f);
+        __m128 orientation = _mm_or_ps(_mm_set1_ps(1.0f), _mm_and_ps(area, signBit));
+        __m128 hasArea = _mm_cmpge_ps(_mm_andnot_ps(signBit, area), _mm_set1_ps(1e-20f));
+        Vec3x4 tangent = mul(sub(mul(edge1, dv2), mul(edge2, dv1)), orientation);
+        Vec3x4 bitangent = mul(sub(mul(edge2, du1), mul(edge1, du2)), orientation);
+        for (int k = 0; k < 3; k++)
+        {
+            Vec3x4 a = sub(p[(k + 1) % 3], p[k]), b = sub(p[(k + 2) % 3], p[k]);
+            alignas(16) float cosines[4], angles[4];
+            _mm_store_ps(cosines, _mm_mul_ps(dot(a, b), _mm_mul_ps(inverseLength(a), inverseLength(b))));
+            for (int lane = 0; lane < 4; lane++)
+                angles[lane] = std::acos(glm::clamp(cosines[lane], -1.0f, 1.0f));
+            // degenerate corners have a zero inverse length, the angle of a zero cosine must not count then
+            __m128 weight = _mm_and_ps(_mm_load_ps(angles), hasArea);
+            weight = _mm_and_ps(weight, _mm_cmpgt_ps(_mm_mul_ps(dot(a, a), dot(b, b)), _mm_setzero_ps()));
+            Vec3x4 t = sub(tangent, mul(n[k], dot(n[k], tangent)));
+            Vec3x4 s = sub(bitangent, mul(n[k], dot(n[k], bitangent)));
+            t = mul(t, _mm_mul_ps(weight, inverseLength(t)));
+            s = mul(s, _mm_mul_ps(weight, inverseLength(s)));
+            alignas(16) float out[6][4];
+            _mm_store_ps(out[0], t.x);
+            _mm_store_ps(out[1], t.y);
+            _mm_store_ps(out[2], t.z);
+            _mm_store_ps(out[3], s.x);
+            _mm_store_ps(out[4], s.y);
+            _mm_store_ps(out[5], s.z);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                cornerTangents[lane * 3 + k] = glm::vec3(out[0][lane], out[1][lane], out[2][lane]);
+                cornerBitangents[lane * 3 + k] = glm::vec3(out[3][lane], out[4][lane], out[5][lane]);
+            }
+        }
+    }
+#endif
+}
+
+// tangents[i].xyz is the unit tangent of vertex i, tangents[i].w the sign of its bitangent (+1 or -1).
+// Vertices without a usable triangle get any unit vector perpendicular to their normal.
+inline void generateTangents(const TangentMeshView& mesh, std::vector<glm::vec4>& tangents, JobSystem& jobs = JobSystem::Instance())
+{
+    PROFILE_SCOPE("generateTangents");
+    const size_t triangleCount = mesh.indexCount / 3;
+    std::vector<glm::vec3> cornerTangents(triangleCount * 3), cornerBitangents(triangleCount * 3);
+    jobs.ParallelFor(triangleCount, 4096, [&mesh, &cornerTangents, &cornerBitangents](size_t begin, size_t end) {
+        size_t triangle = begin;
+#if TANGENT_SPACE_SSE
+        for (; triangle + 4 <= end; triangle += 4)
+            tangent_space::triangleCorners4(mesh, triangle, &cornerTangents[triangle * 3], &cornerBitangents[triangle * 3]);
+#endif
+        for (; triangle < end; triangle++)
+            tangent_space::triangleCorners(mesh, triangle, &cornerTangents[triangle * 3], &cornerBitangents[triangle * 3]);
+    });
+
+    // corners of every vertex, in index order
+    std::vector<unsigned int> firstCorner(mesh.vertexCount + 1, 0), corners(triangleCount * 3);
+    for (size_t c = 0; c < triangleCount * 3; c++)
+        firstCorner[mesh.indices[c] + 1]++;
+    for (size_t i = 0; i < mesh.vertexCount; i++)
+        firstCorner[i + 1] += firstCorner[i];
+    std::vector<unsigned int> next(firstCorner.begin(), firstCorner.end() - 1);
+    for (size_t c = 0; c < triangleCount * 3; c++)
+        corners[next[mesh.indices[c]]++] = (unsigned int)c;
+
+    tangents.resize(mesh.vertexCount);
+    jobs.ParallelFor(mesh.vertexCount, 8192, [&mesh, &tangents, &firstCorner, &corners, &cornerTangents, &cornerBitangents](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            glm::vec3 tangent(0.0f), bitangent(0.0f);
+            for (unsigned int c = firstCorner[i]; c < firstCorner[i + 1]; c++)
+            {
+                tangent += cornerTangents[corners[c]];
+                bitangent += cornerBitangents[corners[c]];
+            }
+            const float* normalData = tangent_space::attribute(mesh.normals, mesh.normalStride, (unsigned int)i);
+            glm::vec3 normal(normalData[0], normalData[1], normalData[2]);
+            tangent -= normal * glm::dot(normal, tangent);
+            float length = glm::length(tangent);
+            if (length > 1e-12f)
+                tangent /= length;
+            else
+                tangent = glm::normalize(glm::cross(normal, std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f)));
+            float sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            tangents[i] = glm::vec4(tangent, sign);
+        }
+    });
+}
+
+// Tangent and sign as GL_INT_2_10_10_10_REV, read with glVertexAttribPointer(location, 4, GL_INT_2_10_10_10_REV,
+// GL_TRUE, ...). Shaders normalize the tangent and only test the sign of w, both conversion rules of normalized
+// integers (GL 3.3 and 4.2) work then.
+inline unsigned int packTangent(const glm::vec4& tangent)
+{
+    unsigned int packed = tangent.w < 0.0f ? 3u << 30 : 1u << 30;
+    for (int c = 0; c < 3; c++)
+    {
+        int value = (int)std::floor(glm::clamp(tangent[c], -1.0f, 1.0f) * 511.0f + 0.5f);
+        packed |= ((unsigned int)value & 0x3FFu) << (c * 10);
+    }
+    return packed;
+}
+
+inline glm::vec4 unpackTangent(unsigned int packed)
+{
+    glm::vec4 tangent;
+    for (int c = 0; c < 3; c++)
+    {
+        int value = (int)((packed >> (c * 10)) & 0x3FFu);
+        value = value >= 512 ? value - 1024 : value;
+        tangent[c] = value / 511.0f;
+    }
+    tangent.w = (packed >> 31) ? -1.0f : 1.0f;
+    return tangent;
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+// Material textures packed into the layers of GL_TEXTURE_2D_ARRAY textures, so objects with different materials can be
+// drawn by one (instanced) draw call which picks its layer per instance, instead of a texture bind and a draw per object.
+//   TextureArrays arrays;
+//   TextureLayer container = arrays.Add(diffuseMap), floor = arrays.Add(floorTexture);
+//   arrays.Build();
+//   glBindTexture(GL_TEXTURE_2D_ARRAY, arrays.Texture(container.array)), sample layer container.layer
+// Textures of the same size and format share an array. With LayerSize set every texture is resized to LayerSize x
+// LayerSize and converted to RGBA8 instead, so all of them end up in one array. The layers are blitted from the 2D
+// textures, bilinear when resizing (from the mipmap closest above the layer size), the 2D textures stay valid.
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "Log.h"
+
+// Where a texture added to TextureArrays ended up
+struct TextureLayer
+{
+    int array = -1;         // index for TextureArrays::Texture
+    int layer = -1;
+};
+
+class TextureArrays
+{
+public:
+    int LayerSize = 0;      // 0 groups the textures by size and format, otherwise the size every texture is resized to
+
+    // A mipmapped 2D texture, before Build. Needs the GL context (the size and format are queried)
+    TextureLayer Add(unsigned int texture)
+    {
+        Source source;
+        source.texture = texture;
+        GLint boundTexture = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &source.width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &source.height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &source.format);
+        glBindTexture(GL_TEXTURE_2D, boundTexture);
+        source.format = this->LayerSize > 0 ? GL_RGBA8 : sizedFormat(source.format);
+        const int width = this->LayerSize > 0 ? this->LayerSize : source.width;
+        const int height = this->LayerSize > 0 ? this->LayerSize : source.height;
+
+        TextureLayer placed;
+        for (size_t i = 0; i < this->arrays.size() && placed.array < 0; i++)
+            if (this->arrays[i].width == width && this->arrays[i].height == height && this->arrays[i].format == source.format)
+                placed.array = (int)i;
+        if (placed.array < 0)
+        {
+            Array array;
+            array.width = width;
+            array.height = height;
+            array.format = source.format;
+            placed.array = (int)this->arrays.size();
+            this->arrays.push_back(array);
+        }
+        placed.layer = (int)this->arrays[placed.array].sources.size();
+        this->arrays[placed.array].sources.push_back(source);
+        return placed;
+    }
+
+    // Creates the arrays and copies the layers. Leaves framebuffer 0 bound, the texture bound before is bound again
+    bool Build()
+    {
+        GLint boundTexture = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+        GLuint fbos[2];
+        glGenFramebuffers(2, fbos);
+        bool complete = true;
+        for (size_t i = 0; i < this->arrays.size(); i++)
+        {
+            Array& array = this->arrays[i];
+            const GLsizei layers = (GLsizei)array.sources.size();
+            glGenTextures(1, &array.texture);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, array.format, array.width, array.height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            for (GLsizei layer = 0; layer < layers; layer++)
+            {
+                const Source& source = array.sources[layer];
+                //shrinking reads the smallest mipmap still at least as large, a plain bilinear blit would skip texels
+                const float shrink = std::min((float)source.width / array.width, (float)source.height / array.height);
+                const int level = shrink >= 2.0f ? (int)std::floor(std::log2(shrink)) : 0;
+                const int sourceWidth = std::max(1, source.width >> level), sourceHeight = std::max(1, source.height >> level);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, fbos[0]);
+                glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source.texture, level);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[1]);
+                glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.texture, 0, layer);
+                if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE
+                    || glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                {
+                    complete = false;
+                    continue;
+                }
+                const bool resized = sourceWidth != array.width || sourceHeight != array.height;
+                glBlitFramebuffer(0, 0, sourceWidth, sourceHeight, 0, 0, array.width, array.height, GL_COLOR_BUFFER_BIT, resized ? GL_LINEAR : GL_NEAREST);
+                if (source.width != array.width || source.height != array.height)
+                    this->resized++;
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(2, fbos);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glBindTexture(GL_TEXTURE_2D, boundTexture);
+        if (!complete)
+            LOG_ERROR << "ERROR::TEXTURE_ARRAY::LAYER_NOT_COPIED";
+        return complete;
+    }
+
+    void Delete()
+    {
+        for (size_t i = 0; i < this->arrays.size(); i++)
+            glDeleteTextures(1, &this->arrays[i].texture);
+        this->arrays.clear();
+        this->resized = 0;
+    }
+
+    size_t ArrayCount() const
+    {
+        return this->arrays.size();
+    }
+    unsigned int Texture(int array) const
+    {
+        return this->arrays[array].texture;
+    }
+
+    // "2 textures in 1 array (512x512x2), 2 resized, 2.7 MB with mipmaps"
+    std::string Summary() const
+    {
+        size_t textures = 0;
+        double bytes = 0.0;
+        std::stringstream sizes;
+        for (size_t i = 0; i < this->arrays.size(); i++)
+        {
+            const Array& array = this->arrays[i];
+            textures += array.sources.size();
+            bytes += (double)array.width * array.height * array.sources.size() * texelBytes(array.format) * 4.0 / 3.0;
+            sizes << (i > 0 ? ", " : "") << array.width << "x" << array.height << "x" << array.sources.size();
+        }
+        std::stringstream out;
+        out << textures << " textures in " << this->arrays.size() << (this->arrays.size() == 1 ? " array (" : " arrays (") << sizes.str() << "), "
+            << this->resized << " resized, " << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MB with mipmaps";
+        return out.str();
+    }
+
+private:
+    struct Source
+    {
+        unsigned int texture = 0;
+        GLint width = 0;
+        GLint height = 0;
+        GLint format = 0;
+    };
+    struct Array
+    {
+        GLuint texture = 0;
+        int width = 0;
+        int height = 0;
+        GLint format = 0;
+        std::vector<Source> sources;    // one per layer
+    };
+
+    // The unsized formats of uploadTexture are renderable once sized, the layers are render targets of the blits
+    static GLint sizedFormat(GLint format)
+    {
+        switch (format)
+        {
+        case GL_RED: return GL_R8;
+        case GL_RG: return GL_RG8;
+        case GL_RGB: return GL_RGB8;
+        case GL_RGBA: return GL_RGBA8;
+        default: return format;
+        }
+    }
+
+    static int texelBytes(GLint format)
+    {
+        return format == GL_R8 ? 1 : format == GL_RG8 ? 2 : format == GL_RGB8 ? 3 : 4;
+    }
+
+    std::vector<Array> arrays;
+    int resized = 0;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+#include "stb_image.h"
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include "Log.h"
+
+// Pixels of an image file. Decoding needs no GL context, so it can run on any thread.
+struct DecodedImage
+{
+    int width;
+    int height;
+    int components;
+    unsigned char* data;        // NULL when the file could not be decoded
+};
+
+inline DecodedImage decodeImage(const std::string& path)
+{
+    PROFILE_SCOPE("decodeImage");
+    DecodedImage image;
+    image.data = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+    if (!image.data)
+        LOG_ERROR << "Texture failed to load at path: " << path;
+    return image;
+}
+
+inline void freeImage(DecodedImage& image)
+{
+    stbi_image_free(image.data);
+    image.data = NULL;
+}
+
+inline GLenum imageFormat(const DecodedImage& image)
+{
+    if (image.components == 1)
+        return GL_RED;
+    if (image.components == 4)
+        return GL_RGBA;
+    return GL_RGB;
+}
+
+// Mipmapped, repeating 2D texture (empty when the image failed to decode). Needs the GL context, frees the pixels.
+inline unsigned int uploadTexture(DecodedImage& image)
+{
+    PROFILE_SCOPE("uploadTexture");
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    if (image.data)
+    {
+        GLenum format = imageFormat(image);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        freeImage(image);
+    }
+    return textureID;
+}
+
+// The files are decoded on the job workers, every texture is uploaded by the main thread as soon as its
+// file is ready, so uploads overlap the decoding of the rest. Has to be called on the main thread.
+inline std::vector<unsigned int> loadTextures(const std::vector<std::string>& paths)
+{
+    PROFILE_SCOPE("loadTextures");
+    JobSystem& jobs = JobSystem::Instance();
+    std::vector<DecodedImage> images(paths.size());
+    std::vector<unsigned int> textures(paths.size(), 0);
+    JobCounter uploaded;
+    for (size_t i = 0; i < paths.size(); i++)
+        jobs.Run([&jobs, &paths, &images, &textures, &uploaded, i]()
+        {
+            images[i] = decodeImage(paths[i]);
+            jobs.RunOnMainThread([&images, &textures, i]() { textures[i] = uploadTexture(images[i]); }, &uploaded);
+        }, &uploaded);
+    jobs.Wait(uploaded);
+    return textures;
+}
+
+#endif
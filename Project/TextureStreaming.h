@@ -0,0 +1,512 @@
+#ifndef TEXTURE_STREAMING_H
+#define TEXTURE_STREAMING_H
+
+// Texture streaming: a texture starts with only its small mipmaps resident (StartSize texels and below) and gets the finer
+// ones once something shows it large enough on screen. Every frame the renderer reports how many pixels one repeat of a
+// texture covers (Require), Update then
+//   - uploads the mipmaps the job workers finished (decoded from the file again and downsampled)
+//   - fits what the textures need into BudgetBytes: while it does not fit, the texture whose finest wanted mipmap is the
+//     largest gets a level coarser
+//   - releases mipmaps finer than wanted, only while the resident ones exceed the budget, so the textures the camera
+//     just turned away from stay cached as long as there is room
+//   - starts loading the mipmaps which are wanted and fit, at most MaxLoads textures at a time
+// The resident mipmaps of a texture are GL_TEXTURE_BASE_LEVEL to the last one, the levels above the base are released by
+// specifying them 0x0 (levels outside base..max do not count for completeness).
+//   std::vector<unsigned int> textures = streamer.Load(paths);       // main thread, needs the GL context
+//   per frame on the thread with the context: streamer.Require(texture, pixels) for everything drawn, then Update()
+// The last HISTORY_SIZE frames (resident, required and budget) are kept for the report, WriteCsv exports them.
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "TextureLoader.h"
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include "Log.h"
+
+struct StreamingSample
+{
+    unsigned long long frame;
+    double residentMb;          // after the frame's update
+    double requiredMb;          // what the textures needed, before fitting the budget
+    float residency;            // share of the textures drawn this frame which had the mipmap they need
+    int loading;                // textures with a load in flight
+};
+
+class TextureStreamer
+{
+public:
+    static const int HISTORY_SIZE = 1024;
+    static const int MAX_LEVELS = 16;
+
+    size_t BudgetBytes = 64 << 20;
+    int StartSize = 64;             // largest mipmap a texture starts with
+    int MaxLoads = 2;               // textures loading at the same time
+
+    TextureStreamer() : frame(0), historySize(0)
+    {
+    }
+
+    // Decodes the files on the job workers and uploads the mipmaps up to StartSize. Has to be called on the main thread
+    std::vector<unsigned int> Load(const std::vector<std::string>& paths)
+    {
+        PROFILE_SCOPE("TextureStreamer::Load");
+        JobSystem& jobs = JobSystem::Instance();
+        const size_t first = this->textures.size();
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            this->textures.emplace_back(new StreamedTexture());
+            this->textures.back()->path = paths[i];
+        }
+        std::vector<unsigned int> names(paths.size(), 0);
+        JobCounter uploaded;
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            StreamedTexture* texture = this->textures[first + i].get();
+            unsigned int* name = &names[i];
+            jobs.Run([this, &jobs, &uploaded, texture, name]()
+            {
+                DecodedImage image = decodeImage(texture->path);
+                if (image.data)
+                {
+                    texture->width = image.width;
+                    texture->height = image.height;
+                    texture->components = image.components;
+                    texture->levels = 1 + (int)std::floor(std::log2((double)std::max(image.width, image.height)));
+                    texture->levels = std::min(texture->levels, MAX_LEVELS);
+                    texture->start = 0;
+                    while (texture->start + 1 < texture->levels && std::max(image.width, image.height) >> texture->start > this->StartSize)
+                        texture->start++;
+                    buildLevels(*texture, image.data, texture->start, texture->levels);
+                    freeImage(image);
+                }
+                jobs.RunOnMainThread([this, texture, name]() { *name = this->create(*texture); }, &uploaded);
+            }, &uploaded);
+        }
+        jobs.Wait(uploaded);
+        return names;
+    }
+
+    // One use of texture this frame, pixels is the size on screen of one repeat of it. The finest mipmap any use
+    // needs is the one wanted
+    void Require(unsigned int name, float pixels)
+    {
+        StreamedTexture* texture = this->find(name);
+        if (texture == NULL || texture->levels == 0)
+            return;
+        const float texels = (float)std::max(texture->width, texture->height);
+        int level = pixels > 0.0f ? (int)std::floor(std::log2(std::max(texels / pixels, 1.0f))) : texture->start;
+        level = std::min(level, texture->start);
+        texture->required = texture->drawn ? std::min(texture->required, level) : level;
+        texture->drawn = true;
+    }
+
+    // Once per frame after the Require calls, on the thread with the GL context. Leaves texture unit 0 active and
+    // nothing bound to it
+    void Update()
+    {
+        PROFILE_SCOPE("texture streaming");
+        glActiveTexture(GL_TEXTURE0);
+        for (size_t i = 0; i < this->textures.size(); i++)
+            if (this->textures[i]->state.load(std::memory_order_acquire) == STREAM_READY)
+                this->upload(*this->textures[i]);
+
+        //what the textures need, coarsened until it fits
+        size_t required = 0, wanted = 0;
+        int drawn = 0, satisfied = 0;
+        for (size_t i = 0; i < this->textures.size(); i++)
+        {
+            StreamedTexture& texture = *this->textures[i];
+            if (texture.levels == 0)
+                continue;
+            texture.wanted = texture.drawn ? texture.required : texture.start;
+            required += bytes(texture, texture.wanted, texture.levels);
+            if (texture.drawn)
+            {
+                drawn++;
+                satisfied += texture.resident <= texture.required ? 1 : 0;
+            }
+        }
+        wanted = required;
+        while (wanted > this->BudgetBytes)
+        {
+            StreamedTexture* largest = NULL;
+            for (size_t i = 0; i < this->textures.size(); i++)
+            {
+                StreamedTexture& texture = *this->textures[i];
+                if (texture.levels > 0 && texture.wanted < texture.start
+                    && (largest == NULL || bytes(texture, texture.wanted, texture.wanted + 1) > bytes(*largest, largest->wanted, largest->wanted + 1)))
+                    largest = &texture;
+            }
+            if (largest == NULL)
+                break;
+            wanted -= bytes(*largest, largest->wanted, largest->wanted + 1);
+            largest->wanted++;
+        }
+
+        //the mipmaps nobody wants go when the resident and the incoming ones together exceed the budget, the largest
+        //surplus first
+        size_t resident = this->residentBytes(), loadingBytes = 0, missing = 0;
+        for (size_t i = 0; i < this->textures.size(); i++)
+        {
+            const StreamedTexture& texture = *this->textures[i];
+            if (texture.state.load(std::memory_order_acquire) != STREAM_IDLE)
+                loadingBytes += bytes(texture, texture.loadLevel, texture.resident);
+            else if (texture.wanted < texture.resident && !texture.failed)
+                missing += bytes(texture, texture.wanted, texture.resident);
+        }
+        while (resident + loadingBytes + missing > this->BudgetBytes)
+        {
+            StreamedTexture* surplus = NULL;
+            for (size_t i = 0; i < this->textures.size(); i++)
+            {
+                StreamedTexture& texture = *this->textures[i];
+                if (texture.resident < texture.wanted && texture.state.load(std::memory_order_acquire) == STREAM_IDLE
+                    && (surplus == NULL || bytes(texture, texture.resident, texture.wanted) > bytes(*surplus, surplus->resident, surplus->wanted)))
+                    surplus = &texture;
+            }
+            if (surplus == NULL)
+                break;
+            resident -= bytes(*surplus, surplus->resident, surplus->wanted);
+            this->evict(*surplus, surplus->wanted);
+        }
+
+        //then the loads which fit, the texture furthest from what it wants first
+        resident += loadingBytes;
+        int loading = 0;
+        for (size_t i = 0; i < this->textures.size(); i++)
+            loading += this->textures[i]->state.load(std::memory_order_acquire) != STREAM_IDLE ? 1 : 0;
+        while (loading < this->MaxLoads)
+        {
+            StreamedTexture* furthest = NULL;
+            for (size_t i = 0; i < this->textures.size(); i++)
+            {
+                StreamedTexture& texture = *this->textures[i];
+                if (texture.wanted < texture.resident && !texture.failed && texture.state.load(std::memory_order_acquire) == STREAM_IDLE
+                    && resident + bytes(texture, texture.wanted, texture.resident) <= this->BudgetBytes
+                    && (furthest == NULL || texture.resident - texture.wanted > furthest->resident - furthest->wanted))
+                    furthest = &texture;
+            }
+            if (furthest == NULL)
+                break;
+            resident += bytes(*furthest, furthest->wanted, furthest->resident);
+            this->startLoad(*furthest);
+            loading++;
+        }
+
+        for (size_t i = 0; i < this->textures.size(); i++)
+            this->textures[i]->drawn = false;
+        StreamingSample& sample = this->history[this->frame % HISTORY_SIZE];
+        sample.frame = this->frame++;
+        sample.residentMb = this->residentBytes() / (1024.0 * 1024.0);
+        sample.requiredMb = required / (1024.0 * 1024.0);
+        sample.residency = drawn > 0 ? (float)satisfied / drawn : 1.0f;
+        sample.loading = loading;
+        this->historySize = std::min(this->historySize + 1, HISTORY_SIZE);
+        this->stats.frames++;
+        this->stats.residentMb += sample.residentMb;
+        this->stats.peakResidentMb = std::max(this->stats.peakResidentMb, sample.residentMb);
+        this->stats.requiredMb += sample.requiredMb;
+        this->stats.residency += sample.residency;
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Waits for the loads in flight and deletes the textures
+    void Delete()
+    {
+        JobSystem::Instance().Wait(this->loads);
+        for (size_t i = 0; i < this->textures.size(); i++)
+        {
+            StreamedTexture& texture = *this->textures[i];
+            if (texture.state.load(std::memory_order_acquire) == STREAM_READY)
+                freeLevels(texture);
+            glDeleteTextures(1, &texture.name);
+        }
+        this->textures.clear();
+    }
+
+    // Statistics of the frames since the last call
+    void ResetStats()
+    {
+        this->stats = Stats();
+    }
+
+    // "resident 10.2 MB on average (peak 15.9) of a 16.0 MB budget, required 20.1 MB, 87% of the textures drawn had
+    // their mipmap, 34 loads (18.2 MB) 2.3 frames each, 12 evictions (9.1 MB)"
+    std::string Summary() const
+    {
+        const double frames = std::max(1.0, (double)this->stats.frames);
+        std::stringstream out;
+        out << std::fixed << std::setprecision(1) << "resident " << this->stats.residentMb / frames << " MB on average (peak "
+            << this->stats.peakResidentMb << ") of a " << this->BudgetBytes / (1024.0 * 1024.0) << " MB budget, required "
+            << this->stats.requiredMb / frames << " MB, " << std::setprecision(0) << 100.0 * this->stats.residency / frames
+            << "% of the textures drawn had their mipmap, " << this->stats.loads << " loads (" << std::setprecision(1)
+            << this->stats.loadedBytes / (1024.0 * 1024.0) << " MB) " << (this->stats.loads > 0 ? (double)this->stats.loadFrames / this->stats.loads : 0.0)
+            << " frames each, " << this->stats.evictions << " evictions (" << this->stats.evictedBytes / (1024.0 * 1024.0) << " MB)";
+        return out.str();
+    }
+
+    // Resident mipmaps per texture, "container2.png 1/10" is level 1 of 10 levels (0 is the full size)
+    std::string Residency() const
+    {
+        std::stringstream out;
+        for (size_t i = 0; i < this->textures.size(); i++)
+        {
+            const StreamedTexture& texture = *this->textures[i];
+            out << (i > 0 ? ", " : "") << texture.path.substr(texture.path.find_last_of("/\\") + 1) << " " << texture.resident << "/" << texture.levels;
+        }
+        return out.str();
+    }
+
+    int HistorySize() const
+    {
+        return this->historySize;
+    }
+    const StreamingSample& History(int i) const
+    {
+        return this->history[(this->frame - this->historySize + i) % HISTORY_SIZE];
+    }
+
+    bool WriteCsv(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file.is_open())
+            return false;
+        file << std::fixed << std::setprecision(4);
+        file << "frame,resident_mb,required_mb,budget_mb,residency,loading\n";
+        for (int i = 0; i < this->historySize; i++)
+        {
+            const StreamingSample& sample = this->History(i);
+            file << sample.frame << "," << sample.residentMb << "," << sample.requiredMb << "," << this->BudgetBytes / (1024.0 * 1024.0) << ","
+                << sample.residency << "," << sample.loading << "\n";
+        }
+        return true;
+    }
+
+private:
+    enum StreamState
+    {
+        STREAM_IDLE,
+        STREAM_LOADING,     // a worker decodes the file
+        STREAM_READY        // the pixels of loadLevel..resident - 1 wait for the upload
+    };
+
+    struct StreamedTexture
+    {
+        std::string path;
+        GLuint name = 0;
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        int levels = 0;             // 0 when the file could not be decoded
+        int start = 0;              // the coarse mipmaps from here on stay resident
+        int resident = 0;           // GL_TEXTURE_BASE_LEVEL
+        int required = 0;           // finest level a use needed this frame
+        int wanted = 0;             // required, coarsened to fit the budget
+        bool drawn = false;         // Require was called this frame
+        bool failed = false;        // a load could not decode the file, it is not tried again
+        std::atomic<int> state{ STREAM_IDLE };
+        int loadLevel = 0;
+        unsigned long long loadFrame = 0;
+        unsigned char* pixels[MAX_LEVELS] = {};
+    };
+
+    struct Stats
+    {
+        unsigned long long frames = 0;
+        double residentMb = 0.0;
+        double peakResidentMb = 0.0;
+        double requiredMb = 0.0;
+        double residency = 0.0;
+        unsigned long long loads = 0;
+        unsigned long long loadFrames = 0;      // from the start of a load to its upload
+        size_t loadedBytes = 0;
+        unsigned long long evictions = 0;
+        size_t evictedBytes = 0;
+    };
+
+    static size_t bytes(const StreamedTexture& texture, int from, int to)
+    {
+        size_t total = 0;
+        for (int level = from; level < to; level++)
+            total += (size_t)std::max(1, texture.width >> level) * std::max(1, texture.height >> level) * texture.components;
+        return total;
+    }
+
+    static GLenum format(const StreamedTexture& texture)
+    {
+        return texture.components == 1 ? GL_RED : texture.components == 4 ? GL_RGBA : GL_RGB;
+    }
+
+    // The mipmaps from..to - 1 of the full size image into texture.pixels, each one box filtered from the one above
+    static void buildLevels(StreamedTexture& texture, const unsigned char* image, int from, int to)
+    {
+        const int components = texture.components;
+        if (from == 0)
+        {
+            const size_t size = (size_t)texture.width * texture.height * components;
+            texture.pixels[0] = (unsigned char*)std::malloc(size);
+            std::copy(image, image + size, texture.pixels[0]);
+        }
+        const unsigned char* source = image;
+        unsigned char* discarded = NULL;        //a level above from, only needed for the next one
+        for (int level = 1; level < to; level++)
+        {
+            const int sourceWidth = std::max(1, texture.width >> (level - 1)), sourceHeight = std::max(1, texture.height >> (level - 1));
+            const int width = std::max(1, texture.width >> level), height = std::max(1, texture.height >> level);
+            unsigned char* pixels = (unsigned char*)std::malloc((size_t)width * height * components);
+            for (int y = 0; y < height; y++)
+            {
+                const unsigned char* row0 = source + (size_t)std::min(2 * y, sourceHeight - 1) * sourceWidth * components;
+                const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, sourceHeight - 1) * sourceWidth * components;
+                for (int x = 0; x < width; x++)
+                {
+                    const int x0 = std::min(2 * x, sourceWidth - 1) * components, x1 = std::min(2 * x + 1, sourceWidth - 1) * components;
+                    for (int c = 0; c < components; c++)
+                        pixels[((size_t)y * width + x) * components + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+            }
+            std::free(discarded);
+            discarded = NULL;
+            if (level >= from)
+                texture.pixels[level] = pixels;
+            else
+                discarded = pixels;
+            source = pixels;
+        }
+        std::free(discarded);
+    }
+
+    static void freeLevels(StreamedTexture& texture)
+    {
+        for (int level = 0; level < MAX_LEVELS; level++)
+        {
+            std::free(texture.pixels[level]);
+            texture.pixels[level] = NULL;
+        }
+    }
+
+    // The texture with its start mipmaps, on the main thread
+    GLuint create(StreamedTexture& texture)
+    {
+        glGenTextures(1, &texture.name);
+        glBindTexture(GL_TEXTURE_2D, texture.name);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (texture.levels > 0)
+        {
+            texture.resident = texture.levels;
+            texture.loadLevel = texture.start;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+            this->uploadLevels(texture);
+        }
+        return texture.name;
+    }
+
+    // texture.pixels of loadLevel..resident - 1 into the bound texture, which then starts at loadLevel
+    void uploadLevels(StreamedTexture& texture)
+    {
+        const GLenum pixelFormat = format(texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);      //the rows of the small mipmaps are not padded
+        for (int level = texture.loadLevel; level < texture.resident; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, pixelFormat, std::max(1, texture.width >> level), std::max(1, texture.height >> level), 0,
+                pixelFormat, GL_UNSIGNED_BYTE, texture.pixels[level]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.loadLevel);
+        texture.resident = texture.loadLevel;
+        freeLevels(texture);
+    }
+
+    void upload(StreamedTexture& texture)
+    {
+        const bool decoded = texture.pixels[texture.loadLevel] != NULL;
+        if (decoded)
+        {
+            this->stats.loads++;
+            this->stats.loadFrames += this->frame - texture.loadFrame;
+            this->stats.loadedBytes += bytes(texture, texture.loadLevel, texture.resident);
+            glBindTexture(GL_TEXTURE_2D, texture.name);
+            this->uploadLevels(texture);
+        }
+        else
+        {
+            texture.failed = true;
+            freeLevels(texture);
+        }
+        texture.state.store(STREAM_IDLE, std::memory_order_release);
+    }
+
+    void evict(StreamedTexture& texture, int level)
+    {
+        this->stats.evictions++;
+        this->stats.evictedBytes += bytes(texture, texture.resident, level);
+        glBindTexture(GL_TEXTURE_2D, texture.name);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        const GLenum pixelFormat = format(texture);
+        for (int released = texture.resident; released < level; released++)
+            glTexImage2D(GL_TEXTURE_2D, released, pixelFormat, 0, 0, 0, pixelFormat, GL_UNSIGNED_BYTE, NULL);
+        texture.resident = level;
+    }
+
+    // The job only captures the texture, small enough for std::function to store without allocating. Without workers
+    // nothing would execute it before Delete, the load is done right away then
+    void startLoad(StreamedTexture& texture)
+    {
+        texture.loadLevel = texture.wanted;
+        texture.loadFrame = this->frame;
+        texture.state.store(STREAM_LOADING, std::memory_order_release);
+        StreamedTexture* loaded = &texture;
+        JobSystem& jobs = JobSystem::Instance();
+        if (jobs.WorkerCount() == 0)
+            load(*loaded);
+        else
+            jobs.Run([loaded]() { load(*loaded); }, &this->loads);
+    }
+
+    static void load(StreamedTexture& texture)
+    {
+        PROFILE_SCOPE("stream texture");
+        DecodedImage image = decodeImage(texture.path);
+        if (image.data && image.width == texture.width && image.height == texture.height && image.components == texture.components)
+            buildLevels(texture, image.data, texture.loadLevel, texture.resident);
+        freeImage(image);
+        texture.state.store(STREAM_READY, std::memory_order_release);
+    }
+
+    size_t residentBytes() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < this->textures.size(); i++)
+            total += bytes(*this->textures[i], this->textures[i]->resident, this->textures[i]->levels);
+        return total;
+    }
+
+    StreamedTexture* find(unsigned int name)
+    {
+        for (size_t i = 0; i < this->textures.size(); i++)
+            if (this->textures[i]->name == name)
+                return this->textures[i].get();
+        return NULL;
+    }
+
+    std::vector<std::unique_ptr<StreamedTexture>> textures;
+    JobCounter loads;
+    Stats stats;
+    unsigned long long frame;
+    StreamingSample history[HISTORY_SIZE];
+    int historySize;
+};
+
+#endif
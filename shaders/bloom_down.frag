@@ -0,0 +1,47 @@
+#version 330 core
+// Variant features (see Shader):
+//   BRIGHT_PASS - the first level, read from the scene: only what is brighter than threshold is kept (soft knee)
+in vec2 TexCoords;
+out vec4 FragColor;
+
+uniform sampler2D source;   // the level above, or the scene
+uniform vec2 texelSize;     // of source
+uniform vec2 uvScale;       // part of source holding the frame (dynamic resolution), 1 otherwise
+uniform float threshold;
+uniform float knee;
+
+vec3 tap(vec2 uv, vec2 offset)
+{
+    return texture(source, clamp(uv + offset * texelSize, vec2(0.0), uvScale - 0.5 * texelSize)).rgb;
+}
+
+// 13 bilinear taps: a 4x4 box around the texel and four 2x2 boxes overlapping it, so a small bright spot does not
+// flicker while it moves (Jimenez, Next Generation Post Processing in Call of Duty: Advanced Warfare)
+vec3 downsample(vec2 uv)
+{
+    vec3 a = tap(uv, vec2(-2.0, 2.0)), b = tap(uv, vec2(0.0, 2.0)), c = tap(uv, vec2(2.0, 2.0));
+    vec3 d = tap(uv, vec2(-2.0, 0.0)), e = tap(uv, vec2(0.0, 0.0)), f = tap(uv, vec2(2.0, 0.0));
+    vec3 g = tap(uv, vec2(-2.0, -2.0)), h = tap(uv, vec2(0.0, -2.0)), i = tap(uv, vec2(2.0, -2.0));
+    vec3 j = tap(uv, vec2(-1.0, 1.0)), k = tap(uv, vec2(1.0, 1.0));
+    vec3 l = tap(uv, vec2(-1.0, -1.0)), m = tap(uv, vec2(1.0, -1.0));
+    return e * 0.125 + (a + c + g + i) * 0.03125 + (b + d + f + h) * 0.0625 + (j + k + l + m) * 0.125;
+}
+
+#ifdef BRIGHT_PASS
+vec3 brightPass(vec3 color)
+{
+    float brightness = max(color.r, max(color.g, color.b));
+    float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+    soft = soft * soft / (4.0 * knee + 1e-4);
+    return color * max(soft, brightness - threshold) / max(brightness, 1e-4);
+}
+#endif
+
+void main()
+{
+    vec3 color = downsample(TexCoords * uvScale);
+#ifdef BRIGHT_PASS
+    color = brightPass(color);
+#endif
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+in vec2 TexCoords;
+out vec4 FragColor;
+
+uniform sampler2D source;   // the level below, added onto the one drawn to by blending
+uniform vec2 texelSize;     // of source
+uniform float radius;       // of the tent, in texels of source
+
+// 3x3 tent filter
+void main()
+{
+    vec2 d = texelSize * radius;
+    vec3 color = texture(source, TexCoords).rgb * 4.0;
+    color += (texture(source, TexCoords + vec2(-d.x, 0.0)).rgb + texture(source, TexCoords + vec2(d.x, 0.0)).rgb +
+        texture(source, TexCoords + vec2(0.0, -d.y)).rgb + texture(source, TexCoords + vec2(0.0, d.y)).rgb) * 2.0;
+    color += texture(source, TexCoords - d).rgb + texture(source, TexCoords + d).rgb +
+        texture(source, TexCoords + vec2(d.x, -d.y)).rgb + texture(source, TexCoords + vec2(-d.x, d.y)).rgb;
+    FragColor = vec4(color / 16.0, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+// Variant features (see Shader):
+//   BLOOM        - adds the bloom pyramid
+//   TONE_MAPPING - exposure and a filmic curve instead of clamping
+in vec2 TexCoords;
+out vec4 FragColor;
+
+uniform sampler2D scene;
+uniform vec2 uvScale;       // part of scene holding the frame, stretched over the output (dynamic resolution)
+uniform sampler2D bloom;
+uniform float bloomIntensity;
+uniform float exposure;
+
+void main()
+{
+    vec3 color = texture(scene, TexCoords * uvScale).rgb;
+#ifdef BLOOM
+    color += bloomIntensity * texture(bloom, TexCoords).rgb;
+#endif
+#ifdef TONE_MAPPING
+    // ACES fitted by Narkowicz
+    color *= exposure;
+    color = (color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14);
+#endif
+    FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,22 @@
+#version 330 core
+out float FragDepth;
+
+uniform sampler2D depthMap;     // the level above, or the depth buffer
+
+// Farthest depth of the 2x2 texels under this one. With an odd size the last texel of a row or a column
+// takes the third one as well, so nothing of the level above is left out
+void main()
+{
+    ivec2 size = textureSize(depthMap, 0);
+    ivec2 first = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = min(first + 1, size - 1);
+    if (first.x + 3 == size.x)
+        last.x = size.x - 1;
+    if (first.y + 3 == size.y)
+        last.y = size.y - 1;
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            depth = max(depth, texelFetch(depthMap, ivec2(x, y), 0).r);
+    FragDepth = depth;
+}
@@ -0,0 +1,15 @@
+// Tangent-space Blinn-Phong shared by the normal mapping and parallax shaders
+vec3 BlinnPhongTangent(vec3 color, vec3 normal, vec3 lightDir, vec3 viewDir)
+{
+    //ambient component
+    vec3 ambient = 0.1 * color;
+    //diffuse component
+    float diff = max(dot(lightDir, normal), 0.0);
+    vec3 diffuse = diff * color;
+    //specular component
+    vec3 halfwayDir = normalize(lightDir + viewDir);  
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    vec3 specular = vec3(0.2) * spec;
+
+    return ambient + diffuse + specular;
+}
@@ -0,0 +1,98 @@
+//==============STRUCTS================
+struct DirectLight {
+	vec3 direction;
+  
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+struct PointLight {    
+	vec3 position;
+	
+	float constant;
+	float linear;
+	float quadratic;  
+
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+struct Spotlight {
+	vec3 position;
+	vec3 direction;
+	float cutOff;
+	float outerCutOff;
+  
+	float constant;
+	float linear;
+	float quadratic;
+  
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;       
+};
+//=====================================
+//====================================FUNCTIONS===============================================
+// albedo and specularColor are the material samples at the fragment, fetched once by the caller
+vec3 CalculateDirectLight(DirectLight light, vec3 normal, vec3 viewDir, float shadow, vec3 albedo, vec3 specularColor, float shininess)
+{
+	vec3 lightDir = normalize(-light.direction);
+	//diffuse component
+	float diff = max(dot(normal, lightDir), 0.0);
+	//Blinn-Phong model
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+	float spec = pow(max(dot(normal, halfwayDir),0.0), 0.25 * shininess);
+
+	vec3 ambient = light.ambient * albedo;
+	vec3 diffuse = light.diffuse * diff * albedo;
+	vec3 specular = light.specular * spec * specularColor;
+	
+	return ambient + (1.0 - shadow)*(diffuse + specular);
+}
+
+vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+	vec3 lightDir = normalize(light.position - fragPos);
+	//diffuse component
+	float diff = max(dot(normal, lightDir), 0.0);
+	//Blinn-Phong model
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+	float spec = pow(max(dot(normal, halfwayDir),0.0), 2 * shininess);
+	//attenuation
+	float distance = length(light.position - fragPos);
+	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+
+	vec3 ambient = light.ambient * albedo;
+	vec3 diffuse = light.diffuse * diff * albedo;
+	vec3 specular = light.specular * spec * specularColor;
+
+	//applying attenuation
+	return (ambient + diffuse + specular) * attenuation;
+}
+
+vec3 CalculateSpotlight(Spotlight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+	vec3 lightDir = normalize(light.position - fragPos);
+	//diffuse component
+	float diff = max(dot(normal, lightDir), 0.0);
+	//Blinn-Phong model
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+	float spec = pow(max(dot(normal, halfwayDir),0.0), 2 * shininess);
+	//intensity(for soft edges)
+	float theta = dot(lightDir, normalize(-light.direction)); 
+	float epsilon = (light.cutOff - light.outerCutOff);
+	float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+	//attenuation
+	float distance = length(light.position - fragPos);
+	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+	vec3 ambient  = light.ambient * albedo;
+	vec3 diffuse = light.diffuse * diff * albedo;
+	vec3 specular = light.specular * spec * specularColor;
+
+	//applying intensity and attenuation
+	return (ambient + diffuse + specular) * attenuation * intensity;
+}
+//============================================================================================
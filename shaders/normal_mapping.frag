@@ -1,4 +1,6 @@
 #version 330 core
+// Variant features (see Shader):
+//   PLAIN - the vertex normal instead of the normal map, for surfaces small on screen (ShadingLod)
 out vec4 FragColor;
 
 in vec3 FragPos;
@@ -13,25 +15,20 @@ uniform sampler2D normalMap;
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+#include "include/blinn_phong.glsl"
+
 void main()
 {    
+#ifdef PLAIN
+    vec3 normal = vec3(0.0, 0.0, 1.0);
+#else
     vec3 normal = texture(normalMap, TexCoords).rgb;
     normal = normalize(normal * 2.0 - 1.0);
+#endif
 
     //diffuse color
     vec3 color = texture(diffuseMap, TexCoords).rgb;
-    //ambient component
-    vec3 ambient = 0.1 * color;
-    //diffuse component
     vec3 lightDir = normalize(TangentLightPos - TangentFragPos);
-    float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = diff * color;
-    //specular component
     vec3 viewDir = normalize(TangentViewPos - TangentFragPos);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir + viewDir);  
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
-
-    vec3 specular = vec3(0.2) * spec;
-    FragColor = vec4(ambient + diffuse + specular, 1.0);
+    FragColor = vec4(BlinnPhongTangent(color, normal, lightDir, viewDir), 1.0);
 }
@@ -0,0 +1,28 @@
+#version 330 core
+out ivec2 Seed;
+
+uniform isampler2D seeds;   // texel coordinates of the nearest marked pixel found so far, -1 where none
+uniform vec2 frameSize;
+uniform int stepSize;
+
+// One step of jump flooding: the nearest of the seeds known to this pixel and to the eight pixels stepSize away
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 last = ivec2(frameSize) - 1;
+    ivec2 best = ivec2(-1);
+    int bestDistance = 0x7fffffff;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+        {
+            ivec2 seed = texelFetch(seeds, clamp(pixel + ivec2(x, y) * stepSize, ivec2(0), last), 0).xy;
+            ivec2 offset = seed - pixel;
+            int distance = offset.x * offset.x + offset.y * offset.y;
+            if (seed.x >= 0 && distance < bestDistance)
+            {
+                best = seed;
+                bestDistance = distance;
+            }
+        }
+    Seed = best;
+}
@@ -0,0 +1,22 @@
+#version 330 core
+out ivec2 Seed;
+
+uniform isampler2D seeds;   // the marked pixels are their own seeds, -1 elsewhere
+uniform vec2 frameSize;
+uniform int radius;
+
+// First half of the direct search: the nearest marked pixel of the row within radius, the outline pass goes along the
+// columns. Two passes of 2 * radius + 1 reads find the nearest one in the square as well
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    int last = int(frameSize.x) - 1;
+    ivec2 best = ivec2(-1);
+    for (int x = -radius; x <= radius; x++)
+    {
+        ivec2 seed = texelFetch(seeds, ivec2(clamp(pixel.x + x, 0, last), pixel.y), 0).xy;
+        if (seed.x >= 0 && (best.x < 0 || abs(seed.x - pixel.x) < abs(best.x - pixel.x)))
+            best = seed;
+    }
+    Seed = best;
+}
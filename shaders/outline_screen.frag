@@ -0,0 +1,36 @@
+#version 330 core
+// Variant features (see Shader):
+//   JUMP_FLOOD - seeds holds the nearest marked pixel of every pixel (wide outlines), otherwise the nearest one of every
+//                row (outline_rows.frag) and the pass looks along the column
+// The stencil test keeps the pass off the marked pixels themselves
+out vec4 FragColor;
+
+uniform isampler2D seeds;   // texel coordinates of the nearest marked pixel, -1 where none
+uniform vec2 frameSize;
+uniform vec3 outlineColor;
+uniform float outlineWidth; // in pixels
+
+int squaredDistance(ivec2 seed, ivec2 pixel)
+{
+    ivec2 offset = seed - pixel;
+    return seed.x >= 0 ? offset.x * offset.x + offset.y * offset.y : 0x7fffffff;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+#ifdef JUMP_FLOOD
+    int nearest = squaredDistance(texelFetch(seeds, pixel, 0).xy, pixel);
+#else
+    int last = int(frameSize.y) - 1;
+    int radius = int(ceil(outlineWidth));
+    int nearest = 0x7fffffff;
+    for (int y = -radius; y <= radius; y++)
+        nearest = min(nearest, squaredDistance(texelFetch(seeds, ivec2(pixel.x, clamp(pixel.y + y, 0, last)), 0).xy, pixel));
+#endif
+    // the last pixel fades out, diagonal steps of the silhouette stay smooth
+    float coverage = clamp(outlineWidth + 1.0 - sqrt(float(nearest)), 0.0, 1.0);
+    if (coverage <= 0.0)
+        discard;
+    FragColor = vec4(outlineColor, coverage);
+}
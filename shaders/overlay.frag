@@ -0,0 +1,28 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 local;
+
+uniform vec4 color;
+
+#ifdef TEXT
+#define MAX_LABEL 32
+#define GLYPH_WIDTH 6       // cells of the font atlas, glyph plus spacing
+#define GLYPH_HEIGHT 8
+uniform sampler2D font;     // one row of glyph cells, cell 0 is blank
+uniform int text[MAX_LABEL];
+uniform int textLength;
+#endif
+
+void main()
+{
+#ifdef TEXT
+    // the rect holds textLength glyph cells side by side
+    float x = local.x * textLength;
+    int cell = text[min(int(x), MAX_LABEL - 1)];
+    ivec2 texel = ivec2(cell * GLYPH_WIDTH + int(fract(x) * GLYPH_WIDTH), min(int((1.0 - local.y) * GLYPH_HEIGHT), GLYPH_HEIGHT - 1));
+    if (texelFetch(font, texel, 0).r < 0.5)
+        discard;
+#endif
+    FragColor = color;
+}
@@ -1,4 +1,8 @@
 #version 330 core
+// Variant features (see Shader):
+//   CONE_STEP_MAPPING - depthMap is a baked cone step map (ConeStepMap.h), otherwise a linear march
+//   NORMAL_MAP_ONLY   - no relief, the normal map at the interpolated coordinates (ShadingLod)
+//   PLAIN             - neither relief nor normal map (ShadingLod)
 out vec4 FragColor;
 
 in vec3 FragPos;
@@ -13,7 +17,36 @@ uniform sampler2D depthMap;
 
 uniform float heightScale;
 
+#include "include/blinn_phong.glsl"
+
 //=================================================================================================
+#ifdef CONE_STEP_MAPPING
+// depthMap is the baked cone step map: depth in r, square root of the cone ratio in g. Every step
+// jumps to where the ray leaves the empty cone above the texel under it, so the ray never passes
+// the surface and the steps get long wherever the relief leaves room. Near walls the steps shrink,
+// the limit grows towards grazing angles like the layers of the linear march (and, not being a
+// constant, keeps the loop from being unrolled).
+vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
+{
+    const float minSteps = 4;
+    const float maxSteps = 16;
+    const float minStep = 0.002;
+    int numSteps = int(mix(maxSteps, minSteps, abs(viewDir.z)));
+    vec2 P = viewDir.xy / viewDir.z * heightScale;
+    float rayRatio = length(P);
+    float depth = 0.0;
+    for(int i = 0; i < numSteps; i++)
+    {
+        vec2 texel = texture(depthMap, texCoords - P * depth).rg;
+        float coneRatio = texel.g * texel.g;
+        float step = coneRatio * (texel.r - depth) / (coneRatio + rayRatio);
+        if(step < minStep)
+            break;
+        depth += step;
+    }
+    return texCoords - P * depth;
+}
+#else
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 { 
     const float minLayers = 8;
@@ -44,6 +77,7 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 
     return finalTexCoords;
 }
+#endif
 //=================================================================================================
 
 void main()
@@ -51,26 +85,21 @@ void main()
     vec3 viewDir = normalize(TangentViewPos - TangentFragPos);
     vec2 texCoords = TexCoords;
     
+#if !defined(NORMAL_MAP_ONLY) && !defined(PLAIN)
     texCoords = ParallaxMapping(TexCoords,  viewDir);       
     if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
         discard;
+#endif
 
+#ifdef PLAIN
+    vec3 normal = vec3(0.0, 0.0, 1.0);
+#else
     vec3 normal = texture(normalMap, texCoords).rgb;
     normal = normalize(normal * 2.0 - 1.0);   
+#endif
    
     //diffuse color
     vec3 color = texture(diffuseMap, texCoords).rgb;
-    //ambient component
-    vec3 ambient = 0.1 * color;
-    //diffuse component
     vec3 lightDir = normalize(TangentLightPos - TangentFragPos);
-    float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = diff * color;
-    //specular component   
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir + viewDir);  
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
-
-    vec3 specular = vec3(0.2) * spec;
-    FragColor = vec4(ambient + diffuse + specular, 1.0);
+    FragColor = vec4(BlinnPhongTangent(color, normal, lightDir, viewDir), 1.0);
 }
\ No newline at end of file
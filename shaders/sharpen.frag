@@ -0,0 +1,23 @@
+#version 330 core
+in vec2 TexCoords;
+out vec4 FragColor;
+
+uniform sampler2D source;
+uniform vec2 texelSize;
+uniform float sharpness;    // 0..1
+
+// Contrast adaptive: the centre is pushed away from its four neighbours, less where the local contrast leaves
+// little room, so edges do not ring
+void main()
+{
+    vec3 c = texture(source, TexCoords).rgb;
+    vec3 n = texture(source, TexCoords + vec2(0.0, texelSize.y)).rgb;
+    vec3 s = texture(source, TexCoords - vec2(0.0, texelSize.y)).rgb;
+    vec3 e = texture(source, TexCoords + vec2(texelSize.x, 0.0)).rgb;
+    vec3 w = texture(source, TexCoords - vec2(texelSize.x, 0.0)).rgb;
+    vec3 lowest = min(c, min(min(n, s), min(e, w)));
+    vec3 highest = max(c, max(max(n, s), max(e, w)));
+    vec3 amount = sqrt(clamp(min(lowest, 1.0 - highest) / max(highest, 1e-4), 0.0, 1.0));
+    vec3 weight = -amount * mix(0.125, 0.2, sharpness);
+    FragColor = vec4(clamp((c + (n + s + e + w) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0), 1.0);
+}